@@ -8,6 +8,9 @@
 #define DEVICE_NR 64
 #define NAMELEN 16
 
+#define SECTOR_SIZE 512
+#define DEV_MAX_COUNT 255   // default max sectors per request
+
 // device type
 enum device_type_t {
     DEV_NULL,       // empty device
@@ -24,22 +27,68 @@ enum device_subtype_t {
     DEV_SB16,           // sound blaster 16
     DEV_IDE_DISK,       // IDE disk
     DEV_IDE_PART,        // IDE disk part
-    DEV_RAMDISK,      // ramdisk
+    DEV_RAMDISK,      // ramdisk, zram
     DEV_FLOPPY,         // floppy disk
+    DEV_SATA_DISK,      // SATA disk
+    DEV_SATA_PART,      // SATA disk part
+    DEV_VIRTIO_DISK,    // virtio block disk
+    DEV_VIRTIO_PART,    // virtio block disk part
 };
 
 // device commands
 enum device_cmd_t {
     DEV_CMD_SECTOR_START = 1,   // get dev start sector
     DEV_CMD_SECTOR_SIZE,        // get dev sector size
+    DEV_CMD_SCHED_GET,          // get block dev I/O scheduler
+    DEV_CMD_SCHED_SET,          // set block dev I/O scheduler, args is iosched_type_t
+    DEV_CMD_IOSTAT_GET,         // copy block dev iostat_t to args
+    DEV_CMD_IOSTAT_RESET,       // clear block dev iostat_t
+    DEV_CMD_FLUSH,              // flush block dev write cache
 };
 
 #define REQ_READ 0
 #define REQ_WRITE 1
+#define REQ_FLUSH 2         // flush volatile write cache, no data
+
+// request flags
+#define REQ_PREFLUSH 0x01   // flush write cache before this write
+#define REQ_FUA 0x02        // write is on media when completed
+
+// block dev write cache
+#define DEV_WCACHE 0x01     // volatile write cache, written data needs flush
+#define DEV_FUA 0x02        // driver handles REQ_FUA writes
 
 #define DIRECT_UP 0
 #define DIRECT_DOWN 1
 
+#define IOSTAT_HIST_NR 24   // log2 latency buckets, i is [2^i, 2^(i+1)) us
+
+// block dev I/O statistics, partitions report the whole disk
+typedef struct iostat_t {
+    dev_t dev;              // disk device number
+    u32 since;              // stats start, ms since boot
+    u32 now;                // ms since boot when read
+    u32 ios[2];             // completed reqs, REQ_READ / REQ_WRITE
+    u32 sectors[2];         // sectors transferred
+    u32 splits;             // extra reqs from splitting by max_count
+    u32 errors;             // failed reqs
+    u32 flushes;            // completed cache flushes
+    u32 queued;             // reqs in scheduler now
+    u32 inflight;           // reqs in driver now
+    u32 max_depth;          // max reqs outstanding
+    u32 queue_ms[2];        // time in scheduler
+    u32 service_ms[2];      // time in driver
+    u32 busy_ms;            // time with reqs outstanding
+    u32 depth_ms;           // sum of outstanding reqs * time
+    u32 queue_hist[IOSTAT_HIST_NR];   // time in scheduler
+    u32 service_hist[IOSTAT_HIST_NR]; // time in driver
+    u32 queue_us[2];        // below 1ms parts of the times above
+    u32 service_us[2];
+    u32 busy_us;
+    u32 depth_us;
+    u32 stamp;              // last depth accounting, us since boot
+} iostat_t;
+
 // block device request
 typedef struct request_t {
     dev_t dev;
@@ -51,6 +100,17 @@ typedef struct request_t {
     u8 *buf;
     struct task_t *task;        // req process
     list_node_t node;          // list node
+    list_node_t qnode;         // driver queue node
+    list_node_t fifo;          // scheduler fifo node
+    u32 deadline;              // expire jiffies
+    u16 ioprio;                // I/O priority of req task
+    u32 start_us;              // queued time
+    u32 dispatch_us;           // handed to driver time
+    bool dispatched;           // handed to driver
+    bool done;                 // driver completed
+    err_t ret;                 // completion result
+    u32 npages;                // pages spanned by buf
+    u32 pages[0];              // physical addr of each page (queued dev)
 }request_t;
 
 typedef struct device_t {
@@ -62,6 +122,18 @@ typedef struct device_t {
     void *ptr;          // pointer to device
     list_t request_list;    // block dev req list
     bool direct;          // block dev direct up/down
+    idx_t head;           // last dispatched sector
+    u32 depth;            // max requests in driver (queued dev)
+    u32 inflight;         // requests in driver
+    u32 max_count;        // max sectors per request
+    u32 queued;           // requests in scheduler
+    u32 cache;            // DEV_WCACHE / DEV_FUA
+    list_t flush_list;    // flush reqs, wait for driver queue to drain
+    bool flushing;        // flush req in driver (queued dev)
+    bool unflushed;       // writes completed since last flush
+    struct iosched_t *sched;  // I/O scheduler
+    void *elevator;           // scheduler private data
+    iostat_t stat;            // I/O statistics
 
     // device control
     int (*ioctl)(void *dev, int cmd, void *args, int flags);
@@ -69,6 +141,12 @@ typedef struct device_t {
     int (*read)(void *dev, void *buf, size_t count, idx_t idx, int flags); 
     // write
     int (*write)(void *dev, void *buf, size_t count, idx_t idx, int flags);
+    // submit request, driver calls device_complete when done
+    int (*submit)(void *dev, request_t *req);
+    // flush write cache (non-queued dev)
+    int (*flush)(void *dev);
+    // direct access, kernel address of sectors in device memory
+    void *(*dax)(void *dev, idx_t idx, u32 count);
 }device_t;
 
 
@@ -94,6 +172,31 @@ int device_read(dev_t dev, void *buf, size_t count, idx_t idx, int flags);
 int device_write(dev_t dev, void *buf, size_t count, idx_t idx, int flags);
 
 // block dev req
-err_t device_request(dev_t dev, void *buf, u8 count, idx_t idx, int flags, u32 type);
+err_t device_request(dev_t dev, void *buf, u32 count, idx_t idx, int flags, u32 type);
+
+// let block dev take requests from queue, up to depth requests in driver,
+// larger requests are split into max_count sectors
+void device_set_queue(dev_t dev, void *submit, u32 depth, u32 max_count);
+
+// driver finished req, may be called in interrupt
+void device_complete(request_t *req, err_t ret);
+
+// block dev has volatile write cache, flush is called for non-queued dev
+void device_set_cache(dev_t dev, u32 cache, void *flush);
+
+// write back volatile write cache of block dev
+err_t device_flush(dev_t dev);
+
+// flush all block devs written since their last flush
+void device_sync();
+
+// block dev memory can be accessed directly
+void device_set_dax(dev_t dev, void *dax);
+
+// kernel address of sectors of memory block dev, NULL if not supported
+void *device_dax(dev_t dev, idx_t idx, u32 count);
+
+// change I/O scheduler of block dev, queue must be empty
+err_t device_set_sched(dev_t dev, int type);
 
 #endif /* XJOS_DEVICE_H */
\ No newline at end of file
@@ -0,0 +1,30 @@
+#ifndef XJOS_IOSCHED_H
+#define XJOS_IOSCHED_H
+
+
+#include <drivers/device.h>
+
+enum iosched_type_t {
+    IOSCHED_SCAN,       // elevator, sorted by sector
+    IOSCHED_DEADLINE,   // read / write fifo with expire
+    IOSCHED_FAIR,       // per task fair queuing by ioprio
+    IOSCHED_NR,
+};
+
+#define IOSCHED_DEFAULT IOSCHED_DEADLINE
+
+// block dev I/O scheduler, called with interrupt disabled
+typedef struct iosched_t {
+    char *name;
+    int type;
+    // alloc private data of device
+    void *(*init)(device_t *device);
+    // queue a new req
+    void (*add)(device_t *device, request_t *req);
+    // take out the next req to dispatch, NULL if empty
+    request_t *(*pick)(device_t *device);
+} iosched_t;
+
+iosched_t *iosched_get(int type);
+
+#endif /* XJOS_IOSCHED_H */
@@ -0,0 +1,26 @@
+#ifndef XJOS_ZRAM_H
+#define XJOS_ZRAM_H
+
+
+#include <xjos/types.h>
+
+// compressed ramdisk statistics, /proc/zram
+typedef struct zram_stat_t {
+    char name[8];
+    u32 pages;          // disk size in pages
+    u32 stored;         // pages holding data, not zero
+    u32 zero;           // zero pages, no storage
+    u32 raw;            // incompressible pages stored as is
+    u32 compr_bytes;    // compressed size of stored pages
+    u32 mem_pages;      // kernel pages used by the store
+    u32 max_pages;      // peak of mem_pages
+    u32 limit_pages;    // max kernel pages may be used
+    u32 reads;          // pages loaded
+    u32 writes;         // pages stored
+    u32 failed;         // writes failed for no memory
+} zram_stat_t;
+
+// stat of idx zram, false if not exist
+bool zram_stat(idx_t idx, zram_stat_t *stat);
+
+#endif /* XJOS_ZRAM_H */
@@ -11,7 +11,8 @@
 #define BLOCK_SECS (BLOCK_SIZE / SECTOR_SIZE) // 1 block = 2 sectors
 
 typedef struct buffer_t {
-    char *data;         // buffer data ptr
+    char *data;         // buffer data ptr, device memory if dax
+    char *cache;        // own data block, NULL for head only buffer
     dev_t dev;        // device number
     idx_t block;    // block number
     int count;      // reference count
@@ -20,18 +21,50 @@ typedef struct buffer_t {
 
     list_node_t lru_node;   // node for free_list(clean & idle)
     list_node_t dirty_node; // node for dirty_list(all dirty buffers) 
+    list_node_t inode_node; // node for owner inode's dirty_list (sorted by block)
+    struct inode_t *inode;  // owner inode of a dirty file block
+    list_node_t jnode;      // node for file system journal transaction
 
     mutex_t lock;    // buffer lock
     bool dirty;    // has been modified
     bool valid;    // has been read from disk
+    bool delay;    // delayed allocation, no disk block assigned yet
+    idx_t lblock;  // logical block in owner inode, EOF for index blocks
+    bool dax;      // data aliases device memory, never dirty
 } buffer_t;
 
 void bdirty(buffer_t *bf, bool dirty);
 
 buffer_t *getblk(dev_t dev, idx_t block);
 buffer_t *bread(dev_t dev, idx_t block);
-void bwrite(buffer_t *bf);
+err_t bwrite(buffer_t *bf);
 void brelse(buffer_t *bf);
+bool bcached(dev_t dev, idx_t block);
+
+// per inode dirty buffers, for fsync
+void bdirty_inode(buffer_t *bf, struct inode_t *inode, idx_t lblock);
+int bsync_inode(struct inode_t *inode, idx_t start, idx_t end);
+void bdetach_inode(struct inode_t *inode);
+
+// delayed allocation buffers
+buffer_t *bdelay(dev_t dev, idx_t lblock);
+void bassign(buffer_t *bf, idx_t block);
+void bforget(buffer_t *bf);
+
+typedef struct buffer_stat_t {
+    u32 count;  // 已分配缓冲数量
+    u32 max;    // 缓冲数量上限
+    u32 free;   // 空闲 (LRU) 缓冲数量
+    u32 dirty;  // 脏缓冲数量
+    u32 hits;   // getblk 命中次数
+    u32 misses; // getblk 未命中次数
+    u32 reads;  // 读盘次数
+    u32 writes; // 写盘次数
+    u32 dax;    // 直接指向设备内存的次数
+    u32 heads;  // 没有数据块的缓冲头数量
+} buffer_stat_t;
+
+void buffer_stat(buffer_stat_t *stat);
 
 void buffer_init();
 
@@ -19,28 +19,48 @@ enum file_flag {
     O_TRUNC = 01000,            // file exists (write): truncate it
     O_APPEND = 02000,           // add to the end of file
     O_NONBLOCK = 04000,         // non-blocking mode
+    O_DIRECT = 040000,          // bypass buffer cache
 };
 
-typedef struct inode_desc_t {
-    u16 mode;       // file type and attr(rwx bits)
-    u16 uid;        // owner user id
-    u32 size;       // file size in bytes
-    u32 mtime;      // access time (UTC)
-    u8 gid;         // group id
-    u8 nlinks;      // * number of links
-    u16 zones[9];   // * block numbers (0-6 direct, 7 indirect, 8 double indirect)
-} inode_desc_t;
+enum sync_file_range_flag {
+    SYNC_FILE_RANGE_WAIT_BEFORE = 1, // wait for previous writeback
+    SYNC_FILE_RANGE_WRITE = 2,       // start writeback of dirty pages
+    SYNC_FILE_RANGE_WAIT_AFTER = 4,  // wait for writeback to finish
+};
+
+#define MKFS_JOURNAL 0x40000000 // mkfs 参数: 创建元数据日志
+#define MKFS_V2 0x10000000      // mkfs 参数: minix v2, 32 位逻辑块号
+#define MKFS_V3 0x20000000      // mkfs 参数: minix v3, 32 位 inode 数和 60 字符文件名
+
+#define MOUNT_TMPFS 0x40000000  // mount 参数: 安装 tmpfs, 低位为容量 (KB), 0 为默认容量
+#define MOUNT_PROC 0x20000000   // mount 参数: 安装 procfs
+#define MOUNT_SIZE_MASK 0x0FFFFFFF
+
+enum fsync_flag {
+    FSYNC_DATA = 1,             // fdatasync: 只回写读取数据所需的元数据
+    FSYNC_RANGE = 2,            // sync_file_range: 只回写范围内的数据块
+};
+
+enum fcntl_cmd {
+    F_GETFL = 3,                // get file flags
+    F_SETPIPE_SZ = 1031,        // set pipe buffer size
+    F_GETPIPE_SZ = 1032,        // get pipe buffer size
+};
 
 enum {
     FS_TYPE_NONE = 0,
     FS_TYPE_PIPE,
     FS_TYPE_SOCKET,
     FS_TYPE_MINIX,
+    FS_TYPE_TMPFS,
+    FS_TYPE_PROC,
     FS_TYPE_NUM,
 };
 
 typedef struct inode_t {
     list_node_t node;  // list node
+    list_node_t hnode;    // inode 哈希表节点
+    list_node_t lru_node; // 空闲 inode LRU 节点
 
     void *desc;
 
@@ -71,8 +91,12 @@ typedef struct inode_t {
     struct super_t *super;   // 超级块
     struct fs_op_t *op;      // 文件系统操作
 
-    struct task_t *rxwaiter;    // read wait process
-    struct task_t *txwaiter;    // write wait process
+    void *dindex;           // 大目录的哈希索引
+    list_t dalloc_list;     // 延迟分配的数据块缓冲 (按逻辑块号排序)
+    u32 dalloc_count;       // 延迟分配块数量
+
+    list_t dirty_list;      // 属于该 inode 的脏缓冲 (按块号排序)
+    bool map_dirty;         // 大小或块映射已修改，fdatasync 也要回写 inode
 } inode_t;
 
 typedef struct super_t {
@@ -86,6 +110,7 @@ typedef struct super_t {
     list_t inode_list;    // 使用中 inode 链表
     inode_t *iroot;       // 根目录 inode
     inode_t *imount;      // 安装到的 inode} super_block_t;
+    void *info;           // 文件系统私有信息 (kmalloc)
 } super_t;
 
 typedef struct dentry_t {
@@ -95,6 +120,23 @@ typedef struct dentry_t {
     char name[MAXNAMELEN]; // file name
 } dentry_t;
 
+#define GETDENTS_PLUS 1 // 同时返回文件属性 (readdirplus)
+
+// getdents 返回的变长目录项，与 xjos/dirent.h 一致
+typedef struct getdent_t {
+    u32 nr;        // inode number
+    u16 reclen;    // 记录长度
+    u16 namelen;   // 文件名长度
+    u16 mode;      // 文件模式      (GETDENTS_PLUS)
+    u8 nlinks;     // 链接数        (GETDENTS_PLUS)
+    u8 gid;        // 组 id         (GETDENTS_PLUS)
+    u16 uid;       // 用户 id       (GETDENTS_PLUS)
+    u16 reserved;
+    u32 size;      // 文件大小      (GETDENTS_PLUS)
+    time_t mtime;  // 最后修改时间  (GETDENTS_PLUS)
+    char name[0];  // 文件名，以 EOS 结尾
+} getdent_t;
+
 typedef struct dcache_entry_t {
     list_node_t hnode; // hash table node
     list_node_t lru_node;   // lru list node
@@ -108,6 +150,16 @@ typedef struct dcache_entry_t {
     u32 hash;        // name hash value
 } dcache_entry_t;
 
+typedef struct dcache_stat_t {
+    u32 count;    // 表项数量
+    u32 negative; // 负目录项数量
+    u32 buckets;  // 哈希桶数量
+    u32 used;     // 非空的哈希桶数量
+    u32 longest;  // 最长链长
+    u32 hits;     // 查找命中次数
+    u32 misses;   // 查找未命中次数
+} dcache_stat_t;
+
 typedef struct file_t {
     inode_t *inode;     // file inode
     u32 count;          // reference count
@@ -120,7 +172,9 @@ typedef dentry_t dirent_t;
 typedef enum whence_t {
     SEEK_SET = 1,  // 直接设置偏移
     SEEK_CUR,      // 当前位置偏移
-    SEEK_END       // 结束位置偏移
+    SEEK_END,      // 结束位置偏移
+    SEEK_DATA,     // 下一个有数据的位置
+    SEEK_HOLE,     // 下一个空洞的位置，文件末尾视为空洞
 } whence_t;
 
 typedef struct fs_op_t {
@@ -145,6 +199,14 @@ typedef struct fs_op_t {
     int (*unlink)(inode_t *dir, char *name);
     int (*mknod)(inode_t *dir, char *name, int mode, int dev);
     int (*readdir)(inode_t *inode, dentry_t *entry, size_t count, off_t offset);
+    int (*sync)(inode_t *inode);
+    int (*evict)(inode_t *inode);
+    int (*direct_io)(inode_t *inode, char *data, int len, off_t offset, int type);
+    int (*fsync)(inode_t *inode, off_t offset, size_t len, int flags);
+
+    int (*sync_fs)(super_t *super);   // 提交文件系统的元数据
+    int (*put_super)(super_t *super); // 卸载前释放文件系统私有数据
+    int (*seek)(inode_t *inode, off_t offset, int whence); // SEEK_DATA / SEEK_HOLE
 } fs_op_t;
 
 err_t fd_check(fd_t fd, file_t **file);
@@ -157,17 +219,35 @@ void *fs_default_null(); // 返回空指针
 super_t *get_super(dev_t dev);  // 获得 dev 对应的超级块
 super_t *read_super(dev_t dev); // 读取 dev 对应的超级块
 void put_super(super_t *sb);
+void ssync(); // 提交所有文件系统的元数据
 
 inode_t *get_root_inode(); // 获取根目录 inode
 void iput(inode_t *inode); // 释放 inode
 inode_t *find_inode(dev_t dev, idx_t nr);
 inode_t *fit_inode(inode_t *inode);
+void isync(); // 回写所有 inode 的延迟数据
+
+void hash_inode(inode_t *inode);  // 加入 inode 哈希表
+void cache_inode(inode_t *inode); // 引用归零的 inode 放入 LRU
+u32 shrink_inodes(u32 count);     // 回收空闲 inode
+void prune_inodes(dev_t dev);     // 释放设备的所有空闲 inode
 
-super_t *get_free_super();
+super_t *get_free_super(); // 没有空闲超级块时返回 NULL
+dev_t get_anon_dev(); // 分配匿名设备号
+
+super_t *tmpfs_mount(u32 size); // 创建 tmpfs, size 为容量 (KB)，失败返回 NULL
+super_t *proc_mount();          // 创建 procfs，失败返回 NULL
+
+#define DCACHE_NEGATIVE ((idx_t)-1) // 负目录项, 名字不存在
 
 void dcache_init();
 idx_t dcache_lookup(struct inode_t *dir, const char *name, size_t len);
 void dcache_add(struct inode_t *dir, const char *name, size_t len, idx_t nr);
+void dcache_delete(struct inode_t *dir, const char *name, size_t len);
+void dcache_invalidate(dev_t dev, idx_t p_nr); // 删除目录或设备下的表项
+u32 dcache_shrink(u32 count);
+void dcache_stat(dcache_stat_t *stat);
+size_t dentry_name_len(const char *name); // 路径第一个分量的长度
 
 inode_t *named(char *pathname, char **next); // get pathname parent dir inode
 inode_t *namei(char *pathname);              // get pathname inode
@@ -178,6 +258,13 @@ void fs_register_op(int type, fs_op_t *op);
 inode_t *get_free_inode();
 void put_free_inode(inode_t *inode);
 
+int pipe_getsize(inode_t *inode);
+int pipe_setsize(inode_t *inode, u32 size);
+u32 pipe_read_begin(inode_t *inode, char **data, bool wait);
+void pipe_read_end(inode_t *inode, u32 len);
+u32 pipe_write_begin(inode_t *inode, char **data);
+void pipe_write_end(inode_t *inode, u32 len);
+
 file_t *get_file();
 void put_file(file_t *file);
 
@@ -0,0 +1,95 @@
+#ifndef AHCI_H_
+#define AHCI_H_
+
+#include <xjos/types.h>
+#include <hardware/ide.h>
+
+
+#define AHCI_PORT_NR 32 // HBA 最多端口数
+#define AHCI_SLOT_NR 32 // 每个端口最多命令槽
+#define AHCI_PRD_NR 56  // 每个命令表的 PRD 数，命令表 1K
+
+// command header, 32 bytes
+typedef struct ahci_cmd_header_t {
+    u16 flags;              // CFL(4:0) A(5) W(6) P(7) R(8) B(9) C(10) PMP(15:12)
+    u16 prdtl;              // PRD entry count
+    volatile u32 prdbc;     // bytes transferred
+    u32 ctba;               // command table base
+    u32 ctbau;              // command table base upper 32 bits
+    u32 RESERVED[4];
+} _packed ahci_cmd_header_t;
+
+// physical region descriptor, 16 bytes
+typedef struct ahci_prd_t {
+    u32 dba;                // data base
+    u32 dbau;               // data base upper 32 bits
+    u32 RESERVED;
+    u32 dbc;                // byte count - 1 (21:0), interrupt (31)
+} _packed ahci_prd_t;
+
+typedef struct ahci_cmd_table_t {
+    u8 cfis[64];            // command FIS
+    u8 acmd[16];            // ATAPI command
+    u8 RESERVED[48];
+    ahci_prd_t prdt[AHCI_PRD_NR];
+} _packed ahci_cmd_table_t;
+
+// register FIS, host to device
+typedef struct fis_reg_h2d_t {
+    u8 type;                // FIS_TYPE_REG_H2D
+    u8 flags;               // PMP(3:0) C(7)
+    u8 command;             // ATA command
+    u8 featurel;            // feature 7:0, NCQ: count 7:0
+    u8 lba0;
+    u8 lba1;
+    u8 lba2;
+    u8 device;
+    u8 lba3;
+    u8 lba4;
+    u8 lba5;
+    u8 featureh;            // feature 15:8, NCQ: count 15:8
+    u8 countl;              // count 7:0, NCQ: tag << 3
+    u8 counth;
+    u8 icc;
+    u8 control;
+    u8 RESERVED[4];
+} _packed fis_reg_h2d_t;
+
+typedef struct ahci_part_t {
+    char name[8];               // partition name
+    struct ahci_port_t *port;   // disk port
+    u32 system;                 // system type
+    u32 start;                  // start lba
+    u32 count;                  // use sector count
+} ahci_part_t;
+
+// one SATA disk on a port
+typedef struct ahci_port_t {
+    char name[8];                       // disk name, sda...
+    struct ahci_ctrl_t *ctrl;           // ctrl pointer
+    u32 idx;                            // port number
+    u32 base;                           // port register base
+    ahci_cmd_header_t *cmds;            // command list
+    u8 *fis;                            // received FIS
+    ahci_cmd_table_t *tables;           // command table of each slot
+    struct request_t *reqs[AHCI_SLOT_NR]; // request of each slot
+    u32 slots;                          // usable slots mask
+    u32 active;                         // slots in flight
+    bool ncq;                           // native command queuing
+    bool wcache;                        // volatile write cache enabled
+    bool fua;                           // FUA write supported
+    u32 total_lba;                      // total lba count
+    dev_t dev;                          // device number
+    struct timer_t *timer;              // command timeout
+    ahci_part_t parts[IDE_PART_NR];     // disk partition
+} ahci_port_t;
+
+typedef struct ahci_ctrl_t {
+    u32 membase;                        // ABAR
+    u32 irq;                            // legacy interrupt line
+    u32 nslots;                         // command slots per port
+    bool sncq;                          // HBA supports NCQ
+    ahci_port_t *ports[AHCI_PORT_NR];   // present disks
+} ahci_ctrl_t;
+
+#endif /* AHCI_H_ */
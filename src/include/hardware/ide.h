@@ -46,17 +46,23 @@ typedef struct ide_prd_t {
     u32 len;
 } ide_prd_t;
 
+#define IDE_PRD_NR (PAGE_SIZE / sizeof(ide_prd_t))
+
 typedef struct ide_disk_t {
     char name[8];               // disk name
     struct ide_ctrl_t *ctrl;    // ctrl pointer
     u8 selector;                // disk select
     bool master;                // master disk
     bool dma;                   // disk DMA enabled
+    bool lba48;                 // 48-bit LBA supported
+    bool wcache;                // volatile write cache
+    bool fua;                   // WRITE DMA FUA EXT supported
     u32 total_lba;               // total lba count
     u32 cylinders;               // cylinder count
     u32 heads;                   // head count
     u32 sectors;                 // sector count
     u32 interface;             // 0: PIO, 1: DMA, 2: LBA48
+    dev_t dev;                  // device number
     ide_part_t parts[IDE_PART_NR]; // disk partition
 }ide_disk_t;
 
@@ -71,7 +77,10 @@ typedef struct ide_ctrl_t {
     u8 devsel;                      // cached HDDEVSEL value
     u8 control;                     // control Byte
     task_t *waiter;                 // waiting task
-    ide_prd_t prd;                  // Physical Region Descriptor
+    ide_prd_t *prdt;                // Physical Region Descriptor table, one page
+    list_t queue;                   // DMA requests of both disks
+    struct request_t *current;      // DMA request in progress
+    struct timer_t *timer;          // DMA request timeout
 }ide_ctrl_t;
 
 int ide_pio_read(ide_disk_t *disk, void *buf, u8 count, idx_t lba);
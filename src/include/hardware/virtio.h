@@ -0,0 +1,93 @@
+#ifndef VIRTIO_H_
+#define VIRTIO_H_
+
+#include <xjos/types.h>
+#include <hardware/ide.h>
+
+
+#define VIRTIO_BLK_SLOT_NR 32   // 同时在设备中的请求数
+#define VIRTIO_BLK_SEG_NR 62    // 每个请求的数据段数，加上请求头和状态共 64 个描述符
+
+// split virtqueue descriptor
+typedef struct vring_desc_t {
+    u64 addr;               // physical address
+    u32 len;
+    u16 flags;              // NEXT(0) WRITE(1) INDIRECT(2)
+    u16 next;
+} _packed vring_desc_t;
+
+typedef struct vring_avail_t {
+    u16 flags;              // NO_INTERRUPT(0)
+    u16 idx;                // next free entry
+    u16 ring[0];            // head descriptor, followed by used_event
+} _packed vring_avail_t;
+
+typedef struct vring_used_elem_t {
+    u32 id;                 // head descriptor
+    u32 len;                // bytes written
+} _packed vring_used_elem_t;
+
+typedef struct vring_used_t {
+    u16 flags;              // NO_NOTIFY(0)
+    u16 idx;
+    vring_used_elem_t ring[0]; // followed by avail_event
+} _packed vring_used_t;
+
+typedef struct virtqueue_t {
+    u16 size;               // descriptor count, power of 2
+    u16 last_used;          // next used entry to handle
+    u32 pages;              // pages of the ring
+    vring_desc_t *desc;
+    vring_avail_t *avail;
+    vring_used_t *used;
+} virtqueue_t;
+
+// virtio-blk request header, device reads
+typedef struct virtio_blk_hdr_t {
+    u32 type;               // IN / OUT / FLUSH
+    u32 RESERVED;
+    u64 sector;
+} _packed virtio_blk_hdr_t;
+
+// per slot header and status, in one page
+typedef struct virtio_blk_cmd_t {
+    virtio_blk_hdr_t hdr;
+    u8 status;              // device writes
+    u8 RESERVED[15];
+} _packed virtio_blk_cmd_t;
+
+typedef struct virtio_blk_slot_t {
+    u16 head;                   // head descriptor in the ring
+    vring_desc_t *table;        // indirect table, or the chain in the ring
+    virtio_blk_cmd_t *cmd;
+    struct request_t *req;
+} virtio_blk_slot_t;
+
+typedef struct virtio_blk_part_t {
+    char name[8];               // partition name
+    struct virtio_blk_t *blk;   // disk pointer
+    u32 system;                 // system type
+    u32 start;                  // start lba
+    u32 count;                  // use sector count
+} virtio_blk_part_t;
+
+typedef struct virtio_blk_t {
+    char name[8];               // disk name, vda
+    u16 iobase;                 // legacy I/O BAR
+    u8 irq;                     // legacy interrupt line
+    u32 features;               // negotiated features
+    virtqueue_t vq;             // request queue
+    bool indirect;              // indirect descriptors
+    bool event_idx;             // notification suppression by index
+    bool ro;                    // read only
+    u32 segs;                   // max data segments per request
+    u32 seg_size;               // max bytes per segment
+    u32 slots;                  // usable slots mask
+    u32 active;                 // slots in flight
+    virtio_blk_slot_t slot[VIRTIO_BLK_SLOT_NR];
+    u32 total_lba;              // capacity in sectors
+    dev_t dev;                  // device number
+    virtio_blk_part_t parts[IDE_PART_NR]; // disk partition
+} virtio_blk_t;
+
+#endif /* VIRTIO_H_ */
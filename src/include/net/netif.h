@@ -32,6 +32,11 @@ typedef struct netif_t {
     void (*nic_output)(struct netif_t *netif, pbuf_t *pbuf);
 
     u32 flags;
+
+    u32 rx_packets;         // 接收包数
+    u32 rx_bytes;           // 接收字节数
+    u32 tx_packets;         // 发送包数
+    u32 tx_bytes;           // 发送字节数
 } netif_t;
 
 // 创建虚拟网卡
@@ -42,6 +47,9 @@ netif_t *netif_setup(void *nic, eth_addr_t hwaddr, void *output);
 
 netif_t *netif_get();
 
+// 第 idx 个虚拟网卡，不存在返回 NULL
+netif_t *netif_index(idx_t idx);
+
 // ip 路由选择
 netif_t *netif_route(ip_addr_t addr);
 
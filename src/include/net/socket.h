@@ -64,6 +64,8 @@ typedef struct sockaddr_ll_t {
     u8 zero[8];
 } sockaddr_ll_t;
 
+#define IOVEC_MAX 1024 // max iovlen of recvmsg / sendmsg
+
 typedef struct iovec_t {
     size_t size;
     void *base;
@@ -108,7 +110,7 @@ typedef struct socket_op_t {
 
 void socket_register_op(socktype_t type, socket_op_t *op);
 
-err_t iovec_check(iovec_t *iov, int iovlen, int write);
+err_t iovec_check(iovec_t *iov, int iovlen);
 size_t iovec_size(iovec_t *iov, int iovlen);
 iovec_t *iovec_dup(iovec_t *iov, int iovlen);
 int iovec_read(iovec_t *iov, int iovlen, char *buf, size_t count);
@@ -14,4 +14,21 @@ typedef struct dentry_t {
     char name[MAXNAMELEN];
 } dentry_t;
 
+#define GETDENTS_PLUS 1 // 同时返回文件属性 (readdirplus)
+
+// getdents 返回的变长目录项，reclen 为 4 字节对齐后的记录长度
+typedef struct getdent_t {
+    u32 nr;        // inode number
+    u16 reclen;    // 记录长度
+    u16 namelen;   // 文件名长度
+    u16 mode;      // 文件模式      (GETDENTS_PLUS)
+    u8 nlinks;     // 链接数        (GETDENTS_PLUS)
+    u8 gid;        // 组 id         (GETDENTS_PLUS)
+    u16 uid;       // 用户 id       (GETDENTS_PLUS)
+    u16 reserved;
+    u32 size;      // 文件大小      (GETDENTS_PLUS)
+    time_t mtime;  // 最后修改时间  (GETDENTS_PLUS)
+    char name[0];  // 文件名，以 EOS 结尾
+} getdent_t;
+
 #endif /* XJOS_DIRENT_H */
@@ -14,12 +14,25 @@
 #define O_TRUNC 01000
 #define O_APPEND 02000
 #define O_NONBLOCK 04000
+#define O_DIRECT 040000
+
+// fcntl commands
+#define F_GETFL 3
+#define F_SETPIPE_SZ 1031
+#define F_GETPIPE_SZ 1032
+
+// sync_file_range flags
+#define SYNC_FILE_RANGE_WAIT_BEFORE 1
+#define SYNC_FILE_RANGE_WRITE 2
+#define SYNC_FILE_RANGE_WAIT_AFTER 4
 
 // lseek whence
 typedef enum whence_t {
     SEEK_SET = 1,
     SEEK_CUR,
-    SEEK_END
+    SEEK_END,
+    SEEK_DATA,
+    SEEK_HOLE,
 } whence_t;
 
 #endif /* XJOS_FCNTL_H */
@@ -80,6 +80,9 @@ void set_interrupt_handler(u32 irq, handler_t handler);
 void set_interrupt_mask(u32 irq, bool enable);
 void set_exception_handler(u32 intr, handler_t handler);
 
+// 向量 vector 发生的中断次数, 0x80 为系统调用次数
+u32 interrupt_get_count(u32 vector);
+
 bool interrupt_disable();                   // clear IF flag
 bool get_interrupt_state();                 // get IF flag
 void set_interrupt_state(bool state);       // set IF flag
@@ -0,0 +1,31 @@
+#ifndef XJOS_IOPRIO_H
+#define XJOS_IOPRIO_H
+
+
+#include <xjos/types.h>
+
+// ioprio = class << 13 | level, 与 linux 相同
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_PRIO_MASK ((1 << IOPRIO_CLASS_SHIFT) - 1)
+
+#define IOPRIO_PRIO_CLASS(ioprio) ((ioprio) >> IOPRIO_CLASS_SHIFT)
+#define IOPRIO_PRIO_DATA(ioprio) ((ioprio) & IOPRIO_PRIO_MASK)
+#define IOPRIO_PRIO_VALUE(class, data) (((class) << IOPRIO_CLASS_SHIFT) | (data))
+
+#define IOPRIO_CLASS_NR 4
+#define IOPRIO_LEVEL_NR 8   // level 0 最高，7 最低
+
+enum ioprio_class_t {
+    IOPRIO_CLASS_NONE,  // 未设置，由 nice 推出 best effort level
+    IOPRIO_CLASS_RT,    // 实时，总是最先服务
+    IOPRIO_CLASS_BE,    // best effort
+    IOPRIO_CLASS_IDLE,  // 磁盘空闲时才服务
+};
+
+enum ioprio_who_t {
+    IOPRIO_WHO_PROCESS = 1, // who 为 pid，0 表示自己
+    IOPRIO_WHO_PGRP,        // who 为进程组，0 表示自己的进程组
+    IOPRIO_WHO_USER,        // who 为 uid
+};
+
+#endif /* XJOS_IOPRIO_H */
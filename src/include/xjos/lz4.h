@@ -0,0 +1,18 @@
+#ifndef XJOS_LZ4_H
+#define XJOS_LZ4_H
+
+
+#include <xjos/types.h>
+
+// LZ4 block format, input at most 64KB
+#define LZ4_MAX_INPUT 0x10000
+#define LZ4_HASH_BITS 12
+#define LZ4_WORK_SIZE (sizeof(u16) << LZ4_HASH_BITS)  // hash table of compressor
+
+// 压缩结果放不进 cap 时返回 0
+int lz4_compress(const void *src, int len, void *dst, int cap, void *work);
+
+// 返回解压后的长度，数据损坏返回 -EINVAL
+int lz4_decompress(const void *src, int len, void *dst, int cap);
+
+#endif /* XJOS_LZ4_H */
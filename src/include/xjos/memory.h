@@ -66,10 +66,24 @@ u32 get_cr2();
 u32 get_cr3();
 void set_cr3(u32 pde);
 
+typedef struct memory_stat_t {
+    u32 total_pages;  // 物理内存页数
+    u32 free_pages;   // 空闲物理页数 (用户内存)
+    u32 kernel_pages; // 内核内存页数
+    u32 kernel_free;  // 空闲内核页数
+} memory_stat_t;
+
+void memory_stat(memory_stat_t *stat);
+
 // alloc and free count contiguous kernel pages
 u32 alloc_kpage(u32 count);
 void free_kpage(u32 vaddr, u32 count);
 
+// 内存紧张时回收缓存对象，返回回收数量
+typedef u32 (*shrinker_t)(u32 count);
+void register_shrinker(shrinker_t shrinker);
+u32 shrink_memory(u32 count);
+
 // get page table entry
 page_entry_t *get_entry(u32 vaddr, bool create);
 page_entry_t *get_entry_private(u32 vaddr, bool create);
@@ -94,6 +108,19 @@ void free_pde();
 // get vaddr's paddr
 u32 get_paddr(u32 vaddr);
 
-bool memory_access(void *vaddr, int size, bool write, bool user);
+// 访问用户内存，缺页照常处理，地址无效时返回 -EFAULT 而不是结束进程
+err_t copy_from_user(void *dst, const void *src, size_t count);
+err_t copy_to_user(void *dst, const void *src, size_t count);
+err_t clear_user(void *dst, size_t count);
+
+// 返回字符串长度，count 内没有结束符时返回 count
+int strncpy_from_user(char *dst, const char *src, size_t count);
+
+// 固定 / 释放用户缓冲的物理页，供设备直接读写；地址无效时返回 -EFAULT
+err_t pin_user_pages(void *addr, size_t count, bool write);
+void unpin_user_pages(void *addr, size_t count);
+
+// 设置当前任务的 TASK_KERNEL_DS，返回原来的状态
+bool set_kernel_ds(bool on);
 
 #endif /* XJOS_MEMORY_H */
\ No newline at end of file
@@ -57,6 +57,12 @@ u64 sched_get_min_vruntime(void);
  */
 u32 sched_get_task_count(void);
 
+/**
+ * @brief Gets the total weight of tasks in the ready queue.
+ * @return The sum of ready task weights.
+ */
+u32 sched_get_total_weight(void);
+
 
 // === Extern Global Variables ===
 // Shared between scheduler and clock interrupt
@@ -22,10 +22,15 @@ pid_t getpgrp();
 /* session */
 pid_t setsid();
 
+/* I/O priority, see xjos/ioprio.h */
+int ioprio_set(int which, int who, int ioprio);
+int ioprio_get(int which, int who);
+
 int stty();
 int gtty();
 
 int ioctl(fd_t fd, int cmd, int args);
+int fcntl(fd_t fd, int cmd, int arg);
 
 pid_t fork();
 
@@ -50,6 +55,12 @@ int read(fd_t fd, char *buf, int len);
 int write(fd_t fd, char *buf, int len);
 int lseek(fd_t fd, off_t offset, int whence);
 int readdir(fd_t fd, void *dir, int count);
+int getdents(fd_t fd, void *buf, int count, int flags);
+
+// 内核中直接搬运数据，不经过用户缓冲
+int sendfile(fd_t out_fd, fd_t in_fd, off_t *offset, size_t count);
+int splice(fd_t fd_in, off_t *off_in, fd_t fd_out, off_t *off_out, size_t len, int flags);
+int copy_file_range(fd_t fd_in, off_t *off_in, fd_t fd_out, off_t *off_out, size_t len, int flags);
 
 int execve(char *filename, char *argv[], char *envp[]);
 
@@ -73,10 +84,20 @@ time_t time();
 mode_t umask(mode_t mask);
 
 void sync();
+int fsync(fd_t fd);
+int fdatasync(fd_t fd);
+int sync_file_range(fd_t fd, off_t offset, off_t nbytes, int flags);
 
 int stat(char *filename, stat_t *statbuf);
 int fstat(fd_t fd, stat_t *statbuf);
 
+#define MKFS_JOURNAL 0x40000000 // 创建元数据日志
+#define MKFS_V2 0x10000000      // minix v2
+#define MKFS_V3 0x20000000      // minix v3
+
+#define MOUNT_TMPFS 0x40000000  // 安装 tmpfs, 低位为容量 (KB)
+#define MOUNT_PROC 0x20000000   // 安装 procfs
+
 int mkfs(char *devname, int icount);
 
 int kill(pid_t pid, int sig);
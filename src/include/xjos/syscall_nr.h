@@ -42,6 +42,7 @@ typedef enum {
     SYS_NR_BRK = 45,
     SYS_NR_SIGNAL = 48,
     SYS_NR_IOCTL = 54,
+    SYS_NR_FCNTL = 55,
     SYS_NR_SETPGID = 57,
     SYS_NR_UMASK = 60,
     SYS_NR_CHROOT = 61,
@@ -55,9 +56,17 @@ typedef enum {
     SYS_NR_READDIR = 89,
     SYS_NR_MMAP = 90,
     SYS_NR_MUNMAP = 91,
+    SYS_NR_FSYNC = 118,
+    SYS_NR_GETDENTS = 141,
+    SYS_NR_FDATASYNC = 148,
     SYS_NR_YIELD = 158,
     SYS_NR_SLEEP = 162,
     SYS_NR_GETCWD = 183,
+    SYS_NR_SENDFILE = 187,
+    SYS_NR_IOPRIO_SET = 289,
+    SYS_NR_IOPRIO_GET = 290,
+    SYS_NR_SPLICE = 313,
+    SYS_NR_SYNC_FILE_RANGE = 314,
 
     SYS_NR_SOCKET = 359,
     SYS_NR_BIND = 361,
@@ -74,6 +83,8 @@ typedef enum {
     SYS_NR_RECVMSG,
     SYS_NR_SHUTDOWN,
 
+    SYS_NR_COPY_FILE_RANGE = 377,
+
     SYS_NR_MKFS = SYSCALL_SIZE - 1,
 } syscall_t;
 
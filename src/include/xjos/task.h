@@ -41,6 +41,7 @@ typedef enum {
 typedef enum task_flag_t {
     TASK_FPU_USED = 1,      // 任务使用过 FPU，需要在切换时保存/恢复 FPU 状态
     TASK_FPU_ENABLED = 2,   // 任务当前 FPU 状态已启用 (如果设置了 TASK_FPU_USED)，否则在切换时会禁用 FPU
+    TASK_KERNEL_DS = 4,     // copy_*_user 接受内核地址，内核调用方传入内核缓冲时设置
 } task_flag_t;
 
 /* +---------------------+ <--- Page End (High Address, e.g., 0x2000)
@@ -114,7 +115,11 @@ typedef struct task_t {
     u32 sched_slice;         // 物理时间片 (ms)
     int ticks;               // 剩余时间片 (tick)
     u32 wakeup_time;         // 睡眠唤醒时间 (jiffies)
+    u32 runtime;             // 累计运行时间 (jiffies)
+    u32 start_time;          // 创建时间 (jiffies)
     struct rb_node cfs_node; // 红黑树节点 (连接到 cfs_ready_root)
+    u16 ioprio;              // I/O 优先级 (class << 13 | level)
+    u32 io_vtime;            // I/O 虚拟时间 (fair 调度器)
 
     // === 6. 链表关系 ===
     list_node_t node;        // 通用链表节点 (用于 sleep_list, block_list 等)
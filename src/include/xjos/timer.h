@@ -31,5 +31,7 @@ void timer_update(timer_t *timer, u32 expire_ms);
 int timer_expire_jiffies(u32 expire_ms);
 // 判断是否超时
 bool timer_is_expires(u32 expires);
+// 开机以来的微秒数
+u32 clock_us();
 
 #endif // XJOS_TIMER_H
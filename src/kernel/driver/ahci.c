@@ -0,0 +1,639 @@
+#include <hardware/ahci.h>
+#include <hardware/pci.h>
+#include <xjos/mio.h>
+#include <xjos/memory.h>
+#include <xjos/arena.h>
+#include <xjos/interrupt.h>
+#include <xjos/task.h>
+#include <xjos/timer.h>
+#include <xjos/string.h>
+#include <xjos/stdlib.h>
+#include <xjos/stdio.h>
+#include <xjos/debug.h>
+#include <xjos/assert.h>
+#include <xjos/errno.h>
+#include <drivers/device.h>
+
+
+#define LOGK(fmt, args...) DEBUGK(fmt, ##args)
+
+#define AHCI_TIMEOUT 60000       // 命令超时 ms
+#define AHCI_POLL_COUNT 1000000  // 不睡眠的忙等次数
+
+#define PCI_CLASS_STORAGE_AHCI 0x010601
+
+// HBA 全局寄存器
+#define HBA_CAP 0x00  // host capabilities
+#define HBA_GHC 0x04  // global host control
+#define HBA_IS 0x08   // interrupt status
+#define HBA_PI 0x0C   // ports implemented
+#define HBA_VS 0x10   // version
+
+#define HBA_CAP_NCS(cap) ((((cap) >> 8) & 0x1F) + 1) // 命令槽数
+#define HBA_CAP_SNCQ (1 << 30)                       // 支持 NCQ
+
+#define HBA_GHC_HR 0x00000001 // HBA reset
+#define HBA_GHC_IE 0x00000002 // interrupt enable
+#define HBA_GHC_AE 0x80000000 // AHCI enable
+
+// 端口寄存器，位于 0x100 + port * 0x80
+#define HBA_PORT_BASE 0x100
+#define HBA_PORT_SIZE 0x80
+
+#define PX_CLB 0x00  // command list base
+#define PX_CLBU 0x04
+#define PX_FB 0x08   // FIS base
+#define PX_FBU 0x0C
+#define PX_IS 0x10   // interrupt status
+#define PX_IE 0x14   // interrupt enable
+#define PX_CMD 0x18  // command and status
+#define PX_TFD 0x20  // task file data
+#define PX_SIG 0x24  // signature
+#define PX_SSTS 0x28 // SATA status
+#define PX_SCTL 0x2C // SATA control
+#define PX_SERR 0x30 // SATA error
+#define PX_SACT 0x34 // SATA active (NCQ)
+#define PX_CI 0x38   // command issue
+
+#define PX_CMD_ST 0x0001  // start
+#define PX_CMD_FRE 0x0010 // FIS receive enable
+#define PX_CMD_FR 0x4000  // FIS receive running
+#define PX_CMD_CR 0x8000  // command list running
+
+#define PX_IS_DHRS 0x00000001 // D2H register FIS
+#define PX_IS_PSS 0x00000002  // PIO setup FIS
+#define PX_IS_DSS 0x00000004  // DMA setup FIS
+#define PX_IS_SDBS 0x00000008 // set device bits FIS (NCQ done)
+#define PX_IS_DPS 0x00000020  // descriptor processed
+#define PX_IS_IFS 0x08000000  // interface fatal error
+#define PX_IS_HBDS 0x10000000 // host bus data error
+#define PX_IS_HBFS 0x20000000 // host bus fatal error
+#define PX_IS_TFES 0x40000000 // task file error
+
+#define PX_IS_ERROR (PX_IS_IFS | PX_IS_HBDS | PX_IS_HBFS | PX_IS_TFES)
+#define PX_IE_DEFAULT (PX_IS_DHRS | PX_IS_PSS | PX_IS_DSS | PX_IS_SDBS | PX_IS_DPS | PX_IS_ERROR)
+
+#define PX_TFD_ERR 0x01
+#define PX_TFD_DRQ 0x08
+#define PX_TFD_BSY 0x80
+
+#define PX_SSTS_DET_PRESENT 3 // 设备存在且通信建立
+#define PX_SSTS_IPM_ACTIVE 1  // 接口处于活动状态
+
+#define SATA_SIG_ATA 0x00000101 // SATA 硬盘
+
+#define FIS_TYPE_REG_H2D 0x27
+#define FIS_CMD 0x80       // 命令 FIS
+#define FIS_DEV_LBA 0x40   // LBA 模式
+#define FIS_DEV_FUA 0x80   // NCQ 写: 写入介质后才完成
+
+#define CMD_FLAG_WRITE 0x40 // 写设备
+#define CMD_FLAG_PREFETCH 0x80
+
+#define AHCI_PRD_MAX 0x400000 // 每个 PRD 最多 4M
+
+// 最坏情况每页一个 PRD，首尾不对齐多占一个
+#define AHCI_MAX_SECS ((AHCI_PRD_NR - 1) * (PAGE_SIZE / SECTOR_SIZE))
+
+// ATA commands
+#define ATA_CMD_IDENTIFY 0xEC
+#define ATA_CMD_READ_DMA_EXT 0x25
+#define ATA_CMD_WRITE_DMA_EXT 0x35
+#define ATA_CMD_READ_FPDMA 0x60  // NCQ read
+#define ATA_CMD_WRITE_FPDMA 0x61 // NCQ write
+#define ATA_CMD_WRITE_DMA_FUA_EXT 0x3D
+#define ATA_CMD_FLUSH_EXT 0xEA
+
+// IDENTIFY words
+#define ATA_ID_MODEL 27
+#define ATA_ID_LBA 60
+#define ATA_ID_QUEUE_DEPTH 75
+#define ATA_ID_SATA_CAP 76
+#define ATA_ID_CMDSET 83
+#define ATA_ID_CMDSET_EXT 84
+#define ATA_ID_CMDSET_ENABLED 85
+#define ATA_ID_LBA48 100
+
+#define ATA_SATA_CAP_NCQ (1 << 8)
+#define ATA_CMDSET_LBA48 (1 << 10)
+#define ATA_CMDSET_WCACHE (1 << 5)  // word 82 / 85
+#define ATA_CMDSET_FUA (1 << 6)     // word 84
+
+static ahci_ctrl_t controller;
+
+extern void map_area(u32 paddr, u32 size);
+
+static void ahci_complete_slots(ahci_port_t *port, u32 slots, err_t ret);
+
+
+// busy wait without sleep, used in interrupt
+static err_t ahci_wait_clear(u32 addr, u32 mask) {
+    for (size_t i = 0; i < AHCI_POLL_COUNT; i++) {
+        if (!(minl(addr) & mask))
+            return EOK;
+    }
+    return -ETIME;
+}
+
+
+static err_t ahci_port_stop(ahci_port_t *port) {
+    u32 cmd = minl(port->base + PX_CMD);
+    moutl(port->base + PX_CMD, cmd & ~PX_CMD_ST);
+    if (ahci_wait_clear(port->base + PX_CMD, PX_CMD_CR) < EOK)
+        return -ETIME;
+
+    cmd = minl(port->base + PX_CMD);
+    moutl(port->base + PX_CMD, cmd & ~PX_CMD_FRE);
+    return ahci_wait_clear(port->base + PX_CMD, PX_CMD_FR);
+}
+
+
+static err_t ahci_port_start(ahci_port_t *port) {
+    if (ahci_wait_clear(port->base + PX_TFD, PX_TFD_BSY | PX_TFD_DRQ) < EOK)
+        return -ETIME;
+
+    u32 cmd = minl(port->base + PX_CMD);
+    moutl(port->base + PX_CMD, cmd | PX_CMD_FRE);
+    moutl(port->base + PX_CMD, cmd | PX_CMD_FRE | PX_CMD_ST);
+    return EOK;
+}
+
+
+static void ahci_fis(fis_reg_h2d_t *fis, u8 command, u32 lba, u32 count, u32 slot, bool ncq) {
+    memset(fis, 0, sizeof(fis_reg_h2d_t));
+    fis->type = FIS_TYPE_REG_H2D;
+    fis->flags = FIS_CMD;
+    fis->command = command;
+
+    if (command == ATA_CMD_IDENTIFY || command == ATA_CMD_FLUSH_EXT)
+        return;
+
+    fis->device = FIS_DEV_LBA;
+    fis->lba0 = lba & 0xFF;
+    fis->lba1 = (lba >> 8) & 0xFF;
+    fis->lba2 = (lba >> 16) & 0xFF;
+    fis->lba3 = (lba >> 24) & 0xFF;
+
+    if (ncq) {
+        // NCQ 扇区数在 feature 中，count 中是命令标签
+        fis->featurel = count & 0xFF;
+        fis->featureh = (count >> 8) & 0xFF;
+        fis->countl = slot << 3;
+    } else {
+        fis->countl = count & 0xFF;
+        fis->counth = (count >> 8) & 0xFF;
+    }
+}
+
+
+// 在 slot 中构建命令，物理地址连续的页合并为一个 PRD
+static err_t ahci_setup_cmd(ahci_port_t *port, u32 slot, u32 *pages, u32 len, bool write) {
+    ahci_cmd_table_t *table = &port->tables[slot];
+    ahci_prd_t *prd = NULL;
+    size_t nr = 0;
+    u32 size = 0;
+
+    for (size_t i = 0; len; i++) {
+        u32 addr = pages[i];
+        if (!addr || (addr & 1))
+            return -EFAULT;
+
+        u32 chunk = MIN(len, PAGE_SIZE - (addr & (PAGE_SIZE - 1)));
+        len -= chunk;
+
+        if (prd && prd->dba + size == addr && size + chunk <= AHCI_PRD_MAX) {
+            size += chunk;
+            prd->dbc = size - 1;
+            continue;
+        }
+
+        if (nr == AHCI_PRD_NR) {
+            LOGK("ahci %s too many segments\n", port->name);
+            return -EINVAL;
+        }
+        prd = &table->prdt[nr++];
+        size = chunk;
+        memset(prd, 0, sizeof(ahci_prd_t));
+        prd->dba = addr;
+        prd->dbc = size - 1;
+    }
+
+    ahci_cmd_header_t *header = &port->cmds[slot];
+    header->flags = (sizeof(fis_reg_h2d_t) / 4) | CMD_FLAG_PREFETCH;
+    if (write)
+        header->flags |= CMD_FLAG_WRITE;
+    header->prdtl = nr;
+    header->prdbc = 0;
+    header->ctba = get_paddr((u32)table);
+    header->ctbau = 0;
+    return EOK;
+}
+
+
+static void ahci_issue(ahci_port_t *port, u32 slot, bool ncq) {
+    u32 mask = 1 << slot;
+    port->active |= mask;
+
+    if (ncq)
+        moutl(port->base + PX_SACT, mask);
+    moutl(port->base + PX_CI, mask);
+}
+
+
+// 初始化时轮询执行命令，buf 在一页之内
+static err_t ahci_exec(ahci_port_t *port, u8 command, u32 lba, u32 count, void *buf, bool write) {
+    u32 page = get_paddr((u32)buf);
+    fis_reg_h2d_t *fis = (fis_reg_h2d_t *)port->tables[0].cfis;
+
+    ahci_fis(fis, command, lba, count, 0, false);
+    err_t ret = ahci_setup_cmd(port, 0, &page, count * SECTOR_SIZE, write);
+    if (ret < EOK)
+        return ret;
+
+    moutl(port->base + PX_CI, 1);
+    for (size_t i = 0; i < AHCI_POLL_COUNT; i++) {
+        if (minl(port->base + PX_IS) & PX_IS_TFES)
+            break;
+        if (!(minl(port->base + PX_CI) & 1))
+            return (minl(port->base + PX_TFD) & PX_TFD_ERR) ? -EIO : EOK;
+    }
+
+    LOGK("ahci %s command 0x%x failed tfd 0x%x\n", port->name, command, minl(port->base + PX_TFD));
+    moutl(port->base + PX_IS, minl(port->base + PX_IS));
+    return -EIO;
+}
+
+
+// 端口出错或超时: 重启端口，失败全部进行中的命令
+static void ahci_port_fail(ahci_port_t *port, err_t ret) {
+    LOGK("ahci %s error %d tfd 0x%x serr 0x%x\n", port->name, ret,
+         minl(port->base + PX_TFD), minl(port->base + PX_SERR));
+
+    ahci_port_stop(port);
+    moutl(port->base + PX_SERR, 0xFFFFFFFF);
+    moutl(port->base + PX_IS, 0xFFFFFFFF);
+    ahci_port_start(port);
+
+    ahci_complete_slots(port, port->active, ret);
+}
+
+
+static void ahci_timeout(timer_t *timer) {
+    ahci_port_t *port = (ahci_port_t *)timer->arg;
+    port->timer = NULL;     // timer_wakeup frees it
+    ahci_port_fail(port, -ETIME);
+}
+
+
+static void ahci_complete_slots(ahci_port_t *port, u32 slots, err_t ret) {
+    request_t *reqs[AHCI_SLOT_NR];
+    size_t nr = 0;
+
+    // 先释放命令槽，完成回调可能立即提交新的请求
+    for (size_t slot = 0; slot < AHCI_SLOT_NR; slot++) {
+        if (!(slots & (1 << slot)))
+            continue;
+        reqs[nr++] = port->reqs[slot];
+        port->reqs[slot] = NULL;
+    }
+    port->active &= ~slots;
+
+    if (port->timer) {
+        if (port->active) {
+            timer_update(port->timer, AHCI_TIMEOUT);
+        } else {
+            timer_put(port->timer);
+            port->timer = NULL;
+        }
+    }
+
+    for (size_t i = 0; i < nr; i++) {
+        if (reqs[i])
+            device_complete(reqs[i], ret);
+    }
+}
+
+
+static void ahci_port_handler(ahci_port_t *port) {
+    u32 status = minl(port->base + PX_IS);
+    moutl(port->base + PX_IS, status);
+
+    if (status & PX_IS_ERROR) {
+        ahci_port_fail(port, -EIO);
+        return;
+    }
+
+    // 已经不在 SACT 和 CI 中的命令都完成了
+    u32 pending = minl(port->base + PX_SACT) | minl(port->base + PX_CI);
+    u32 done = port->active & ~pending;
+    if (done)
+        ahci_complete_slots(port, done, EOK);
+}
+
+
+static void ahci_handler(int vector) {
+    send_eoi(vector);
+
+    ahci_ctrl_t *ctrl = &controller;
+    u32 status = minl(ctrl->membase + HBA_IS);
+
+    for (size_t i = 0; i < AHCI_PORT_NR; i++) {
+        if (!(status & (1 << i)) || !ctrl->ports[i])
+            continue;
+        ahci_port_handler(ctrl->ports[i]);
+    }
+    moutl(ctrl->membase + HBA_IS, status);
+}
+
+
+// 取一个空闲的命令槽发出请求，完成时在中断中通知设备层
+static int ahci_submit(ahci_port_t *port, request_t *req) {
+    u32 free = port->slots & ~port->active;
+    if (!free)
+        return -EBUSY;
+
+    u32 slot = 0;
+    while (!(free & (1 << slot)))
+        slot++;
+
+    bool write = req->type == REQ_WRITE;
+    bool fua = write && (req->flags & REQ_FUA);
+    bool ncq = port->ncq;
+    u8 command;
+    if (req->type == REQ_FLUSH) {
+        // 不是队列命令，设备层保证此时端口上没有其它命令
+        command = ATA_CMD_FLUSH_EXT;
+        ncq = false;
+    } else if (ncq) {
+        command = write ? ATA_CMD_WRITE_FPDMA : ATA_CMD_READ_FPDMA;
+    } else if (fua) {
+        command = ATA_CMD_WRITE_DMA_FUA_EXT;
+    } else {
+        command = write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+    }
+
+    fis_reg_h2d_t *fis = (fis_reg_h2d_t *)port->tables[slot].cfis;
+    ahci_fis(fis, command, req->offset, req->count, slot, ncq);
+    if (ncq && fua)
+        fis->device |= FIS_DEV_FUA;
+
+    err_t ret = ahci_setup_cmd(port, slot, req->pages, req->count * SECTOR_SIZE, write);
+    if (ret < EOK)
+        return ret;
+
+    MM_TRACEK("ahci %s slot %d lba 0x%x count %d\n", port->name, slot, req->offset, req->count);
+
+    port->reqs[slot] = req;
+    ahci_issue(port, slot, ncq);
+
+    if (!port->timer)
+        port->timer = timer_add(AHCI_TIMEOUT, ahci_timeout, port, NULL);
+    return EOK;
+}
+
+
+int ahci_ioctl(ahci_port_t *port, int cmd, void *args, int flags) {
+    switch (cmd) {
+        case DEV_CMD_SECTOR_START:
+            return 0;
+        case DEV_CMD_SECTOR_SIZE:
+            return port->total_lba;
+        default:
+            return -EINVAL;
+    }
+}
+
+
+int ahci_read(ahci_port_t *port, void *buf, size_t count, idx_t lba) {
+    return device_request(port->dev, buf, count, lba, 0, REQ_READ);
+}
+
+
+int ahci_write(ahci_port_t *port, void *buf, size_t count, idx_t lba) {
+    return device_request(port->dev, buf, count, lba, 0, REQ_WRITE);
+}
+
+
+int ahci_part_ioctl(ahci_part_t *part, int cmd, void *args, int flags) {
+    switch (cmd) {
+        case DEV_CMD_SECTOR_START:
+            return part->start;
+        case DEV_CMD_SECTOR_SIZE:
+            return part->count;
+        default:
+            return -EINVAL;
+    }
+}
+
+
+int ahci_part_read(ahci_part_t *part, void *buf, size_t count, idx_t lba) {
+    return ahci_read(part->port, buf, count, part->start + lba);
+}
+
+
+int ahci_part_write(ahci_part_t *part, void *buf, size_t count, idx_t lba) {
+    return ahci_write(part->port, buf, count, part->start + lba);
+}
+
+
+static err_t ahci_identify(ahci_port_t *port, u16 *buf) {
+    err_t ret = ahci_exec(port, ATA_CMD_IDENTIFY, 0, 1, buf, false);
+    if (ret < EOK)
+        return ret;
+
+    char model[41];
+    for (size_t i = 0; i < 20; i++) {
+        model[i * 2] = buf[ATA_ID_MODEL + i] >> 8;
+        model[i * 2 + 1] = buf[ATA_ID_MODEL + i] & 0xFF;
+    }
+    model[40] = '\0';
+    LOGK("ahci %s model %s\n", port->name, model);
+
+    port->total_lba = buf[ATA_ID_LBA] | ((u32)buf[ATA_ID_LBA + 1] << 16);
+    if (buf[ATA_ID_CMDSET] & ATA_CMDSET_LBA48) {
+        // 扇区号为 32 位，超过 2T 的部分不使用
+        bool huge = buf[ATA_ID_LBA48 + 2] || buf[ATA_ID_LBA48 + 3];
+        u32 total = buf[ATA_ID_LBA48] | ((u32)buf[ATA_ID_LBA48 + 1] << 16);
+        port->total_lba = huge ? 0xFFFFFFFF : total;
+    }
+    if (!port->total_lba)
+        return -EIO;
+
+    // 队列深度取 HBA 命令槽数和设备深度中较小的
+    u32 depth = 1;
+    port->ncq = controller.sncq && (buf[ATA_ID_SATA_CAP] & ATA_SATA_CAP_NCQ);
+    if (port->ncq)
+        depth = MIN(controller.nslots, (u32)(buf[ATA_ID_QUEUE_DEPTH] & 0x1F) + 1);
+    port->slots = depth == 32 ? 0xFFFFFFFF : (1 << depth) - 1;
+
+    port->wcache = !!(buf[ATA_ID_CMDSET_ENABLED] & ATA_CMDSET_WCACHE);
+    port->fua = port->ncq || !!(buf[ATA_ID_CMDSET_EXT] & ATA_CMDSET_FUA);
+
+    LOGK("ahci %s total lba %u ncq %d depth %d wcache %d fua %d\n",
+         port->name, port->total_lba, port->ncq, depth, port->wcache, port->fua);
+    return EOK;
+}
+
+
+static void ahci_part_init(ahci_port_t *port, u16 *buf) {
+    if (ahci_exec(port, ATA_CMD_READ_DMA_EXT, 0, 1, buf, false) < EOK)
+        return;
+
+    boot_sector_t *boot = (boot_sector_t *)buf;
+    if (boot->signature != 0xAA55)
+        return;
+
+    for (size_t i = 0; i < IDE_PART_NR; i++) {
+        part_entry_t *entry = &boot->entry[i];
+        ahci_part_t *part = &port->parts[i];
+        if (!entry->count || entry->system == 0x05)
+            continue;
+
+        sprintf(part->name, "%s%d", port->name, i + 1);
+        part->port = port;
+        part->count = entry->count;
+        part->system = entry->system;
+        part->start = entry->start;
+        LOGK("part %s start %d count %d system 0x%x\n", part->name, part->start, part->count, part->system);
+    }
+}
+
+
+static ahci_port_t *ahci_port_init(ahci_ctrl_t *ctrl, u32 idx, u16 *buf) {
+    u32 base = ctrl->membase + HBA_PORT_BASE + idx * HBA_PORT_SIZE;
+
+    u32 ssts = minl(base + PX_SSTS);
+    if ((ssts & 0xF) != PX_SSTS_DET_PRESENT || ((ssts >> 8) & 0xF) != PX_SSTS_IPM_ACTIVE)
+        return NULL;
+    if (minl(base + PX_SIG) != SATA_SIG_ATA) {
+        LOGK("ahci port %d signature 0x%x not a disk\n", idx, minl(base + PX_SIG));
+        return NULL;
+    }
+
+    static char next = 'a';
+    ahci_port_t *port = (ahci_port_t *)kmalloc(sizeof(ahci_port_t));
+    memset(port, 0, sizeof(ahci_port_t));
+    sprintf(port->name, "sd%c", next);
+    port->ctrl = ctrl;
+    port->idx = idx;
+    port->base = base;
+
+    // 命令列表 1K 和 FIS 接收区 256 字节共用一页
+    u8 *page = (u8 *)alloc_kpage(1);
+    memset(page, 0, PAGE_SIZE);
+    port->cmds = (ahci_cmd_header_t *)page;
+    port->fis = page + sizeof(ahci_cmd_header_t) * AHCI_SLOT_NR;
+
+    u32 tables = sizeof(ahci_cmd_table_t) * AHCI_SLOT_NR / PAGE_SIZE;
+    port->tables = (ahci_cmd_table_t *)alloc_kpage(tables);
+    memset(port->tables, 0, tables * PAGE_SIZE);
+
+    ahci_port_stop(port);
+    moutl(base + PX_CLB, get_paddr((u32)port->cmds));
+    moutl(base + PX_CLBU, 0);
+    moutl(base + PX_FB, get_paddr((u32)port->fis));
+    moutl(base + PX_FBU, 0);
+    moutl(base + PX_SERR, 0xFFFFFFFF);
+    moutl(base + PX_IS, 0xFFFFFFFF);
+
+    if (ahci_port_start(port) < EOK || ahci_identify(port, buf) < EOK) {
+        LOGK("ahci port %d init failed\n", idx);
+        ahci_port_stop(port);
+        free_kpage((u32)port->tables, tables);
+        free_kpage((u32)page, 1);
+        kfree(port);
+        return NULL;
+    }
+
+    ahci_part_init(port, buf);
+    next++;
+    return port;
+}
+
+
+static void ahci_install(ahci_port_t *port) {
+    port->dev = device_install(
+        DEV_BLOCK, DEV_SATA_DISK,
+        port, port->name, 0,
+        ahci_ioctl, ahci_read, ahci_write);
+
+    // 请求从队列中取出，最多同时有 slots 个命令在设备中
+    u32 depth = 0;
+    for (u32 slots = port->slots; slots; slots >>= 1)
+        depth++;
+    device_set_queue(port->dev, ahci_submit, depth, AHCI_MAX_SECS);
+    if (port->wcache)
+        device_set_cache(port->dev, DEV_WCACHE | (port->fua ? DEV_FUA : 0), NULL);
+
+    for (size_t i = 0; i < IDE_PART_NR; i++) {
+        ahci_part_t *part = &port->parts[i];
+        if (!part->count)
+            continue;
+        device_install(DEV_BLOCK, DEV_SATA_PART,
+                       part, part->name, port->dev,
+                       ahci_part_ioctl, ahci_part_read, ahci_part_write);
+    }
+
+    moutl(port->base + PX_IE, PX_IE_DEFAULT);
+}
+
+
+void ahci_init() {
+    pci_device_t *device = pci_find_device_by_class(PCI_CLASS_STORAGE_AHCI);
+    if (!device) {
+        LOGK("ahci not found\n");
+        return;
+    }
+
+    ahci_ctrl_t *ctrl = &controller;
+    memset(ctrl, 0, sizeof(ahci_ctrl_t));
+
+    // ABAR 是唯一的内存 BAR
+    pci_bar_t membar;
+    if (pci_find_bar(device, &membar, PCI_BAR_TYPE_MEM) < EOK) {
+        LOGK("ahci abar not found\n");
+        return;
+    }
+    assert(membar.iobase < 0xFFC00000 && membar.iobase >= 0xF0000000);
+
+    ctrl->irq = pci_interrupt(device);
+    if (ctrl->irq >= 16) {
+        LOGK("ahci no legacy interrupt\n");
+        return;
+    }
+
+    u32 command = pci_inl(device->bus, device->dev, device->func, PCI_CONF_COMMAND);
+    pci_outl(device->bus, device->dev, device->func, PCI_CONF_COMMAND, command | PCI_COMMAND_MEMORY);
+    pci_enable_busmastering(device);
+
+    ctrl->membase = membar.iobase;
+    map_area(membar.iobase, membar.size);
+
+    moutl(ctrl->membase + HBA_GHC, minl(ctrl->membase + HBA_GHC) | HBA_GHC_AE);
+
+    u32 cap = minl(ctrl->membase + HBA_CAP);
+    ctrl->nslots = HBA_CAP_NCS(cap);
+    ctrl->sncq = !!(cap & HBA_CAP_SNCQ);
+    LOGK("ahci abar 0x%x version 0x%x slots %d ncq %d irq %d\n",
+         ctrl->membase, minl(ctrl->membase + HBA_VS), ctrl->nslots, ctrl->sncq, ctrl->irq);
+
+    u32 pi = minl(ctrl->membase + HBA_PI);
+    u16 *buf = (u16 *)alloc_kpage(1);
+    for (size_t i = 0; i < AHCI_PORT_NR; i++) {
+        if (pi & (1 << i))
+            ctrl->ports[i] = ahci_port_init(ctrl, i, buf);
+    }
+    free_kpage((u32)buf, 1);
+
+    for (size_t i = 0; i < AHCI_PORT_NR; i++) {
+        if (ctrl->ports[i])
+            ahci_install(ctrl->ports[i]);
+    }
+
+    moutl(ctrl->membase + HBA_IS, 0xFFFFFFFF);
+    set_interrupt_handler(ctrl->irq, ahci_handler);
+    set_interrupt_mask(ctrl->irq, true);
+    if (ctrl->irq >= 8)
+        set_interrupt_mask(IRQ_CASCADE, true);
+    moutl(ctrl->membase + HBA_GHC, minl(ctrl->membase + HBA_GHC) | HBA_GHC_IE);
+}
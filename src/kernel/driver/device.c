@@ -1,10 +1,15 @@
 #include <drivers/device.h>
+#include <drivers/iosched.h>
 #include <xjos/string.h>
 #include <xjos/task.h>
 #include <xjos/assert.h>
 #include <xjos/debug.h>
 #include <xjos/arena.h>
+#include <xjos/memory.h>
+#include <xjos/stdlib.h>
 #include <xjos/errno.h>
+#include <xjos/timer.h>
+#include <xjos/sched.h>
 
 
 
@@ -14,6 +19,9 @@
 
 static device_t devices[DEVICE_NR];
 
+static void iostat_depth(device_t *device);
+static void iostat_reset(device_t *device);
+
 
 // get null device
 static device_t *get_null_device() {
@@ -29,6 +37,42 @@ static device_t *get_null_device() {
 
 int device_ioctl(dev_t dev, int cmd, void *args, int flags) {
     device_t *device = device_get(dev);
+
+    // I/O scheduler belongs to the whole disk
+    if (device->type == DEV_BLOCK && (cmd == DEV_CMD_SCHED_GET || cmd == DEV_CMD_SCHED_SET)) {
+        if (device->parent)
+            device = device_get(device->parent);
+        if (cmd == DEV_CMD_SCHED_GET)
+            return device->sched->type;
+        // 调度器影响整个磁盘上的所有任务
+        if (running_task()->uid != KERNEL_USER)
+            return -EPERM;
+        return device_set_sched(device->dev, (int)args);
+    }
+
+    if (device->type == DEV_BLOCK && (cmd == DEV_CMD_IOSTAT_GET || cmd == DEV_CMD_IOSTAT_RESET)) {
+        if (device->parent)
+            device = device_get(device->parent);
+        if (cmd == DEV_CMD_IOSTAT_RESET) {
+            if (running_task()->uid != KERNEL_USER)
+                return -EPERM;
+            iostat_reset(device);
+            return EOK;
+        }
+        iostat_depth(device);
+        device->stat.now = jiffies * jiffy;
+        device->stat.queued = device->queued;
+        device->stat.inflight = device->inflight;
+        return copy_to_user(args, &device->stat, sizeof(iostat_t));
+    }
+
+    if (device->type == DEV_BLOCK && cmd == DEV_CMD_FLUSH) {
+        // 文件的 fsync 不经过这里，只有整盘刷新需要权限
+        if (running_task()->uid != KERNEL_USER)
+            return -EPERM;
+        return device_flush(dev);
+    }
+
     if (device->ioctl) {
         return device->ioctl(device->ptr, cmd, args, flags);
     }
@@ -74,6 +118,11 @@ dev_t device_install(
     device->ioctl = ioctl;
     device->read = read;
     device->write = write;
+
+    if (type == DEV_BLOCK && !parent) {
+        assert(device_set_sched(device->dev, IOSCHED_DEFAULT) == EOK);
+        iostat_reset(device);
+    }
     return device->dev;  
 }
 
@@ -90,9 +139,23 @@ void device_init() {
         device->ioctl = NULL;
         device->read = NULL;
         device->write = NULL;
+        device->submit = NULL;
+        device->flush = NULL;
+        device->dax = NULL;
 
         list_init(&device->request_list);
         device->direct = DIRECT_UP;
+        device->head = 0;
+        device->depth = 0;
+        device->inflight = 0;
+        device->max_count = DEV_MAX_COUNT;
+        device->queued = 0;
+        device->cache = 0;
+        list_init(&device->flush_list);
+        device->flushing = false;
+        device->unflushed = false;
+        device->sched = NULL;
+        device->elevator = NULL;
     }
 }
 
@@ -131,6 +194,10 @@ static int do_request(request_t *req) {
         case REQ_WRITE:
             return device_write(req->dev, req->buf, req->count, req->offset, req->flags);
             break;
+        case REQ_FLUSH: {
+            device_t *device = device_get(req->dev);
+            return device->flush ? device->flush(device->ptr) : EOK;
+        }
         default:
             panic("req type %d unknown!!!\n", req->dev);
             break;
@@ -138,40 +205,256 @@ static int do_request(request_t *req) {
 }
 
 
-static request_t *request_nextreq(device_t *device, request_t *req) {
-    list_t *list = &device->request_list;
+void device_set_queue(dev_t dev, void *submit, u32 depth, u32 max_count) {
+    device_t *device = device_get(dev);
+    assert(device->type == DEV_BLOCK);
+    assert(depth > 0 && max_count > 0);
 
-    // change direction at the ends
-    if (device->direct == DIRECT_UP && req->node.next == &list->head)
-        device->direct = DIRECT_DOWN;   // change direction
-    else if (device->direct == DIRECT_DOWN && req->node.prev == &list->head)
-        device->direct = DIRECT_UP;     // change direction
+    device->submit = submit;
+    device->depth = depth;
+    device->max_count = max_count;
+}
 
-    // get next req according to direction
-    void *next = NULL;
-    if (device->direct == DIRECT_UP)
-        next = req->node.next;
-    else
-        next = req->node.prev;
 
-    if (next == &list->head)
+void device_set_cache(dev_t dev, u32 cache, void *flush) {
+    device_t *device = device_get(dev);
+    assert(device->type == DEV_BLOCK && !device->parent);
+    assert(device->submit || flush || !(cache & DEV_WCACHE));
+
+    device->cache = cache;
+    device->flush = flush;
+}
+
+
+void device_set_dax(dev_t dev, void *dax) {
+    device_t *device = device_get(dev);
+    assert(device->type == DEV_BLOCK && !device->parent);
+    device->dax = dax;
+}
+
+
+void *device_dax(dev_t dev, idx_t idx, u32 count) {
+    device_t *device = device_get(dev);
+    if (device->type != DEV_BLOCK)
         return NULL;
 
-    return list_entry(next, request_t, node);
+    if (device->parent) {
+        idx += device_ioctl(device->dev, DEV_CMD_SECTOR_START, 0, 0);
+        device = device_get(device->parent);
+    }
+    if (!device->dax)
+        return NULL;
+    return device->dax(device->ptr, idx, count);
 }
 
 
-err_t device_request(dev_t dev, void *buf, u8 count, idx_t idx, int flags, u32 type) {
+err_t device_set_sched(dev_t dev, int type) {
     device_t *device = device_get(dev);
-    assert(device->type == DEV_BLOCK);
+    assert(device->type == DEV_BLOCK && !device->parent);
+
+    iosched_t *sched = iosched_get(type);
+    if (!sched)
+        return -EINVAL;
+    if (device->sched == sched)
+        return EOK;
+    // queued reqs live in old scheduler
+    if (device->queued || device->inflight)
+        return -EBUSY;
+
+    if (device->elevator)
+        kfree(device->elevator);
+    device->sched = sched;
+    device->elevator = sched->init(device);
+    LOGK("device %s I/O scheduler %s\n", device->name, sched->name);
+    return EOK;
+}
+
+
+static void iostat_reset(device_t *device) {
+    iostat_t *stat = &device->stat;
+    memset(stat, 0, sizeof(iostat_t));
+    stat->dev = device->dev;
+    stat->since = jiffies * jiffy;
+    stat->stamp = clock_us();
+}
+
+
+static void iostat_time(u32 *ms, u32 *us, u32 delta) {
+    *us += delta;
+    if (*us >= 1000) {
+        *ms += *us / 1000;
+        *us %= 1000;
+    }
+}
+
+
+static u32 iostat_bucket(u32 us) {
+    u32 idx = 0;
+    while (us > 1 && idx < IOSTAT_HIST_NR - 1) {
+        us >>= 1;
+        idx++;
+    }
+    return idx;
+}
+
+
+static u32 iostat_since(u32 start) {
+    u32 delta = clock_us() - start;
+    // clock_us may lag one jiffy while clock interrupt is pending
+    return (int)delta < 0 ? 0 : delta;
+}
+
+
+// integrate outstanding reqs over time, called before they change
+static void iostat_depth(device_t *device) {
+    iostat_t *stat = &device->stat;
+    u32 delta = iostat_since(stat->stamp);
+    if (!delta)
+        return;
+    stat->stamp += delta;
+
+    u32 outstanding = device->queued + device->inflight;
+    if (!outstanding)
+        return;
+    iostat_time(&stat->busy_ms, &stat->busy_us, delta);
+    iostat_time(&stat->depth_ms, &stat->depth_us, delta * outstanding);
+}
+
+
+static void iostat_done(device_t *device, request_t *req, err_t ret) {
+    iostat_t *stat = &device->stat;
+    int dir = req->type == REQ_READ ? REQ_READ : REQ_WRITE;
+    u32 delta = iostat_since(req->dispatch_us);
+
+    if (req->type == REQ_FLUSH) {
+        stat->flushes++;
+    } else {
+        stat->ios[dir]++;
+        stat->sectors[dir] += req->count;
+    }
+    if (ret < EOK)
+        stat->errors++;
+    iostat_time(&stat->service_ms[dir], &stat->service_us[dir], delta);
+    stat->service_hist[iostat_bucket(delta)]++;
+}
+
+
+static void request_add(device_t *device, request_t *req) {
+    iostat_depth(device);
+    req->start_us = clock_us();
+    device->queued++;
+    if (req->type == REQ_FLUSH)
+        list_pushback(&device->flush_list, &req->node);
+    else
+        device->sched->add(device, req);
+
+    u32 outstanding = device->queued + device->inflight;
+    if (outstanding > device->stat.max_depth)
+        device->stat.max_depth = outstanding;
+}
+
 
+// flush 不经过调度器: 等之前分派的请求全部完成后单独交给驱动，
+// 完成之前不再分派其它请求，flush 覆盖的是它之前完成的写
+static request_t *request_pick_flush(device_t *device) {
+    if (device->flushing || (device->submit && device->inflight))
+        return NULL;
+
+    request_t *req = element_entry(request_t, node, list_pop(&device->flush_list));
+    device->flushing = device->submit != NULL;
+    return req;
+}
+
+
+static request_t *request_pick(device_t *device) {
+    iostat_depth(device);
+    request_t *req;
+    if (device->flushing || !list_empty(&device->flush_list))
+        req = request_pick_flush(device);
+    else
+        req = device->sched->pick(device);
+    if (!req)
+        return NULL;
+
+    device->queued--;
+    if (req->type != REQ_FLUSH)
+        device->head = req->offset;
+
+    iostat_t *stat = &device->stat;
+    int dir = req->type == REQ_READ ? REQ_READ : REQ_WRITE;
+    u32 delta = iostat_since(req->start_us);
+    req->dispatch_us = req->start_us + delta;
+    iostat_time(&stat->queue_ms[dir], &stat->queue_us[dir], delta);
+    stat->queue_hist[iostat_bucket(delta)]++;
+    return req;
+}
+
+
+// hand reqs to driver until its queue is full
+static void request_dispatch(device_t *device) {
+    request_t *req;
+    while (device->inflight < device->depth && (req = request_pick(device))) {
+        req->dispatched = true;
+        device->inflight++;
+
+        err_t ret = device->submit(device->ptr, req);
+        if (ret < EOK)
+            device_complete(req, ret);
+    }
+}
+
+
+void device_complete(request_t *req, err_t ret) {
+    device_t *device = device_get(req->dev);
+    assert(req->dispatched && !req->done);
+
+    iostat_depth(device);
+    iostat_done(device, req, ret);
+    device->inflight--;
+    if (req->type == REQ_FLUSH)
+        device->flushing = false;
+
+    req->ret = ret;
+    req->done = true;
+    if (req->task->state == TASK_BLOCKED)
+        task_unblock(req->task, ret);   // wake up req task
+
+    request_dispatch(device);
+}
+
+
+// queued dev: caller only waits for its own req
+static err_t request_queue(device_t *device, request_t *req) {
+    // driver may start req in interrupt, translate buf in caller page table
+    u32 vaddr = (u32)req->buf;
+    for (size_t i = 0; i < req->npages; i++) {
+        req->pages[i] = get_paddr(vaddr);
+        vaddr = (vaddr & ~(PAGE_SIZE - 1)) + PAGE_SIZE;
+    }
+    request_add(device, req);
+
+    request_dispatch(device);
+    while (!req->done)
+        task_block(req->task, NULL, TASK_BLOCKED, TIMELESS);
+
+    return req->ret;
+}
+
+
+static err_t block_request(device_t *device, void *buf, u32 count, idx_t idx, int flags, u32 type) {
     idx_t offset = idx + device_ioctl(device->dev, DEV_CMD_SECTOR_START, 0, 0);
     // get parent device, /dev/hda1 -> /dev/hda
     if (device->parent)   
         device = device_get(device->parent);
-    
-    request_t *req = kmalloc(sizeof(request_t));
-    memset(req, 0, sizeof(request_t));
+
+    // queued dev gets physical pages of buf
+    u32 npages = 0;
+    if (device->submit && count)
+        npages = ((u32)buf + count * SECTOR_SIZE - 1) / PAGE_SIZE - (u32)buf / PAGE_SIZE + 1;
+
+    size_t size = sizeof(request_t) + npages * sizeof(u32);
+    request_t *req = kmalloc(size);
+    memset(req, 0, size);
 
     req->dev = device->dev;
     req->buf = buf;
@@ -180,32 +463,102 @@ err_t device_request(dev_t dev, void *buf, u8 count, idx_t idx, int flags, u32 t
     req->offset = offset;
     req->flags = flags;
     req->type = type;
-    req->task = NULL;
+    req->task = running_task();
+    req->ioprio = req->task->ioprio;
+    req->npages = npages;
 
     MM_TRACEK("dev %d requset idx %d\n", req->dev, req->idx);
 
-    bool empty = list_empty(&device->request_list);
-
-    // req to device reqlist
-    // list_pushback(&device->request_list, &req->node);
-
-    list_insert_sort(&device->request_list, &req->node, list_node_offset(request_t, node, offset));
+    if (device->submit) {
+        err_t ret = request_queue(device, req);
+        kfree(req);
+        return ret;
+    }
 
-    if (!empty) {   // wait for device idle
-        req->task = running_task();
-        assert(task_block(req->task, NULL, TASK_BLOCKED, TIMELESS) == 0);
+    // one req in driver at a time, finished req hands the device to the next
+    request_add(device, req);
+    if (!device->inflight) {
+        assert(request_pick(device) == req);
+        req->dispatched = true;
+        device->inflight++;
     }
+    while (!req->dispatched)    // wait for device idle
+        task_block(req->task, NULL, TASK_BLOCKED, TIMELESS);
 
     err_t ret = do_request(req);    // do req
+    iostat_done(device, req, ret);
 
-    request_t *nextreq = request_nextreq(device, req);
-    list_remove(&req->node);    // remove req from device reqlist
-
+    request_t *nextreq = request_pick(device);
     kfree(req);   // free req
 
     if (nextreq) {
         assert(nextreq->task->magic == XJOS_MAGIC);
+        nextreq->dispatched = true;
         task_unblock(nextreq->task, EOK);   // wake up next req task
+    } else {
+        device->inflight--;
     }
     return ret;
-}
\ No newline at end of file
+}
+
+
+err_t device_request(dev_t dev, void *buf, u32 count, idx_t idx, int flags, u32 type) {
+    device_t *device = device_get(dev);
+    assert(device->type == DEV_BLOCK);
+    assert(count > 0 || type == REQ_FLUSH);
+
+    device_t *parent = device->parent ? device_get(device->parent) : device;
+
+    // 没有易失写缓存时写完成就已经落盘
+    if (type == REQ_FLUSH) {
+        if (!(parent->cache & DEV_WCACHE))
+            return EOK;
+        parent->unflushed = false;
+        return block_request(device, NULL, 0, 0, 0, REQ_FLUSH);
+    }
+    if (type != REQ_WRITE || !(parent->cache & DEV_WCACHE))
+        flags &= ~(REQ_PREFLUSH | REQ_FUA);
+
+    err_t ret = EOK;
+    if (flags & REQ_PREFLUSH)
+        ret = block_request(device, NULL, 0, 0, 0, REQ_FLUSH);
+    flags &= ~REQ_PREFLUSH;
+
+    // 驱动不支持 FUA 时写完之后再 flush
+    bool postflush = (flags & REQ_FUA) && !(parent->cache & DEV_FUA);
+    if (postflush)
+        flags &= ~REQ_FUA;
+
+    parent->stat.splits += (count - 1) / parent->max_count;
+
+    // split into requests driver can take
+    for (u32 done = 0; done < count && ret == EOK;) {
+        u32 chunk = MIN(count - done, parent->max_count);
+        ret = block_request(device, (u8 *)buf + done * SECTOR_SIZE, chunk, idx + done, flags, type);
+        done += chunk;
+    }
+
+    // 完成之后才标记，之前开始的 flush 不一定覆盖这次写
+    if (type == REQ_WRITE && (parent->cache & DEV_WCACHE))
+        parent->unflushed = true;
+
+    if (ret == EOK && postflush) {
+        parent->unflushed = false;
+        ret = block_request(device, NULL, 0, 0, 0, REQ_FLUSH);
+    }
+    return ret;
+}
+
+
+err_t device_flush(dev_t dev) {
+    return device_request(dev, NULL, 0, 0, 0, REQ_FLUSH);
+}
+
+
+void device_sync() {
+    for (size_t i = 0; i < DEVICE_NR; i++) {
+        device_t *device = &devices[i];
+        if (device->type == DEV_BLOCK && !device->parent && device->unflushed)
+            device_flush(device->dev);
+    }
+}
@@ -13,6 +13,7 @@
 #include <drivers/device.h>
 #include <hardware/isa.h>
 #include <xjos/timer.h>
+#include <xjos/stdlib.h>
 
 
 #define LOGK(fmt, args...) DEBUGK(fmt, ##args)
@@ -75,7 +76,9 @@
 
 #define SECTOR_SIZE 512
 
-#define DMA_BUF_ADDR 0x98000 // 不能跨越 64K 边界
+#define DMA_BUF_ADDR 0x98000 // 不能跨越 64K 边界，能放下一个柱面
+
+#define CACHE_NONE 0xFF     // 柱面缓冲为空
 
 #define RESULT_NR 8
 
@@ -101,7 +104,11 @@ typedef struct floppy_t {
 
     u8 dor; // dor registers
 
-    u8 *buf; // DMA 地址
+    u8 *buf; // DMA 地址，同时缓存一个柱面
+
+    u8 cache_track; // 缓冲中的柱面
+    u64 valid;      // 缓冲中有效的扇区，按柱面内序号
+    u64 dirty;      // 还没有写回的扇区
 
     union {
         u8 tracks;    // 磁道数
@@ -299,27 +306,10 @@ static void fd_seek(floppy_t *fd, u8 track, u8 head) {
     task_sleep(15);
 }
 
-static void lba2chs(floppy_t *fd, idx_t lba, u8 *track, u8 *head, u8 *sector) {
-    *track = lba / (fd->heads * fd->sectors);
-    *head = (lba / fd->sectors) % fd->heads;
-    *sector = lba % fd->sectors + 1;
-}
-
-static err_t fd_transfer(floppy_t *fd, bool mode, void *buf, u8 count, idx_t lba) {
-    u8 track, head, sector;
-
-    // 转换 lba 到 chs cylinder head sector
-    lba2chs(fd, lba, &track, &head, &sector);
-
-    // 当前磁道剩余扇区数
-    u8 remaining = ((fd->sectors + 1 - sector) + fd->sectors * (fd->heads - head - 1));
-
-    // 这个地方确实有问题，可能存在读取内容较少，外层做了兼容；
-    if (remaining < count)
-        count = remaining;
-
-    if (mode == FD_WRITE)
-        memcpy(fd->buf, buf, count * SECTOR_SIZE);
+// 柱面内从 idx 开始 count 个扇区，MT 模式下跨越磁头
+static err_t fd_transfer(floppy_t *fd, bool mode, u8 track, u8 idx, u8 count) {
+    u8 head = idx / fd->sectors;
+    u8 sector = idx % fd->sectors + 1;
 
     // Perform seek if necessary
     fd_seek(fd, track, head);
@@ -337,7 +327,7 @@ static err_t fd_transfer(floppy_t *fd, bool mode, void *buf, u8 count, idx_t lba
         isa_dma_mode(2, DMA_MODE_SINGLE | DMA_MODE_WRITE);
 
     // Setup DMA transfer
-    isa_dma_addr(2, fd->buf);
+    isa_dma_addr(2, fd->buf + idx * SECTOR_SIZE);
     isa_dma_size(2, (u32)count * SECTOR_SIZE);
     isa_dma_mask(2, true);
 
@@ -362,8 +352,6 @@ static err_t fd_transfer(floppy_t *fd, bool mode, void *buf, u8 count, idx_t lba
 
     if ((fd->result.st0 & 0xC0) == 0) {
         // Successful transfer
-        if (mode == FD_READ)
-            memcpy(buf, fd->buf, count * SECTOR_SIZE);
         return EOK;
     } else {
         LOGK("fd: xfer error, st0 %02X st1 %02X st2 %02X THS=%d/%d/%d\n",
@@ -373,40 +361,158 @@ static err_t fd_transfer(floppy_t *fd, bool mode, void *buf, u8 count, idx_t lba
     }
 }
 
-static err_t fd_read(floppy_t *fd, void *buf, u8 count, idx_t lba) {
-    assert(count + lba < (u32)fd->tracks * fd->heads * fd->sectors);
+// 柱面内 [idx, idx + count) 的扇区位图
+static u64 fd_cache_mask(u8 idx, u8 count) {
+    return ((count < 64 ? (1ULL << count) : 0) - 1) << idx;
+}
 
-    mutex_lock(&fd->lock);
+// 换盘之后缓冲失效，未写回的扇区也不能写到新盘上
+static void fd_cache_check(floppy_t *fd) {
+    if (!fd->changed)
+        return;
+    if (fd->dirty)
+        LOGK("fd: disk changed, drop dirty track %d\n", fd->cache_track);
+    fd->changed = false;
+    fd->cache_track = CACHE_NONE;
+    fd->valid = 0;
+    fd->dirty = 0;
+}
 
-    if (!fd->ready && fd_setup(fd) < EOK) {
-        mutex_unlock(&fd->lock);
-        return -EIO;
+// 写回缓冲中连续的脏扇区，每段一次传输
+static err_t fd_cache_flush(floppy_t *fd) {
+    u8 total = fd->heads * fd->sectors;
+    for (u8 idx = 0; fd->dirty && idx < total;) {
+        if (!(fd->dirty & (1ULL << idx))) {
+            idx++;
+            continue;
+        }
+        u8 count = 1;
+        while (idx + count < total && (fd->dirty & (1ULL << (idx + count))))
+            count++;
+
+        err_t ret = fd_transfer(fd, FD_WRITE, fd->cache_track, idx, count);
+        if (ret < EOK)
+            return ret;
+        fd->dirty &= ~fd_cache_mask(idx, count);
+        idx += count;
     }
+    return EOK;
+}
+
+// 一次读入整个柱面，之后顺序读不用再等旋转
+static err_t fd_cache_fill(floppy_t *fd, u8 track) {
+    err_t ret = fd_cache_flush(fd);
+    if (ret < EOK)
+        return ret;
+
+    u8 total = fd->heads * fd->sectors;
+    fd->cache_track = track;
+    fd->valid = 0;
+    ret = fd_transfer(fd, FD_READ, track, 0, total);
+    if (ret == EOK)
+        fd->valid = fd_cache_mask(0, total);
+    return ret;
+}
 
+// 需要访问软盘时才打开马达
+static err_t fd_start(floppy_t *fd, bool *motor) {
+    if (*motor)
+        return EOK;
+    if (!fd->ready && fd_setup(fd) < EOK)
+        return -EIO;
     fd_motor_on(fd);
+    *motor = true;
+    return EOK;
+}
+
+static err_t fd_read(floppy_t *fd, void *buf, u8 count, idx_t lba) {
+    assert(count + lba <= (u32)fd->tracks * fd->heads * fd->sectors);
 
-    int ret = fd_transfer(fd, FD_READ, buf, count, lba);
+    mutex_lock(&fd->lock);
+    fd_cache_check(fd);
+
+    u8 *ptr = (u8 *)buf;
+    u8 total = fd->heads * fd->sectors;
+    bool motor = false;
+    err_t ret = EOK;
+    while (count) {
+        u8 track = lba / total;
+        u8 idx = lba % total;
+        u8 chunk = MIN(count, total - idx);
+        u64 mask = fd_cache_mask(idx, chunk);
+
+        if (track != fd->cache_track || (fd->valid & mask) != mask) {
+            if ((ret = fd_start(fd, &motor)) < EOK)
+                break;
+            if ((ret = fd_cache_fill(fd, track)) < EOK)
+                break;
+        }
+        memcpy(ptr, fd->buf + idx * SECTOR_SIZE, chunk * SECTOR_SIZE);
+
+        ptr += chunk * SECTOR_SIZE;
+        lba += chunk;
+        count -= chunk;
+    }
 
-    fd_motor_off(fd);
+    if (motor)
+        fd_motor_off(fd);
     mutex_unlock(&fd->lock);
     return ret;
 }
 
+// 写入柱面缓冲，离开这个柱面或 flush 时再写回
 static err_t fd_write(floppy_t *fd, void *buf, u8 count, idx_t lba) {
-    assert(count + lba < (u32)fd->tracks * fd->heads * fd->sectors);
+    assert(count + lba <= (u32)fd->tracks * fd->heads * fd->sectors);
 
     mutex_lock(&fd->lock);
+    fd_cache_check(fd);
+
+    u8 *ptr = (u8 *)buf;
+    u8 total = fd->heads * fd->sectors;
+    bool motor = false;
+    err_t ret = EOK;
+    while (count) {
+        u8 track = lba / total;
+        u8 idx = lba % total;
+        u8 chunk = MIN(count, total - idx);
+
+        if (track != fd->cache_track) {
+            if (fd->dirty) {
+                if ((ret = fd_start(fd, &motor)) < EOK)
+                    break;
+                if ((ret = fd_cache_flush(fd)) < EOK)
+                    break;
+            }
+            fd->cache_track = track;
+            fd->valid = 0;
+        }
+        memcpy(fd->buf + idx * SECTOR_SIZE, ptr, chunk * SECTOR_SIZE);
+        fd->valid |= fd_cache_mask(idx, chunk);
+        fd->dirty |= fd_cache_mask(idx, chunk);
 
-    if (!fd->ready && fd_setup(fd) < EOK) {
-        mutex_unlock(&fd->lock);
-        return -EIO;
+        ptr += chunk * SECTOR_SIZE;
+        lba += chunk;
+        count -= chunk;
     }
 
-    fd_motor_on(fd);
+    if (motor)
+        fd_motor_off(fd);
+    mutex_unlock(&fd->lock);
+    return ret;
+}
+
+// 写回柱面缓冲
+static err_t fd_flush(floppy_t *fd) {
+    mutex_lock(&fd->lock);
+    fd_cache_check(fd);
 
-    int ret = fd_transfer(fd, FD_WRITE, buf, count, lba);
+    bool motor = false;
+    err_t ret = EOK;
+    if (fd->dirty && (ret = fd_start(fd, &motor)) == EOK)
+        ret = fd_cache_flush(fd);
 
-    fd_motor_off(fd);
+    if (motor)
+        fd_motor_off(fd);
     mutex_unlock(&fd->lock);
     return ret;
 }
@@ -478,7 +584,14 @@ void floppy_init() {
     fd->track = 0xFF;
     fd->ready = false;
 
-    device_install(
+    fd->cache_track = CACHE_NONE;
+    fd->valid = 0;
+    fd->dirty = 0;
+
+    dev_t dev = device_install(
         DEV_BLOCK, DEV_FLOPPY, fd, fd->name, 0,
         fd_ioctl, fd_read, fd_write);
+
+    // 写入的扇区留在柱面缓冲里，由 sync 写回
+    device_set_cache(dev, DEV_WCACHE, fd_flush);
 }
\ No newline at end of file
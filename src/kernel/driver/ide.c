@@ -6,6 +6,7 @@
 #include <xjos/interrupt.h>
 #include <xjos/task.h>
 #include <xjos/string.h>
+#include <xjos/stdlib.h>
 #include <xjos/debug.h>
 #include <xjos/assert.h>
 #include <drivers/device.h>
@@ -17,6 +18,7 @@
 #define LOGK(fmt, args...) DEBUGK(fmt, ##args)
 
 #define IDE_TIMEOUT 60000
+#define IDE_POLL_COUNT 100000  // busy wait count without sleep
 
 // IDE Reg Addresses
 #define IDE_IOBASE_PRIMARY 0x1F0    // master
@@ -49,6 +51,14 @@
 #define IDE_CMD_DIAGNOSTIC 0x90 // Run Diagnostics
 #define IDE_CMD_READ_UDMA 0xC8  // UDMA read
 #define IDE_CMD_WRITE_UDMA 0xCA // UDMA write
+#define IDE_CMD_READ_DMA_EXT 0x25  // LBA48 DMA read
+#define IDE_CMD_WRITE_DMA_EXT 0x35 // LBA48 DMA write
+#define IDE_CMD_WRITE_DMA_FUA_EXT 0x3D // LBA48 DMA write, on media when done
+#define IDE_CMD_FLUSH 0xE7      // Flush Cache
+#define IDE_CMD_FLUSH_EXT 0xEA  // LBA48 Flush Cache
+#define IDE_CMD_SET_FEATURES 0xEF // Set Features
+
+#define IDE_FEATURE_WCACHE_ON 0x02 // set features: enable write cache
 
 // IDE Status Register Bits (read from IDE_STATUS or IDE_ALT_STATUS)
 #define IDE_SR_NULL 0x00 // NULL
@@ -104,6 +114,16 @@
 #define BM_SR_SIMPLEX 0x80 // 仅单纯形操作
 
 #define IDE_LAST_PRD 0x80000000 // 最后一个描述符
+#define IDE_PRD_BOUNDARY 0x10000 // 描述符不能跨越 64K 边界
+
+#define IDE_LBA28_MAX 0x0FFFFFFF  // LBA28 最大扇区
+#define IDE_LBA28_SECS 256        // LBA28 每次最多传输扇区数 (0 表示 256)
+// PRD 表一页，最坏情况每页一个描述符，首尾不对齐多占一个
+#define IDE_DMA_MAX_SECS ((IDE_PRD_NR - 1) * (PAGE_SIZE / SECTOR_SIZE))
+
+#define IDE_CMDSET_LBA48 (1 << 10) // word 83: 48-bit address feature set
+#define IDE_CMDSET_WCACHE (1 << 5) // word 82 / 85: write cache supported / enabled
+#define IDE_CMDSET_FUA (1 << 6)    // word 84: WRITE DMA FUA EXT
 
 #define PCI_IDE_BUS_MASTER_BAR PCI_CONF_BASE_ADDR4
 
@@ -149,7 +169,10 @@ typedef struct ide_params_t
     u16 major_version;              // 80: Major version number
     u16 minor_version;              // 81: Minor version number
     u16 commmand_sets[87 - 81];     // 82-87: Supported command sets
-    u16 RESERVED[118 - 87];         // 88-118: Reserved
+    u16 RESERVED[99 - 87];          // 88-99: Reserved
+    u32 total_lba48;                // 100-101: Total LBA48 sectors (low 32 bits)
+    u32 total_lba48_high;           // 102-103: Total LBA48 sectors (high 32 bits)
+    u16 RESERVED[118 - 103];        // 104-118: Reserved
     u16 support_settings;           // 119: Supported settings
     u16 enable_settings;            // 120: Enabled settings
     u16 RESERVED[221 - 120];        // 121-221: Reserved
@@ -192,6 +215,18 @@ static bool ide_find_bus_master_base(pci_device_t *device, u16 *bmbase) {
     return true;
 }
 
+static void ide_dma_done(ide_ctrl_t *ctrl, err_t ret);
+
+static void ide_wake_waiter(ide_ctrl_t *ctrl) {
+    if (ctrl->waiter) {
+        // have process waiter
+        task_t *task = ctrl->waiter;
+        ctrl->waiter = NULL;
+        if (task->state == TASK_BLOCKED)
+            task_unblock(task, EOK);
+    }
+}
+
 static void ide_handler(int vector) {
     send_eoi(vector);
 
@@ -202,13 +237,13 @@ static void ide_handler(int vector) {
     u8 state = inb(ctrl->iobase + IDE_STATUS);
     MM_TRACEK("harddisk interrupt vector %d state 0x%x\n", vector, state);
 
-    if (ctrl->waiter) {
-        // have process waiter
-        task_t *task = ctrl->waiter;
-        ctrl->waiter = NULL;
-        if (task->state == TASK_BLOCKED)
-            task_unblock(task, EOK);
-    }
+    // DMA request done, start next one in queue
+    if (ctrl->current)
+        ide_dma_done(ctrl, (state & (IDE_SR_ERR | IDE_SR_DWF)) ? -EIO : EOK);
+
+    // PIO waiter runs only when no DMA in progress
+    if (!ctrl->current)
+        ide_wake_waiter(ctrl);
 }
 
 
@@ -277,6 +312,26 @@ static err_t ide_reset_controller(ide_ctrl_t *ctrl) {
 }
 
 
+static void ide_dma_next(ide_ctrl_t *ctrl);
+
+// PIO ops own the controller, wait for DMA request in progress
+static void ide_lock(ide_ctrl_t *ctrl) {
+    mutex_lock(&ctrl->lock);
+
+    task_t *task = running_task();
+    while (ctrl->current) {
+        ctrl->waiter = task;
+        task_block(task, NULL, TASK_BLOCKED, IDE_TIMEOUT);
+    }
+}
+
+
+static void ide_unlock(ide_ctrl_t *ctrl) {
+    mutex_unlock(&ctrl->lock);
+    ide_dma_next(ctrl);     // go on with DMA queue
+}
+
+
 static void ide_select_device(ide_disk_t *disk, u8 devsel) {
     ide_ctrl_t *ctrl = disk->ctrl;
     if (ctrl->active == disk && ctrl->devsel == devsel)
@@ -311,6 +366,26 @@ static void ide_select_sector(ide_disk_t *disk, u32 lba, u8 count) {
 }
 
 
+// select sector, LBA48: high bytes first, then low bytes
+static void ide_select_sector48(ide_disk_t *disk, u32 lba, u16 count) {
+    ide_ctrl_t *ctrl = disk->ctrl;
+
+    outb(ctrl->iobase + IDE_FEATURE, 0);
+
+    // count 15-8, LBA 24-47 (扇区号为 32 位, 高 16 位为 0)
+    outb(ctrl->iobase + IDE_SECTOR, (count >> 8) & 0xFF);
+    outb(ctrl->iobase + IDE_LBA_LOW, (lba >> 24) & 0xFF);
+    outb(ctrl->iobase + IDE_LBA_MID, 0);
+    outb(ctrl->iobase + IDE_LBA_HIGH, 0);
+
+    // count 7-0, LBA 0-23
+    outb(ctrl->iobase + IDE_SECTOR, count & 0xFF);
+    outb(ctrl->iobase + IDE_LBA_LOW, lba & 0xFF);
+    outb(ctrl->iobase + IDE_LBA_MID, (lba >> 8) & 0xFF);
+    outb(ctrl->iobase + IDE_LBA_HIGH, (lba >> 16) & 0xFF);
+}
+
+
 // read -> buf
 static void ide_pio_read_sector(ide_disk_t *disk, u16 *buf) {
     u16 port = disk->ctrl->iobase + IDE_DATA;
@@ -345,7 +420,7 @@ int ide_pio_read(ide_disk_t *disk, void *buf, u8 count, idx_t lba) {
 
     ide_ctrl_t *ctrl = disk->ctrl;
 
-    mutex_lock(&ctrl->lock);
+    ide_lock(ctrl);
 
     int ret = -EIO;
 
@@ -377,7 +452,7 @@ int ide_pio_read(ide_disk_t *disk, void *buf, u8 count, idx_t lba) {
 
 rollback:
     ide_clear_waiter(ctrl, task);
-    mutex_unlock(&ctrl->lock);
+    ide_unlock(ctrl);
 
     return ret;
 }
@@ -389,7 +464,7 @@ int ide_pio_write(ide_disk_t *disk, void *buf, u8 count, idx_t lba) {
 
     ide_ctrl_t *ctrl = disk->ctrl;
 
-    mutex_lock(&ctrl->lock);
+    ide_lock(ctrl);
 
     int ret = EOK;
 
@@ -419,7 +494,36 @@ int ide_pio_write(ide_disk_t *disk, void *buf, u8 count, idx_t lba) {
 
 rollback:    
     ide_clear_waiter(ctrl, task);
-    mutex_unlock(&ctrl->lock);
+    ide_unlock(ctrl);
+
+    return ret;
+}
+
+
+// write back disk write cache, interrupt when done
+int ide_pio_flush(ide_disk_t *disk) {
+    assert(!get_interrupt_state());
+
+    ide_ctrl_t *ctrl = disk->ctrl;
+    task_t *task = running_task();
+
+    ide_lock(ctrl);
+
+    int ret = EOK;
+
+    ide_select_drive(disk);
+    if ((ret = ide_busy_wait(ctrl, IDE_SR_DRDY, IDE_TIMEOUT)) < EOK)
+        goto rollback;
+    outb(ctrl->iobase + IDE_COMMAND, disk->lba48 ? IDE_CMD_FLUSH_EXT : IDE_CMD_FLUSH);
+
+    ctrl->waiter = task;
+    if ((ret = task_block(task, NULL, TASK_BLOCKED, IDE_TIMEOUT)) < EOK)
+        goto rollback;
+    ret = ide_busy_wait(ctrl, IDE_SR_NULL, IDE_TIMEOUT);
+
+rollback:
+    ide_clear_waiter(ctrl, task);
+    ide_unlock(ctrl);
 
     return ret;
 }
@@ -461,21 +565,47 @@ static bool ide_dma_drive_capable(ide_disk_t *disk) {
 }
 
 
-static err_t ide_setup_dma(ide_ctrl_t *ctrl, int cmd, char *buf, u32 len) {
-    // 跨页面 DMA 是不允许的，必须保证 buf + len 不跨页
-    if ((((u32)buf + len) > (((u32)buf & (~0xFFF)) + PAGE_SIZE)) || len == 0 || len > 0x10000) {
-        LOGK("IDE dma invalid buffer %p len %u\n", buf, len);
+// 由请求缓冲区的物理页构建 PRD 表, 物理地址连续的页合并为一个描述符
+static err_t ide_setup_dma(ide_ctrl_t *ctrl, int cmd, request_t *req) {
+    u32 len = req->count * SECTOR_SIZE;
+    if (len == 0 || ((u32)req->buf & 1)) {
+        LOGK("IDE dma invalid buffer %p len %u\n", req->buf, len);
         return -EINVAL;
     }
 
-    // set prdt
-    ctrl->prd.addr = get_paddr((u32)buf);
-    if (!ctrl->prd.addr)
-        return -EFAULT;
-    ctrl->prd.len = (len & 0xFFFF) | IDE_LAST_PRD; // 设置最后一个描述符标志
+    ide_prd_t *prd = NULL;
+    size_t nr = 0;
+    for (size_t i = 0; len; i++) {
+        assert(i < req->npages);
+        u32 addr = req->pages[i];
+        if (!addr)
+            return -EFAULT;
+
+        u32 size = MIN(len, PAGE_SIZE - (addr & (PAGE_SIZE - 1)));
+        len -= size;
+
+        // 连续且不跨越 64K 边界时合并到上一个描述符
+        if (prd && prd->addr + prd->len == addr && (addr & (IDE_PRD_BOUNDARY - 1))) {
+            prd->len += size;
+            continue;
+        }
+
+        if (nr == IDE_PRD_NR) {
+            LOGK("IDE dma too many segments\n");
+            return -EINVAL;
+        }
+        prd = &ctrl->prdt[nr++];
+        prd->addr = addr;
+        prd->len = size;
+    }
+
+    // 长度 0 表示 64K
+    for (size_t i = 0; i < nr; i++)
+        ctrl->prdt[i].len &= 0xFFFF;
+    prd->len |= IDE_LAST_PRD; // 设置最后一个描述符标志
 
     // 设置 prd 地址
-    u32 prd_paddr = get_paddr((u32)&ctrl->prd);
+    u32 prd_paddr = get_paddr((u32)ctrl->prdt);
     if (!prd_paddr)
         return -EFAULT;
     outl(ctrl->bmbase + BM_PRD_ADDR, prd_paddr);
@@ -515,79 +645,157 @@ static err_t ide_stop_dma(ide_ctrl_t *ctrl) {
 }
 
 
-static err_t ide_dma_transfer(ide_disk_t *disk, void *buf, u8 count, idx_t lba, u8 bm_cmd, u8 ata_cmd) {
-    assert(count > 0);
-    assert(!get_interrupt_state());
+// busy wait without sleep, used in interrupt
+static err_t ide_poll_ready(ide_ctrl_t *ctrl) {
+    for (size_t i = 0; i < IDE_POLL_COUNT; i++) {
+        u8 state = inb(ctrl->iobase + IDE_ALT_STATUS);
+        if (state & IDE_SR_ERR) {
+            ide_error(ctrl);
+            return -EIO;
+        }
+        if (!(state & IDE_SR_BSY) && (state & IDE_SR_DRDY))
+            return EOK;
+    }
+    LOGK("IDE %s poll ready timeout\n", ctrl->name);
+    return -EBUSY;
+}
 
-    err_t ret = EOK;
-    err_t stop_ret = EOK;
-    ide_ctrl_t *ctrl = disk->ctrl;
-    task_t *task = running_task();
-    bool dma_started = false;
 
-    mutex_lock(&ctrl->lock);
+// DMA request hang, reset controller and fail it
+static void ide_timeout(timer_t *timer) {
+    ide_ctrl_t *ctrl = (ide_ctrl_t *)timer->arg;
+    ctrl->timer = NULL;     // timer_wakeup frees it
+    LOGK("IDE %s dma timeout\n", ctrl->name);
 
-    if (!disk->dma) {
-        ret = -ENODEV;
-        goto rollback;
-    }
+    // soft reset, can't sleep here, status reads as delay
+    outb(ctrl->iobase + IDE_CONTROL, IDE_CTRL_SRST);
+    for (size_t i = 0; i < 8; i++)
+        inb(ctrl->iobase + IDE_ALT_STATUS);
+    outb(ctrl->iobase + IDE_CONTROL, ctrl->control);
+    ctrl->active = NULL;
+    ctrl->devsel = 0xFF;
 
-    if (ctrl->waiter) {
-        ret = -EBUSY;
-        goto rollback;
+    ide_dma_done(ctrl, -ETIME);
+    if (!ctrl->current)
+        ide_wake_waiter(ctrl);
+}
+
+
+// send DMA command of req, done in ide_handler
+static err_t ide_dma_start(ide_ctrl_t *ctrl, request_t *req) {
+    ide_disk_t *disk = (ide_disk_t *)device_get(req->dev)->ptr;
+    idx_t lba = req->offset;
+    bool write = req->type == REQ_WRITE;
+    bool fua = write && (req->flags & REQ_FUA);
+    err_t ret;
+
+    if (!disk->dma)
+        return -ENODEV;
+
+    // flush 没有数据，只等待完成中断
+    if (req->type == REQ_FLUSH) {
+        ide_select_drive(disk);
+        if ((ret = ide_poll_ready(ctrl)) < EOK)
+            return ret;
+        outb(ctrl->iobase + IDE_COMMAND, disk->lba48 ? IDE_CMD_FLUSH_EXT : IDE_CMD_FLUSH);
+        ctrl->current = req;
+        ctrl->timer = timer_add(IDE_TIMEOUT, ide_timeout, ctrl, NULL);
+        return EOK;
     }
 
-    ide_select_device(disk, ((lba >> 24) & 0xf) | disk->selector);
-    if ((ret = ide_busy_wait(ctrl, IDE_SR_DRDY, IDE_TIMEOUT)) < EOK)
-        goto rollback;
+    assert(req->count > 0);
 
-    // 设置 DMA
-    if ((ret = ide_setup_dma(ctrl, bm_cmd, buf, count * SECTOR_SIZE)) < EOK)
-        goto rollback;
+    // 超出 LBA28 范围或扇区数时使用 LBA48 命令，FUA 只有 LBA48 命令
+    bool ext = lba + req->count - 1 > IDE_LBA28_MAX || req->count > IDE_LBA28_SECS || fua;
+    if (ext && !disk->lba48)
+        return -EINVAL;
 
-    ctrl->waiter = task;
+    if (ext)
+        ide_select_device(disk, disk->selector);
+    else
+        ide_select_device(disk, ((lba >> 24) & 0xf) | disk->selector);
+    if ((ret = ide_poll_ready(ctrl)) < EOK)
+        return ret;
+
+    // 设置 DMA
+    u8 bm_cmd = write ? BM_CR_WRITE : BM_CR_READ;
+    if ((ret = ide_setup_dma(ctrl, bm_cmd, req)) < EOK)
+        return ret;
 
     // 选择扇区
-    ide_select_sector(disk, lba, count);
+    u8 cmd;
+    if (ext) {
+        ide_select_sector48(disk, lba, req->count);
+        cmd = write ? IDE_CMD_WRITE_DMA_EXT : IDE_CMD_READ_DMA_EXT;
+        if (fua)
+            cmd = IDE_CMD_WRITE_DMA_FUA_EXT;
+    } else {
+        ide_select_sector(disk, lba, req->count);
+        cmd = write ? IDE_CMD_WRITE_UDMA : IDE_CMD_READ_UDMA;
+    }
 
-    outb(ctrl->iobase + IDE_COMMAND, ata_cmd);
+    outb(ctrl->iobase + IDE_COMMAND, cmd);
 
     ide_start_dma(ctrl);
-    dma_started = true;
+    ctrl->current = req;
+    ctrl->timer = timer_add(IDE_TIMEOUT, ide_timeout, ctrl, NULL);
+    return EOK;
+}
 
-    if ((ret = task_block(task, NULL, TASK_BLOCKED, IDE_TIMEOUT)) < EOK) {
-        LOGK("ide dma error occur!!! %d\n", ret);
-        goto rollback;
+
+// start next DMA request unless busy or PIO owns controller
+static void ide_dma_next(ide_ctrl_t *ctrl) {
+    while (!ctrl->current && !ctrl->lock.holder && !list_empty(&ctrl->queue)) {
+        request_t *req = element_entry(request_t, qnode, list_pop(&ctrl->queue));
+        err_t ret = ide_dma_start(ctrl, req);
+        if (ret < EOK)
+            device_complete(req, ret);
     }
+}
 
-    stop_ret = ide_stop_dma(ctrl);
-    dma_started = false;
-    if (stop_ret < EOK)
-        ret = stop_ret;
 
-rollback:
-    ide_clear_waiter(ctrl, task);
-    if (dma_started) {
-        stop_ret = ide_stop_dma(ctrl);
-        if (ret == EOK && stop_ret < EOK)
+static void ide_dma_done(ide_ctrl_t *ctrl, err_t ret) {
+    request_t *req = ctrl->current;
+    assert(req);
+
+    if (ctrl->timer) {
+        timer_put(ctrl->timer);
+        ctrl->timer = NULL;
+    }
+
+    if (req->type != REQ_FLUSH) {
+        err_t stop_ret = ide_stop_dma(ctrl);
+        if (ret == EOK)
             ret = stop_ret;
     }
-    if (ret < EOK)
-        ide_reset_controller(ctrl);
-    mutex_unlock(&ctrl->lock);
-    return ret;
+    if (ret == -EIO)
+        ide_error(ctrl);
+
+    ctrl->current = NULL;
+    device_complete(req, ret);   // may submit next req of the disk
+    ide_dma_next(ctrl);
 }
 
 
-err_t ide_udma_read(ide_disk_t *disk, void *buf, u8 count, idx_t lba) {
-    MM_TRACEK("IDE dma read lba 0x%x\n", lba);
-    return ide_dma_transfer(disk, buf, count, lba, BM_CR_READ, IDE_CMD_READ_UDMA);
+// both disks of a channel share controller queue, one DMA at a time
+static int ide_submit(ide_disk_t *disk, request_t *req) {
+    ide_ctrl_t *ctrl = disk->ctrl;
+    assert(!get_interrupt_state());
+
+    MM_TRACEK("IDE dma %s lba 0x%x\n", req->type == REQ_READ ? "read" : "write", req->offset);
+    list_pushback(&ctrl->queue, &req->qnode);
+    ide_dma_next(ctrl);
+    return EOK;
 }
 
 
-err_t ide_udma_write(ide_disk_t *disk, void *buf, u8 count, idx_t lba) {
-    MM_TRACEK("IDE dma write lba 0x%x\n", lba);
-    return ide_dma_transfer(disk, buf, count, lba, BM_CR_WRITE, IDE_CMD_WRITE_UDMA);
+err_t ide_udma_read(ide_disk_t *disk, void *buf, size_t count, idx_t lba) {
+    return device_request(disk->dev, buf, count, lba, 0, REQ_READ);
+}
+
+
+err_t ide_udma_write(ide_disk_t *disk, void *buf, size_t count, idx_t lba) {
+    return device_request(disk->dev, buf, count, lba, 0, REQ_WRITE);
 }
 
 
@@ -663,7 +871,7 @@ static err_t ide_identify(ide_disk_t *disk, u16 *buf) {
     /*
         lock - select disk - wait - send identify cmd - wait - read data - unlock
     */
-    mutex_lock(&ctrl->lock);
+    ide_lock(ctrl);
     ide_select_drive(disk);
 
     int ret = EOK;
@@ -693,16 +901,32 @@ static err_t ide_identify(ide_disk_t *disk, u16 *buf) {
 
 
     disk->total_lba = params->total_lba;
+    disk->lba48 = !!(params->commmand_sets[1] & IDE_CMDSET_LBA48);
+    if (disk->lba48 && params->total_lba48) {
+        // 扇区号为 32 位，超过 2T 的部分不使用
+        disk->total_lba = params->total_lba48_high ? 0xFFFFFFFF : params->total_lba48;
+        LOGK("disk %s lba48 total lba %u\n", disk->name, disk->total_lba);
+    }
     disk->cylinders = params->cylinders;
     disk->heads = params->heads;
     disk->sectors = params->sectors;
     disk->dma = ctrl->iotype == IDE_TYPE_DMA && ide_dma_drive_capable(disk) && !!(params->mdma_mode & 0x7);
     if (ctrl->iotype == IDE_TYPE_DMA && !disk->dma)
         LOGK("disk %s fallback to PIO\n", disk->name);
+
+    // 写缓存保持打开，落盘顺序由 flush 和 FUA 保证
+    disk->wcache = !!(params->commmand_sets[0] & IDE_CMDSET_WCACHE);
+    disk->fua = disk->lba48 && !!(params->commmand_sets[2] & IDE_CMDSET_FUA);
+    if (disk->wcache && !(params->commmand_sets[3] & IDE_CMDSET_WCACHE)) {
+        outb(ctrl->iobase + IDE_FEATURE, IDE_FEATURE_WCACHE_ON);
+        outb(ctrl->iobase + IDE_COMMAND, IDE_CMD_SET_FEATURES);
+        ide_busy_wait(ctrl, IDE_SR_NULL, IDE_TIMEOUT);
+    }
+    LOGK("disk %s write cache %d fua %d\n", disk->name, disk->wcache, disk->fua);
     ret = EOK;
 
 rollback:
-    mutex_unlock(&ctrl->lock);
+    ide_unlock(ctrl);
     return ret;
 }
 
@@ -783,6 +1007,12 @@ static void ide_ctrl_init() {
         ctrl->active = NULL;
         ctrl->devsel = 0xFF;
         ctrl->waiter = NULL;
+        list_init(&ctrl->queue);
+        ctrl->prdt = NULL;
+        if (iotype == IDE_TYPE_DMA)
+            ctrl->prdt = (ide_prd_t *)alloc_kpage(1);
+        ctrl->current = NULL;
+        ctrl->timer = NULL;
         ctrl->iotype = iotype;
         ctrl->bmbase = bmbase + cidx * 8; // 每个控制器占用 8 字节的总线主控寄存器空间
 
@@ -810,6 +1040,9 @@ static void ide_ctrl_init() {
                 disk->selector = IDE_LBA_MASTER;
             }
             disk->dma = false;
+            disk->lba48 = false;
+            disk->wcache = false;
+            disk->fua = false;
 
             if (ide_probe_device(disk) < 0) {
                 LOGK("IDE device %s not exists...\n", disk->name);
@@ -853,6 +1086,19 @@ static void ide_install() {
                     disk, disk->name, 0, 
                     ide_pio_ioctl, read,
                     write);
+                disk->dev = dev;
+
+                // DMA disk takes requests from queue, one in ctrl queue per disk
+                if (disk->dma)
+                    device_set_queue(dev, ide_submit, 1, disk->lba48 ? IDE_DMA_MAX_SECS : IDE_LBA28_SECS);
+
+                // FUA write is a DMA command, PIO disk flushes after write
+                if (disk->wcache) {
+                    u32 cache = DEV_WCACHE;
+                    if (disk->dma && disk->fua)
+                        cache |= DEV_FUA;
+                    device_set_cache(dev, cache, disk->dma ? NULL : ide_pio_flush);
+                }
             
             for (size_t i = 0; i < IDE_PART_NR; i++) {
                 ide_part_t *part = &disk->parts[i];
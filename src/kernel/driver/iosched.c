@@ -0,0 +1,347 @@
+#include <drivers/iosched.h>
+#include <xjos/ioprio.h>
+#include <xjos/task.h>
+#include <xjos/timer.h>
+#include <xjos/arena.h>
+#include <xjos/string.h>
+#include <xjos/assert.h>
+#include <xjos/debug.h>
+#include <xjos/errno.h>
+
+
+#define LOGK(fmt, args...) DEBUGK(fmt, ##args)
+
+#define DEADLINE_READ_EXPIRE 500    // 读请求最长等待 ms
+#define DEADLINE_WRITE_EXPIRE 5000  // 写请求最长等待 ms
+#define DEADLINE_BATCH 16           // 同方向连续分派的请求数
+#define DEADLINE_WRITES_STARVED 2   // 读批次连续优先的次数
+
+#define FAIR_IDLE_EXPIRE 5000       // idle 类请求最长等待 ms
+#define FAIR_CHARGE_SCALE 16        // vtime = sectors * scale / weight
+
+extern task_t *tasks_table[TASK_NR];
+
+static request_t *request_next(list_t *list, idx_t head) {
+    for (list_node_t *ptr = list->head.next; ptr != &list->head; ptr = ptr->next) {
+        request_t *req = list_entry(ptr, request_t, node);
+        if (req->offset >= head)
+            return req;
+    }
+    return NULL;
+}
+
+// -------------------------------------------------------------
+// scan: 电梯算法，按扇区排序，到头后换方向
+// -------------------------------------------------------------
+
+static void *scan_init(device_t *device) {
+    device->direct = DIRECT_UP;
+    return NULL;
+}
+
+
+static void scan_add(device_t *device, request_t *req) {
+    list_insert_sort(&device->request_list, &req->node, list_node_offset(request_t, node, offset));
+}
+
+
+static request_t *scan_pick(device_t *device) {
+    list_t *list = &device->request_list;
+
+    for (size_t pass = 0; pass < 2; pass++) {
+        if (device->direct == DIRECT_UP) {
+            request_t *req = request_next(list, device->head);
+            if (req) {
+                list_remove(&req->node);
+                return req;
+            }
+            device->direct = DIRECT_DOWN;
+        } else {
+            for (list_node_t *ptr = list->head.prev; ptr != &list->head; ptr = ptr->prev) {
+                request_t *req = list_entry(ptr, request_t, node);
+                if (req->offset <= device->head) {
+                    list_remove(&req->node);
+                    return req;
+                }
+            }
+            device->direct = DIRECT_UP;
+        }
+    }
+    return NULL;
+}
+
+// -------------------------------------------------------------
+// deadline: 读写分开排序，每个请求有期限，读优先
+// -------------------------------------------------------------
+
+typedef struct deadline_t {
+    list_t sort[2];     // REQ_READ / REQ_WRITE, sorted by sector
+    list_t fifo[2];     // sorted by arrival
+    int dir;            // direction of current batch
+    u32 batch;          // reqs dispatched in current batch
+    u32 starved;        // read batches while writes pending
+} deadline_t;
+
+
+static void *deadline_init(device_t *device) {
+    deadline_t *dd = kmalloc(sizeof(deadline_t));
+    for (size_t i = 0; i < 2; i++) {
+        list_init(&dd->sort[i]);
+        list_init(&dd->fifo[i]);
+    }
+    dd->dir = REQ_READ;
+    dd->batch = 0;
+    dd->starved = 0;
+    return dd;
+}
+
+
+static void deadline_add(device_t *device, request_t *req) {
+    deadline_t *dd = device->elevator;
+    int dir = req->type == REQ_WRITE ? REQ_WRITE : REQ_READ;
+
+    u32 expire = dir == REQ_READ ? DEADLINE_READ_EXPIRE : DEADLINE_WRITE_EXPIRE;
+    req->deadline = timer_expire_jiffies(expire);
+
+    list_insert_sort(&dd->sort[dir], &req->node, list_node_offset(request_t, node, offset));
+    list_pushback(&dd->fifo[dir], &req->fifo);
+}
+
+
+static request_t *deadline_pick(device_t *device) {
+    deadline_t *dd = device->elevator;
+    bool reads = !list_empty(&dd->fifo[REQ_READ]);
+    bool writes = !list_empty(&dd->fifo[REQ_WRITE]);
+    if (!reads && !writes)
+        return NULL;
+
+    // 当前批次按扇区顺序继续
+    request_t *req = NULL;
+    if (dd->batch < DEADLINE_BATCH)
+        req = request_next(&dd->sort[dd->dir], device->head);
+
+    if (!req) {
+        // 新批次: 读优先，但写不能一直等
+        if (reads && (!writes || dd->starved < DEADLINE_WRITES_STARVED)) {
+            if (writes)
+                dd->starved++;
+            dd->dir = REQ_READ;
+        } else {
+            dd->starved = 0;
+            dd->dir = REQ_WRITE;
+        }
+        dd->batch = 0;
+
+        // 最老的请求超时就从它开始，否则从磁头位置继续
+        request_t *first = list_entry(dd->fifo[dd->dir].head.next, request_t, fifo);
+        req = request_next(&dd->sort[dd->dir], device->head);
+        if (!req || timer_is_expires(first->deadline))
+            req = first;
+    }
+
+    dd->batch++;
+    list_remove(&req->node);
+    list_remove(&req->fifo);
+    return req;
+}
+
+// -------------------------------------------------------------
+// fair: 按 ioprio 分类，类内按任务的 I/O 虚拟时间公平分配
+// -------------------------------------------------------------
+
+typedef struct fair_t {
+    list_t queue[IOPRIO_CLASS_NR];  // reqs of each class by arrival
+    u32 min_vtime;                  // vtime of last served task
+} fair_t;
+
+
+static int ioprio_class(u16 ioprio) {
+    int class = IOPRIO_PRIO_CLASS(ioprio);
+    return class == IOPRIO_CLASS_NONE ? IOPRIO_CLASS_BE : class;
+}
+
+
+static int ioprio_level(task_t *task, u16 ioprio) {
+    // 没有设置时，由 nice 推出 level
+    switch (IOPRIO_PRIO_CLASS(ioprio)) {
+        case IOPRIO_CLASS_NONE:
+            return (task->nice + 20) / 5;
+        case IOPRIO_CLASS_IDLE:
+            return IOPRIO_LEVEL_NR - 1;
+        default:
+            return IOPRIO_PRIO_DATA(ioprio);
+    }
+}
+
+
+static void *fair_init(device_t *device) {
+    fair_t *fq = kmalloc(sizeof(fair_t));
+    for (size_t i = 0; i < IOPRIO_CLASS_NR; i++)
+        list_init(&fq->queue[i]);
+    fq->min_vtime = 0;
+    return fq;
+}
+
+
+static void fair_add(device_t *device, request_t *req) {
+    fair_t *fq = device->elevator;
+    task_t *task = req->task;
+
+    // 空闲了很久的任务不能攒下太多 vtime
+    if ((int)(task->io_vtime - fq->min_vtime) < 0)
+        task->io_vtime = fq->min_vtime;
+
+    req->deadline = timer_expire_jiffies(FAIR_IDLE_EXPIRE);
+    list_pushback(&fq->queue[ioprio_class(req->ioprio)], &req->fifo);
+}
+
+
+static request_t *fair_pick(device_t *device) {
+    fair_t *fq = device->elevator;
+
+    list_t *list = NULL;
+    list_t *idle = &fq->queue[IOPRIO_CLASS_IDLE];
+    for (size_t class = IOPRIO_CLASS_RT; class < IOPRIO_CLASS_NR; class++) {
+        if (!list_empty(&fq->queue[class])) {
+            list = &fq->queue[class];
+            break;
+        }
+    }
+    if (!list)
+        return NULL;
+
+    // idle 类等太久时插队一次，防止 sync 永远等待
+    if (list != idle && !list_empty(idle)) {
+        request_t *first = list_entry(idle->head.next, request_t, fifo);
+        if (timer_is_expires(first->deadline))
+            list = idle;
+    }
+
+    // 实时类先比较 level，然后选 vtime 最小的任务中最先到达的请求
+    bool rt = list == &fq->queue[IOPRIO_CLASS_RT];
+    request_t *req = NULL;
+    for (list_node_t *ptr = list->head.next; ptr != &list->head; ptr = ptr->next) {
+        request_t *cand = list_entry(ptr, request_t, fifo);
+        if (!req) {
+            req = cand;
+            continue;
+        }
+        if (rt) {
+            int level = ioprio_level(req->task, req->ioprio);
+            int cand_level = ioprio_level(cand->task, cand->ioprio);
+            if (cand_level != level) {
+                if (cand_level < level)
+                    req = cand;
+                continue;
+            }
+        }
+        if ((int)(cand->task->io_vtime - req->task->io_vtime) < 0)
+            req = cand;
+    }
+
+    // level 越高权重越小，同样的扇区数消耗更多 vtime
+    task_t *task = req->task;
+    fq->min_vtime = task->io_vtime;
+    int weight = IOPRIO_LEVEL_NR - ioprio_level(task, req->ioprio);
+    task->io_vtime += req->count * FAIR_CHARGE_SCALE / weight;
+
+    list_remove(&req->fifo);
+    return req;
+}
+
+// -------------------------------------------------------------
+
+static iosched_t schedulers[IOSCHED_NR] = {
+    {"scan", IOSCHED_SCAN, scan_init, scan_add, scan_pick},
+    {"deadline", IOSCHED_DEADLINE, deadline_init, deadline_add, deadline_pick},
+    {"fair", IOSCHED_FAIR, fair_init, fair_add, fair_pick},
+};
+
+
+iosched_t *iosched_get(int type) {
+    if (type < 0 || type >= IOSCHED_NR)
+        return NULL;
+    return &schedulers[type];
+}
+
+
+static bool ioprio_valid(int ioprio) {
+    int class = IOPRIO_PRIO_CLASS(ioprio);
+    int level = IOPRIO_PRIO_DATA(ioprio);
+
+    switch (class) {
+        case IOPRIO_CLASS_NONE:
+            return level == 0;
+        case IOPRIO_CLASS_RT:
+        case IOPRIO_CLASS_BE:
+            return level < IOPRIO_LEVEL_NR;
+        case IOPRIO_CLASS_IDLE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+static bool ioprio_match(task_t *task, int which, int who) {
+    task_t *current = running_task();
+
+    switch (which) {
+        case IOPRIO_WHO_PROCESS:
+            return task->pid == (who ? who : current->pid);
+        case IOPRIO_WHO_PGRP:
+            return task->pgid == (who ? who : current->pgid);
+        case IOPRIO_WHO_USER:
+            return task->uid == (u32)(who ? who : current->uid);
+        default:
+            return false;
+    }
+}
+
+
+int sys_ioprio_set(int which, int who, int ioprio) {
+    task_t *current = running_task();
+
+    if (!ioprio_valid(ioprio))
+        return -EINVAL;
+    if (IOPRIO_PRIO_CLASS(ioprio) == IOPRIO_CLASS_RT && current->uid != KERNEL_USER)
+        return -EPERM;
+    if (which < IOPRIO_WHO_PROCESS || which > IOPRIO_WHO_USER)
+        return -EINVAL;
+
+    int ret = -ESRCH;
+    for (size_t i = 0; i < TASK_NR; i++) {
+        task_t *task = tasks_table[i];
+        if (!task || !ioprio_match(task, which, who))
+            continue;
+
+        // 普通用户只能修改自己的进程
+        if (current->uid != KERNEL_USER && task->uid != current->uid) {
+            ret = -EPERM;
+            continue;
+        }
+        task->ioprio = ioprio;
+        ret = EOK;
+    }
+    return ret;
+}
+
+
+int sys_ioprio_get(int which, int who) {
+    if (which < IOPRIO_WHO_PROCESS || which > IOPRIO_WHO_USER)
+        return -EINVAL;
+
+    // 多个任务匹配时返回优先级最高的
+    int ret = -ESRCH;
+    for (size_t i = 0; i < TASK_NR; i++) {
+        task_t *task = tasks_table[i];
+        if (!task || !ioprio_match(task, which, who))
+            continue;
+
+        int ioprio = task->ioprio;
+        if (ret < 0 || ioprio_class(ioprio) < ioprio_class(ret) ||
+            (ioprio_class(ioprio) == ioprio_class(ret) && IOPRIO_PRIO_DATA(ioprio) < IOPRIO_PRIO_DATA(ret)))
+            ret = ioprio;
+    }
+    return ret;
+}
@@ -34,6 +34,7 @@ struct {
     {0x010200, "Floppy disk controller"},
     {0x010300, "IPI bus controller"},
     {0x010400, "RAID bus controller"},
+    {0x010600, "SATA controller"},
     {0x018000, "Unknown mass storage controller"},
     {0x020000, "Ethernet controller"},
     {0x020100, "Token ring network controller"},
@@ -47,6 +47,13 @@ int ramdisk_write(ramdisk_t *disk, void *buf, u8 count, idx_t lba) {
     return EOK;
 }
 
+// 数据就在内存中，缓冲直接指向 ramdisk，不再复制
+void *ramdisk_dax(ramdisk_t *disk, idx_t lba, u32 count) {
+    if ((lba + count) * SECTOR_SIZE > disk->size)
+        return NULL;
+    return disk->start + lba * SECTOR_SIZE;
+}
+
 void ramdisk_init() {
     LOGK("ramdisk init...\n");
 
@@ -60,7 +67,8 @@ void ramdisk_init() {
         ramdisk->start = (u8 *)(KERNEL_RAMDISK_MEM + size * i);
         ramdisk->size = size;
         sprintf(name, "md%c", i + 'a');
-        device_install(DEV_BLOCK, DEV_RAMDISK, ramdisk, name, 0,
+        dev_t dev = device_install(DEV_BLOCK, DEV_RAMDISK, ramdisk, name, 0,
             ramdisk_ioctl, ramdisk_read, ramdisk_write);
+        device_set_dax(dev, ramdisk_dax);
     }
 }
\ No newline at end of file
@@ -0,0 +1,554 @@
+#include <hardware/virtio.h>
+#include <hardware/pci.h>
+#include <hardware/io.h>
+#include <xjos/memory.h>
+#include <xjos/arena.h>
+#include <xjos/interrupt.h>
+#include <xjos/string.h>
+#include <xjos/stdlib.h>
+#include <xjos/stdio.h>
+#include <xjos/debug.h>
+#include <xjos/assert.h>
+#include <xjos/errno.h>
+#include <drivers/device.h>
+
+
+#define LOGK(fmt, args...) DEBUGK(fmt, ##args)
+
+#define VIRTIO_VENDOR_ID 0x1AF4
+#define VIRTIO_BLK_DEVICE_ID 0x1001 // legacy / transitional
+
+#define VIRTIO_POLL_COUNT 10000000
+
+// legacy PCI 寄存器，没有 MSI-X 时设备配置从 0x14 开始
+#define VIRTIO_PCI_HOST_FEATURES 0x00
+#define VIRTIO_PCI_GUEST_FEATURES 0x04
+#define VIRTIO_PCI_QUEUE_PFN 0x08
+#define VIRTIO_PCI_QUEUE_NUM 0x0C
+#define VIRTIO_PCI_QUEUE_SEL 0x0E
+#define VIRTIO_PCI_QUEUE_NOTIFY 0x10
+#define VIRTIO_PCI_STATUS 0x12
+#define VIRTIO_PCI_ISR 0x13
+#define VIRTIO_PCI_CONFIG 0x14
+
+#define VIRTIO_BLK_CFG_CAPACITY (VIRTIO_PCI_CONFIG + 0x00) // u64
+#define VIRTIO_BLK_CFG_SIZE_MAX (VIRTIO_PCI_CONFIG + 0x08)
+#define VIRTIO_BLK_CFG_SEG_MAX (VIRTIO_PCI_CONFIG + 0x0C)
+
+#define VIRTIO_STATUS_ACKNOWLEDGE 1
+#define VIRTIO_STATUS_DRIVER 2
+#define VIRTIO_STATUS_DRIVER_OK 4
+#define VIRTIO_STATUS_FAILED 128
+
+#define VIRTIO_ISR_QUEUE 1
+
+#define VIRTIO_BLK_F_SIZE_MAX (1 << 1)
+#define VIRTIO_BLK_F_SEG_MAX (1 << 2)
+#define VIRTIO_BLK_F_RO (1 << 5)
+#define VIRTIO_BLK_F_FLUSH (1 << 9)     // 有写缓存，支持 flush 命令
+#define VIRTIO_RING_F_INDIRECT_DESC (1 << 28)
+#define VIRTIO_RING_F_EVENT_IDX (1 << 29)
+
+#define VIRTIO_BLK_FEATURES (VIRTIO_BLK_F_SIZE_MAX | VIRTIO_BLK_F_SEG_MAX | VIRTIO_BLK_F_RO | VIRTIO_BLK_F_FLUSH | \
+                             VIRTIO_RING_F_INDIRECT_DESC | VIRTIO_RING_F_EVENT_IDX)
+
+#define VRING_DESC_F_NEXT 1
+#define VRING_DESC_F_WRITE 2     // device writes
+#define VRING_DESC_F_INDIRECT 4
+
+#define VRING_USED_F_NO_NOTIFY 1
+
+#define VRING_ALIGN PAGE_SIZE
+
+#define VIRTIO_BLK_T_IN 0
+#define VIRTIO_BLK_T_OUT 1
+#define VIRTIO_BLK_T_FLUSH 4
+
+#define VIRTIO_BLK_S_OK 0
+
+#define VIRTIO_SEG_MAX 0x400000
+
+// 描述符和 used 环的写入顺序
+#define virtio_mb() asm volatile("lock; addl $0, (%%esp)" ::: "memory")
+#define virtio_wmb() asm volatile("" ::: "memory")
+#define virtio_rmb() asm volatile("" ::: "memory")
+
+// 每个请求最坏情况每页一个数据段，首尾不对齐多占一个
+#define VIRTIO_BLK_MAX_SECS(segs) (((segs) - 1) * (PAGE_SIZE / SECTOR_SIZE))
+
+static virtio_blk_t *virtio_blk;
+
+
+#define vring_used_event(vq) ((vq)->avail->ring[(vq)->size])
+#define vring_avail_event(vq) (*(volatile u16 *)&(vq)->used->ring[(vq)->size])
+
+// event idx 是否落在 (old, new] 之间
+static inline bool vring_need_event(u16 event, u16 new, u16 old) {
+    return (u16)(new - event - 1) < (u16)(new - old);
+}
+
+
+static err_t virtqueue_init(virtio_blk_t *blk, u16 index) {
+    virtqueue_t *vq = &blk->vq;
+
+    outw(blk->iobase + VIRTIO_PCI_QUEUE_SEL, index);
+    u16 size = inw(blk->iobase + VIRTIO_PCI_QUEUE_NUM);
+    if (!size || (size & (size - 1))) {
+        LOGK("virtio %s queue %d size %d invalid\n", blk->name, index, size);
+        return -EINVAL;
+    }
+
+    // desc[size] | avail | used_event | 对齐 | used | avail_event
+    u32 avail = sizeof(vring_desc_t) * size;
+    u32 used = avail + sizeof(vring_avail_t) + sizeof(u16) * (size + 1);
+    used = (used + VRING_ALIGN - 1) & ~(VRING_ALIGN - 1);
+    u32 total = used + sizeof(vring_used_t) + sizeof(vring_used_elem_t) * size + sizeof(u16);
+
+    vq->size = size;
+    vq->last_used = 0;
+    vq->pages = div_round_up(total, PAGE_SIZE);
+
+    u32 vaddr = alloc_kpage(vq->pages);
+    memset((void *)vaddr, 0, vq->pages * PAGE_SIZE);
+    vq->desc = (vring_desc_t *)vaddr;
+    vq->avail = (vring_avail_t *)(vaddr + avail);
+    vq->used = (vring_used_t *)(vaddr + used);
+
+    outl(blk->iobase + VIRTIO_PCI_QUEUE_PFN, get_paddr(vaddr) >> 12);
+    return EOK;
+}
+
+
+// 按描述符布局分配命令槽
+static void virtio_blk_slots_init(virtio_blk_t *blk) {
+    u32 descs = blk->segs + 2;
+    u32 nslots = VIRTIO_BLK_SLOT_NR;
+
+    vring_desc_t *tables = NULL;
+    if (blk->indirect) {
+        // 每个请求只占环中一个描述符，指向自己的间接表
+        nslots = MIN(nslots, blk->vq.size);
+        tables = (vring_desc_t *)alloc_kpage(div_round_up(nslots * descs * sizeof(vring_desc_t), PAGE_SIZE));
+    } else {
+        // 请求的描述符链直接放在环中
+        if (blk->vq.size < descs) {
+            blk->segs = blk->vq.size - 2;
+            descs = blk->vq.size;
+        }
+        nslots = MIN(nslots, blk->vq.size / descs);
+    }
+
+    virtio_blk_cmd_t *cmds = (virtio_blk_cmd_t *)alloc_kpage(1);
+    memset(cmds, 0, PAGE_SIZE);
+    assert(nslots * sizeof(virtio_blk_cmd_t) <= PAGE_SIZE);
+
+    for (size_t i = 0; i < nslots; i++) {
+        virtio_blk_slot_t *slot = &blk->slot[i];
+        slot->cmd = &cmds[i];
+        slot->req = NULL;
+        if (blk->indirect) {
+            slot->head = i;
+            slot->table = &tables[i * descs];
+        } else {
+            slot->head = i * descs;
+            slot->table = &blk->vq.desc[slot->head];
+        }
+    }
+    blk->slots = nslots == 32 ? 0xFFFFFFFF : (1 << nslots) - 1;
+    blk->active = 0;
+}
+
+
+// 请求头 + 合并后的数据段 + 状态
+static err_t virtio_blk_setup(virtio_blk_t *blk, virtio_blk_slot_t *slot, request_t *req) {
+    bool write = req->type == REQ_WRITE;
+    u16 base = blk->indirect ? 0 : slot->head;
+    vring_desc_t *table = slot->table;
+    vring_desc_t *desc = &table[0];
+    size_t nr = 1;
+
+    slot->cmd->hdr.type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    slot->cmd->hdr.sector = req->offset;
+    if (req->type == REQ_FLUSH) {
+        slot->cmd->hdr.type = VIRTIO_BLK_T_FLUSH;
+        slot->cmd->hdr.sector = 0;
+    }
+    slot->cmd->status = 0xFF;
+
+    desc->addr = get_paddr((u32)&slot->cmd->hdr);
+    desc->len = sizeof(virtio_blk_hdr_t);
+    desc->flags = VRING_DESC_F_NEXT;
+    desc->next = base + 1;
+
+    vring_desc_t *seg = NULL;
+    u32 len = req->count * SECTOR_SIZE;
+    for (size_t i = 0; len; i++) {
+        u32 addr = req->pages[i];
+        if (!addr)
+            return -EFAULT;
+
+        u32 chunk = MIN(len, PAGE_SIZE - (addr & (PAGE_SIZE - 1)));
+        len -= chunk;
+
+        if (seg && (u32)seg->addr + seg->len == addr && seg->len + chunk <= blk->seg_size) {
+            seg->len += chunk;
+            continue;
+        }
+
+        if (nr - 1 == blk->segs) {
+            LOGK("virtio %s too many segments\n", blk->name);
+            return -EINVAL;
+        }
+        seg = &table[nr];
+        seg->addr = addr;
+        seg->len = chunk;
+        seg->flags = VRING_DESC_F_NEXT | (write ? 0 : VRING_DESC_F_WRITE);
+        seg->next = base + nr + 1;
+        nr++;
+    }
+
+    desc = &table[nr++];
+    desc->addr = get_paddr((u32)&slot->cmd->status);
+    desc->len = 1;
+    desc->flags = VRING_DESC_F_WRITE;
+    desc->next = 0;
+
+    if (blk->indirect) {
+        desc = &blk->vq.desc[slot->head];
+        desc->addr = get_paddr((u32)table);
+        desc->len = nr * sizeof(vring_desc_t);
+        desc->flags = VRING_DESC_F_INDIRECT;
+        desc->next = 0;
+    }
+    return EOK;
+}
+
+
+// 放入 avail 环，设备正在处理队列时不通知
+static void virtio_blk_kick(virtio_blk_t *blk, u16 head) {
+    virtqueue_t *vq = &blk->vq;
+    u16 old = vq->avail->idx;
+
+    vq->avail->ring[old & (vq->size - 1)] = head;
+    virtio_wmb();
+    vq->avail->idx = old + 1;
+    virtio_mb();
+
+    bool notify;
+    if (blk->event_idx)
+        notify = vring_need_event(vring_avail_event(vq), old + 1, old);
+    else
+        notify = !(((volatile vring_used_t *)vq->used)->flags & VRING_USED_F_NO_NOTIFY);
+
+    if (notify)
+        outw(blk->iobase + VIRTIO_PCI_QUEUE_NOTIFY, 0);
+}
+
+
+static int virtio_blk_submit(virtio_blk_t *blk, request_t *req) {
+    u32 free = blk->slots & ~blk->active;
+    if (!free)
+        return -EBUSY;
+    if (req->type == REQ_WRITE && blk->ro)
+        return -EROFS;
+
+    u32 idx = 0;
+    while (!(free & (1 << idx)))
+        idx++;
+
+    virtio_blk_slot_t *slot = &blk->slot[idx];
+    err_t ret = virtio_blk_setup(blk, slot, req);
+    if (ret < EOK)
+        return ret;
+
+    MM_TRACEK("virtio %s slot %d lba 0x%x count %d\n", blk->name, idx, req->offset, req->count);
+
+    slot->req = req;
+    blk->active |= 1 << idx;
+    virtio_blk_kick(blk, slot->head);
+    return EOK;
+}
+
+
+static virtio_blk_slot_t *virtio_blk_slot(virtio_blk_t *blk, u32 head, u32 *mask) {
+    for (size_t i = 0; i < VIRTIO_BLK_SLOT_NR; i++) {
+        if ((blk->active & (1 << i)) && blk->slot[i].head == head) {
+            *mask = 1 << i;
+            return &blk->slot[i];
+        }
+    }
+    return NULL;
+}
+
+
+// 取出 used 环中所有完成的请求，返回完成的槽
+static u32 virtio_blk_reap(virtio_blk_t *blk, request_t **reqs, err_t *rets, size_t *nr) {
+    virtqueue_t *vq = &blk->vq;
+    volatile vring_used_t *used = vq->used;
+    u32 done = 0;
+
+    while (true) {
+        while (vq->last_used != used->idx) {
+            virtio_rmb();
+            vring_used_elem_t *elem = &vq->used->ring[vq->last_used & (vq->size - 1)];
+            vq->last_used++;
+
+            u32 mask;
+            virtio_blk_slot_t *slot = virtio_blk_slot(blk, elem->id, &mask);
+            if (!slot) {
+                LOGK("virtio %s unknown used id %d\n", blk->name, elem->id);
+                continue;
+            }
+
+            reqs[*nr] = slot->req;
+            rets[*nr] = slot->cmd->status == VIRTIO_BLK_S_OK ? EOK : -EIO;
+            (*nr)++;
+            slot->req = NULL;
+            done |= mask;
+        }
+
+        if (!blk->event_idx)
+            break;
+
+        // 下一个完成时中断，写入后再检查一次防止丢失
+        vring_used_event(vq) = vq->last_used;
+        virtio_mb();
+        if (vq->last_used == used->idx)
+            break;
+    }
+
+    blk->active &= ~done;
+    return done;
+}
+
+
+static void virtio_blk_handler(int vector) {
+    send_eoi(vector);
+
+    virtio_blk_t *blk = virtio_blk;
+    u8 isr = inb(blk->iobase + VIRTIO_PCI_ISR); // 读取即清除
+    if (!(isr & VIRTIO_ISR_QUEUE))
+        return;
+
+    request_t *reqs[VIRTIO_BLK_SLOT_NR];
+    err_t rets[VIRTIO_BLK_SLOT_NR];
+    size_t nr = 0;
+    virtio_blk_reap(blk, reqs, rets, &nr);
+
+    // 先释放全部槽，完成回调会提交新请求
+    for (size_t i = 0; i < nr; i++)
+        device_complete(reqs[i], rets[i]);
+}
+
+
+// 中断启用之前轮询读取
+static err_t virtio_blk_poll_read(virtio_blk_t *blk, void *buf, u32 count, idx_t lba) {
+    u32 npages = div_round_up(count * SECTOR_SIZE, PAGE_SIZE);
+    request_t *req = (request_t *)kmalloc(sizeof(request_t) + npages * sizeof(u32));
+    memset(req, 0, sizeof(request_t));
+    req->type = REQ_READ;
+    req->offset = lba;
+    req->count = count;
+    req->npages = npages;
+    for (size_t i = 0; i < npages; i++)
+        req->pages[i] = get_paddr((u32)buf + i * PAGE_SIZE);
+
+    err_t ret = virtio_blk_submit(blk, req);
+    if (ret == EOK) {
+        request_t *reqs[VIRTIO_BLK_SLOT_NR];
+        err_t rets[VIRTIO_BLK_SLOT_NR];
+        size_t nr = 0;
+
+        ret = -ETIME;
+        for (size_t i = 0; i < VIRTIO_POLL_COUNT && !nr; i++)
+            virtio_blk_reap(blk, reqs, rets, &nr);
+        if (nr)
+            ret = rets[0];
+    }
+    kfree(req);
+    return ret;
+}
+
+
+int virtio_blk_ioctl(virtio_blk_t *blk, int cmd, void *args, int flags) {
+    switch (cmd) {
+        case DEV_CMD_SECTOR_START:
+            return 0;
+        case DEV_CMD_SECTOR_SIZE:
+            return blk->total_lba;
+        default:
+            return -EINVAL;
+    }
+}
+
+
+int virtio_blk_read(virtio_blk_t *blk, void *buf, size_t count, idx_t lba) {
+    return device_request(blk->dev, buf, count, lba, 0, REQ_READ);
+}
+
+
+int virtio_blk_write(virtio_blk_t *blk, void *buf, size_t count, idx_t lba) {
+    return device_request(blk->dev, buf, count, lba, 0, REQ_WRITE);
+}
+
+
+int virtio_blk_part_ioctl(virtio_blk_part_t *part, int cmd, void *args, int flags) {
+    switch (cmd) {
+        case DEV_CMD_SECTOR_START:
+            return part->start;
+        case DEV_CMD_SECTOR_SIZE:
+            return part->count;
+        default:
+            return -EINVAL;
+    }
+}
+
+
+int virtio_blk_part_read(virtio_blk_part_t *part, void *buf, size_t count, idx_t lba) {
+    return virtio_blk_read(part->blk, buf, count, part->start + lba);
+}
+
+
+int virtio_blk_part_write(virtio_blk_part_t *part, void *buf, size_t count, idx_t lba) {
+    return virtio_blk_write(part->blk, buf, count, part->start + lba);
+}
+
+
+static void virtio_blk_part_init(virtio_blk_t *blk, u16 *buf) {
+    if (virtio_blk_poll_read(blk, buf, 1, 0) < EOK)
+        return;
+
+    boot_sector_t *boot = (boot_sector_t *)buf;
+    if (boot->signature != 0xAA55)
+        return;
+
+    for (size_t i = 0; i < IDE_PART_NR; i++) {
+        part_entry_t *entry = &boot->entry[i];
+        virtio_blk_part_t *part = &blk->parts[i];
+        if (!entry->count || entry->system == 0x05)
+            continue;
+
+        sprintf(part->name, "%s%d", blk->name, i + 1);
+        part->blk = blk;
+        part->count = entry->count;
+        part->system = entry->system;
+        part->start = entry->start;
+        LOGK("part %s start %d count %d system 0x%x\n", part->name, part->start, part->count, part->system);
+    }
+}
+
+
+static void virtio_blk_config(virtio_blk_t *blk) {
+    u32 high = inl(blk->iobase + VIRTIO_BLK_CFG_CAPACITY + 4);
+    blk->total_lba = high ? 0xFFFFFFFF : inl(blk->iobase + VIRTIO_BLK_CFG_CAPACITY);
+
+    blk->segs = VIRTIO_BLK_SEG_NR;
+    if (blk->features & VIRTIO_BLK_F_SEG_MAX) {
+        u32 seg_max = inl(blk->iobase + VIRTIO_BLK_CFG_SEG_MAX);
+        if (seg_max >= 2)
+            blk->segs = MIN(blk->segs, seg_max);
+    }
+
+    blk->seg_size = VIRTIO_SEG_MAX;
+    if (blk->features & VIRTIO_BLK_F_SIZE_MAX) {
+        u32 size_max = inl(blk->iobase + VIRTIO_BLK_CFG_SIZE_MAX);
+        if (size_max >= PAGE_SIZE)
+            blk->seg_size = MIN(blk->seg_size, size_max);
+    }
+
+    blk->indirect = !!(blk->features & VIRTIO_RING_F_INDIRECT_DESC);
+    blk->event_idx = !!(blk->features & VIRTIO_RING_F_EVENT_IDX);
+    blk->ro = !!(blk->features & VIRTIO_BLK_F_RO);
+}
+
+
+static void virtio_blk_install(virtio_blk_t *blk) {
+    blk->dev = device_install(
+        DEV_BLOCK, DEV_VIRTIO_DISK,
+        blk, blk->name, 0,
+        virtio_blk_ioctl, virtio_blk_read, virtio_blk_write);
+
+    u32 depth = 0;
+    for (u32 slots = blk->slots; slots; slots >>= 1)
+        depth++;
+    device_set_queue(blk->dev, virtio_blk_submit, depth, VIRTIO_BLK_MAX_SECS(blk->segs));
+
+    // 没有 FUA 命令，FUA 写由设备层补一次 flush
+    if (blk->features & VIRTIO_BLK_F_FLUSH)
+        device_set_cache(blk->dev, DEV_WCACHE, NULL);
+
+    for (size_t i = 0; i < IDE_PART_NR; i++) {
+        virtio_blk_part_t *part = &blk->parts[i];
+        if (!part->count)
+            continue;
+        device_install(DEV_BLOCK, DEV_VIRTIO_PART,
+                       part, part->name, blk->dev,
+                       virtio_blk_part_ioctl, virtio_blk_part_read, virtio_blk_part_write);
+    }
+}
+
+
+void virtio_blk_init() {
+    pci_device_t *device = pci_find_device(VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID);
+    if (!device) {
+        LOGK("virtio blk not found\n");
+        return;
+    }
+
+    pci_bar_t bar;
+    if (pci_find_bar(device, &bar, PCI_BAR_TYPE_IO) < EOK) {
+        LOGK("virtio blk legacy io bar not found\n");
+        return;
+    }
+
+    u8 irq = pci_interrupt(device);
+    if (irq >= 16) {
+        LOGK("virtio blk no legacy interrupt\n");
+        return;
+    }
+
+    u32 command = pci_inl(device->bus, device->dev, device->func, PCI_CONF_COMMAND);
+    pci_outl(device->bus, device->dev, device->func, PCI_CONF_COMMAND, command | PCI_COMMAND_IO);
+    pci_enable_busmastering(device);
+
+    virtio_blk_t *blk = (virtio_blk_t *)kmalloc(sizeof(virtio_blk_t));
+    memset(blk, 0, sizeof(virtio_blk_t));
+    strcpy(blk->name, "vda");
+    blk->iobase = bar.iobase;
+    blk->irq = irq;
+
+    // reset, 然后协商特性
+    outb(blk->iobase + VIRTIO_PCI_STATUS, 0);
+    outb(blk->iobase + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+    outb(blk->iobase + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+
+    blk->features = inl(blk->iobase + VIRTIO_PCI_HOST_FEATURES) & VIRTIO_BLK_FEATURES;
+    outl(blk->iobase + VIRTIO_PCI_GUEST_FEATURES, blk->features);
+    virtio_blk_config(blk);
+
+    if (virtqueue_init(blk, 0) < EOK) {
+        outb(blk->iobase + VIRTIO_PCI_STATUS, VIRTIO_STATUS_FAILED);
+        kfree(blk);
+        return;
+    }
+    virtio_blk_slots_init(blk);
+
+    outb(blk->iobase + VIRTIO_PCI_STATUS,
+         VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+
+    LOGK("virtio %s io 0x%x irq %d lba %u features 0x%x queue %d slots 0x%x segs %d\n",
+         blk->name, blk->iobase, blk->irq, blk->total_lba, blk->features,
+         blk->vq.size, blk->slots, blk->segs);
+
+    u16 *buf = (u16 *)alloc_kpage(1);
+    virtio_blk_part_init(blk, buf);
+    free_kpage((u32)buf, 1);
+
+    virtio_blk = blk;
+    virtio_blk_install(blk);
+
+    set_interrupt_handler(blk->irq, virtio_blk_handler);
+    set_interrupt_mask(blk->irq, true);
+    if (blk->irq >= 8)
+        set_interrupt_mask(IRQ_CASCADE, true);
+}
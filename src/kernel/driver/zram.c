@@ -0,0 +1,398 @@
+#include <drivers/zram.h>
+#include <drivers/device.h>
+#include <xjos/memory.h>
+#include <xjos/arena.h>
+#include <xjos/list.h>
+#include <xjos/lz4.h>
+#include <xjos/string.h>
+#include <xjos/stdlib.h>
+#include <xjos/stdio.h>
+#include <xjos/errno.h>
+#include <xjos/assert.h>
+#include <xjos/debug.h>
+
+#define LOGK(fmt, args...) DEBUGK(fmt, ##args)
+
+/**
+ * zram 压缩内存磁盘
+ *
+ * 磁盘按页管理，每页用 LZ4 压缩后放入按大小分类的 slab。
+ * 全零的页只做标记不占内存，压缩后仍超过 3/4 页的按原样存一整页。
+ * 压缩数据占用的内核页数有上限，超出时写请求返回 -ENOSPC。
+ */
+
+#define ZRAM_NR 1
+#define ZRAM_SIZE 0x800000          // 8MB 磁盘容量
+#define ZRAM_MEM_LIMIT 512          // 最多占用 2MB 内核内存
+#define ZRAM_RESERVE 256            // 内核空闲页少于 1MB 时不再分配
+
+#define PAGE_SECS (PAGE_SIZE / SECTOR_SIZE)
+
+#define ZRAM_MAX_ZSIZE (PAGE_SIZE / 4 * 3)  // 更大的压缩结果按原样存放
+
+// slab 的大小分类，一个 zspage 由 1 ~ ZPOOL_MAX_PAGES 个连续页组成，
+// 对象可以跨越页边界，这样 2KB ~ 3KB 的对象也不会浪费半页
+#define ZPOOL_MIN_SIZE 32
+#define ZPOOL_DELTA 64
+#define ZPOOL_MAX_PAGES 4
+#define ZPOOL_CLASS_NR ((ZRAM_MAX_ZSIZE - ZPOOL_MIN_SIZE) / ZPOOL_DELTA + 2)
+
+enum zram_flag_t {
+    ZRAM_ZERO = 1,  // zero page, no data
+    ZRAM_RAW = 2,   // data is a whole page, not compressed
+};
+
+typedef struct zclass_t {
+    u32 size;           // object size
+    u32 pages;          // pages per zspage
+    u32 total;          // objects per zspage
+    list_t partial;     // zspages with free objects
+} zclass_t;
+
+typedef struct zspage_t {
+    list_node_t node;   // zclass_t.partial
+    zclass_t *class;
+    u32 used;           // objects in use
+    list_t free;        // free objects
+} zspage_t;
+
+typedef struct zram_entry_t {
+    void *data;         // stored data, NULL for zero / never written page
+    zspage_t *zspage;   // NULL for raw page
+    u16 size;           // compressed size, PAGE_SIZE for raw page
+    u16 flags;
+} zram_entry_t;
+
+typedef struct zram_t {
+    zram_entry_t *table;
+    u8 *buffer;         // page of read modify write
+    u8 *zbuffer;        // output of compressor
+    void *work;         // hash table of compressor
+    zclass_t classes[ZPOOL_CLASS_NR];
+    zram_stat_t stat;
+} zram_t;
+
+static zram_t zrams[ZRAM_NR];
+
+// -------------------------------------------------------------
+// zpool: 压缩数据的 slab
+// -------------------------------------------------------------
+
+static void zpool_init(zram_t *zram) {
+    u32 avail[ZPOOL_MAX_PAGES + 1];
+    for (size_t pages = 1; pages <= ZPOOL_MAX_PAGES; pages++)
+        avail[pages] = pages * PAGE_SIZE - sizeof(zspage_t);
+
+    for (size_t i = 0; i < ZPOOL_CLASS_NR; i++) {
+        zclass_t *class = &zram->classes[i];
+        class->size = MIN(ZPOOL_MIN_SIZE + i * ZPOOL_DELTA, ZRAM_MAX_ZSIZE);
+        list_init(&class->partial);
+
+        // 选择浪费最少的页数
+        class->pages = 1;
+        u32 best = 0;
+        for (size_t pages = 1; pages <= ZPOOL_MAX_PAGES; pages++) {
+            u32 used = avail[pages] / class->size * class->size;
+            u32 usage = used * 100 / (pages * PAGE_SIZE);
+            if (usage > best) {
+                best = usage;
+                class->pages = pages;
+            }
+        }
+        class->total = avail[class->pages] / class->size;
+    }
+}
+
+
+static zclass_t *zpool_class(zram_t *zram, u32 size) {
+    assert(size <= ZRAM_MAX_ZSIZE);
+    if (size <= ZPOOL_MIN_SIZE)
+        return &zram->classes[0];
+    return &zram->classes[div_round_up(size - ZPOOL_MIN_SIZE, ZPOOL_DELTA)];
+}
+
+
+// 还能否再占用 count 个内核页
+static bool zpool_reserve(zram_t *zram, u32 count) {
+    memory_stat_t mem;
+    memory_stat(&mem);
+
+    zram_stat_t *stat = &zram->stat;
+    if (stat->mem_pages + count > stat->limit_pages)
+        return false;
+    if (mem.kernel_free < ZRAM_RESERVE + count)
+        return false;
+
+    stat->mem_pages += count;
+    stat->max_pages = MAX(stat->max_pages, stat->mem_pages);
+    return true;
+}
+
+
+static void *zpool_alloc(zram_t *zram, u32 size, zspage_t **result) {
+    zclass_t *class = zpool_class(zram, size);
+    zspage_t *zspage;
+
+    if (list_empty(&class->partial)) {
+        if (!zpool_reserve(zram, class->pages))
+            return NULL;
+
+        zspage = (zspage_t *)alloc_kpage(class->pages);
+        zspage->class = class;
+        zspage->used = 0;
+        list_init(&zspage->free);
+
+        u8 *addr = (u8 *)(zspage + 1);
+        for (size_t i = 0; i < class->total; i++)
+            list_pushback(&zspage->free, (list_node_t *)(addr + i * class->size));
+        list_push(&class->partial, &zspage->node);
+    }
+
+    zspage = list_entry(class->partial.head.next, zspage_t, node);
+    void *data = list_pop(&zspage->free);
+    zspage->used++;
+    if (zspage->used == class->total)
+        list_remove(&zspage->node);
+
+    *result = zspage;
+    return data;
+}
+
+
+static void zpool_free(zram_t *zram, zspage_t *zspage, void *data) {
+    zclass_t *class = zspage->class;
+    assert(zspage->used > 0);
+
+    if (zspage->used == class->total)
+        list_push(&class->partial, &zspage->node);
+    zspage->used--;
+
+    if (zspage->used) {
+        list_push(&zspage->free, (list_node_t *)data);
+        return;
+    }
+
+    list_remove(&zspage->node);
+    free_kpage((u32)zspage, class->pages);
+    zram->stat.mem_pages -= class->pages;
+}
+
+// -------------------------------------------------------------
+// 页的读写
+// -------------------------------------------------------------
+
+static void zram_free(zram_t *zram, zram_entry_t *entry) {
+    zram_stat_t *stat = &zram->stat;
+
+    if (entry->flags & ZRAM_ZERO)
+        stat->zero--;
+
+    if (entry->data) {
+        if (entry->flags & ZRAM_RAW) {
+            free_kpage((u32)entry->data, 1);
+            stat->mem_pages--;
+            stat->raw--;
+        } else {
+            zpool_free(zram, entry->zspage, entry->data);
+        }
+        stat->stored--;
+        stat->compr_bytes -= entry->size;
+    }
+
+    entry->data = NULL;
+    entry->zspage = NULL;
+    entry->size = 0;
+    entry->flags = 0;
+}
+
+
+static bool page_is_zero(u8 *page) {
+    u32 *ptr = (u32 *)page;
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(u32); i++) {
+        if (ptr[i])
+            return false;
+    }
+    return true;
+}
+
+
+static err_t zram_load(zram_t *zram, u32 index, u8 *page) {
+    zram_entry_t *entry = &zram->table[index];
+    zram->stat.reads++;
+
+    if (!entry->data) {
+        memset(page, 0, PAGE_SIZE);
+        return EOK;
+    }
+
+    if (entry->flags & ZRAM_RAW) {
+        memcpy(page, entry->data, PAGE_SIZE);
+        return EOK;
+    }
+
+    int len = lz4_decompress(entry->data, entry->size, page, PAGE_SIZE);
+    if (len != PAGE_SIZE) {
+        LOGK("zram page %d corrupted\n", index);
+        return -EIO;
+    }
+    return EOK;
+}
+
+
+static err_t zram_store(zram_t *zram, u32 index, u8 *page) {
+    zram_entry_t *entry = &zram->table[index];
+    zram_stat_t *stat = &zram->stat;
+    stat->writes++;
+
+    if (page_is_zero(page)) {
+        zram_free(zram, entry);
+        entry->flags = ZRAM_ZERO;
+        stat->zero++;
+        return EOK;
+    }
+
+    u16 flags = 0;
+    u8 *src = zram->zbuffer;
+    int size = lz4_compress(page, PAGE_SIZE, zram->zbuffer, ZRAM_MAX_ZSIZE, zram->work);
+    if (!size) {
+        flags = ZRAM_RAW;
+        src = page;
+        size = PAGE_SIZE;
+    }
+
+    // 先分配新的空间，失败时旧数据保持不变
+    void *data = NULL;
+    zspage_t *zspage = NULL;
+    if (flags & ZRAM_RAW) {
+        if (zpool_reserve(zram, 1))
+            data = (void *)alloc_kpage(1);
+    } else {
+        data = zpool_alloc(zram, size, &zspage);
+    }
+
+    if (!data) {
+        stat->failed++;
+        return -ENOSPC;
+    }
+
+    zram_free(zram, entry);
+    memcpy(data, src, size);
+    entry->data = data;
+    entry->zspage = zspage;
+    entry->size = size;
+    entry->flags = flags;
+
+    stat->stored++;
+    stat->compr_bytes += size;
+    if (flags & ZRAM_RAW)
+        stat->raw++;
+    return EOK;
+}
+
+// -------------------------------------------------------------
+// 设备接口
+// -------------------------------------------------------------
+
+int zram_ioctl(zram_t *zram, int cmd, void *args, int flags) {
+    switch (cmd) {
+        case DEV_CMD_SECTOR_START:
+            return 0;
+        case DEV_CMD_SECTOR_SIZE:
+            return zram->stat.pages * PAGE_SECS;
+        default:
+            return -EINVAL;
+    }
+}
+
+
+int zram_read(zram_t *zram, void *buf, u8 count, idx_t lba) {
+    if (lba + count > zram->stat.pages * PAGE_SECS)
+        return -EINVAL;
+
+    while (count) {
+        u32 index = lba / PAGE_SECS;
+        u32 offset = lba % PAGE_SECS;
+        u32 secs = MIN(count, PAGE_SECS - offset);
+        u32 len = secs * SECTOR_SIZE;
+
+        err_t ret;
+        if (secs == PAGE_SECS) {
+            ret = zram_load(zram, index, buf);
+        } else {
+            ret = zram_load(zram, index, zram->buffer);
+            memcpy(buf, zram->buffer + offset * SECTOR_SIZE, len);
+        }
+        if (ret < 0)
+            return ret;
+
+        buf += len;
+        lba += secs;
+        count -= secs;
+    }
+    return EOK;
+}
+
+
+int zram_write(zram_t *zram, void *buf, u8 count, idx_t lba) {
+    if (lba + count > zram->stat.pages * PAGE_SECS)
+        return -EINVAL;
+
+    while (count) {
+        u32 index = lba / PAGE_SECS;
+        u32 offset = lba % PAGE_SECS;
+        u32 secs = MIN(count, PAGE_SECS - offset);
+        u32 len = secs * SECTOR_SIZE;
+
+        // 不满一页时先解压原来的页再修改
+        err_t ret;
+        if (secs == PAGE_SECS) {
+            ret = zram_store(zram, index, buf);
+        } else {
+            ret = zram_load(zram, index, zram->buffer);
+            if (ret == EOK) {
+                memcpy(zram->buffer + offset * SECTOR_SIZE, buf, len);
+                ret = zram_store(zram, index, zram->buffer);
+            }
+        }
+        if (ret < 0)
+            return ret;
+
+        buf += len;
+        lba += secs;
+        count -= secs;
+    }
+    return EOK;
+}
+
+
+bool zram_stat(idx_t idx, zram_stat_t *stat) {
+    if (idx >= ZRAM_NR || !zrams[idx].table)
+        return false;
+    *stat = zrams[idx].stat;
+    return true;
+}
+
+
+void zram_init() {
+    LOGK("zram init...\n");
+
+    for (size_t i = 0; i < ZRAM_NR; i++) {
+        zram_t *zram = &zrams[i];
+        zram_stat_t *stat = &zram->stat;
+
+        memset(stat, 0, sizeof(zram_stat_t));
+        sprintf(stat->name, "zram%d", i);
+        stat->pages = ZRAM_SIZE / PAGE_SIZE;
+        stat->limit_pages = ZRAM_MEM_LIMIT;
+
+        zram->table = kmalloc(stat->pages * sizeof(zram_entry_t));
+        memset(zram->table, 0, stat->pages * sizeof(zram_entry_t));
+        zram->buffer = (u8 *)alloc_kpage(1);
+        zram->zbuffer = (u8 *)alloc_kpage(1);
+        zram->work = (void *)alloc_kpage(div_round_up(LZ4_WORK_SIZE, PAGE_SIZE));
+        zpool_init(zram);
+
+        device_install(DEV_BLOCK, DEV_RAMDISK, zram, stat->name, 0,
+            zram_ioctl, zram_read, zram_write);
+    }
+}
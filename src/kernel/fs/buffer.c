@@ -6,10 +6,13 @@
 #include <xjos/string.h>
 #include <drivers/device.h>
 #include <xjos/errno.h>
+#include <xjos/printk.h>
 
 
 #define LOGK(fmt, args...) DEBUGK(fmt, ##args)
 
+#define BUFFER_SHRINK_BATCH 16  // 缓冲不足时每次回收的空闲 inode 数
+
 // hash
 static list_t *hash_table;   // hash table
 static u32 hash_mask;
@@ -26,6 +29,15 @@ static void *buffer_data;
 static list_t free_list;    // cache free list(LRU)
 static list_t dirty_list;   // cache dirty list [新增: 脏缓冲链表]
 static list_t wait_list;    // wait list
+static list_t head_list;    // 空闲的只有缓冲头的缓冲 (dax)
+
+// 统计信息，通过 /proc/buffers 查看
+static u32 buffer_hits;     // getblk 命中
+static u32 buffer_misses;   // getblk 未命中
+static u32 buffer_reads;    // 读盘次数
+static u32 buffer_writes;   // 写盘次数
+static u32 buffer_dax;      // 直接指向设备内存
+static u32 buffer_heads;    // 只有缓冲头的缓冲数量
 
 /**
  * hash function
@@ -81,21 +93,33 @@ static void hash_remove(buffer_t *bf) {
  * buffer alloc and control
  */
 
+static void buffer_head_init(buffer_t *bf, void *data) {
+    bf->data = data;
+    bf->cache = data;
+    bf->dev = EOF;
+    bf->block = 0;
+    bf->count = 0;
+    bf->dirty = false;
+    bf->valid = false;
+    bf->delay = false;
+    bf->dax = false;
+    bf->lblock = 0;
+    bf->inode = NULL;
+    list_node_init(&bf->hnode);
+    list_node_init(&bf->lru_node);
+    list_node_init(&bf->dirty_node);
+    list_node_init(&bf->inode_node);
+    list_node_init(&bf->jnode);
+    mutex_init(&bf->lock);
+}
+
+
 static buffer_t *get_new_buffer() {
     buffer_t *bf = NULL;
 
     if ((u32)buffer_ptr + sizeof(buffer_t) < (u32)buffer_data) {
         bf = buffer_ptr;
-        bf->data = buffer_data;
-        bf->dev = EOF;
-        bf->block = 0;
-        bf->count = 0;
-        bf->dirty = false;
-        bf->valid = false;
-        list_node_init(&bf->hnode);
-        list_node_init(&bf->lru_node);
-        list_node_init(&bf->dirty_node);
-        mutex_init(&bf->lock);
+        buffer_head_init(bf, buffer_data);
         
         buffer_count++;
         buffer_ptr++;
@@ -117,10 +141,12 @@ static buffer_t *get_free_buffer() {
         // 2. LRU back replace
         if (!list_empty(&free_list)) {
             bf = list_entry(list_popback(&free_list), buffer_t, lru_node);
-            
-            if (bf->dirty) {
-                // must write back first
-                bwrite(bf);
+            assert(!bf->delay);
+
+            if (bf->dirty && bwrite(bf) < EOK) {
+                // 写不回去只能丢弃，否则所有缓冲都可能卡在写失败的块上
+                printk("buffer: lost write of block %d on device %d\n", bf->block, bf->dev);
+                bdirty(bf, false);
             }
             hash_remove(bf);
 
@@ -129,20 +155,75 @@ static buffer_t *get_free_buffer() {
             return bf;
         }
 
-        // 3. wait for buffer release
+        // 3. 回收缓存中的空闲 inode，它们持有 inode 块的引用
+        if (shrink_inodes(BUFFER_SHRINK_BATCH))
+            continue;
+
+        // 4. wait for buffer release
         task_block(running_task(), &wait_list, TASK_WAITING, TIMELESS);
     }
 }
 
 
+/**
+ * direct access
+ *
+ * Blocks of a memory device (ramdisk) are not copied into the cache: the
+ * buffer only holds a head whose data points into device memory, it is
+ * always valid and never dirty. Heads without a data block come from the
+ * same area as normal buffers and are reused through head_list. A dax
+ * buffer leaves the hash table as soon as the last reference is dropped.
+ */
+
+static void *bdax(dev_t dev, idx_t block) {
+    return device_dax(dev, block * BLOCK_SECS, BLOCK_SECS);
+}
+
+
+static buffer_t *get_free_head() {
+    if (!list_empty(&head_list))
+        return list_entry(list_pop(&head_list), buffer_t, lru_node);
+
+    if ((u32)buffer_ptr + sizeof(buffer_t) < (u32)buffer_data) {
+        buffer_t *bf = buffer_ptr++;
+        buffer_head_init(bf, NULL);
+        buffer_heads++;
+        return bf;
+    }
+
+    // 空间用完，借用一个普通缓冲的头
+    return get_free_buffer();
+}
+
+
+static void bdax_release(buffer_t *bf) {
+    hash_remove(bf);
+    bf->dax = false;
+    bf->valid = false;
+    bf->dev = EOF;
+    bf->data = bf->cache;
+
+    if (bf->cache)
+        list_pushback(&free_list, &bf->lru_node);
+    else
+        list_push(&head_list, &bf->lru_node);
+}
+
+
 /**
  * buffer kernel API
  */
 
+// block is in the cache (maybe still being read), used by O_DIRECT
+bool bcached(dev_t dev, idx_t block) {
+    return get_from_hash_table(dev, block) != NULL;
+}
+
 buffer_t *getblk(dev_t dev, idx_t block) {
     buffer_t *bf = get_from_hash_table(dev, block);
     if (bf) {
         // cache hit
+        buffer_hits++;
         bf->count++;
         if (bf->count == 1) {
             // 被复用
@@ -151,8 +232,18 @@ buffer_t *getblk(dev_t dev, idx_t block) {
         return bf;
     }
 
-    // cache miss
-    bf = get_free_buffer();
+    void *addr = bdax(dev, block);
+    if (addr) {
+        buffer_dax++;
+        bf = get_free_head();
+        bf->data = addr;
+        bf->dax = true;
+        bf->valid = true;
+    } else {
+        // cache miss
+        buffer_misses++;
+        bf = get_free_buffer();
+    }
     assert(bf->count == 0);
     assert(bf->dirty == false);
 
@@ -175,6 +266,7 @@ buffer_t *bread(dev_t dev, idx_t block) {
     mutex_lock(&bf->lock);
     if (!bf->valid) {
         // read disk
+        buffer_reads++;
         assert(device_request(bf->dev, bf->data, BLOCK_SECS, bf->block * BLOCK_SECS, 0, REQ_READ) == 0);
 
         bf->dirty = false;
@@ -186,24 +278,32 @@ buffer_t *bread(dev_t dev, idx_t block) {
 }
 
 
-void bwrite(buffer_t *bf) {
+err_t bwrite(buffer_t *bf) {
     assert(bf);
 
     mutex_lock(&bf->lock);
 
     if (!bf->dirty) {     // no need to write
         mutex_unlock(&bf->lock);
-        return;
+        return EOK;
     }
 
     // write to disk
-    assert(device_request(bf->dev, bf->data, BLOCK_SECS, bf->block * BLOCK_SECS, 0, REQ_WRITE) == 0);
+    buffer_writes++;
+    err_t ret = device_request(bf->dev, bf->data, BLOCK_SECS, bf->block * BLOCK_SECS, 0, REQ_WRITE);
+    if (ret < EOK) {
+        // 写失败 (如 zram 内存不足) 时保持脏，之后的回写再次尝试
+        LOGK("write block %d of device %d failed %d\n", bf->block, bf->dev, ret);
+        mutex_unlock(&bf->lock);
+        return ret;
+    }
 
     bdirty(bf, false);
     bf->valid = true;
 
     mutex_unlock(&bf->lock);
-} 
+    return EOK;
+}
 
 
 void brelse(buffer_t *bf) {
@@ -215,7 +315,10 @@ void brelse(buffer_t *bf) {
 
     if (bf->count == 0) {
         // 只要引用归零， 就放入 free_list
-        list_push(&free_list, &bf->lru_node);
+        if (bf->dax)
+            bdax_release(bf);
+        else
+            list_push(&free_list, &bf->lru_node);
         // wake-up waiters
         if (!list_empty(&wait_list)) {
             // wake up one waiting task
@@ -226,6 +329,148 @@ void brelse(buffer_t *bf) {
 }
 
 
+/**
+ * per inode dirty buffers
+ *
+ * A dirty file block is also linked on its owner inode's dirty_list,
+ * sorted by block number, so fsync writes back one file instead of the
+ * whole global dirty_list. The link is dropped when the buffer becomes
+ * clean or the inode is evicted.
+ */
+
+static void bunlink_inode(buffer_t *bf) {
+    if (bf->inode_node.next) {
+        list_remove(&bf->inode_node);
+    }
+    bf->inode = NULL;
+}
+
+
+void bdirty_inode(buffer_t *bf, inode_t *inode, idx_t lblock) {
+    bdirty(bf, true);
+    if (bf->dax)
+        return;
+    if (bf->inode == inode && bf->inode_node.next) {
+        bf->lblock = lblock;
+        return;
+    }
+
+    bunlink_inode(bf);
+    bf->inode = inode;
+    bf->lblock = lblock;
+    list_insert_sort(&inode->dirty_list, &bf->inode_node,
+                     list_node_offset(buffer_t, inode_node, block));
+}
+
+
+// write back dirty buffers of inode whose lblock in [start, end], by block order
+// return the number of blocks written, or the first write error
+int bsync_inode(inode_t *inode, idx_t start, idx_t end) {
+    u32 count = 0;
+    idx_t last = 0;
+    err_t ret = EOK;
+
+    while (true) {
+        buffer_t *bf = NULL;
+        buffer_t *ptr;
+
+        // bwrite may block and the list may change, always rescan after last
+        list_for_each_entry(ptr, &inode->dirty_list, inode_node) {
+            if (count && ptr->block <= last)
+                continue;
+            if (ptr->lblock < start || ptr->lblock > end)
+                continue;
+            bf = ptr;
+            break;
+        }
+        if (!bf)
+            break;
+
+        last = bf->block;
+        bf = getblk(bf->dev, bf->block); // hold it while writing
+        err_t err = bwrite(bf);
+        if (err < EOK && ret == EOK)
+            ret = err;
+        brelse(bf);
+        count++;
+    }
+    return ret < EOK ? ret : (int)count;
+}
+
+
+void bdetach_inode(inode_t *inode) {
+    while (!list_empty(&inode->dirty_list)) {
+        buffer_t *bf = list_entry(inode->dirty_list.head.next, buffer_t, inode_node);
+        bunlink_inode(bf);
+    }
+}
+
+
+/**
+ * delayed allocation
+ *
+ * A delayed buffer holds file data whose disk block has not been chosen yet.
+ * It is not hashed and never sits on the dirty list; the owner inode keeps
+ * the reference until the file system assigns a block (bassign) or drops
+ * the data (bforget).
+ */
+
+buffer_t *bdelay(dev_t dev, idx_t lblock) {
+    buffer_t *bf = get_free_buffer();
+    assert(bf->count == 0);
+    assert(bf->dirty == false);
+
+    bf->count = 1;
+    bf->dev = dev;
+    bf->block = 0;
+    bf->lblock = lblock;
+    bf->delay = true;
+    bf->valid = true;
+    memset(bf->data, 0, BLOCK_SIZE);
+    return bf;
+}
+
+
+void bassign(buffer_t *bf, idx_t block) {
+    assert(bf->delay);
+
+    // a stale copy of a previously freed block may still be cached
+    buffer_t *old = get_from_hash_table(bf->dev, block);
+    if (old) {
+        assert(old->count == 0);
+        list_remove(&old->lru_node);
+        hash_remove(old);
+        bdirty(old, false);
+        old->valid = false;
+        old->dev = EOF;
+        list_pushback(&free_list, &old->lru_node);
+    }
+
+    bf->block = block;
+    bf->delay = false;
+    hash_insert(bf);
+
+    // 直接写入设备内存，不保留副本
+    void *addr = bdax(bf->dev, block);
+    if (addr) {
+        memcpy(addr, bf->data, BLOCK_SIZE);
+        bf->data = addr;
+        bf->dax = true;
+        return;
+    }
+    bdirty(bf, true);
+}
+
+
+void bforget(buffer_t *bf) {
+    assert(bf->delay);
+    bf->delay = false;
+    bf->valid = false;
+    bf->dev = EOF;
+    brelse(bf);
+}
+
+
 void bsync() {
     // [修改] 优化后的 sync，只处理脏链表
     buffer_t *bf = NULL;
@@ -239,6 +484,9 @@ void bsync() {
         flushed_count++;
     }
 
+    // 写完成只表示到了磁盘缓存，包括之前淘汰时写回的块
+    device_sync();
+
     if (flushed_count > 0) {
         LOGK("bsync: [Dirty List Logic] Flushed %d blocks to disk.\n", flushed_count);
     }
@@ -246,7 +494,8 @@ void bsync() {
 
 
 void bdirty(buffer_t *bf, bool dirty) {
-    if (bf->dirty == dirty)
+    // 修改已经在设备内存中
+    if (bf->dirty == dirty || bf->dax)
         return;
 
     if (dirty) {
@@ -260,11 +509,26 @@ void bdirty(buffer_t *bf, bool dirty) {
             list_remove(&bf->dirty_node);
             list_node_init(&bf->dirty_node);
         }
+        bunlink_inode(bf);
     }
     bf->dirty = dirty;
 }
 
 
+void buffer_stat(buffer_stat_t *stat) {
+    stat->count = buffer_count;
+    stat->max = buffer_count + ((u32)buffer_data - (u32)buffer_ptr + BLOCK_SIZE) / (sizeof(buffer_t) + BLOCK_SIZE);
+    stat->free = list_len(&free_list);
+    stat->dirty = list_len(&dirty_list);
+    stat->hits = buffer_hits;
+    stat->misses = buffer_misses;
+    stat->reads = buffer_reads;
+    stat->writes = buffer_writes;
+    stat->dax = buffer_dax;
+    stat->heads = buffer_heads;
+}
+
+
 /**
  * init
  */
@@ -275,6 +539,7 @@ void buffer_init() {
     list_init(&free_list);
     list_init(&dirty_list); // [新增] 初始化脏链表
     list_init(&wait_list);
+    list_init(&head_list);
 
     u32 total_mem_size = KERNEL_BUFFER_SIZE;
     u32 entry_size = sizeof(buffer_t) + BLOCK_SIZE;
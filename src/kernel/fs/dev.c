@@ -61,6 +61,38 @@ void dev_init() {
         sys_mknod(name, IFBLK | 0600, device->dev);
     }
 
+    for (size_t i = 0; true; i++) {
+        device = device_find(DEV_SATA_DISK, i);
+        if (!device)
+            break;
+        sprintf(name, "/dev/%s", device->name);
+        sys_mknod(name, IFBLK | 0600, device->dev);
+    }
+
+    for (size_t i = 0; true; i++) {
+        device = device_find(DEV_SATA_PART, i);
+        if (!device)
+            break;
+        sprintf(name, "/dev/%s", device->name);
+        sys_mknod(name, IFBLK | 0600, device->dev);
+    }
+
+    for (size_t i = 0; true; i++) {
+        device = device_find(DEV_VIRTIO_DISK, i);
+        if (!device)
+            break;
+        sprintf(name, "/dev/%s", device->name);
+        sys_mknod(name, IFBLK | 0600, device->dev);
+    }
+
+    for (size_t i = 0; true; i++) {
+        device = device_find(DEV_VIRTIO_PART, i);
+        if (!device)
+            break;
+        sprintf(name, "/dev/%s", device->name);
+        sys_mknod(name, IFBLK | 0600, device->dev);
+    }
+
     // serial devices
     for (size_t i = 0; true; i++) {
         device = device_find(DEV_SERIAL, i);
@@ -4,10 +4,35 @@
 #include <drivers/device.h>
 #include <xjos/debug.h>
 #include <xjos/string.h>
+#include <xjos/memory.h>
+#include <xjos/arena.h>
+#include <xjos/stdlib.h>
 
 extern void sys_close(fd_t fd);
 
-fd_t sys_open(char *filename, int flags, int mode)
+// 用户路径复制到内核，之后的路径查找不再访问用户内存
+static err_t getname(char *filename, char **name)
+{
+    char *buf = (char *)kmalloc(MAX_PATH_LEN);
+    int len = strncpy_from_user(buf, filename, MAX_PATH_LEN);
+    if (len == MAX_PATH_LEN)
+        len = -ENAMETOOLONG;
+    if (len < EOK)
+    {
+        kfree(buf);
+        return len;
+    }
+    *name = buf;
+    return EOK;
+}
+
+static void putname(char *name)
+{
+    if (name)
+        kfree(name);
+}
+
+static fd_t do_open(char *filename, int flags, int mode)
 {
     char *next;
     inode_t *dir = NULL;
@@ -30,6 +55,14 @@ fd_t sys_open(char *filename, int flags, int mode)
     if (ret < 0)
         goto rollback;
 
+    // 目录不支持直接 I/O
+    if ((flags & O_DIRECT) && ISDIR(inode->mode))
+    {
+        iput(inode);
+        ret = -EINVAL;
+        goto rollback;
+    }
+
 makeup:
     file_t *file;
     fd_t fd = fd_get(&file);
@@ -53,6 +86,17 @@ rollback:
     return ret;
 }
 
+fd_t sys_open(char *filename, int flags, int mode)
+{
+    char *name;
+    err_t ret = getname(filename, &name);
+    if (ret < EOK)
+        return ret;
+    ret = do_open(name, flags, mode);
+    putname(name);
+    return ret;
+}
+
 int sys_creat(char *filename, int mode)
 {
     return sys_open(filename, O_CREAT | O_TRUNC, mode);
@@ -78,7 +122,11 @@ int sys_read(fd_t fd, char *buf, int count)
 
     inode_t *inode = file->inode;
 
-    int len = inode->op->read(inode, buf, count, file->offset);
+    int len;
+    if ((file->flags & O_DIRECT) && ISFILE(inode->mode))
+        len = inode->op->direct_io(inode, buf, count, file->offset, REQ_READ);
+    else
+        len = inode->op->read(inode, buf, count, file->offset);
 
     if (len > 0)
         file->offset += len;
@@ -98,7 +146,11 @@ int sys_readdir(fd_t fd, dirent_t *dir, u32 count)
 
     inode_t *inode = file->inode;
 
-    int len = inode->op->readdir(inode, dir, count, file->offset);
+    dentry_t entry;
+    int len = inode->op->readdir(inode, &entry, count, file->offset);
+
+    if (len > 0 && copy_to_user(dir, &entry, sizeof(dentry_t)) < EOK)
+        return -EFAULT;
 
     if (len > 0)
         file->offset += len;
@@ -106,6 +158,93 @@ int sys_readdir(fd_t fd, dirent_t *dir, u32 count)
     return len;
 }
 
+// 填充 readdirplus 属性，通过目录项缓存和 inode 缓存查找
+static void getdents_stat(inode_t *dir, dentry_t *entry, getdent_t *dent)
+{
+    char *next = NULL;
+    inode_t *inode = NULL;
+    if (dir->op->namei(dir, entry->name, &next, &inode) < EOK)
+        return;
+
+    stat_t statbuf;
+    if (inode->op->stat(inode, &statbuf) == EOK)
+    {
+        dent->mode = statbuf.mode;
+        dent->nlinks = statbuf.nlinks;
+        dent->uid = statbuf.uid;
+        dent->gid = statbuf.gid;
+        dent->size = statbuf.size;
+        dent->mtime = statbuf.mtime;
+    }
+    iput(inode);
+}
+
+// 一次读取尽可能多的目录项到 buf，返回填充的字节数，0 表示目录结束
+int sys_getdents(fd_t fd, void *buf, u32 count, int flags)
+{
+    file_t *file;
+    err_t ret = EOK;
+    if ((ret = fd_check(fd, &file)) < EOK)
+        return ret;
+
+    if ((file->flags & O_ACCMODE) == O_WRONLY)
+        return EOF;
+
+    inode_t *inode = file->inode;
+    if (!ISDIR(inode->mode))
+        return -ENOTDIR;
+
+    dentry_t entry;
+    u32 dbuf[(sizeof(getdent_t) + MAXNAMELEN + 4) / sizeof(u32)];
+    u32 total = 0;
+    while (true)
+    {
+        int len = inode->op->readdir(inode, &entry, 1, file->offset);
+        if (len < 0 && !total)
+            return len;
+        if (len <= 0)
+            break;
+
+        // 空目录项直接跳过
+        if (!entry.nr)
+        {
+            file->offset += len;
+            continue;
+        }
+
+        u32 reclen = (sizeof(getdent_t) + entry.namelen + 1 + 3) & ~3;
+        if (total + reclen > count)
+        {
+            if (!total)
+                return -EINVAL;
+            break;
+        }
+
+        // 在内核中填好一项再复制给用户
+        getdent_t *dent = (getdent_t *)dbuf;
+        memset(dent, 0, sizeof(getdent_t));
+        dent->nr = entry.nr;
+        dent->reclen = reclen;
+        dent->namelen = entry.namelen;
+        memcpy(dent->name, entry.name, entry.namelen);
+        dent->name[entry.namelen] = EOS;
+
+        if (flags & GETDENTS_PLUS)
+            getdents_stat(inode, &entry, dent);
+
+        if (copy_to_user((char *)buf + total, dent, reclen) < EOK)
+        {
+            if (!total)
+                return -EFAULT;
+            break;
+        }
+
+        total += reclen;
+        file->offset += len;
+    }
+    return total;
+}
+
 int sys_write(unsigned int fd, char *buf, int count)
 {
     if (count < 0)
@@ -122,7 +261,11 @@ int sys_write(unsigned int fd, char *buf, int count)
     inode_t *inode = file->inode;
     assert(inode);
 
-    int len = inode->op->write(inode, buf, count, file->offset);
+    int len;
+    if ((file->flags & O_DIRECT) && ISFILE(inode->mode))
+        len = inode->op->direct_io(inode, buf, count, file->offset, REQ_WRITE);
+    else
+        len = inode->op->write(inode, buf, count, file->offset);
 
     if (len > 0)
         file->offset += len;
@@ -130,6 +273,18 @@ int sys_write(unsigned int fd, char *buf, int count)
     return len;
 }
 
+// 查找 offset 之后的数据或空洞，文件系统不支持时整个文件视为数据
+static int do_seek_data(inode_t *inode, off_t offset, int whence)
+{
+    if (offset < 0 || offset >= (off_t)inode->size)
+        return -ENXIO;
+
+    int ret = inode->op->seek(inode, offset, whence);
+    if (ret != -ENOSYS)
+        return ret;
+    return whence == SEEK_DATA ? offset : (off_t)inode->size;
+}
+
 int sys_lseek(fd_t fd, off_t offset, whence_t whence)
 {
     err_t ret = EOK;
@@ -153,6 +308,12 @@ int sys_lseek(fd_t fd, off_t offset, whence_t whence)
         assert(file->inode->size + offset >= 0);
         file->offset = file->inode->size + offset;
         break;
+    case SEEK_DATA:
+    case SEEK_HOLE:
+        if ((ret = do_seek_data(file->inode, offset, whence)) < EOK)
+            return ret;
+        file->offset = ret;
+        break;
     default:
         panic("whence not defined !!!");
         break;
@@ -160,6 +321,73 @@ int sys_lseek(fd_t fd, off_t offset, whence_t whence)
     return file->offset;
 }
 
+// 文件控制
+int sys_fcntl(fd_t fd, int cmd, int arg)
+{
+    file_t *file;
+    err_t ret = EOK;
+    if ((ret = fd_check(fd, &file)) < EOK)
+        return ret;
+
+    inode_t *inode = file->inode;
+    switch (cmd)
+    {
+    case F_GETFL:
+        return file->flags;
+    case F_GETPIPE_SZ:
+        if (inode->type != FS_TYPE_PIPE)
+            return -EBADF;
+        return pipe_getsize(inode);
+    case F_SETPIPE_SZ:
+        if (inode->type != FS_TYPE_PIPE)
+            return -EBADF;
+        if (arg <= 0)
+            return -EINVAL;
+        return pipe_setsize(inode, arg);
+    default:
+        return -EINVAL;
+    }
+}
+
+// 只回写一个文件，不受系统中其它脏数据影响
+static int do_fsync(fd_t fd, off_t offset, size_t len, int flags)
+{
+    file_t *file;
+    err_t ret = EOK;
+    if ((ret = fd_check(fd, &file)) < EOK)
+        return ret;
+
+    inode_t *inode = file->inode;
+    if (inode->type == FS_TYPE_PIPE || inode->type == FS_TYPE_SOCKET)
+        return -EINVAL;
+    return inode->op->fsync(inode, offset, len, flags);
+}
+
+int sys_fsync(fd_t fd)
+{
+    return do_fsync(fd, 0, 0, 0);
+}
+
+int sys_fdatasync(fd_t fd)
+{
+    return do_fsync(fd, 0, 0, FSYNC_DATA);
+}
+
+// 缓冲回写是同步的，两种等待标志不需要额外处理
+int sys_sync_file_range(fd_t fd, off_t offset, off_t nbytes, int flags)
+{
+    if (offset < 0 || nbytes < 0)
+        return -EINVAL;
+    if (flags & ~(SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER))
+        return -EINVAL;
+    if (!(flags & SYNC_FILE_RANGE_WRITE))
+    {
+        file_t *file;
+        return fd_check(fd, &file);
+    }
+    return do_fsync(fd, offset, nbytes, FSYNC_RANGE);
+}
+
 static int dupfd(fd_t fd, fd_t arg)
 {
     int ret = EOK;
@@ -193,14 +421,28 @@ fd_t sys_dup2(fd_t oldfd, fd_t newfd)
     return dupfd(oldfd, newfd);
 }
 
-int sys_stat(char *filename, stat_t *statbuf)
+static int do_stat(char *filename, stat_t *statbuf)
 {
     inode_t *inode = namei(filename);
     if (!inode)
         return -ENOENT;
 
-    int ret = inode->op->stat(inode, statbuf);
+    stat_t kstat;
+    int ret = inode->op->stat(inode, &kstat);
     iput(inode);
+    if (ret == EOK)
+        ret = copy_to_user(statbuf, &kstat, sizeof(stat_t));
+    return ret;
+}
+
+int sys_stat(char *filename, stat_t *statbuf)
+{
+    char *name;
+    err_t ret = getname(filename, &name);
+    if (ret < EOK)
+        return ret;
+    ret = do_stat(name, statbuf);
+    putname(name);
     return ret;
 }
 
@@ -213,7 +455,11 @@ int sys_fstat(fd_t fd, stat_t *statbuf)
 
     inode_t *inode = file->inode;
     assert(inode);
-    return inode->op->stat(inode, statbuf);
+
+    stat_t kstat;
+    if ((ret = inode->op->stat(inode, &kstat)) < EOK)
+        return ret;
+    return copy_to_user(statbuf, &kstat, sizeof(stat_t));
 }
 
 // 控制设备输入输出
@@ -244,7 +490,12 @@ int sys_ioctl(fd_t fd, int cmd, void *args)
 char *sys_getcwd(char *buf, size_t size)
 {
     task_t *task = running_task();
-    strlcpy(buf, task->pwd, size);
+    if (!size)
+        return NULL;
+
+    size_t len = MIN(strlen(task->pwd), size - 1);
+    if (copy_to_user(buf, task->pwd, len) < EOK || clear_user(buf + len, 1) < EOK)
+        return NULL;
     return buf;
 }
 
@@ -324,7 +575,7 @@ void abspath(char *pwd, const char *pathname)
     strlcpy(pwd, tmp, MAX_PATH_LEN);
 }
 
-int sys_chdir(char *pathname)
+static int do_chdir(char *pathname)
 {
     inode_t *inode = namei(pathname);
     if (!inode)
@@ -358,7 +609,18 @@ rollback:
     return ret;
 }
 
-int sys_chroot(char *pathname)
+int sys_chdir(char *pathname)
+{
+    char *name;
+    err_t ret = getname(pathname, &name);
+    if (ret < EOK)
+        return ret;
+    ret = do_chdir(name);
+    putname(name);
+    return ret;
+}
+
+static int do_chroot(char *pathname)
 {
 
     inode_t *inode = namei(pathname);
@@ -383,7 +645,18 @@ rollback:
     return ret;
 }
 
-int sys_mkdir(char *pathname, int mode)
+int sys_chroot(char *pathname)
+{
+    char *name;
+    err_t ret = getname(pathname, &name);
+    if (ret < EOK)
+        return ret;
+    ret = do_chroot(name);
+    putname(name);
+    return ret;
+}
+
+static int do_mkdir(char *pathname, int mode)
 {
     char *next = NULL;
     inode_t *dir = NULL;
@@ -417,7 +690,18 @@ rollback:
     return ret;
 }
 
-int sys_rmdir(char *pathname)
+int sys_mkdir(char *pathname, int mode)
+{
+    char *name;
+    err_t ret = getname(pathname, &name);
+    if (ret < EOK)
+        return ret;
+    ret = do_mkdir(name, mode);
+    putname(name);
+    return ret;
+}
+
+static int do_rmdir(char *pathname)
 {
     char *next = NULL;
     inode_t *dir = NULL;
@@ -451,7 +735,18 @@ rollback:
     return ret;
 }
 
-int sys_link(char *oldname, char *newname)
+int sys_rmdir(char *pathname)
+{
+    char *name;
+    err_t ret = getname(pathname, &name);
+    if (ret < EOK)
+        return ret;
+    ret = do_rmdir(name);
+    putname(name);
+    return ret;
+}
+
+static int do_link(char *oldname, char *newname)
 {
     int ret = -ERROR;
 
@@ -479,7 +774,19 @@ rollback:
     return ret;
 }
 
-int sys_unlink(char *filename)
+int sys_link(char *oldname, char *newname)
+{
+    char *oname = NULL;
+    char *nname = NULL;
+    err_t ret = getname(oldname, &oname);
+    if (ret == EOK && (ret = getname(newname, &nname)) == EOK)
+        ret = do_link(oname, nname);
+    putname(oname);
+    putname(nname);
+    return ret;
+}
+
+static int do_unlink(char *filename)
 {
     int ret = -ERROR;
     char *next = NULL;
@@ -507,7 +814,18 @@ rollback:
     return ret;
 }
 
-int sys_mknod(char *filename, int mode, int dev)
+int sys_unlink(char *filename)
+{
+    char *name;
+    err_t ret = getname(filename, &name);
+    if (ret < EOK)
+        return ret;
+    ret = do_unlink(name);
+    putname(name);
+    return ret;
+}
+
+static int do_mknod(char *filename, int mode, int dev)
 {
     int ret = -ERROR;
     char *next = NULL;
@@ -534,13 +852,68 @@ rollback:
     return ret;
 }
 
-int sys_mount(char *devname, char *dirname, int flags)
+int sys_mknod(char *filename, int mode, int dev)
+{
+    char *name;
+    err_t ret = getname(filename, &name);
+    if (ret < EOK)
+        return ret;
+    ret = do_mknod(name, mode, dev);
+    putname(name);
+    return ret;
+}
+
+// 在 dirname 上安装一个不需要设备的文件系统 (tmpfs, procfs)
+static int mount_nodev(char *dirname, int flags)
+{
+    // tmpfs 占用内核内存，只有 root 可以创建；内核线程启动时挂载 /proc
+    task_t *task = running_task();
+    if (task->uid != KERNEL_USER && !(task->flags & TASK_KERNEL_DS))
+        return -EPERM;
+
+    inode_t *dirinode = namei(dirname);
+    if (!dirinode)
+        return -ENOENT;
+
+    int ret = EOK;
+    if (!ISDIR(dirinode->mode))
+        ret = -EPERM;
+    else if (dirinode->count != 1 || dirinode->mount)
+        ret = -EBUSY;
+
+    if (ret < EOK)
+    {
+        iput(dirinode);
+        return ret;
+    }
+
+    super_t *super;
+    if (flags & MOUNT_TMPFS)
+        super = tmpfs_mount(flags & MOUNT_SIZE_MASK);
+    else
+        super = proc_mount();
+
+    if (!super)
+    {
+        iput(dirinode);
+        return -EBUSY;
+    }
+
+    super->imount = dirinode;
+    dirinode->mount = super->dev;
+    return EOK;
+}
+
+static int do_mount(char *devname, char *dirname, int flags)
 {
     inode_t *devinode = NULL;
     inode_t *dirinode = NULL;
     super_t *super = NULL;
     int ret = -ERROR;
 
+    if (flags & (MOUNT_TMPFS | MOUNT_PROC))
+        return mount_nodev(dirname, flags);
+
     devinode = namei(devname);
     if (!devinode)
     {
@@ -604,7 +977,23 @@ rollback:
     return ret;
 }
 
-int sys_umount(char *target)
+int sys_mount(char *devname, char *dirname, int flags)
+{
+    char *dev = NULL;
+    char *dir = NULL;
+    err_t ret = EOK;
+
+    // tmpfs 和 procfs 不使用设备名
+    if (!(flags & (MOUNT_TMPFS | MOUNT_PROC)))
+        ret = getname(devname, &dev);
+    if (ret == EOK && (ret = getname(dirname, &dir)) == EOK)
+        ret = do_mount(dev, dir, flags);
+    putname(dev);
+    putname(dir);
+    return ret;
+}
+
+static int do_umount(char *target)
 {
     inode_t *inode = NULL;
     super_t *super = NULL;
@@ -643,6 +1032,9 @@ int sys_umount(char *target)
         goto rollback;
     }
 
+    // cached idle inodes would keep the fs busy
+    prune_inodes(dev);
+
     if (inode == super->iroot)
     {
         // One reference is held by the mounted superblock itself and one is the
@@ -656,6 +1048,8 @@ int sys_umount(char *target)
         goto rollback;
     }
 
+    // 先释放 namei 得到的引用，根 inode 才能随超级块一起释放
+    iput(inode);
     iput(super->iroot);
     super->iroot = NULL;
 
@@ -671,7 +1065,18 @@ rollback:
     return ret;
 }
 
-int sys_mkfs(char *devname, int args)
+int sys_umount(char *target)
+{
+    char *name;
+    err_t ret = getname(target, &name);
+    if (ret < EOK)
+        return ret;
+    ret = do_umount(name);
+    putname(name);
+    return ret;
+}
+
+static int do_mkfs(char *devname, int args)
 {
     inode_t *inode = NULL;
     int ret = EOF;
@@ -697,3 +1102,14 @@ rollback:
     iput(inode);
     return ret;
 }
+
+int sys_mkfs(char *devname, int args)
+{
+    char *name;
+    err_t ret = getname(devname, &name);
+    if (ret < EOK)
+        return ret;
+    ret = do_mkfs(name, args);
+    putname(name);
+    return ret;
+}
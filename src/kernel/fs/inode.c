@@ -17,52 +17,108 @@
 extern time_t sys_time();
 
 
-#define INODE_NR 64
+#define INODE_HASH_SIZE 128  // inode 哈希表大小, 2 的幂
+#define INODE_IDLE_MAX 128   // LRU 中空闲 inode 上限
+
+static inode_t root_inode;               // 引导阶段的根目录占位 inode
+static list_t inode_hash[INODE_HASH_SIZE]; // (dev, nr) -> inode
+static list_t inode_lru;                 // 引用为 0 但仍然有效的 inode，表头为最近使用
+static u32 inode_idle;                   // lru 中 inode 数量
+static u32 inode_total;                  // 已分配 inode 数量
+
+static _inline u32 inode_hashfn(dev_t dev, idx_t nr) {
+    return ((u32)dev * 0x9e370001 ^ nr) & (INODE_HASH_SIZE - 1);
+}
+
+// 引用一个 inode，空闲 inode 从 LRU 中取出
+static void inode_grab(inode_t *inode) {
+    if (inode->lru_node.next) {
+        list_remove(&inode->lru_node);
+        inode_idle--;
+    }
+    inode->count++;
+}
+
+// 释放 LRU 中的空闲 inode，有延迟数据的留给 isync 回写
+static bool inode_evict(inode_t *inode) {
+    assert(inode->count == 0);
+    if (!list_empty(&inode->dalloc_list))
+        return false;
+
+    list_remove(&inode->lru_node);
+    inode_idle--;
+    inode->op->evict(inode);
+    return true;
+}
 
-static inode_t inode_table[INODE_NR];
 
 // apply inode
 inode_t *get_free_inode() {
-    // inode_table[0] is reserved as the bootstrap root placeholder.
-    for (size_t i = 1; i < INODE_NR; i++) {
-        inode_t *inode = &inode_table[i];
-        if (inode->type == FS_TYPE_NONE)
-            return inode;
-    }
+    if (inode_idle >= INODE_IDLE_MAX)
+        shrink_inodes(inode_idle - INODE_IDLE_MAX + 1);
+
+    inode_t *inode = (inode_t *)kmalloc(sizeof(inode_t));
+    memset(inode, 0, sizeof(inode_t));
+    inode->dev = EOF;
+    inode->type = FS_TYPE_NONE;
+    list_init(&inode->dalloc_list);
+    list_init(&inode->dirty_list);
 
-    panic("no free inode");
+    inode_total++;
+    return inode;
 }
 
 
 // release inode
 void put_free_inode(inode_t *inode) {
-    assert(inode != inode_table);
+    assert(inode != &root_inode);
     assert(inode->count == 0);
-    inode->dev = EOF;
-    inode->nr = 0;
-    inode->super = NULL;
-    inode->op = NULL;
-    inode->type = FS_TYPE_NONE;
+    assert(list_empty(&inode->dalloc_list));
+    assert(list_empty(&inode->dirty_list));
+    assert(!inode->lru_node.next);
+
+    if (inode->hnode.next)
+        list_remove(&inode->hnode);
+
+    inode_total--;
+    kfree(inode);
 }
 
 
 // get root inode
 inode_t *get_root_inode() {
-    return inode_table;
+    return &root_inode;
+}
+
+
+// 加入哈希表，之后可以被 find_inode 找到
+void hash_inode(inode_t *inode) {
+    assert(!inode->hnode.next);
+    list_push(&inode_hash[inode_hashfn(inode->dev, inode->nr)], &inode->hnode);
+}
+
+
+// 引用归零的 inode 放入 LRU，保留描述符以便再次打开时免去读盘
+void cache_inode(inode_t *inode) {
+    assert(inode->count == 0);
+    assert(inode->hnode.next);
+    list_push(&inode_lru, &inode->lru_node);
+    inode_idle++;
 }
 
 
-// find inode by nr
+// find inode by nr, 调用者负责增加引用计数
 inode_t *find_inode(dev_t dev, idx_t nr) {
-    super_t *super = get_super(dev);
-    assert(super);
-    // inode list
-    list_t *list = &super->inode_list;
+    list_t *list = &inode_hash[inode_hashfn(dev, nr)];
 
     inode_t *inode;
 
-    list_for_each_entry(inode, list, node) {
-        if (inode->nr == nr) {
+    list_for_each_entry(inode, list, hnode) {
+        if (inode->dev == dev && inode->nr == nr) {
+            if (inode->lru_node.next) {
+                list_remove(&inode->lru_node);
+                inode_idle--;
+            }
             return inode;
         }
     }
@@ -71,6 +127,44 @@ inode_t *find_inode(dev_t dev, idx_t nr) {
 }
 
 
+// 从 LRU 尾部回收最多 count 个空闲 inode，返回回收数量
+u32 shrink_inodes(u32 count) {
+    // 回收时回写可能分配内存，再次进入这里 (evict -> kmalloc -> shrink_memory)，
+    // 嵌套的调用直接返回，避免在遍历中途修改 LRU
+    static bool shrinking = false;
+    if (shrinking)
+        return 0;
+    shrinking = true;
+
+    u32 freed = 0;
+    inode_t *inode, *prev;
+
+    list_for_each_entry_safe_reverse(inode, prev, &inode_lru, lru_node) {
+        if (freed >= count)
+            break;
+        if (inode_evict(inode))
+            freed++;
+    }
+    shrinking = false;
+
+    if (freed)
+        LOGK("shrink %d inodes, idle %d total %d\n", freed, inode_idle, inode_total);
+    return freed;
+}
+
+
+// 回写并释放设备 dev 的所有空闲 inode，卸载前调用
+void prune_inodes(dev_t dev) {
+    isync();
+
+    inode_t *inode, *prev;
+    list_for_each_entry_safe_reverse(inode, prev, &inode_lru, lru_node) {
+        if (inode->dev == dev)
+            inode_evict(inode);
+    }
+}
+
+
 inode_t *fit_inode(inode_t *inode) {
     if (!inode || !inode->mount)
         return inode;
@@ -98,16 +192,44 @@ void iput(inode_t *inode) {
 }
 
 
+void isync() {
+    for (size_t i = 0; i < INODE_HASH_SIZE; i++) {
+        inode_t *inode;
+    restart:
+        list_for_each_entry(inode, &inode_hash[i], hnode) {
+            if (list_empty(&inode->dalloc_list) || !inode->op->sync)
+                continue;
+
+            // 回写期间持有引用，防止被回收
+            inode_grab(inode);
+            inode->op->sync(inode);
+            iput(inode);
+
+            // 回写可能阻塞，链表已经改变
+            goto restart;
+        }
+    }
+}
+
+
 void inode_init() {
-    for (size_t i = 0; i < INODE_NR; i++) {
-        inode_t *inode = &inode_table[i];
-        inode->dev = EOF;
-        inode->count = 0;
-        inode->nr = 0;
-        inode->super = NULL;
-        inode->op = NULL;
-        inode->type = FS_TYPE_NONE;
-        inode->rxwaiter = NULL;
-        inode->txwaiter = NULL;
+    for (size_t i = 0; i < INODE_HASH_SIZE; i++) {
+        list_init(&inode_hash[i]);
     }
+    list_init(&inode_lru);
+    inode_idle = 0;
+    inode_total = 0;
+
+    inode_t *inode = &root_inode;
+    inode->dev = EOF;
+    inode->count = 0;
+    inode->nr = 0;
+    inode->super = NULL;
+    inode->op = NULL;
+    inode->type = FS_TYPE_NONE;
+    list_init(&inode->dalloc_list);
+    inode->dalloc_count = 0;
+    list_init(&inode->dirty_list);
+
+    register_shrinker(shrink_inodes);
 }
@@ -0,0 +1,218 @@
+#include <xjos/assert.h>
+#include <xjos/debug.h>
+#include <xjos/arena.h>
+#include <xjos/string.h>
+
+#include "minix.h"
+
+#define LOGK(fmt, args...) DEBUGK(fmt, ##args)
+
+/**
+ * 大目录的内存哈希索引
+ *
+ * 目录项在磁盘上的格式不变，索引只记录 名字哈希 -> 目录项序号 (slot)，
+ * 名字本身仍然从目录块中比较。没有索引的目录继续使用线性扫描。
+ *
+ * inode 被回收时索引暂存在 dindex_cache 中，目录只能通过内存中的 inode 修改，
+ * 再次读入时直接取回，不必线性扫描重建；缓存满时丢弃最久未用的索引。
+ */
+
+#define DINDEX_SIZE_MIN 64  // 初始哈希表大小
+#define DINDEX_FREE_MIN 16  // 初始空闲槽栈大小
+#define DINDEX_CACHE_NR 8   // 暂存的索引数量
+
+#define SLOT_EMPTY ((u32)-1)   // 从未使用
+#define SLOT_DELETED ((u32)-2) // 已删除 (墓碑)
+
+// FNV-1a
+u32 dindex_hash(const char *name, size_t len) {
+    u32 hash = 2166136261u;
+    for (size_t i = 0; i < len && name[i]; i++) {
+        hash ^= (u8)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static dindex_slot_t *dindex_table(u32 size) {
+    dindex_slot_t *table = (dindex_slot_t *)kmalloc(size * sizeof(dindex_slot_t));
+    for (size_t i = 0; i < size; i++) {
+        table[i].hash = 0;
+        table[i].slot = SLOT_EMPTY;
+    }
+    return table;
+}
+
+minix_dindex_t *dindex_create() {
+    minix_dindex_t *index = (minix_dindex_t *)kmalloc(sizeof(minix_dindex_t));
+    index->size = DINDEX_SIZE_MIN;
+    index->used = 0;
+    index->count = 0;
+    index->gen = 0;
+    index->table = dindex_table(index->size);
+
+    index->free_size = DINDEX_FREE_MIN;
+    index->free_count = 0;
+    index->free = (u32 *)kmalloc(index->free_size * sizeof(u32));
+    return index;
+}
+
+void dindex_destroy(minix_dindex_t *index) {
+    if (!index)
+        return;
+    kfree(index->table);
+    kfree(index->free);
+    kfree(index);
+}
+
+static void dindex_put(minix_dindex_t *index, u32 hash, u32 slot) {
+    u32 mask = index->size - 1;
+    for (u32 i = hash & mask; true; i = (i + 1) & mask) {
+        dindex_slot_t *entry = &index->table[i];
+        if (entry->slot == SLOT_EMPTY || entry->slot == SLOT_DELETED) {
+            if (entry->slot == SLOT_EMPTY)
+                index->used++;
+            entry->hash = hash;
+            entry->slot = slot;
+            index->count++;
+            return;
+        }
+    }
+}
+
+// 重建哈希表，负载较高时扩容，同时清理墓碑
+static void dindex_resize(minix_dindex_t *index) {
+    dindex_slot_t *old = index->table;
+    u32 old_size = index->size;
+
+    u32 size = old_size;
+    while (index->count * 2 >= size)
+        size *= 2;
+
+    index->table = dindex_table(size);
+    index->size = size;
+    index->used = 0;
+    index->count = 0;
+    index->gen++;
+
+    for (size_t i = 0; i < old_size; i++) {
+        if (old[i].slot == SLOT_EMPTY || old[i].slot == SLOT_DELETED)
+            continue;
+        dindex_put(index, old[i].hash, old[i].slot);
+    }
+    kfree(old);
+}
+
+void dindex_insert(minix_dindex_t *index, u32 hash, u32 slot) {
+    // 有效项和墓碑超过一半时重建，保证探测链较短
+    if ((index->used + 1) * 2 > index->size)
+        dindex_resize(index);
+    dindex_put(index, hash, slot);
+}
+
+bool dindex_remove(minix_dindex_t *index, u32 hash, u32 slot) {
+    u32 mask = index->size - 1;
+    for (u32 i = hash & mask; index->table[i].slot != SLOT_EMPTY; i = (i + 1) & mask) {
+        dindex_slot_t *entry = &index->table[i];
+        if (entry->hash == hash && entry->slot == slot) {
+            entry->slot = SLOT_DELETED;
+            index->count--;
+            return true;
+        }
+    }
+    return false;
+}
+
+// 遍历哈希值为 hash 的候选目录项，pos 初始为 0，返回 EOF 表示结束
+idx_t dindex_next(minix_dindex_t *index, u32 hash, u32 *pos) {
+    u32 mask = index->size - 1;
+    for (; *pos < index->size; (*pos)++) {
+        dindex_slot_t *entry = &index->table[(hash + *pos) & mask];
+        if (entry->slot == SLOT_EMPTY)
+            break;
+        if (entry->slot == SLOT_DELETED || entry->hash != hash)
+            continue;
+        (*pos)++;
+        return entry->slot;
+    }
+    return EOF;
+}
+
+void dindex_free_push(minix_dindex_t *index, u32 slot) {
+    if (index->free_count == index->free_size) {
+        u32 *free = (u32 *)kmalloc(index->free_size * 2 * sizeof(u32));
+        memcpy(free, index->free, index->free_size * sizeof(u32));
+        kfree(index->free);
+        index->free = free;
+        index->free_size *= 2;
+    }
+    index->free[index->free_count++] = slot;
+}
+
+// 取一个空闲目录项序号，没有返回 EOF
+idx_t dindex_free_pop(minix_dindex_t *index) {
+    if (!index->free_count)
+        return EOF;
+    return index->free[--index->free_count];
+}
+
+typedef struct dindex_cache_t {
+    minix_dindex_t *index; // NULL 表示空闲
+    dev_t dev;
+    idx_t nr;
+    u32 size;  // 暂存时的目录大小和修改时间，取回时校验
+    u32 mtime;
+    u32 stamp; // 暂存顺序，最小的最先丢弃
+} dindex_cache_t;
+
+static dindex_cache_t dindex_cache[DINDEX_CACHE_NR];
+static u32 dindex_stamp;
+
+void dindex_park(dev_t dev, idx_t nr, u32 size, u32 mtime, minix_dindex_t *index) {
+    dindex_cache_t *victim = &dindex_cache[0];
+    for (size_t i = 0; i < DINDEX_CACHE_NR; i++) {
+        dindex_cache_t *cache = &dindex_cache[i];
+        if (!cache->index) {
+            victim = cache;
+            break;
+        }
+        if ((int)(cache->stamp - victim->stamp) < 0)
+            victim = cache;
+    }
+
+    dindex_destroy(victim->index);
+    victim->index = index;
+    victim->dev = dev;
+    victim->nr = nr;
+    victim->size = size;
+    victim->mtime = mtime;
+    victim->stamp = dindex_stamp++;
+}
+
+minix_dindex_t *dindex_unpark(dev_t dev, idx_t nr, u32 size, u32 mtime) {
+    for (size_t i = 0; i < DINDEX_CACHE_NR; i++) {
+        dindex_cache_t *cache = &dindex_cache[i];
+        if (!cache->index || cache->dev != dev || cache->nr != nr)
+            continue;
+
+        minix_dindex_t *index = cache->index;
+        cache->index = NULL;
+        if (cache->size == size && cache->mtime == mtime)
+            return index;
+
+        dindex_destroy(index);
+        return NULL;
+    }
+    return NULL;
+}
+
+// 卸载时丢弃设备上暂存的索引
+void dindex_drop(dev_t dev) {
+    for (size_t i = 0; i < DINDEX_CACHE_NR; i++) {
+        dindex_cache_t *cache = &dindex_cache[i];
+        if (cache->index && cache->dev == dev) {
+            dindex_destroy(cache->index);
+            cache->index = NULL;
+        }
+    }
+}
@@ -0,0 +1,499 @@
+#include <xjos/assert.h>
+#include <xjos/debug.h>
+#include <xjos/arena.h>
+#include <xjos/string.h>
+#include <xjos/stdlib.h>
+#include <xjos/memory.h>
+#include <xjos/interrupt.h>
+#include <xjos/task.h>
+#include <drivers/device.h>
+
+#include "minix.h"
+
+#define LOGK(fmt, args...) DEBUGK(fmt, ##args)
+
+/**
+ * 元数据日志 (write-ahead)
+ *
+ * 日志区位于最后一个逻辑块之后，第一块是日志超级块，之后顺序记录事务：
+ *     描述块 + 元数据块副本 ... + 提交块
+ *
+ * 修改元数据的操作是一个句柄，修改过的缓冲加入运行中的事务，被固定在内存中
+ * 且不标记为脏，提交之前不会写回原位置。很多操作合并成一次顺序写提交 (组提交)，
+ * 提交之后缓冲才变脏，由普通的回写写回原位置；日志快满时才做检查点：
+ * 回写全部脏缓冲后从头开始记录。挂载时重放完整提交的事务，不需要 fsck。
+ *
+ * 只记录元数据，文件数据直接写回原位置。
+ */
+
+#define JOURNAL_PAGE_BLOCKS (PAGE_SIZE / BLOCK_SIZE) // 一次顺序写的最大块数
+
+static minix_journal_t *journal_get(super_t *super) {
+    minix_sb_info_t *info = (minix_sb_info_t *)super->info;
+    if (!info)
+        return NULL;
+    return info->journal;
+}
+
+static void journal_io(minix_journal_t *j, u32 rel, void *data, u32 count, int flags, int type) {
+    assert(device_request(j->dev, data, count * BLOCK_SECS, (j->base + rel) * BLOCK_SECS, flags, type) == EOK);
+}
+
+static u32 journal_checksum(u32 sum, void *data) {
+    u32 *ptr = (u32 *)data;
+    for (size_t i = 0; i < BLOCK_SIZE / sizeof(u32); i++) {
+        sum = ((sum << 1) | (sum >> 31)) + ptr[i];
+    }
+    return sum;
+}
+
+// 事务占用的日志块数
+static u32 journal_need(u32 count, u32 nrevoke) {
+    return div_round_up(count, JOURNAL_TAGS) + count + div_round_up(nrevoke, JOURNAL_TAGS) + 1;
+}
+
+static bool journal_logged(minix_journal_t *j, idx_t block, bool remove) {
+    for (size_t i = 0; i < j->nlogged; i++) {
+        if (j->logged[i] != block)
+            continue;
+        if (remove)
+            j->logged[i] = j->logged[--j->nlogged];
+        return true;
+    }
+    return false;
+}
+
+static void journal_wait(minix_journal_t *j) {
+    task_block(running_task(), &j->wait_list, TASK_BLOCKED, TIMELESS);
+}
+
+static void journal_wakeup(minix_journal_t *j) {
+    while (!list_empty(&j->wait_list)) {
+        task_t *task = list_entry(list_pop(&j->wait_list), task_t, node);
+        task_unblock(task, EOK);
+    }
+}
+
+static void journal_flush(minix_journal_t *j, int flags) {
+    if (!j->pending)
+        return;
+    journal_io(j, j->head, j->page, j->pending, flags, REQ_WRITE);
+    j->head += j->pending;
+    j->pending = 0;
+}
+
+// 顺序追加一块，凑满一页再写
+static void journal_append(minix_journal_t *j, void *data) {
+    memcpy(j->page + j->pending * BLOCK_SIZE, data, BLOCK_SIZE);
+    j->pending++;
+    if (j->pending == JOURNAL_PAGE_BLOCKS)
+        journal_flush(j, 0);
+}
+
+static void journal_write_super(minix_journal_t *j) {
+    memset(j->page, 0, BLOCK_SIZE * 2);
+    journal_super_t *js = (journal_super_t *)j->page;
+    js->header.magic = JOURNAL_MAGIC;
+    js->header.type = JOURNAL_SUPER;
+    js->header.sequence = j->sequence;
+    js->blocks = j->blocks;
+
+    // 同时清除第一个日志块，重放从这里停止
+    // 写回原位置的数据可能还在磁盘缓存里，先 flush 再丢弃日志
+    journal_io(j, 0, j->page, 2, REQ_PREFLUSH | REQ_FUA, REQ_WRITE);
+}
+
+// 检查点：已提交的元数据全部写回原位置，之后日志从头开始
+static void journal_checkpoint(minix_journal_t *j) {
+    bsync();
+    j->head = 1;
+    j->nlogged = 0;
+    journal_write_super(j);
+    LOGK("journal checkpoint dev %d seq %d\n", j->dev, j->sequence);
+}
+
+// 结束运行中的事务，缓冲交给普通回写
+static void journal_release(minix_journal_t *j) {
+    while (!list_empty(&j->running)) {
+        buffer_t *bf = list_entry(list_pop(&j->running), buffer_t, jnode);
+        bdirty(bf, true);
+        brelse(bf);
+    }
+    j->count = 0;
+}
+
+static void journal_header(journal_desc_t *desc, int type, u32 sequence) {
+    memset(desc, 0, BLOCK_SIZE);
+    desc->header.magic = JOURNAL_MAGIC;
+    desc->header.type = type;
+    desc->header.sequence = sequence;
+}
+
+// 把运行中的事务顺序写入日志，调用时没有进行中的操作
+static void journal_write(minix_journal_t *j) {
+    if (!j->count && !j->nrevoke)
+        return;
+
+    if (j->head + journal_need(j->count, j->nrevoke) > j->blocks) {
+        // 事务超出日志容量，只会在大量并发操作时发生：直接写回原位置
+        journal_release(j);
+        journal_checkpoint(j);
+        j->nrevoke = 0;
+        return;
+    }
+
+    journal_desc_t *desc = (journal_desc_t *)kmalloc(BLOCK_SIZE);
+    u32 checksum = 0;
+    list_node_t *node = j->running.head.next;
+    while (node != &j->running.head) {
+        journal_header(desc, JOURNAL_DESC, j->sequence);
+
+        list_node_t *ptr = node;
+        for (; ptr != &j->running.head && desc->count < JOURNAL_TAGS; ptr = ptr->next) {
+            buffer_t *bf = list_entry(ptr, buffer_t, jnode);
+            desc->blocks[desc->count++] = bf->block;
+        }
+        journal_append(j, desc);
+
+        for (; node != ptr; node = node->next) {
+            buffer_t *bf = list_entry(node, buffer_t, jnode);
+            checksum = journal_checksum(checksum, bf->data);
+            journal_append(j, bf->data);
+            if (!journal_logged(j, bf->block, false))
+                j->logged[j->nlogged++] = bf->block;
+        }
+    }
+
+    for (size_t i = 0; i < j->nrevoke;) {
+        journal_header(desc, JOURNAL_REVOKE, j->sequence);
+        for (; i < j->nrevoke && desc->count < JOURNAL_TAGS; i++)
+            desc->blocks[desc->count++] = j->revoke[i];
+        checksum = journal_checksum(checksum, desc);
+        journal_append(j, desc);
+    }
+
+    // 副本全部写出之后再写提交块
+    journal_flush(j, 0);
+
+    journal_header(desc, JOURNAL_COMMIT, j->sequence);
+    journal_commit_t *commit = (journal_commit_t *)desc;
+    commit->count = j->count;
+    commit->checksum = checksum;
+    journal_append(j, commit);
+
+    // PREFLUSH 保证副本先于提交块落盘，FUA 保证返回时事务已持久
+    journal_flush(j, REQ_PREFLUSH | REQ_FUA);
+    kfree(desc);
+
+    LOGK("journal commit dev %d seq %d blocks %d revoke %d\n", j->dev, j->sequence, j->count, j->nrevoke);
+
+    journal_release(j);
+    j->nrevoke = 0;
+    j->sequence++;
+
+    // 剩余空间不够容纳一个满事务时做检查点
+    if (j->head + journal_need(JOURNAL_TXN_MAX * 2, JOURNAL_TAGS) > j->blocks)
+        journal_checkpoint(j);
+}
+
+static void journal_do_commit(minix_journal_t *j) {
+    assert(!j->handles && !j->committing);
+    j->committing = true;
+    journal_write(j);
+    j->committing = false;
+    journal_wakeup(j);
+}
+
+// 开始一个修改元数据的操作，可以嵌套
+void journal_begin(super_t *super) {
+    minix_journal_t *j = journal_get(super);
+    if (!j)
+        return;
+
+    bool intr = interrupt_disable();
+    while (j->committing)
+        journal_wait(j);
+
+    // 事务足够大时在两个操作之间提交
+    if (!j->handles && j->count >= JOURNAL_TXN_MAX)
+        journal_do_commit(j);
+
+    j->handles++;
+    set_interrupt_state(intr);
+}
+
+void journal_end(super_t *super) {
+    minix_journal_t *j = journal_get(super);
+    if (!j)
+        return;
+
+    bool intr = interrupt_disable();
+    assert(j->handles);
+    j->handles--;
+    if (!j->handles)
+        journal_wakeup(j);
+    set_interrupt_state(intr);
+}
+
+// 修改过的元数据缓冲加入运行中的事务，没有日志返回 false
+bool journal_dirty(super_t *super, buffer_t *bf) {
+    minix_journal_t *j = journal_get(super);
+    if (!j)
+        return false;
+
+    // 句柄之外的修改不能保证原子性，直接写回
+    if (!j->handles || j->committing)
+        return false;
+
+    if (bf->jnode.next)
+        return true;
+
+    // 已提交尚未写回的内容仍然在日志中
+    bdirty(bf, false);
+
+    bf->count++; // 提交之前固定在内存中
+    list_push(&j->running, &bf->jnode);
+    j->count++;
+    return true;
+}
+
+// 元数据块被释放：移出运行中的事务，已经写入日志的记录撤销，
+// 避免重放时旧副本覆盖重新分配后的内容
+void journal_forget(super_t *super, idx_t block) {
+    minix_journal_t *j = journal_get(super);
+    if (!j)
+        return;
+
+    buffer_t *bf;
+    list_for_each_entry(bf, &j->running, jnode) {
+        if (bf->block != block)
+            continue;
+        list_remove(&bf->jnode);
+        j->count--;
+        brelse(bf);
+        break;
+    }
+
+    if (!journal_logged(j, block, true))
+        return;
+
+    if (j->nrevoke == j->revoke_size) {
+        u32 *revoke = (u32 *)kmalloc(j->revoke_size * 2 * sizeof(u32));
+        memcpy(revoke, j->revoke, j->revoke_size * sizeof(u32));
+        kfree(j->revoke);
+        j->revoke = revoke;
+        j->revoke_size *= 2;
+    }
+    j->revoke[j->nrevoke++] = block;
+}
+
+// 提交运行中的事务，已经被其它任务提交时直接返回；没有日志返回 false
+bool journal_commit(super_t *super) {
+    minix_journal_t *j = journal_get(super);
+    if (!j)
+        return false;
+
+    bool intr = interrupt_disable();
+    u32 sequence = j->sequence;
+    while (j->sequence == sequence && (j->committing || j->handles))
+        journal_wait(j);
+
+    if (j->sequence == sequence)
+        journal_do_commit(j);
+    set_interrupt_state(intr);
+    return true;
+}
+
+// 重放时的撤销记录
+typedef struct journal_revoke_t {
+    u32 block;
+    u32 sequence;
+} journal_revoke_t;
+
+// 检查从 rel 开始、序号为 sequence 的事务是否完整，
+// 返回提交块之后的位置，不完整返回 0
+static u32 journal_scan(minix_journal_t *j, u32 rel, u32 sequence, u32 *revokes) {
+    u32 checksum = 0;
+    u32 count = 0;
+    u32 nrevoke = 0;
+    while (rel < j->blocks) {
+        journal_io(j, rel++, j->page, 1, 0, REQ_READ);
+        journal_desc_t *desc = (journal_desc_t *)j->page;
+        if (desc->header.magic != JOURNAL_MAGIC || desc->header.sequence != sequence)
+            return 0;
+
+        if (desc->header.type == JOURNAL_COMMIT) {
+            journal_commit_t *commit = (journal_commit_t *)j->page;
+            if (commit->count != count || commit->checksum != checksum)
+                return 0;
+            *revokes += nrevoke;
+            return rel;
+        }
+
+        u32 n = desc->count;
+        if (n > JOURNAL_TAGS)
+            return 0;
+
+        if (desc->header.type == JOURNAL_REVOKE) {
+            checksum = journal_checksum(checksum, desc);
+            nrevoke += n;
+            continue;
+        }
+
+        if (desc->header.type != JOURNAL_DESC || rel + n > j->blocks)
+            return 0;
+
+        for (size_t i = 0; i < n; i++) {
+            journal_io(j, rel++, j->page, 1, 0, REQ_READ);
+            checksum = journal_checksum(checksum, j->page);
+        }
+        count += n;
+    }
+    return 0;
+}
+
+static bool journal_revoked(journal_revoke_t *table, u32 count, u32 block, u32 sequence) {
+    for (size_t i = 0; i < count; i++) {
+        if (table[i].block == block && table[i].sequence > sequence)
+            return true;
+    }
+    return false;
+}
+
+// 遍历 [1, end) 中的完整事务：table 为空时收集撤销记录，否则写入副本
+static u32 journal_walk(minix_journal_t *j, u32 end, journal_desc_t *desc,
+                        journal_revoke_t *table, u32 count, bool apply) {
+    u32 sequence = j->sequence;
+    u32 rel = 1;
+    while (rel < end) {
+        journal_io(j, rel++, desc, 1, 0, REQ_READ);
+        switch (desc->header.type) {
+        case JOURNAL_COMMIT:
+            sequence++;
+            break;
+        case JOURNAL_REVOKE:
+            for (size_t i = 0; !apply && i < desc->count; i++) {
+                table[count].block = desc->blocks[i];
+                table[count].sequence = sequence;
+                count++;
+            }
+            break;
+        case JOURNAL_DESC:
+            for (size_t i = 0; i < desc->count; i++, rel++) {
+                if (!apply || journal_revoked(table, count, desc->blocks[i], sequence))
+                    continue;
+                journal_io(j, rel, j->page, 1, 0, REQ_READ);
+                buffer_t *bf = getblk(j->dev, desc->blocks[i]);
+                memcpy(bf->data, j->page, BLOCK_SIZE);
+                bf->valid = true;
+                bdirty(bf, true);
+                brelse(bf);
+            }
+            break;
+        }
+    }
+    return count;
+}
+
+static u32 journal_replay(minix_journal_t *j) {
+    u32 txns = 0;
+    u32 revokes = 0;
+    u32 rel = 1;
+    u32 end;
+    while ((end = journal_scan(j, rel, j->sequence + txns, &revokes))) {
+        rel = end;
+        txns++;
+    }
+    if (!txns)
+        return 0;
+
+    journal_desc_t *desc = (journal_desc_t *)kmalloc(BLOCK_SIZE);
+    journal_revoke_t *table = NULL;
+    if (revokes)
+        table = (journal_revoke_t *)kmalloc(revokes * sizeof(journal_revoke_t));
+
+    u32 count = journal_walk(j, rel, desc, table, 0, false);
+    journal_walk(j, rel, desc, table, count, true);
+
+    if (table)
+        kfree(table);
+    kfree(desc);
+    j->sequence += txns;
+    return txns;
+}
+
+// mkfs 时初始化日志区
+void journal_format(dev_t dev, idx_t base, u32 blocks) {
+    minix_journal_t journal;
+    journal.dev = dev;
+    journal.base = base;
+    journal.blocks = blocks;
+    journal.sequence = 1;
+    journal.page = (char *)alloc_kpage(1);
+    journal_write_super(&journal);
+    free_kpage((u32)journal.page, 1);
+}
+
+// 挂载时检测日志区，重放已提交的事务
+err_t journal_load(super_t *super, idx_t base) {
+    minix_sb_info_t *info = (minix_sb_info_t *)super->info;
+    info->journal = NULL;
+
+    u32 total = device_ioctl(super->dev, DEV_CMD_SECTOR_SIZE, NULL, 0) / BLOCK_SECS;
+    if (base + JOURNAL_MIN_BLOCKS > total)
+        return EOK;
+
+    minix_journal_t *j = (minix_journal_t *)kmalloc(sizeof(minix_journal_t));
+    j->dev = super->dev;
+    j->base = base;
+    j->page = (char *)alloc_kpage(1);
+
+    journal_io(j, 0, j->page, 1, 0, REQ_READ);
+    journal_super_t *js = (journal_super_t *)j->page;
+    if (js->header.magic != JOURNAL_MAGIC || js->header.type != JOURNAL_SUPER ||
+        js->blocks < JOURNAL_MIN_BLOCKS || base + js->blocks > total) {
+        free_kpage((u32)j->page, 1);
+        kfree(j);
+        return EOK;
+    }
+
+    j->blocks = js->blocks;
+    j->sequence = js->header.sequence;
+    j->head = 1;
+    j->pending = 0;
+    j->count = 0;
+    j->handles = 0;
+    j->committing = false;
+    list_init(&j->running);
+    list_init(&j->wait_list);
+
+    j->nlogged = 0;
+    j->logged = (u32 *)kmalloc(j->blocks * sizeof(u32));
+    j->nrevoke = 0;
+    j->revoke_size = JOURNAL_TAGS;
+    j->revoke = (u32 *)kmalloc(j->revoke_size * sizeof(u32));
+
+    u32 count = journal_replay(j);
+    if (count)
+        LOGK("journal replay dev %d %d transactions\n", j->dev, count);
+
+    journal_checkpoint(j);
+    info->journal = j;
+    return EOK;
+}
+
+// 卸载时提交并做检查点
+void journal_destroy(super_t *super) {
+    minix_journal_t *j = journal_get(super);
+    if (!j)
+        return;
+
+    journal_commit(super);
+    journal_checkpoint(j);
+
+    ((minix_sb_info_t *)super->info)->journal = NULL;
+    free_kpage((u32)j->page, 1);
+    kfree(j->logged);
+    kfree(j->revoke);
+    kfree(j);
+}
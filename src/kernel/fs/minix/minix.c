@@ -17,66 +17,193 @@
 
 extern time_t sys_time();
 
+// 修改元数据块后调用，开启日志时记入运行中的事务
+static void meta_dirty(super_t *super, buffer_t *buf) {
+    if (!journal_dirty(super, buf)) {
+        bdirty(buf, true);
+    }
+}
+
+// 属于 inode 的元数据块 (索引块、目录块)，没有日志时由 fsync 回写
+static void meta_dirty_inode(inode_t *inode, buffer_t *buf) {
+    if (!journal_dirty(inode->super, buf)) {
+        bdirty_inode(buf, inode, EOF);
+    }
+}
+
+// inode 在 inode 块中的位置
+static void *inode_disk(inode_t *inode) {
+    minix_sb_info_t *info = (minix_sb_info_t *)inode->super->info;
+    u32 per_block = BLOCK_SIZE / info->inode_size;
+    return inode->buf->data + ((inode->nr - 1) % per_block) * info->inode_size;
+}
+
+// 从 inode 块读出描述符，转换成内存中统一的格式
+static void minix_inode_read(inode_t *inode) {
+    minix_sb_info_t *info = (minix_sb_info_t *)inode->super->info;
+    minix_inode_t *minode = (minix_inode_t *)inode->desc;
+
+    if (info->version != 1) {
+        memcpy(minode, inode_disk(inode), sizeof(minix_inode_t));
+        return;
+    }
+
+    minix1_inode_t *dinode = (minix1_inode_t *)inode_disk(inode);
+    memset(minode, 0, sizeof(minix_inode_t));
+    minode->mode = dinode->mode;
+    minode->nlinks = dinode->nlinks;
+    minode->uid = dinode->uid;
+    minode->gid = dinode->gid;
+    minode->size = dinode->size;
+    minode->atime = minode->mtime = minode->ctime = dinode->mtime;
+    for (size_t i = 0; i < 9; i++) {
+        minode->zone[i] = dinode->zone[i];
+    }
+}
+
+// 修改 inode 描述符之后调用，写回 inode 块并标记脏
+static void minix_inode_dirty(inode_t *inode) {
+    minix_sb_info_t *info = (minix_sb_info_t *)inode->super->info;
+    minix_inode_t *minode = (minix_inode_t *)inode->desc;
+
+    if (info->version != 1) {
+        minode->atime = inode->atime;
+        minode->ctime = inode->ctime;
+        memcpy(inode_disk(inode), minode, sizeof(minix_inode_t));
+    } else {
+        minix1_inode_t *dinode = (minix1_inode_t *)inode_disk(inode);
+        dinode->mode = minode->mode;
+        dinode->nlinks = minode->nlinks;
+        dinode->uid = minode->uid;
+        dinode->gid = minode->gid;
+        dinode->size = minode->size;
+        dinode->mtime = minode->mtime;
+        for (size_t i = 0; i < 9; i++) {
+            assert(minode->zone[i] <= 0xFFFF);
+            dinode->zone[i] = minode->zone[i];
+        }
+    }
+    meta_dirty(inode->super, inode->buf);
+}
+
+// 索引块中的第 index 个块号，v1 为 16 位
+static inline idx_t index_get(minix_sb_info_t *info, void *data, idx_t index) {
+    if (info->version == 1) {
+        return ((u16 *)data)[index];
+    }
+    return ((u32 *)data)[index];
+}
+
+static inline void index_set(minix_sb_info_t *info, void *data, idx_t index, idx_t nr) {
+    if (info->version == 1) {
+        assert(nr <= 0xFFFF);
+        ((u16 *)data)[index] = nr;
+    } else {
+        ((u32 *)data)[index] = nr;
+    }
+}
+
 // 分配一个文件块
-idx_t minix_balloc(super_t *super) {
-    buffer_t *buf = NULL;
-    idx_t bit = EOF;
-    bitmap_t map;
+// 从 goal 开始向后查找第一个空闲块，使连续写入得到连续的物理块
+idx_t minix_balloc(super_t *super, idx_t goal) {
+    minix_sb_info_t *info = (minix_sb_info_t *)super->info;
 
-    minix_super_t *desc = (minix_super_t *)super->desc;
-    idx_t bidx = 2 + desc->imap_blocks;
+    idx_t bidx = 2 + info->imap_blocks;
+    idx_t base = info->firstdatazone - 1;
+    u32 total = info->zones - base; // 位图中有效的位数
 
-    for (size_t i = 0; i < desc->zmap_blocks; i++) {
-        buf = bread(super->dev, bidx + i);
+    if (goal < info->firstdatazone || goal >= info->zones) {
+        goal = info->firstdatazone;
+    }
+
+    u32 bit = goal - base;
+    for (u32 scanned = 0; scanned < total;) {
+        buffer_t *buf = bread(super->dev, bidx + bit / BLOCK_BITS);
         assert(buf);
 
-        // 将整个缓冲区作为位图
-        bitmap_make(&map, buf->data, BLOCK_SIZE, i * BLOCK_BITS + desc->firstdatazone - 1);
+        u8 *bits = (u8 *)buf->data;
+        u32 end = MIN((bit / BLOCK_BITS + 1) * BLOCK_BITS, total);
+
+        for (; bit < end && scanned < total; bit++, scanned++) {
+            u32 off = bit % BLOCK_BITS;
+            if (bits[off / 8] == 0xFF && (off % 8) == 0 && bit + 8 <= end) {
+                bit += 7;
+                scanned += 7;
+                continue;
+            }
+            if (bits[off / 8] & (1 << (off % 8))) {
+                continue;
+            }
+
+            bits[off / 8] |= (1 << (off % 8));
+            meta_dirty(super, buf);
+            brelse(buf);
+
+            assert(info->free_zones > 0);
+            info->free_zones--;
+            return bit + base;
+        }
 
-        // 从位图中扫描一位
-        bit = bitmap_scan(&map, 1);
-        if (bit != EOF) {
-            // 如果扫描成功，则 标记缓冲区脏，中止查找
-            assert(bit < desc->zones);
-            buf->dirty = true;
-            break;
+        brelse(buf);
+        if (bit >= total) {
+            bit = 0; // 回绕到位图开头
         }
     }
-    brelse(buf); // todo 调试期间强同步
-    return bit;
+    return 0;
+}
+
+// 统计空闲逻辑块数量
+static u32 minix_count_free(super_t *super) {
+    minix_sb_info_t *info = (minix_sb_info_t *)super->info;
+    idx_t bidx = 2 + info->imap_blocks;
+    idx_t base = info->firstdatazone - 1;
+    u32 total = info->zones - base;
+    u32 count = 0;
+
+    for (u32 bit = 0; bit < total; bit++) {
+        if (bit % BLOCK_BITS == 0) {
+            buffer_t *buf = bread(super->dev, bidx + bit / BLOCK_BITS);
+            u8 *bits = (u8 *)buf->data;
+            u32 end = MIN(bit + BLOCK_BITS, total);
+            for (u32 i = bit; i < end; i++) {
+                u32 off = i % BLOCK_BITS;
+                if (!(bits[off / 8] & (1 << (off % 8)))) {
+                    count++;
+                }
+            }
+            brelse(buf);
+        }
+    }
+    return count;
 }
 
 // 释放一个文件块
 void minix_bfree(super_t *super, idx_t idx) {
-    minix_super_t *desc = (minix_super_t *)super->desc;
-    assert(idx < desc->zones);
-
-    buffer_t *buf;
-    bitmap_t map;
+    minix_sb_info_t *info = (minix_sb_info_t *)super->info;
+    assert(idx >= info->firstdatazone && idx < info->zones);
 
-    idx_t bidx = 2 + desc->imap_blocks;
+    // 位图第 0 位对应 firstdatazone - 1，和 minix_balloc 一致
+    idx_t bidx = 2 + info->imap_blocks;
+    u32 bit = idx - (info->firstdatazone - 1);
 
-    for (size_t i = 0; i < desc->zmap_blocks; i++) {
-        // 跳过开始的块
-        if (idx > BLOCK_BITS * (i + 1)) {
-            continue;
-        }
+    buffer_t *buf = bread(super->dev, bidx + bit / BLOCK_BITS);
+    assert(buf);
 
-        buf = bread(super->dev, bidx + i);
-        assert(buf);
+    u8 *bits = (u8 *)buf->data;
+    u32 off = bit % BLOCK_BITS;
 
-        // 将整个缓冲区作为位图
-        bitmap_make(&map, buf->data, BLOCK_SIZE, BLOCK_BITS * i + desc->firstdatazone - 1);
+    // 将 idx 对应的位图置位 0
+    assert(bits[off / 8] & (1 << (off % 8)));
+    bits[off / 8] &= ~(1 << (off % 8));
 
-        // 将 idx 对应的位图置位 0
-        assert(bitmap_test(&map, idx));
-        bitmap_set(&map, idx, 0);
+    // 释放的可能是索引块或目录块，重放日志时不能覆盖新的内容
+    journal_forget(super, idx);
 
-        // 标记缓冲区脏
-        buf->dirty = true;
-        break;
-    }
+    // 标记缓冲区脏
+    meta_dirty(super, buf);
     brelse(buf); // todo 调试期间强同步
+
+    info->free_zones++;
 }
 
 // 分配一个文件系统 inode
@@ -85,17 +212,17 @@ idx_t minix_ialloc(super_t *super) {
     idx_t bit = EOF;
     bitmap_t map;
 
-    minix_super_t *desc = (minix_super_t *)super->desc;
+    minix_sb_info_t *info = (minix_sb_info_t *)super->info;
     idx_t bidx = 2;
-    for (size_t i = 0; i < desc->imap_blocks; i++) {
+    for (size_t i = 0; i < info->imap_blocks; i++) {
         buf = bread(super->dev, bidx + i);
         assert(buf);
 
         bitmap_make(&map, buf->data, BLOCK_SIZE, i * BLOCK_BITS + 1);
         bit = bitmap_scan(&map, 1);
         if (bit != EOF) {
-            assert(bit <= desc->inodes);
-            buf->dirty = true;
+            assert(bit <= info->inodes);
+            meta_dirty(super, buf);
             break;
         }
     }
@@ -105,14 +232,14 @@ idx_t minix_ialloc(super_t *super) {
 
 // 释放一个文件系统 inode
 void minix_ifree(super_t *super, idx_t idx) {
-    minix_super_t *desc = (minix_super_t *)super->desc;
-    assert(idx <= desc->inodes);
+    minix_sb_info_t *info = (minix_sb_info_t *)super->info;
+    assert(idx <= info->inodes);
 
     buffer_t *buf;
     bitmap_t map;
 
     idx_t bidx = 2;
-    for (size_t i = 0; i < desc->imap_blocks; i++) {
+    for (size_t i = 0; i < info->imap_blocks; i++) {
         if (idx > BLOCK_BITS * (i + 1)) {
             continue;
         }
@@ -123,86 +250,228 @@ void minix_ifree(super_t *super, idx_t idx) {
         bitmap_make(&map, buf->data, BLOCK_SIZE, i * BLOCK_BITS + 1);
         assert(bitmap_test(&map, idx));
         bitmap_set(&map, idx, 0);
-        buf->dirty = true;
+        meta_dirty(super, buf);
         break;
     }
     brelse(buf); // todo 调试期间强同步
 }
 
 // 获取 inode 第 block 块的索引值
-// 如果不存在 且 create 为 true，则创建
-idx_t minix_bmap(inode_t *inode, idx_t block, bool create) {
+// 如果不存在 且 create 为 true，则在 goal 附近创建
+// 不存在时 hole 不为空则返回从 block 开始连续未映射的块数
+static idx_t minix_bmap_goal(inode_t *inode, idx_t block, bool create, idx_t goal, u32 *hole) {
+    minix_sb_info_t *info = (minix_sb_info_t *)inode->super->info;
+
     // 确保 block 合法
-    assert(block >= 0 && block < TOTAL_BLOCK);
+    assert(block >= 0 && block < info->max_blocks);
 
     // 数组索引
-    u16 index = block;
+    idx_t index = block;
 
     minix_inode_t *minode = (minix_inode_t *)inode->desc;
 
-    // 数组
-    u16 *array = minode->zone;
-
-    // 缓冲区
-    buffer_t *buf = inode->buf;
-
-    // 用于下面的 brelse，传入参数 inode 的 buf 不应该释放
-    buf->count += 1;
+    // 索引块缓冲，为空时处理 inode 中的块号数组
+    buffer_t *buf = NULL;
 
     // 当前处理级别
     int level = 0;
 
     // 当前子级别块数量
-    int divider = 1;
+    u32 divider = 1;
 
-    // 直接块
-    if (block < DIRECT_BLOCK) {
-        goto reckon;
-    }
+    // 当前索引项管理的块数
+    u32 covers = 1;
 
-    block -= DIRECT_BLOCK;
+    // 间接块: 逐级减去上一级能表示的块数
+    if (block >= DIRECT_BLOCK) {
+        block -= DIRECT_BLOCK;
 
-    if (block < INDIRECT1_BLOCK) {
-        index = DIRECT_BLOCK;
-        level = 1;
-        divider = 1;
-        goto reckon;
+        u32 span = info->indexes;
+        for (level = 1; block >= span; level++) {
+            block -= span;
+            divider *= info->indexes;
+            span *= info->indexes;
+        }
+        index = DIRECT_BLOCK + level - 1;
+        covers = span;
+    } else {
+        block = 0; // 直接块没有下一级，索引项内的偏移为 0
     }
 
-    block -= INDIRECT1_BLOCK;
-    assert(block < INDIRECT2_BLOCK);
-    index = DIRECT_BLOCK + 1;
-    level = 2;
-    divider = BLOCK_INDEXES;
-
-reckon:
     for (; level >= 0; level--) {
+        idx_t nr = buf ? index_get(info, buf->data, index) : minode->zone[index];
+
         // 如果不存在 且 create 则申请一块文件块
-        if (!array[index] && create) {
-            array[index] = minix_balloc(inode->super);
-            buf->dirty = true;
+        if (!nr && create) {
+            nr = minix_balloc(inode->super, goal);
+            assert(nr);
+            if (buf) {
+                index_set(info, buf->data, index, nr);
+                meta_dirty_inode(inode, buf);
+            } else {
+                minode->zone[index] = nr;
+                minix_inode_dirty(inode);
+            }
+            inode->map_dirty = true;
+            goal = nr + 1;
+
+            // 新分配的索引块必须清零，不能沿用磁盘上的旧内容
+            if (level) {
+                buffer_t *ibuf = getblk(inode->dev, nr);
+                memset(ibuf->data, 0, BLOCK_SIZE);
+                ibuf->valid = true;
+                meta_dirty_inode(inode, ibuf);
+                brelse(ibuf);
+            }
         }
 
         brelse(buf);
 
         // 如果 level == 0 或者 索引不存在，直接返回
-        if (level == 0 || !array[index]) {
-            return array[index];
+        if (level == 0 || !nr) {
+            if (!nr && hole) {
+                *hole = covers - block;
+            }
+            return nr;
         }
 
         // level 不为 0，处理下一级索引
-        buf = bread(inode->dev, array[index]);
+        buf = bread(inode->dev, nr);
+        covers = divider;
         index = block / divider;
         block = block % divider;
-        divider /= BLOCK_INDEXES;
-        array = (u16 *)buf->data;
+        divider /= info->indexes;
     }
+    return 0;
+}
+
+idx_t minix_bmap(inode_t *inode, idx_t block, bool create) {
+    return minix_bmap_goal(inode, block, create, 0, NULL);
+}
+
+// 延迟分配：写入时只预留空间，数据留在缓冲中，回写时再批量分配物理块
+
+// 预留一个逻辑块
+static err_t minix_reserve(super_t *super) {
+    minix_sb_info_t *info = (minix_sb_info_t *)super->info;
+    if (!info) {
+        return EOK;
+    }
+    if (info->free_zones <= info->reserved) {
+        return -ENOSPC;
+    }
+    info->reserved++;
+    return EOK;
+}
+
+// 释放一个预留块
+static void minix_unreserve(super_t *super) {
+    minix_sb_info_t *info = (minix_sb_info_t *)super->info;
+    if (!info) {
+        return;
+    }
+    assert(info->reserved > 0);
+    info->reserved--;
+}
+
+// 查找 inode 第 block 块的延迟分配缓冲
+static buffer_t *dalloc_find(inode_t *inode, idx_t block) {
+    buffer_t *bf;
+    list_for_each_entry(bf, &inode->dalloc_list, dirty_node) {
+        if (bf->lblock == block) {
+            return bf;
+        }
+        if (bf->lblock > block) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+// 查找 inode 第 block 块及之后的第一个延迟分配块，没有返回 EOF
+static idx_t dalloc_next(inode_t *inode, idx_t block) {
+    buffer_t *bf;
+    list_for_each_entry(bf, &inode->dalloc_list, dirty_node) {
+        if (bf->lblock >= block) {
+            return bf->lblock;
+        }
+    }
+    return EOF;
+}
+
+// 为 inode 所有延迟分配缓冲按逻辑块顺序分配连续的物理块
+static void minix_dalloc_flush(inode_t *inode) {
+    idx_t goal = 0;
+    idx_t last = EOF;
+
+    while (!list_empty(&inode->dalloc_list)) {
+        buffer_t *bf = list_entry(list_pop(&inode->dalloc_list), buffer_t, dirty_node);
+        idx_t block = bf->lblock;
+
+        // 紧接前一个逻辑块的物理位置，追加写得到连续的块
+        if (last == EOF || block != last + 1) {
+            goal = block ? minix_bmap(inode, block - 1, false) : 0;
+            if (goal) {
+                goal++;
+            }
+        }
+
+        minix_unreserve(inode->super);
+        idx_t nr = minix_bmap_goal(inode, block, true, goal, NULL);
+        assert(nr);
+
+        bassign(bf, nr);
+        bdirty_inode(bf, inode, block);
+        brelse(bf);
+
+        inode->dalloc_count--;
+        last = block;
+        goal = nr + 1;
+    }
+    assert(inode->dalloc_count == 0);
+}
+
+// 丢弃 inode 所有延迟分配缓冲，不产生任何磁盘 I/O
+static void minix_dalloc_discard(inode_t *inode) {
+    while (!list_empty(&inode->dalloc_list)) {
+        buffer_t *bf = list_entry(list_pop(&inode->dalloc_list), buffer_t, dirty_node);
+        minix_unreserve(inode->super);
+        bforget(bf);
+        inode->dalloc_count--;
+    }
+    assert(inode->dalloc_count == 0);
+}
+
+// 获取 inode 第 block 块的延迟分配缓冲，不存在则预留并创建
+static buffer_t *minix_dalloc_get(inode_t *inode, idx_t block) {
+    buffer_t *bf = dalloc_find(inode, block);
+    if (bf) {
+        bf->count++;
+        return bf;
+    }
+
+    if (inode->dalloc_count >= MINIX_DALLOC_MAX) {
+        minix_dalloc_flush(inode);
+    }
+
+    if (minix_reserve(inode->super) < EOK) {
+        return NULL;
+    }
+
+    bf = bdelay(inode->dev, block);
+    list_insert_sort(&inode->dalloc_list, &bf->dirty_node,
+                     list_node_offset(buffer_t, dirty_node, lblock));
+    inode->dalloc_count++;
+
+    bf->count++; // 一个引用属于 inode 延迟链表，一个返回给调用者
+    return bf;
 }
 
 // 计算 inode nr 对应的块号
-static inline idx_t inode_block(minix_super_t *desc, idx_t nr) {
+static inline idx_t inode_block(minix_sb_info_t *info, idx_t nr) {
     // inode 编号 从 1 开始
-    return 2 + desc->imap_blocks + desc->zmap_blocks + (nr - 1) / BLOCK_INODES;
+    u32 per_block = BLOCK_SIZE / info->inode_size;
+    return 2 + info->imap_blocks + info->zmap_blocks + (nr - 1) / per_block;
 }
 
 // 获得设备 dev 的 nr inode
@@ -217,40 +486,42 @@ static inode_t *iget(dev_t dev, idx_t nr) {
     super_t *super = get_super(dev);
     assert(super);
 
-    minix_super_t *desc = (minix_super_t *)super->desc;
+    minix_sb_info_t *info = (minix_sb_info_t *)super->info;
 
-    if (nr == 0 || nr > desc->inodes) {
-        LOGK("iget bad inode dev=%d nr=%d max=%d\n", dev, nr, desc->inodes);
+    if (nr == 0 || nr > info->inodes) {
+        LOGK("iget bad inode dev=%d nr=%d max=%d\n", dev, nr, info->inodes);
     }
 
-    assert(nr <= desc->inodes);
+    assert(nr <= info->inodes);
 
     inode = get_free_inode();
     inode->dev = dev;
     inode->nr = nr;
     inode->count++;
 
-    // 加入超级块 inode 链表
+    // 加入超级块 inode 链表和 inode 哈希表
     list_push(&super->inode_list, &inode->node);
+    hash_inode(inode);
 
-    idx_t block = inode_block(desc, inode->nr);
+    idx_t block = inode_block(info, inode->nr);
     buffer_t *buf = bread(inode->dev, block);
 
     inode->buf = buf;
+    inode->super = super;
 
-    // 将缓冲视为一个 inode 描述符数组，获取对应的指针；
-    inode->desc = &((minix_inode_t *)buf->data)[(inode->nr - 1) % BLOCK_INODES];
+    // 各版本的磁盘 inode 格式不同，内存中保存统一格式的副本
+    inode->desc = kmalloc(sizeof(minix_inode_t));
+    minix_inode_read(inode);
     minix_inode_t *minode = (minix_inode_t *)inode->desc;
 
     inode->rdev = minode->zone[0];
 
     inode->atime = sys_time();
-    inode->mtime = inode->mtime;
-    inode->ctime = minode->mtime;
+    inode->mtime = minode->mtime;
+    inode->ctime = minode->ctime;
 
     inode->mode = minode->mode;
     inode->size = minode->size;
-    inode->super = super;
 
     inode->uid = minode->uid;
     inode->gid = minode->gid;
@@ -267,8 +538,6 @@ static inode_t *new_inode(dev_t dev, idx_t nr) {
 
     // assert(inode->desc->nlinks == 0);
 
-    inode->buf->dirty = true;
-
     minix_inode_t *minode = (minix_inode_t *)inode->desc;
     memset(minode, 0, sizeof(minix_inode_t));
 
@@ -280,9 +549,42 @@ static inode_t *new_inode(dev_t dev, idx_t nr) {
     minode->mtime = inode->atime = inode->mtime = inode->ctime = sys_time();
     minode->nlinks = 1;
 
+    minix_inode_dirty(inode);
     return inode;
 }
 
+// 释放 inode 缓存中的 inode
+static int minix_evict(inode_t *inode) {
+    assert(inode->type == FS_TYPE_MINIX);
+    assert(!inode->count);
+
+    // 已删除的文件丢弃延迟数据
+    minix_dalloc_discard(inode);
+
+    // 目录仍然存在时暂存索引，已删除的目录直接丢弃
+    minix_inode_t *minode = (minix_inode_t *)inode->desc;
+    if (inode->dindex && minode->nlinks)
+        dindex_park(inode->dev, inode->nr, minode->size, minode->mtime, inode->dindex);
+    else
+        dindex_destroy(inode->dindex);
+    inode->dindex = NULL;
+
+    // 脏缓冲留给全局回写
+    bdetach_inode(inode);
+
+    // 释放 inode 对应的缓冲
+    brelse(inode->buf);
+    kfree(inode->desc);
+    inode->desc = NULL;
+
+    // 从超级块链表中移除
+    list_remove(&inode->node);
+
+    // 释放 inode 内存
+    put_free_inode(inode);
+    return EOK;
+}
+
 // 关闭 inode
 static void minix_close(inode_t *inode) {
     assert(inode->type == FS_TYPE_MINIX);
@@ -298,14 +600,14 @@ static void minix_close(inode_t *inode) {
         return;
     }
 
-    // 释放 inode 对应的缓冲
-    brelse(inode->buf);
-
-    // 从超级块链表中移除
-    list_remove(&inode->node);
+    minix_inode_t *minode = (minix_inode_t *)inode->desc;
+    if (minode->nlinks && inode->nr) {
+        // 仍然有效，留在 inode 缓存中
+        cache_inode(inode);
+        return;
+    }
 
-    // 释放 inode 内存
-    put_free_inode(inode);
+    minix_evict(inode);
 }
 
 // 从 inode 的 offset 处，读 len 个字节到 buf
@@ -332,16 +634,21 @@ static int minix_read(inode_t *inode, char *data, int len, off_t offset) {
 
     // 开始读取的位置
     u32 begin = offset;
+    err_t ret = EOK;
 
     // 剩余字节数
     u32 left = MIN(len, minode->size - offset);
     while (left) {
         // 找到对应的文件便宜，所在文件块
         idx_t nr = minix_bmap(inode, offset / BLOCK_SIZE, false);
-        assert(nr);
 
-        // 读取文件块缓冲
-        buffer_t *buf = bread(inode->dev, nr);
+        // 读取文件块缓冲，尚未分配的块在延迟分配缓冲中，都没有则是空洞
+        buffer_t *buf = NULL;
+        if (nr) {
+            buf = bread(inode->dev, nr);
+        } else if ((buf = dalloc_find(inode, offset / BLOCK_SIZE))) {
+            buf->count++;
+        }
 
         // 文件块中的偏移量
         u32 start = offset % BLOCK_SIZE;
@@ -349,16 +656,21 @@ static int minix_read(inode_t *inode, char *data, int len, off_t offset) {
         // 本次需要读取的字节数
         u32 chars = MIN(BLOCK_SIZE - start, left);
 
+        // 拷贝内容，空洞读出 0 不产生 I/O
+        if (buf) {
+            ret = copy_to_user(data, buf->data + start, chars);
+        } else {
+            ret = clear_user(data, chars);
+        }
+        if (ret < EOK) {
+            brelse(buf);
+            break;
+        }
+
         // 更新 偏移量 和 剩余字节数
         offset += chars;
         left -= chars;
 
-        // 文件块中的指针
-        char *ptr = buf->data + start;
-
-        // 拷贝内容
-        memcpy(data, ptr, chars);
-
         // 更新缓存位置
         data += chars;
 
@@ -366,6 +678,9 @@ static int minix_read(inode_t *inode, char *data, int len, off_t offset) {
         brelse(buf);
     }
 
+    if (offset == begin && ret < EOK)
+        return ret;
+
     // 更新访问时间
     inode->atime = sys_time();
 
@@ -394,18 +709,26 @@ static int minix_write(inode_t *inode, char *data, int len, off_t offset) {
 
     // 开始的位置
     u32 begin = offset;
+    err_t ret = EOK;
 
     // 剩余数量
     u32 left = len;
 
     while (left) {
-        // 找到文件块，若不存在则创建
-        idx_t nr = minix_bmap(inode, offset / BLOCK_SIZE, true);
-        assert(nr);
+        // 找到文件块，若不存在则延迟分配
+        idx_t nr = minix_bmap(inode, offset / BLOCK_SIZE, false);
 
         // 将读入文件块
-        buffer_t *buf = bread(inode->dev, nr);
-        buf->dirty = true;
+        buffer_t *buf = NULL;
+        if (nr) {
+            buf = bread(inode->dev, nr);
+            bdirty_inode(buf, inode, offset / BLOCK_SIZE);
+        } else {
+            buf = minix_dalloc_get(inode, offset / BLOCK_SIZE);
+            if (!buf) {
+                break; // 磁盘空间不足
+            }
+        }
 
         // 块中的偏移量
         u32 start = offset % BLOCK_SIZE;
@@ -415,6 +738,12 @@ static int minix_write(inode_t *inode, char *data, int len, off_t offset) {
         // 读取的数量
         u32 chars = MIN(BLOCK_SIZE - start, left);
 
+        // 拷贝内容，用户缓冲无效时不改变文件大小
+        if ((ret = copy_from_user(ptr, data, chars)) < EOK) {
+            brelse(buf);
+            break;
+        }
+
         // 更新偏移量
         offset += chars;
 
@@ -424,12 +753,10 @@ static int minix_write(inode_t *inode, char *data, int len, off_t offset) {
         // 如果偏移量大于文件大小，则更新
         if (offset > minode->size) {
             inode->size = minode->size = offset;
-            inode->buf->dirty = true;
+            inode->map_dirty = true;
+            minix_inode_dirty(inode);
         }
 
-        // 拷贝内容
-        memcpy(ptr, data, chars);
-
         // 更新缓存偏移
         data += chars;
 
@@ -439,44 +766,204 @@ static int minix_write(inode_t *inode, char *data, int len, off_t offset) {
 
     // 更新修改时间
     minode->mtime = inode->atime = sys_time();
+    minix_inode_dirty(inode);
 
     // TODO: 写入磁盘 ？
     bwrite(inode->buf);
 
+    if (offset == begin && len) {
+        return ret < EOK ? ret : -ENOSPC;
+    }
+
     // 返回写入大小
     return offset - begin;
 }
 
-static void inode_bfree(inode_t *inode, u16 *array, int index, int level) {
-    if (!array[index]) {
+/**
+ * 直接 I/O (O_DIRECT)
+ *
+ * 块对齐的读写在用户缓冲和磁盘之间直接传输，不占用缓冲区；
+ * 物理上连续的块合并成一次请求，一次请求不跨越用户页 (DMA 只有一个 PRD)。
+ * 已经在缓冲区中的块、延迟分配的块和空洞仍然经过缓冲区，保证和缓冲 I/O 一致。
+ */
+
+// 直接写时获取块号，没有则立即在前一块之后分配，不走延迟分配
+static idx_t direct_bmap(inode_t *inode, idx_t block, int type) {
+    idx_t nr = minix_bmap(inode, block, false);
+    if (nr || type == REQ_READ || dalloc_find(inode, block)) {
+        return nr;
+    }
+
+    if (minix_reserve(inode->super) < EOK) {
+        return 0;
+    }
+    minix_unreserve(inode->super);
+
+    idx_t goal = block ? minix_bmap(inode, block - 1, false) : 0;
+    return minix_bmap_goal(inode, block, true, goal ? goal + 1 : 0, NULL);
+}
+
+// 经过缓冲区读写一块
+static err_t direct_buffered(inode_t *inode, idx_t nr, idx_t block, char *data, int type) {
+    buffer_t *buf = NULL;
+    if (nr) {
+        buf = bread(inode->dev, nr);
+    } else if ((buf = dalloc_find(inode, block))) {
+        buf->count++;
+    } else if (type == REQ_READ) {
+        return clear_user(data, BLOCK_SIZE); // 空洞读出 0
+    } else {
+        return -ENOSPC;
+    }
+
+    err_t ret;
+    if (type == REQ_READ) {
+        ret = copy_to_user(data, buf->data, BLOCK_SIZE);
+    } else if ((ret = copy_from_user(buf->data, data, BLOCK_SIZE)) == EOK && nr) {
+        // 延迟分配缓冲由 inode 的链表管理，不进入脏链表
+        bdirty_inode(buf, inode, block);
+    }
+    brelse(buf);
+    return ret;
+}
+
+static int minix_direct_io(inode_t *inode, char *data, int len, off_t offset, int type) {
+    minix_inode_t *minode = (minix_inode_t *)inode->desc;
+
+    // 不对齐的请求退回到缓冲 I/O
+    if (((u32)data | (u32)len | (u32)offset) % BLOCK_SIZE) {
+        if (type == REQ_READ) {
+            return minix_read(inode, data, len, offset);
+        }
+        return minix_write(inode, data, len, offset);
+    }
+
+    // 读取时只返回文件大小以内的字节，但按整块传输
+    u32 left = len;
+    if (type == REQ_READ) {
+        if (offset >= minode->size) {
+            return EOF;
+        }
+        left = MIN(len, minode->size - offset);
+    }
+    u32 total = div_round_up(left, BLOCK_SIZE) * BLOCK_SIZE;
+
+    // 检查范围并固定用户页，device_request 按物理页传输
+    err_t ret = pin_user_pages(data, total, type == REQ_READ);
+    if (ret < EOK) {
+        return ret;
+    }
+
+
+    u32 done = 0;
+    while (done < total) {
+        idx_t block = (offset + done) / BLOCK_SIZE;
+        char *ptr = data + done;
+
+        // 块设备按物理页分散传输，一次请求可以跨越用户页
+        u32 count = (total - done) / BLOCK_SIZE;
+
+        idx_t first = direct_bmap(inode, block, type);
+        if (!first || bcached(inode->dev, first)) {
+            if ((ret = direct_buffered(inode, first, block, ptr, type)) < EOK) {
+                break;
+            }
+            done += BLOCK_SIZE;
+            continue;
+        }
+
+        // 合并物理上连续且不在缓冲区中的块
+        u32 i = 1;
+        for (; i < count; i++) {
+            idx_t nr = direct_bmap(inode, block + i, type);
+            if (nr != first + i || bcached(inode->dev, nr)) {
+                break;
+            }
+        }
+
+        ret = device_request(inode->dev, ptr, i * BLOCK_SECS, first * BLOCK_SECS, 0, type);
+        if (ret < EOK) {
+            break;
+        }
+        done += i * BLOCK_SIZE;
+    }
+    unpin_user_pages(data, total);
+
+    if (type == REQ_READ) {
+        inode->atime = sys_time();
+        if (!done) {
+            return ret;
+        }
+        return MIN(done, left);
+    }
+
+    if (offset + done > minode->size) {
+        inode->size = minode->size = offset + done;
+        inode->map_dirty = true;
+    }
+    minode->mtime = inode->atime = sys_time();
+    minix_inode_dirty(inode);
+
+    if (!done && len) {
+        return ret;
+    }
+    return done;
+}
+
+// 释放块 nr，level 不为 0 时是索引块，先释放其下的所有块
+static void inode_bfree(inode_t *inode, idx_t nr, int level) {
+    if (!nr) {
         return;
     }
 
     if (!level) {
-        minix_bfree(inode->super, array[index]);
+        minix_bfree(inode->super, nr);
         return;
     }
 
-    buffer_t *buf = bread(inode->dev, array[index]);
-    for (size_t i = 0; i < BLOCK_INDEXES; i++) {
-        inode_bfree(inode, (u16 *)buf->data, i, level - 1);
+    minix_sb_info_t *info = (minix_sb_info_t *)inode->super->info;
+    buffer_t *buf = bread(inode->dev, nr);
+    for (size_t i = 0; i < info->indexes; i++) {
+        inode_bfree(inode, index_get(info, buf->data, i), level - 1);
     }
     brelse(buf);
-    minix_bfree(inode->super, array[index]);
+    minix_bfree(inode->super, nr);
 }
 
 // 读取文件路径
 int minix_readdir(inode_t *inode, dentry_t *entry, size_t count, off_t offset) {
-    minix_dentry_t mentry;
-    int ret = EOF;
-    if ((ret = minix_read(inode, (char *)&mentry, sizeof(mentry), offset)) < 0) {
-        return ret;
+    minix_sb_info_t *info = (minix_sb_info_t *)inode->super->info;
+    minix_inode_t *minode = (minix_inode_t *)inode->desc;
+    if (offset >= minode->size) {
+        return EOF;
     }
 
-    entry->length = sizeof(mentry);
-    entry->namelen = strlen(mentry.name);
-    memcpy(entry->name, mentry.name, entry->namelen + 1);
-    entry->nr = mentry.nr;
+    // 目录项不跨块，直接从目录块复制，minix_read 只接受用户缓冲
+    char mentry[sizeof(minix3_dentry_t)];
+    memset(mentry, 0, sizeof(mentry));
+    int ret = MIN(info->dentry_size, minode->size - offset);
+    idx_t nr = minix_bmap(inode, offset / BLOCK_SIZE, false);
+    if (nr) {
+        buffer_t *buf = bread(inode->dev, nr);
+        memcpy(mentry, buf->data + offset % BLOCK_SIZE, ret);
+        brelse(buf);
+    }
+
+    char *name = mentry + sizeof(u16);
+    entry->nr = ((minix_dentry_t *)mentry)->nr;
+    if (info->version == 3) {
+        name = mentry + sizeof(u32);
+        entry->nr = ((minix3_dentry_t *)mentry)->nr;
+    }
+
+    // 文件名占满时没有结尾的 0
+    entry->length = info->dentry_size;
+    entry->namelen = 0;
+    while (entry->namelen < info->name_len && name[entry->namelen]) {
+        entry->namelen++;
+    }
+    memcpy(entry->name, name, entry->namelen);
+    entry->name[entry->namelen] = EOS;
     return ret;
 }
 
@@ -487,27 +974,135 @@ static int minix_truncate(inode_t *inode) {
         return -EPERM;
     }
 
+    // 尚未分配的数据直接丢弃
+    minix_dalloc_discard(inode);
+
     // 释放直接块
     for (size_t i = 0; i < DIRECT_BLOCK; i++) {
-        inode_bfree(inode, minode->zone, i, 0);
+        inode_bfree(inode, minode->zone[i], 0);
         minode->zone[i] = 0;
     }
 
-    // 释放一级间接块
-    inode_bfree(inode, minode->zone, DIRECT_BLOCK, 1);
-    minode->zone[DIRECT_BLOCK] = 0;
-
-    // 释放二级间接块
-    inode_bfree(inode, minode->zone, DIRECT_BLOCK + 1, 2);
-    minode->zone[DIRECT_BLOCK + 1] = 0;
+    // 释放一级、二级 (v2/v3: 三级) 间接块
+    minix_sb_info_t *info = (minix_sb_info_t *)inode->super->info;
+    int levels = info->version == 1 ? 2 : 3;
+    for (int level = 1; level <= levels; level++) {
+        inode_bfree(inode, minode->zone[DIRECT_BLOCK + level - 1], level);
+        minode->zone[DIRECT_BLOCK + level - 1] = 0;
+    }
 
     inode->size = minode->size = 0;
-    inode->buf->dirty = true;
     minode->mtime = sys_time();
+    minix_inode_dirty(inode);
     bwrite(inode->buf);
     return EOK;
 }
 
+// 为延迟分配的数据分配物理块，交给缓冲回写
+static int minix_sync(inode_t *inode) {
+    assert(inode->type == FS_TYPE_MINIX);
+    minix_dalloc_flush(inode);
+    return EOK;
+}
+
+// 只回写 inode 自己的脏缓冲，按块号排序，数据先于 inode 落盘
+// 没有日志时回写脏的 inode 位图和逻辑块位图，
+// 使 inode 指向的块在位图中已经标记为使用
+static void minix_sync_bitmaps(super_t *super) {
+    minix_sb_info_t *info = (minix_sb_info_t *)super->info;
+    idx_t end = 2 + info->imap_blocks + info->zmap_blocks;
+    for (idx_t idx = 2; idx < end; idx++) {
+        // 脏缓冲不会被换出，不在缓存中的块不需要回写
+        if (!bcached(super->dev, idx))
+            continue;
+        buffer_t *buf = getblk(super->dev, idx);
+        bwrite(buf);
+        brelse(buf);
+    }
+}
+
+static int minix_fsync(inode_t *inode, off_t offset, size_t len, int flags) {
+    assert(inode->type == FS_TYPE_MINIX);
+    journal_begin(inode->super);
+    minix_dalloc_flush(inode);
+    journal_end(inode->super);
+
+    if (flags & FSYNC_RANGE) {
+        idx_t start = offset / BLOCK_SIZE;
+        idx_t end = len ? (offset + len - 1) / BLOCK_SIZE : EOF - 1;
+        // 不包括索引块 (EOF)
+        int ret = bsync_inode(inode, start, end);
+        if (ret < EOK) {
+            return ret;
+        }
+        return device_flush(inode->dev);
+    }
+
+    // 数据块、索引块和目录块，开启日志时只有数据块
+    int ret = bsync_inode(inode, 0, EOF);
+    if (ret < EOK) {
+        return ret;
+    }
+
+    // fdatasync 只在大小或块映射变化时回写 inode
+    if ((flags & FSYNC_DATA) && !inode->map_dirty) {
+        return device_flush(inode->dev);
+    }
+    inode->map_dirty = false;
+
+    // 有日志时提交运行中的事务，和其它操作一起组提交
+    if (!journal_commit(inode->super)) {
+        minix_sync_bitmaps(inode->super);
+        ret = bwrite(inode->buf);
+        if (ret < EOK) {
+            return ret;
+        }
+    }
+
+    // 事务可能是其它任务提交的，提交块的 FUA 不一定覆盖上面写的数据块
+    return device_flush(inode->dev);
+}
+
+// 从 offset 开始查找数据 (SEEK_DATA) 或空洞 (SEEK_HOLE)，文件末尾视为空洞
+static int minix_seek(inode_t *inode, off_t offset, int whence) {
+    minix_inode_t *minode = (minix_inode_t *)inode->desc;
+    u32 size = minode->size;
+    if (!ISFILE(minode->mode)) {
+        return whence == SEEK_DATA ? offset : size;
+    }
+
+    idx_t end = div_round_up(size, BLOCK_SIZE);
+    idx_t block = offset / BLOCK_SIZE;
+    while (block < end) {
+        u32 hole = 0;
+        idx_t nr = minix_bmap_goal(inode, block, false, 0, &hole);
+        idx_t next = nr ? block : dalloc_next(inode, block);
+
+        // 未映射的范围中可能有延迟分配的块
+        if (!nr && (next == EOF || next >= block + hole)) {
+            if (whence == SEEK_HOLE) {
+                break;
+            }
+            block += hole;
+            continue;
+        }
+
+        if (whence == SEEK_DATA) {
+            block = next;
+            break;
+        }
+        if (next != block) {
+            break; // 延迟分配的块之前是空洞
+        }
+        block++;
+    }
+
+    if (block >= end) {
+        return whence == SEEK_DATA ? -ENXIO : size;
+    }
+    return MAX((u32)offset, block * BLOCK_SIZE);
+}
+
 static int minix_stat(inode_t *inode, stat_t *statbuf) {
     minix_inode_t *minode = (minix_inode_t *)inode->desc;
     statbuf->dev = inode->dev;        // 文件所在的设备号
@@ -551,6 +1146,162 @@ static int minix_permission(inode_t *inode, int mask) {
     return false;
 }
 
+/**
+ * 目录项访问
+ *
+ * v1/v2 目录项为 16 位 inode 号加 14 或 30 字节文件名，v3 为 32 位 inode 号加 60 字节文件名；
+ * 目录块按超级块中的目录项大小划分，文件名占满时没有结尾的 0。
+ */
+
+static inline minix_sb_info_t *dentry_info(inode_t *dir) {
+    return (minix_sb_info_t *)dir->super->info;
+}
+
+// 一块中的目录项数量
+static inline u32 block_dentries(inode_t *dir) {
+    return BLOCK_SIZE / dentry_info(dir)->dentry_size;
+}
+
+// 目录中第 slot 个目录项在目录块中的指针
+static inline minix_dentry_t *dentry_at(inode_t *dir, buffer_t *buf, idx_t slot) {
+    u32 size = dentry_info(dir)->dentry_size;
+    return (minix_dentry_t *)(buf->data + (slot % block_dentries(dir)) * size);
+}
+
+static inline minix_dentry_t *dentry_next(inode_t *dir, minix_dentry_t *entry) {
+    return (minix_dentry_t *)((char *)entry + dentry_info(dir)->dentry_size);
+}
+
+static inline idx_t dentry_nr(inode_t *dir, minix_dentry_t *entry) {
+    if (dentry_info(dir)->version == 3) {
+        return ((minix3_dentry_t *)entry)->nr;
+    }
+    return entry->nr;
+}
+
+static inline void dentry_set_nr(inode_t *dir, minix_dentry_t *entry, idx_t nr) {
+    if (dentry_info(dir)->version == 3) {
+        ((minix3_dentry_t *)entry)->nr = nr;
+    } else {
+        assert(nr <= 0xFFFF);
+        entry->nr = nr;
+    }
+}
+
+static inline char *dentry_name(inode_t *dir, minix_dentry_t *entry) {
+    if (dentry_info(dir)->version == 3) {
+        return ((minix3_dentry_t *)entry)->name;
+    }
+    return entry->name;
+}
+
+// 文件名的哈希，最多取目录项中的文件名长度
+static inline u32 dentry_hash(inode_t *dir, minix_dentry_t *entry) {
+    return dindex_hash(dentry_name(dir, entry), dentry_info(dir)->name_len);
+}
+
+// 比较路径分量 name 与目录项的文件名
+static bool dentry_match(inode_t *dir, const char *name, minix_dentry_t *entry, char **next) {
+    u32 len = dentry_info(dir)->name_len;
+    char ename[MINIX3_NAME_LEN + 1];
+    memcpy(ename, dentry_name(dir, entry), len);
+    ename[len] = EOS;
+    return match_name(name, ename, next);
+}
+
+// 写入目录项的文件名，不足的部分补 0
+static void dentry_set_name(inode_t *dir, minix_dentry_t *entry, const char *name) {
+    u32 len = dentry_info(dir)->name_len;
+    char *ename = dentry_name(dir, entry);
+    memset(ename, 0, len);
+    for (size_t i = 0; i < len && name[i]; i++) {
+        ename[i] = name[i];
+    }
+}
+
+static u32 dentry_gen; // 目录项增删计数，建立索引期间发生变化则放弃该索引
+
+// 获取目录的哈希索引，目录较大时建立，较小的目录返回 NULL 使用线性扫描
+static minix_dindex_t *dindex_get(inode_t *dir) {
+    if (dir->dindex)
+        return dir->dindex;
+
+    minix_inode_t *minode = (minix_inode_t *)dir->desc;
+    if (minode->size < MINIX_DINDEX_BLOCKS * BLOCK_SIZE)
+        return NULL;
+
+    // inode 回收前建立的索引仍然有效
+    dir->dindex = dindex_unpark(dir->dev, dir->nr, minode->size, minode->mtime);
+    if (dir->dindex)
+        return dir->dindex;
+
+    u32 gen = dentry_gen;
+    minix_dindex_t *index = dindex_create();
+
+    u32 entries = minode->size / dentry_info(dir)->dentry_size;
+    buffer_t *buf = NULL;
+    minix_dentry_t *entry = NULL;
+
+    for (idx_t i = 0; i < entries; i++, entry = dentry_next(dir, entry)) {
+        if (!buf || (u32)entry >= (u32)buf->data + BLOCK_SIZE) {
+            brelse(buf);
+            idx_t block = minix_bmap(dir, i / block_dentries(dir), false);
+            assert(block);
+
+            buf = bread(dir->dev, block);
+            entry = (minix_dentry_t *)buf->data;
+        }
+        if (dentry_nr(dir, entry))
+            dindex_insert(index, dentry_hash(dir, entry), i);
+        else
+            dindex_free_push(index, i);
+    }
+    brelse(buf);
+
+    // 读目录块时可能阻塞，期间目录被修改则索引不可信
+    if (gen != dentry_gen || dir->dindex) {
+        dindex_destroy(index);
+        return dir->dindex;
+    }
+
+    LOGK("dir index dev %d nr %d entries %d\n", dir->dev, dir->nr, index->count);
+    dir->dindex = index;
+    return index;
+}
+
+// 通过哈希索引查找目录项
+static buffer_t *find_entry_indexed(inode_t *dir, minix_dindex_t *index, const char *name, char **next, minix_dentry_t **result) {
+    size_t len = dentry_name_len(name);
+    if (len > dentry_info(dir)->name_len)
+        return NULL;
+
+    u32 hash = dindex_hash(name, len);
+    u32 gen;
+    u32 pos;
+    idx_t slot;
+
+restart:
+    gen = index->gen;
+    pos = 0;
+    while ((slot = dindex_next(index, hash, &pos)) != EOF) {
+        idx_t block = minix_bmap(dir, slot / block_dentries(dir), false);
+        assert(block);
+
+        buffer_t *buf = bread(dir->dev, block);
+        minix_dentry_t *entry = dentry_at(dir, buf, slot);
+        if (dentry_nr(dir, entry) && dentry_match(dir, name, entry, next)) {
+            *result = entry;
+            return buf;
+        }
+        brelse(buf);
+
+        // 哈希表在阻塞期间被重建
+        if (gen != index->gen)
+            goto restart;
+    }
+    return NULL;
+}
+
 // 获取 dir 目录下的 name 目录 所在的 minix_dentry_t 和 buffer_t
 static buffer_t *find_entry(inode_t *dir, const char *name, char **next, minix_dentry_t **result) {
     // 保证 dir 是目录
@@ -558,8 +1309,13 @@ static buffer_t *find_entry(inode_t *dir, const char *name, char **next, minix_d
     minix_inode_t *minode = (minix_inode_t *)dir->desc;
     assert(ISDIR(minode->mode));
 
+    minix_dindex_t *index = dindex_get(dir);
+    if (index) {
+        return find_entry_indexed(dir, index, name, next, result);
+    }
+
     // dir 目录最多子目录数量
-    u32 entries = minode->size / sizeof(minix_dentry_t);
+    u32 entries = minode->size / dentry_info(dir)->dentry_size;
 
     idx_t i = 0;
     idx_t block = 0;
@@ -567,16 +1323,16 @@ static buffer_t *find_entry(inode_t *dir, const char *name, char **next, minix_d
     minix_dentry_t *entry = NULL;
     idx_t nr = EOF;
 
-    for (; i < entries; i++, entry++) {
+    for (; i < entries; i++, entry = dentry_next(dir, entry)) {
         if (!buf || (u32)entry >= (u32)buf->data + BLOCK_SIZE) {
             brelse(buf);
-            block = minix_bmap(dir, i / BLOCK_DENTRIES, false);
+            block = minix_bmap(dir, i / block_dentries(dir), false);
             assert(block);
 
             buf = bread(dir->dev, block);
             entry = (minix_dentry_t *)buf->data;
         }
-        if (match_name(name, entry->name, next) && entry->nr) {
+        if (dentry_match(dir, name, entry, next) && dentry_nr(dir, entry)) {
             *result = entry;
             return buf;
         }
@@ -596,7 +1352,8 @@ static buffer_t *add_entry(inode_t *dir, const char *name, minix_dentry_t **resu
     }
 
     // name 中不能有分隔符
-    for (size_t i = 0; i < NAME_LEN && name[i]; i++) {
+    u32 name_len = dentry_info(dir)->name_len;
+    for (size_t i = 0; i < name_len && name[i]; i++) {
         assert(!IS_SEPARATOR(name[i]));
     }
 
@@ -604,33 +1361,94 @@ static buffer_t *add_entry(inode_t *dir, const char *name, minix_dentry_t **resu
     idx_t block = 0;
     minix_dentry_t *entry;
 
+    u32 size = dentry_info(dir)->dentry_size;
     minix_inode_t *minode = (minix_inode_t *)dir->desc;
-    for (; true; i++, entry++) {
+    minix_dindex_t *index = dir->dindex;
+    if (index) {
+        // 有索引时直接取空闲目录项，没有则追加到目录末尾
+        i = dindex_free_pop(index);
+        if (i == EOF)
+            i = minode->size / size;
+
+        block = minix_bmap(dir, i / block_dentries(dir), true);
+        assert(block);
+
+        buf = bread(dir->dev, block);
+        entry = dentry_at(dir, buf, i);
+        if (i * size >= minode->size) {
+            dentry_set_nr(dir, entry, 0);
+            dir->size = minode->size = (i + 1) * size;
+            minix_inode_dirty(dir);
+        }
+        assert(!dentry_nr(dir, entry));
+        goto found;
+    }
+
+    for (; true; i++, entry = dentry_next(dir, entry)) {
         if (!buf || (u32)entry >= (u32)buf->data + BLOCK_SIZE) {
             brelse(buf);
-            block = minix_bmap(dir, i / BLOCK_DENTRIES, true);
+            block = minix_bmap(dir, i / block_dentries(dir), true);
             assert(block);
 
             buf = bread(dir->dev, block);
             entry = (minix_dentry_t *)buf->data;
         }
-        if (i * sizeof(minix_dentry_t) >= minode->size) {
-            entry->nr = 0;
-            dir->size = minode->size = (i + 1) * sizeof(minix_dentry_t);
-            dir->buf->dirty = true;
+        if (i * size >= minode->size) {
+            dentry_set_nr(dir, entry, 0);
+            dir->size = minode->size = (i + 1) * size;
+            minix_inode_dirty(dir);
         }
-        if (entry->nr) {
-            continue;
+        if (!dentry_nr(dir, entry)) {
+            break;
         }
+    }
 
-        strlcpy(entry->name, name, NAME_LEN);
+found:
+    dentry_set_name(dir, entry, name);
+    if (index)
+        dindex_insert(index, dentry_hash(dir, entry), i);
+    dentry_gen++;
 
-        buf->dirty = true;
-        dir->mtime = minode->mtime = sys_time();
-        dir->buf->dirty = true;
-        *result = entry;
-        return buf;
-    };
+    // open/mkdir/link/mknod 都经过这里，使负目录项失效
+    dcache_delete(dir, name, strlen(name));
+
+    meta_dirty_inode(dir, buf);
+    dir->mtime = minode->mtime = sys_time();
+    minix_inode_dirty(dir);
+    *result = entry;
+    return buf;
+}
+
+// 删除 buf 中的目录项 entry
+static void del_entry(inode_t *dir, buffer_t *buf, minix_dentry_t *entry) {
+    minix_dindex_t *index = dir->dindex;
+    if (index) {
+        u32 hash = dentry_hash(dir, entry);
+        idx_t off = ((char *)entry - buf->data) / dentry_info(dir)->dentry_size;
+        u32 gen;
+        u32 pos;
+        idx_t slot;
+
+    restart:
+        gen = index->gen;
+        pos = 0;
+        while ((slot = dindex_next(index, hash, &pos)) != EOF) {
+            if (slot % block_dentries(dir) != off)
+                continue;
+            if (minix_bmap(dir, slot / block_dentries(dir), false) != buf->block) {
+                if (gen != index->gen)
+                    goto restart;
+                continue;
+            }
+            dindex_remove(index, hash, slot);
+            dindex_free_push(index, slot);
+            break;
+        }
+    }
+
+    dentry_set_nr(dir, entry, 0);
+    meta_dirty_inode(dir, buf);
+    dentry_gen++;
 }
 
 static int minix_open(inode_t *dir, char *name, int flags, int mode, inode_t **result) {
@@ -645,13 +1463,24 @@ static int minix_open(inode_t *dir, char *name, int flags, int mode, inode_t **r
         flags |= O_RDWR;
     }
 
-    buf = find_entry(dir, name, &next, &entry);
-    if (buf) {
-        inode = iget(dir->dev, entry->nr);
+    idx_t nr = dcache_lookup(dir, name, strlen(name));
+    if (nr && nr != DCACHE_NEGATIVE) {
+        inode = iget(dir->dev, nr);
         assert(inode);
         goto makeup;
     }
 
+    if (!nr) {
+        buf = find_entry(dir, name, &next, &entry);
+        if (buf) {
+            dcache_add(dir, name, strlen(name), dentry_nr(dir, entry));
+            inode = iget(dir->dev, dentry_nr(dir, entry));
+            assert(inode);
+            goto makeup;
+        }
+        dcache_add(dir, name, strlen(name), DCACHE_NEGATIVE);
+    }
+
     if (!(flags & O_CREAT)) {
         ret = -ENOENT;
         goto rollback;
@@ -668,8 +1497,8 @@ static int minix_open(inode_t *dir, char *name, int flags, int mode, inode_t **r
         goto rollback;
     }
 
-    entry->nr = minix_ialloc(dir->super);
-    inode = new_inode(dir->dev, entry->nr);
+    dentry_set_nr(dir, entry, minix_ialloc(dir->super));
+    inode = new_inode(dir->dev, dentry_nr(dir, entry));
     assert(inode);
 
     task_t *task = running_task();
@@ -680,6 +1509,7 @@ static int minix_open(inode_t *dir, char *name, int flags, int mode, inode_t **r
     minix_inode_t *minode = (minix_inode_t *)inode->desc;
 
     minode->mode = inode->mode = mode;
+    minix_inode_dirty(inode);
 
 makeup:
     if (!dir->op->permission(inode, ACC_MODE(flags & O_ACCMODE))) {
@@ -708,16 +1538,31 @@ rollback:
 
 // 获取 dir 目录下 name 对应的 inode
 static err_t minix_namei(inode_t *dir, char *name, char **next, inode_t **result) {
-    minix_dentry_t *entry = NULL;
-    buffer_t *buf = find_entry(dir, name, next, &entry);
-    if (!buf) {
+    size_t len = dentry_name_len(name);
+
+    // 先查目录项缓存，命中时不必扫描目录块
+    idx_t nr = dcache_lookup(dir, name, len);
+    if (nr == DCACHE_NEGATIVE) {
         return -ENOENT;
     }
 
-    inode_t *inode = iget(dir->dev, entry->nr);
-    brelse(buf);
+    if (nr) {
+        *next = name + len;
+        if (IS_SEPARATOR(**next))
+            (*next)++;
+    } else {
+        minix_dentry_t *entry = NULL;
+        buffer_t *buf = find_entry(dir, name, next, &entry);
+        if (!buf) {
+            dcache_add(dir, name, len, DCACHE_NEGATIVE);
+            return -ENOENT;
+        }
+        nr = dentry_nr(dir, entry);
+        brelse(buf);
+        dcache_add(dir, name, len, nr);
+    }
 
-    *result = inode;
+    *result = iget(dir->dev, nr);
     return EOK;
 }
 
@@ -750,22 +1595,24 @@ int minix_mkdir(inode_t *dir, char *name, int mode) {
         goto rollback;
     }
 
-    ebuf->dirty = true;
+    meta_dirty_inode(dir, ebuf);
     idx_t idx = minix_ialloc(dir->super);
-    entry->nr = idx;
+    dentry_set_nr(dir, entry, idx);
 
     task_t *task = running_task();
-    inode_t *inode = new_inode(dir->dev, entry->nr);
+    inode_t *inode = new_inode(dir->dev, idx);
     assert(inode);
 
+    u32 size = dentry_info(dir)->dentry_size;
     minix_inode_t *iminode = (minix_inode_t *)inode->desc;
     inode->mode = iminode->mode = (mode & 0777 & ~task->umask) | IFDIR;
-    inode->size = iminode->size = sizeof(minix_dentry_t) * 2; // 当前目录和父目录两个目录项
-    iminode->nlinks = 2;                                      // 一个是 '.' 一个是 name
+    inode->size = iminode->size = size * 2; // 当前目录和父目录两个目录项
+    iminode->nlinks = 2;                    // 一个是 '.' 一个是 name
+    minix_inode_dirty(inode);
 
     // 父目录链接数加 1
-    dir->buf->dirty = true;
     dminode->nlinks++; // ..
+    minix_inode_dirty(dir);
 
     // 写入 inode 目录中的默认目录项
     idx = minix_bmap(inode, 0, true);
@@ -774,16 +1621,16 @@ int minix_mkdir(inode_t *dir, char *name, int mode) {
     zbuf = bread(inode->dev, idx);
     assert(zbuf);
 
-    zbuf->dirty = true;
+    meta_dirty_inode(inode, zbuf);
 
     entry = (minix_dentry_t *)zbuf->data;
 
-    strcpy(entry->name, ".");
-    entry->nr = inode->nr;
+    dentry_set_name(inode, entry, ".");
+    dentry_set_nr(inode, entry, inode->nr);
 
-    entry++;
-    strcpy(entry->name, "..");
-    entry->nr = dir->nr;
+    entry = dentry_next(inode, entry);
+    dentry_set_name(inode, entry, "..");
+    dentry_set_nr(inode, entry, dir->nr);
 
     iput(inode);
     bwrite(dir->buf);
@@ -801,7 +1648,7 @@ static bool is_empty(inode_t *inode) {
     minix_inode_t *minode = (minix_inode_t *)inode->desc;
     assert(ISDIR(minode->mode));
 
-    int entries = minode->size / sizeof(minix_dentry_t);
+    int entries = minode->size / dentry_info(inode)->dentry_size;
     if (entries < 2 || !minode->zone[0]) {
         LOGK("bad directory on dev %d\n", inode->super->dev);
         return false;
@@ -813,17 +1660,17 @@ static bool is_empty(inode_t *inode) {
     minix_dentry_t *entry;
     int count = 0;
 
-    for (; i < entries; i++, entry++) {
+    for (; i < entries; i++, entry = dentry_next(inode, entry)) {
         if (!buf || (u32)entry >= (u32)buf->data + BLOCK_SIZE) {
             brelse(buf);
-            block = minix_bmap(inode, i / BLOCK_DENTRIES, false);
+            block = minix_bmap(inode, i / block_dentries(inode), false);
             assert(block);
 
             buf = bread(inode->dev, block);
             assert(buf);
             entry = (minix_dentry_t *)buf->data;
         }
-        if (entry->nr) {
+        if (dentry_nr(inode, entry)) {
             count++;
         }
     };
@@ -863,7 +1710,7 @@ int minix_rmdir(inode_t *dir, char *name) {
         goto rollback;
     }
 
-    inode = iget(dir->dev, entry->nr);
+    inode = iget(dir->dev, dentry_nr(dir, entry));
     if (inode == dir) {
         ret = -EPERM;
         goto rollback;
@@ -897,16 +1744,19 @@ int minix_rmdir(inode_t *dir, char *name) {
     minix_ifree(inode->super, inode->nr);
 
     iminode->nlinks = 0;
-    inode->buf->dirty = true;
+    minix_inode_dirty(inode);
+
+    // 清除该目录及其下的目录项缓存
+    dcache_delete(dir, name, strlen(name));
+    dcache_invalidate(inode->dev, inode->nr);
     inode->nr = 0;
 
     dminode->nlinks--;
     dir->ctime = dir->atime = dminode->mtime = sys_time();
-    dir->buf->dirty = true;
+    minix_inode_dirty(dir);
     assert(dminode->nlinks > 0);
 
-    entry->nr = 0;
-    ebuf->dirty = true;
+    del_entry(dir, ebuf, entry);
     ret = 0;
 
 rollback:
@@ -964,12 +1814,12 @@ int minix_link(inode_t *odir, char *oldname, inode_t *ndir, char *newname) {
         goto rollback;
     }
 
-    entry->nr = inode->nr;
-    buf->dirty = true;
+    dentry_set_nr(ndir, entry, inode->nr);
+    meta_dirty_inode(ndir, buf);
 
     minode->nlinks++;
     inode->ctime = sys_time();
-    inode->buf->dirty = true;
+    minix_inode_dirty(inode);
     ret = EOK;
 
 rollback:
@@ -998,7 +1848,7 @@ int minix_unlink(inode_t *dir, char *name) {
         goto rollback;
     }
 
-    inode = iget(dir->dev, entry->nr);
+    inode = iget(dir->dev, dentry_nr(dir, entry));
     assert(inode);
 
     minix_inode_t *minode = inode->desc;
@@ -1019,11 +1869,11 @@ int minix_unlink(inode_t *dir, char *name) {
              inode->super->count, inode->nr);
     }
 
-    entry->nr = 0;
-    buf->dirty = true;
+    del_entry(dir, buf, entry);
+    dcache_delete(dir, name, strlen(name));
 
     minode->nlinks--;
-    inode->buf->dirty = true;
+    minix_inode_dirty(inode);
 
     if (minode->nlinks == 0) {
         minix_truncate(inode);
@@ -1061,11 +1911,11 @@ int minix_mknod(inode_t *dir, char *name, int mode, int dev) {
         goto rollback;
     }
 
-    buf->dirty = true;
+    meta_dirty_inode(dir, buf);
     idx_t idx = minix_ialloc(dir->super);
-    entry->nr = idx;
+    dentry_set_nr(dir, entry, idx);
 
-    inode = new_inode(dir->dev, entry->nr);
+    inode = new_inode(dir->dev, idx);
     assert(inode);
 
     minix_inode_t *minode = inode->desc;
@@ -1074,6 +1924,7 @@ int minix_mknod(inode_t *dir, char *name, int mode, int dev) {
     if (ISBLK(mode) || ISCHR(mode)) {
         minode->zone[0] = dev;
     }
+    minix_inode_dirty(inode);
 
     ret = 0;
 
@@ -1083,6 +1934,116 @@ rollback:
     return ret;
 }
 
+// 根据版本和文件名长度确定 inode、目录项和索引块的格式
+static void minix_format(minix_sb_info_t *info, int version, int name_len) {
+    info->version = version;
+    info->name_len = name_len;
+    info->dentry_size = name_len + sizeof(u16);
+    info->inode_size = sizeof(minix_inode_t);
+    info->indexes = BLOCK_SIZE / sizeof(u32);
+    if (version == 1) {
+        info->inode_size = sizeof(minix1_inode_t);
+        info->indexes = BLOCK_SIZE / sizeof(u16);
+    } else if (version == 3) {
+        info->dentry_size = sizeof(minix3_dentry_t);
+    }
+
+    // 直接块、一级、二级间接块，v2/v3 还有三级间接块
+    u32 n = info->indexes;
+    info->max_blocks = DIRECT_BLOCK + n + n * n;
+    if (version != 1) {
+        info->max_blocks += n * n * n;
+    }
+}
+
+// 文件最大长度，文件偏移为 32 位有符号数
+static u32 minix_max_size(minix_sb_info_t *info) {
+    return MIN((u64)info->max_blocks * BLOCK_SIZE, 0x7FFFFFFF);
+}
+
+// 读取磁盘超级块，根据魔数识别版本
+static err_t minix_read_super(minix_sb_info_t *info, void *data) {
+    minix_super_t *desc = (minix_super_t *)data;
+    minix3_super_t *desc3 = (minix3_super_t *)data;
+
+    switch (desc->magic) {
+    case MINIX1_MAGIC:
+        minix_format(info, 1, NAME_LEN);
+        break;
+    case MINIX1_MAGIC2:
+        minix_format(info, 1, NAME_LEN2);
+        break;
+    case MINIX2_MAGIC:
+        minix_format(info, 2, NAME_LEN);
+        break;
+    case MINIX2_MAGIC2:
+        minix_format(info, 2, NAME_LEN2);
+        break;
+    default:
+        if (desc3->magic != MINIX3_MAGIC) {
+            return -EFSUNK;
+        }
+        // 只支持 1K 的块
+        if (desc3->block_size != BLOCK_SIZE || desc3->log_zone_size) {
+            LOGK("minix v3 block size %d not supported\n", desc3->block_size);
+            return -EFSUNK;
+        }
+        minix_format(info, 3, MINIX3_NAME_LEN);
+        info->inodes = desc3->inodes;
+        info->zones = desc3->zones;
+        info->imap_blocks = desc3->imap_blocks;
+        info->zmap_blocks = desc3->zmap_blocks;
+        info->firstdatazone = desc3->firstdatazone;
+        return EOK;
+    }
+
+    if (desc->log_zone_size) {
+        return -EFSUNK;
+    }
+    info->inodes = desc->inodes;
+    info->zones = info->version == 1 ? desc->nzones : desc->zones;
+    info->imap_blocks = desc->imap_blocks;
+    info->zmap_blocks = desc->zmap_blocks;
+    info->firstdatazone = desc->firstdatazone;
+    return EOK;
+}
+
+// mkfs 时写入磁盘超级块
+static void minix_write_super(minix_sb_info_t *info, void *data) {
+    memset(data, 0, BLOCK_SIZE);
+
+    if (info->version == 3) {
+        minix3_super_t *desc3 = (minix3_super_t *)data;
+        desc3->inodes = info->inodes;
+        desc3->zones = info->zones;
+        desc3->imap_blocks = info->imap_blocks;
+        desc3->zmap_blocks = info->zmap_blocks;
+        desc3->firstdatazone = info->firstdatazone;
+        desc3->log_zone_size = 0;
+        desc3->max_size = minix_max_size(info);
+        desc3->magic = MINIX3_MAGIC;
+        desc3->block_size = BLOCK_SIZE;
+        desc3->disk_version = 0;
+        return;
+    }
+
+    minix_super_t *desc = (minix_super_t *)data;
+    desc->inodes = info->inodes;
+    desc->imap_blocks = info->imap_blocks;
+    desc->zmap_blocks = info->zmap_blocks;
+    desc->firstdatazone = info->firstdatazone;
+    desc->log_zone_size = 0;
+    desc->max_size = minix_max_size(info);
+    desc->state = 1; // 正常卸载
+    if (info->version == 1) {
+        desc->nzones = info->zones;
+        desc->magic = MINIX1_MAGIC;
+    } else {
+        desc->zones = info->zones;
+        desc->magic = MINIX2_MAGIC;
+    }
+}
+
 static int minix_super(dev_t dev, super_t *super) {
     // 读取超级块
     buffer_t *buf = bread(dev, 1);
@@ -1091,77 +2052,154 @@ static int minix_super(dev_t dev, super_t *super) {
     }
 
     assert(buf);
-    minix_super_t *desc = (minix_super_t *)buf->data;
-
-    if (desc->magic != MINIX1_MAGIC) {
+    minix_sb_info_t *info = (minix_sb_info_t *)kmalloc(sizeof(minix_sb_info_t));
+    if (minix_read_super(info, buf->data) < EOK) {
+        kfree(info);
         brelse(buf);
         return -EFSUNK;
     }
 
     super->buf = buf;
-    super->desc = desc;
+    super->desc = buf->data;
     super->dev = dev;
     super->type = FS_TYPE_MINIX;
     super->block_size = BLOCK_SIZE;
     super->sector_size = SECTOR_SIZE;
+
+    info->reserved = 0;
+    super->info = info;
+
+    LOGK("minix v%d dev %d zones %d inodes %d\n", info->version, dev, info->zones, info->inodes);
+
+    // 先重放日志，再读取位图
+    journal_load(super, info->zones);
+    info->free_zones = minix_count_free(super);
+
     super->iroot = iget(dev, 1);
 
     return EOK;
 }
 
-int minix_mkfs(dev_t dev, int icount) {
+// 计算 mkfs 的磁盘布局，第一个数据块号在超级块中只有 16 位
+static err_t mkfs_layout(minix_sb_info_t *info, u32 total, u32 icount) {
+    u32 inode_blocks = div_round_up(icount, BLOCK_SIZE / info->inode_size);
+    u32 imap_blocks = div_round_up(icount, BLOCK_BITS);
+    if (imap_blocks + inode_blocks + 2 >= total) {
+        return -EINVAL;
+    }
+
+    u32 zcount = total - imap_blocks - inode_blocks - 2;
+    u32 zmap_blocks = div_round_up(zcount, BLOCK_BITS);
+
+    u32 firstdatazone = 2 + imap_blocks + zmap_blocks + inode_blocks;
+    if (firstdatazone > 0xFFFF || firstdatazone >= total) {
+        return -EINVAL;
+    }
+
+    info->inodes = icount;
+    info->zones = total;
+    info->imap_blocks = imap_blocks;
+    info->zmap_blocks = zmap_blocks;
+    info->firstdatazone = firstdatazone;
+    return EOK;
+}
+
+int minix_mkfs(dev_t dev, int args) {
     super_t *super = NULL;
     buffer_t *buf = NULL;
     int ret = EOF;
+    u32 icount = args & ~(MKFS_JOURNAL | MKFS_V2 | MKFS_V3);
 
-    int total_block = device_ioctl(dev, DEV_CMD_SECTOR_SIZE, NULL, 0) / BLOCK_SECS;
+    u32 total_block = device_ioctl(dev, DEV_CMD_SECTOR_SIZE, NULL, 0) / BLOCK_SECS;
     assert(total_block);
+
+    // 日志区放在最后一个逻辑块之后
+    u32 journal_blocks = 0;
+    if (args & MKFS_JOURNAL) {
+        journal_blocks = MIN(JOURNAL_BLOCKS, total_block / 16);
+        if (journal_blocks < JOURNAL_MIN_BLOCKS) {
+            return -EINVAL;
+        }
+        total_block -= journal_blocks;
+    }
     assert(icount < total_block);
-    if (!icount) {
-        icount = total_block / 3;
+
+    // 没有指定版本时，v1 放不下的设备使用 v2
+    int version = 1;
+    if (args & MKFS_V3) {
+        version = 3;
+    } else if ((args & MKFS_V2) || total_block > 0xFFFF) {
+        version = 2;
+    }
+
+    minix_sb_info_t *info = (minix_sb_info_t *)kmalloc(sizeof(minix_sb_info_t));
+    minix_format(info, version, version == 3 ? MINIX3_NAME_LEN : NAME_LEN);
+
+    // v1/v2 超级块中的 inode 数只有 16 位
+    u32 max_inodes = version == 3 ? total_block : 0xFFFF;
+    if (icount > max_inodes) {
+        kfree(info);
+        return -EINVAL;
+    }
+    if (icount) {
+        ret = mkfs_layout(info, total_block, icount);
+    } else {
+        // inode 表太大时减少 inode 数，直到第一个数据块号能够表示
+        icount = MIN(total_block / 3, max_inodes);
+        while ((ret = mkfs_layout(info, total_block, icount)) < EOK && icount > BLOCK_BITS) {
+            icount -= icount / 4;
+        }
+    }
+    if (ret < EOK) {
+        kfree(info);
+        return ret;
     }
+    info->free_zones = info->zones - info->firstdatazone;
+    info->reserved = 0;
+    info->journal = NULL;
 
     super = get_free_super();
+    if (!super) {
+        kfree(info);
+        return -EBUSY;
+    }
     super->type = FS_TYPE_MINIX;
     super->dev = dev;
     super->count++;
+    super->info = info;
 
     buf = bread(dev, 1);
     super->buf = buf;
-    buf->dirty = true;
+    super->desc = buf->data;
 
     // 初始化超级块
-    minix_super_t *desc = (minix_super_t *)buf->data;
-    super->desc = desc;
-
-    int inode_blocks = div_round_up(icount * sizeof(minix_inode_t), BLOCK_SIZE);
-    desc->inodes = icount;
-    desc->zones = total_block;
-    desc->imap_blocks = div_round_up(icount, BLOCK_BITS);
+    minix_write_super(info, buf->data);
+    bdirty(buf, true);
 
-    int zcount = total_block - desc->imap_blocks - inode_blocks - 2;
-    desc->zmap_blocks = div_round_up(zcount, BLOCK_BITS);
-
-    desc->firstdatazone = 2 + desc->imap_blocks + desc->zmap_blocks + inode_blocks;
-    desc->log_zone_size = 0;
-    desc->max_size = BLOCK_SIZE * TOTAL_BLOCK;
-    desc->magic = MINIX1_MAGIC;
+    LOGK("mkfs minix v%d dev %d zones %d inodes %d\n", version, dev, info->zones, info->inodes);
 
     int idx = 2;
-    for (int i = 0; i < (desc->imap_blocks + desc->zmap_blocks); i++, idx++) {
+    for (int i = 0; i < (info->imap_blocks + info->zmap_blocks); i++, idx++) {
         buf = bread(dev, idx);
         assert(buf);
-        buf->dirty = true;
+        bdirty(buf, true);
         memset(buf->data, 0, BLOCK_SIZE);
         brelse(buf);
     }
 
-    // 初始化位图
-    idx = minix_balloc(super);
+    // 初始化位图，逻辑块位图第 0 位保留
+    buf = bread(dev, 2 + info->imap_blocks);
+    buf->data[0] |= 1;
+    bdirty(buf, true);
+    brelse(buf);
 
     idx = minix_ialloc(super);
     idx = minix_ialloc(super);
 
+    if (journal_blocks) {
+        journal_format(dev, info->zones, journal_blocks);
+    }
+
     // 位图尾部置位 TODO:
 
     // 创建根目录
@@ -1173,27 +2211,122 @@ int minix_mkfs(dev_t dev, int icount) {
     minix_inode_t *minode = (minix_inode_t *)iroot->desc;
 
     minode->mode = (0777 & ~task->umask) | IFDIR;
-    minode->size = sizeof(minix_dentry_t) * 2; // 当前目录和父目录两个目录项
-    minode->nlinks = 2;                        // 一个是 '.' 一个是 name
+    minode->size = info->dentry_size * 2; // 当前目录和父目录两个目录项
+    minode->nlinks = 2;                   // 一个是 '.' 一个是 name
+    minix_inode_dirty(iroot);
 
     buf = bread(dev, minix_bmap(iroot, 0, true));
-    buf->dirty = true;
+    bdirty(buf, true);
 
     minix_dentry_t *entry = (minix_dentry_t *)buf->data;
     memset(entry, 0, BLOCK_SIZE);
 
-    strcpy(entry->name, ".");
-    entry->nr = iroot->nr;
+    dentry_set_name(iroot, entry, ".");
+    dentry_set_nr(iroot, entry, iroot->nr);
 
-    entry++;
-    strcpy(entry->name, "..");
-    entry->nr = iroot->nr;
+    entry = dentry_next(iroot, entry);
+    dentry_set_name(iroot, entry, "..");
+    dentry_set_nr(iroot, entry, iroot->nr);
 
     brelse(buf);
 
-    ret = 0;
-rollback:
     put_super(super);
+    return EOK;
+}
+
+// 提交运行中的事务
+static int minix_sync_fs(super_t *super) {
+    journal_commit(super);
+    return EOK;
+}
+
+static int minix_put_super(super_t *super) {
+    dindex_drop(super->dev);
+    journal_destroy(super);
+    return EOK;
+}
+
+/**
+ * 日志句柄
+ *
+ * 修改元数据的操作各自作为一个句柄，事务只在没有句柄时提交，
+ * 保证提交的都是完整的操作。内部互相调用时句柄可以嵌套。
+ */
+
+static int handle_open(inode_t *dir, char *name, int flags, int mode, inode_t **result) {
+    journal_begin(dir->super);
+    int ret = minix_open(dir, name, flags, mode, result);
+    journal_end(dir->super);
+    return ret;
+}
+
+static void handle_close(inode_t *inode) {
+    super_t *super = inode->super;
+    journal_begin(super);
+    minix_close(inode);
+    journal_end(super);
+}
+
+static int handle_write(inode_t *inode, char *data, int len, off_t offset) {
+    journal_begin(inode->super);
+    int ret = minix_write(inode, data, len, offset);
+    journal_end(inode->super);
+    return ret;
+}
+
+static int handle_truncate(inode_t *inode) {
+    journal_begin(inode->super);
+    int ret = minix_truncate(inode);
+    journal_end(inode->super);
+    return ret;
+}
+
+static int handle_mkdir(inode_t *dir, char *name, int mode) {
+    journal_begin(dir->super);
+    int ret = minix_mkdir(dir, name, mode);
+    journal_end(dir->super);
+    return ret;
+}
+
+static int handle_rmdir(inode_t *dir, char *name) {
+    journal_begin(dir->super);
+    int ret = minix_rmdir(dir, name);
+    journal_end(dir->super);
+    return ret;
+}
+
+static int handle_link(inode_t *odir, char *oldname, inode_t *ndir, char *newname) {
+    journal_begin(ndir->super);
+    int ret = minix_link(odir, oldname, ndir, newname);
+    journal_end(ndir->super);
+    return ret;
+}
+
+static int handle_unlink(inode_t *dir, char *name) {
+    journal_begin(dir->super);
+    int ret = minix_unlink(dir, name);
+    journal_end(dir->super);
+    return ret;
+}
+
+static int handle_mknod(inode_t *dir, char *name, int mode, int dev) {
+    journal_begin(dir->super);
+    int ret = minix_mknod(dir, name, mode, dev);
+    journal_end(dir->super);
+    return ret;
+}
+
+static int handle_sync(inode_t *inode) {
+    journal_begin(inode->super);
+    int ret = minix_sync(inode);
+    journal_end(inode->super);
+    return ret;
+}
+
+static int handle_direct_io(inode_t *inode, char *data, int len, off_t offset, int type) {
+    journal_begin(inode->super);
+    int ret = minix_direct_io(inode, data, len, offset, type);
+    journal_end(inode->super);
     return ret;
 }
 
@@ -1201,23 +2334,30 @@ static fs_op_t minix_op = {
     minix_mkfs,
     minix_super,
 
-    minix_open,
-    minix_close,
+    handle_open,
+    handle_close,
 
     minix_read,
-    minix_write,
-    minix_truncate,
+    handle_write,
+    handle_truncate,
 
     minix_stat,
     minix_permission,
 
     minix_namei,
-    minix_mkdir,
-    minix_rmdir,
-    minix_link,
-    minix_unlink,
-    minix_mknod,
+    handle_mkdir,
+    handle_rmdir,
+    handle_link,
+    handle_unlink,
+    handle_mknod,
     minix_readdir,
+    handle_sync,
+    minix_evict,
+    handle_direct_io,
+    minix_fsync,
+    minix_sync_fs,
+    minix_put_super,
+    minix_seek,
 };
 
 void minix_init() {
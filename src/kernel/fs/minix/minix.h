@@ -8,18 +8,22 @@
 #define SECTOR_SIZE 512 // 扇区大小
 #define BLOCK_SECS (BLOCK_SIZE / SECTOR_SIZE) // 一块占 2 个扇区
 
-#define MINIX1_MAGIC 0x137F // 文件系统魔数
+#define MINIX1_MAGIC 0x137F  // v1 文件系统魔数, 14 字符文件名
+#define MINIX1_MAGIC2 0x138F // v1, 30 字符文件名
+#define MINIX2_MAGIC 0x2468  // v2, 32 位逻辑块号
+#define MINIX2_MAGIC2 0x2478 // v2, 30 字符文件名
+#define MINIX3_MAGIC 0x4d5a  // v3, 32 位 inode 数, 60 字符文件名
+
 #define NAME_LEN 14         // 文件名长度
+#define NAME_LEN2 30        // 长文件名长度
+#define MINIX3_NAME_LEN 60  // v3 文件名长度
+
+#define BLOCK_BITS (BLOCK_SIZE * 8) // 块位图大小
 
-#define BLOCK_BITS (BLOCK_SIZE * 8)                          // 块位图大小
-#define BLOCK_INODES (BLOCK_SIZE / sizeof(minix_inode_t))    // 块 inode 数量
-#define BLOCK_DENTRIES (BLOCK_SIZE / sizeof(minix_dentry_t)) // 块 dentry 数量
-#define BLOCK_INDEXES (BLOCK_SIZE / sizeof(u16))             // 块索引数量
+#define DIRECT_BLOCK (7) // 直接块数量，之后依次是一级、二级 (v2/v3: 三级) 间接块
 
-#define DIRECT_BLOCK (7)                                               // 直接块数量
-#define INDIRECT1_BLOCK BLOCK_INDEXES                                  // 一级间接块数量
-#define INDIRECT2_BLOCK (INDIRECT1_BLOCK * INDIRECT1_BLOCK)            // 二级间接块数量
-#define TOTAL_BLOCK (DIRECT_BLOCK + INDIRECT1_BLOCK + INDIRECT2_BLOCK) // 全部块数量
+#define MINIX_DALLOC_MAX 64 // 单个 inode 最多延迟分配的块数
+#define MINIX_DINDEX_BLOCKS 4 // 目录达到此块数时建立哈希索引
 
 #define P_EXEC IXOTH
 #define P_READ IROTH
@@ -27,18 +31,39 @@
 
 #define ACC_MODE(x) ("\004\002\006\377"[(x)&O_ACCMODE])
 
+// v1/v2 超级块
 typedef struct minix_super_t {
     u16 inodes;        // 节点数
-    u16 zones;         // 逻辑块数
+    u16 nzones;        // 逻辑块数 (v1)
     u16 imap_blocks;   // i 节点位图所占用的数据块数
     u16 zmap_blocks;   // 逻辑块位图所占用的数据块数
     u16 firstdatazone; // 第一个数据逻辑块号
     u16 log_zone_size; // log2(每逻辑块数据块数)
     u32 max_size;      // 文件最大长度
     u16 magic;         // 文件系统魔数
+    u16 state;         // 挂载状态
+    u32 zones;         // 逻辑块数 (v2)
 } minix_super_t;
 
-typedef struct minix_inode_t {
+// v3 超级块
+typedef struct minix3_super_t {
+    u32 inodes;        // 节点数
+    u16 pad0;
+    u16 imap_blocks;   // i 节点位图所占用的数据块数
+    u16 zmap_blocks;   // 逻辑块位图所占用的数据块数
+    u16 firstdatazone; // 第一个数据逻辑块号
+    u16 log_zone_size; // log2(每逻辑块数据块数)
+    u16 pad1;
+    u32 max_size;      // 文件最大长度
+    u32 zones;         // 逻辑块数
+    u16 magic;         // 文件系统魔数
+    u16 pad2;
+    u16 block_size;    // 块大小
+    u8 disk_version;   // 磁盘格式版本
+} _packed minix3_super_t;
+
+// v1 磁盘 inode
+typedef struct minix1_inode_t {
     u16 mode;    // 文件类型和属性(rwx 位)
     u16 uid;     // 用户id（文件拥有者标识符）
     u32 size;    // 文件大小（字节数）
@@ -46,12 +71,155 @@ typedef struct minix_inode_t {
     u8 gid;      // 组id(文件拥有者所在的组)
     u8 nlinks;   // 链接数（多少个文件目录项指向该i 节点）
     u16 zone[9]; // 直接 (0-6)、间接(7)或双重间接 (8) 逻辑块号
+} minix1_inode_t;
+
+// v2/v3 磁盘 inode，同时是内存中各版本统一的 inode 描述符
+typedef struct minix_inode_t {
+    u16 mode;     // 文件类型和属性(rwx 位)
+    u16 nlinks;   // 链接数
+    u16 uid;      // 用户id
+    u16 gid;      // 组id
+    u32 size;     // 文件大小（字节数）
+    u32 atime;    // 访问时间
+    u32 mtime;    // 修改时间
+    u32 ctime;    // inode 修改时间
+    u32 zone[10]; // 直接 (0-6)、间接 (7)、双重间接 (8) 和三重间接 (9) 逻辑块号
 } minix_inode_t;
 
-// 文件目录项结构
+// 内存中的超级块私有信息
+typedef struct minix_sb_info_t {
+    u8 version;         // 文件系统版本 1/2/3
+    u8 name_len;        // 文件名最大长度
+    u16 dentry_size;    // 目录项大小
+    u16 inode_size;     // 磁盘 inode 大小
+    u16 indexes;        // 索引块中的索引数, v1 为 16 位块号, v2/v3 为 32 位
+    u32 max_blocks;     // 文件最多块数
+
+    u32 inodes;         // 节点数
+    u32 zones;          // 逻辑块数
+    u16 imap_blocks;    // i 节点位图所占用的数据块数
+    u16 zmap_blocks;    // 逻辑块位图所占用的数据块数
+    u32 firstdatazone;  // 第一个数据逻辑块号
+
+    u32 free_zones; // 空闲逻辑块数
+    u32 reserved;   // 已预留但尚未分配的块数 (延迟分配)
+    struct minix_journal_t *journal; // 元数据日志, 没有日志时为 NULL
+} minix_sb_info_t;
+
+// v1/v2 文件目录项结构，v3 的 inode 号为 32 位；
+// 文件名长度由超级块决定，通过 minix.c 中的 dentry_* 访问
 typedef struct minix_dentry_t {
     u16 nr;              // i 节点
     char name[NAME_LEN]; // 文件名
 } minix_dentry_t;
 
+typedef struct minix3_dentry_t {
+    u32 nr;                     // i 节点
+    char name[MINIX3_NAME_LEN]; // 文件名
+} minix3_dentry_t;
+
+// 目录哈希索引表项
+typedef struct dindex_slot_t {
+    u32 hash; // 名字哈希
+    u32 slot; // 目录项序号
+} dindex_slot_t;
+
+// 大目录的内存哈希索引，开放寻址
+typedef struct minix_dindex_t {
+    dindex_slot_t *table; // 哈希表
+    u32 size;             // 哈希表大小, 2 的幂
+    u32 used;             // 有效项与墓碑数量
+    u32 count;            // 有效项数量
+    u32 gen;              // 哈希表重建次数，遍历时用于检测变化
+
+    u32 *free;            // 空闲目录项序号栈
+    u32 free_size;
+    u32 free_count;
+} minix_dindex_t;
+
+u32 dindex_hash(const char *name, size_t len);
+minix_dindex_t *dindex_create();
+void dindex_destroy(minix_dindex_t *index);
+void dindex_insert(minix_dindex_t *index, u32 hash, u32 slot);
+bool dindex_remove(minix_dindex_t *index, u32 hash, u32 slot);
+idx_t dindex_next(minix_dindex_t *index, u32 hash, u32 *pos);
+void dindex_free_push(minix_dindex_t *index, u32 slot);
+idx_t dindex_free_pop(minix_dindex_t *index);
+
+// inode 回收后保留索引，再次读入时不必重建
+void dindex_park(dev_t dev, idx_t nr, u32 size, u32 mtime, minix_dindex_t *index);
+minix_dindex_t *dindex_unpark(dev_t dev, idx_t nr, u32 size, u32 mtime);
+void dindex_drop(dev_t dev);
+
+#define JOURNAL_MAGIC 0x4c4e524a  // "JRNL"
+#define JOURNAL_BLOCKS 1024       // 日志区最大块数
+#define JOURNAL_MIN_BLOCKS 64     // 日志区最小块数
+#define JOURNAL_TXN_MAX 128       // 运行中事务达到此块数时提交
+
+enum journal_block_type {
+    JOURNAL_SUPER = 1, // 日志超级块
+    JOURNAL_DESC,      // 描述块
+    JOURNAL_COMMIT,    // 提交块
+    JOURNAL_REVOKE,    // 撤销块, 之前事务中这些块的副本不再重放
+};
+
+typedef struct journal_header_t {
+    u32 magic;    // JOURNAL_MAGIC
+    u32 type;     // journal_block_type
+    u32 sequence; // 事务序号
+} journal_header_t;
+
+// 日志超级块，位于最后一个逻辑块之后
+typedef struct journal_super_t {
+    journal_header_t header; // sequence 为日志中第一个事务的序号
+    u32 blocks;              // 日志区块数，包括日志超级块
+} journal_super_t;
+
+#define JOURNAL_TAGS ((BLOCK_SIZE - sizeof(journal_header_t) - sizeof(u32)) / sizeof(u32))
+
+// 描述块，之后紧跟 count 个元数据块的副本；撤销块格式相同，没有副本
+typedef struct journal_desc_t {
+    journal_header_t header;
+    u32 count;               // 副本数量
+    u32 blocks[JOURNAL_TAGS]; // 副本对应的块号
+} journal_desc_t;
+
+// 提交块，写入之后事务才算完成
+typedef struct journal_commit_t {
+    journal_header_t header;
+    u32 count;    // 事务中的元数据块数量
+    u32 checksum; // 元数据块副本的校验和
+} journal_commit_t;
+
+// 内存中的日志
+typedef struct minix_journal_t {
+    dev_t dev;
+    idx_t base;       // 日志超级块的块号
+    u32 blocks;       // 日志区块数
+    u32 head;         // 下一个写入的相对块号
+    u32 pending;      // 顺序写缓冲中的块数
+    u32 sequence;     // 运行中事务的序号
+    list_t running;   // 运行中事务的缓冲
+    u32 count;        // 运行中事务的缓冲数量
+    u32 handles;      // 进行中的操作数量
+    bool committing;  // 正在提交
+    list_t wait_list; // 等待提交完成或操作结束的任务
+    char *page;       // 顺序写日志用的一页缓冲
+
+    u32 *logged;      // 上次检查点之后写入日志的块号
+    u32 nlogged;
+    u32 *revoke;      // 运行中事务释放的已记录块
+    u32 nrevoke;
+    u32 revoke_size;
+} minix_journal_t;
+
+void journal_format(dev_t dev, idx_t base, u32 blocks);
+err_t journal_load(super_t *super, idx_t base);
+void journal_destroy(super_t *super);
+void journal_begin(super_t *super);
+void journal_end(super_t *super);
+bool journal_dirty(super_t *super, buffer_t *bf);
+void journal_forget(super_t *super, idx_t block);
+bool journal_commit(super_t *super);
+
 #endif
\ No newline at end of file
@@ -5,6 +5,8 @@
 #include <xjos/task.h>
 #include <xjos/assert.h>
 #include <xjos/debug.h>
+#include <xjos/arena.h>
+#include <xjos/memory.h>
 
 
 #define LOGK(fmt, args...) DEBUGK(fmt, ##args)
@@ -14,12 +16,23 @@ extern time_t sys_time();
 /**
  * 哈希相关
  */
-#define DCACHE_NR  128 // dcache entry number
-#define DCACHE_HASH_SIZE  64 // dcache hash table size
-
-static dcache_entry_t dcache_entries[DCACHE_NR];
-static list_t dcache_hash_table[DCACHE_HASH_SIZE];
-static list_t dcache_lru_list; // lru list
+#define DCACHE_MAX 1024          // dcache 表项上限
+#define DCACHE_HASH_MIN 64       // 初始哈希桶数量
+#define DCACHE_HASH_MAX 1024     // 哈希桶数量上限
+#define DCACHE_LOAD 2            // 平均链长超过时扩容哈希表
+
+typedef struct dcache_bucket_t {
+    list_t list;     // 冲突链
+    u32 count;       // 链长
+    u32 hits;        // 命中次数
+    u32 misses;      // 未命中次数
+} dcache_bucket_t;
+
+static dcache_bucket_t *dcache_buckets; // hash table
+static u32 dcache_hash_size;            // 哈希桶数量, 2 的幂
+static list_t dcache_lru_list;          // lru list, 表头为最近使用
+static u32 dcache_count;                // 表项数量
+static u32 dcache_negative;             // 负目录项数量
 
 // DJB2
 static u32 str_hash(const char *name, size_t len) {
@@ -30,35 +43,60 @@ static u32 str_hash(const char *name, size_t len) {
     return hash;
 }
 
-/**
- * Dcache kernel logic
- */
-void dcache_init() {
-    // Initialize hash table
-    for (int i = 0; i < DCACHE_HASH_SIZE; i++) {
-        list_init(&dcache_hash_table[i]);
-    }
+static _inline dcache_bucket_t *dcache_bucket(u32 hash) {
+    return &dcache_buckets[hash & (dcache_hash_size - 1)];
+}
 
-    list_init(&dcache_lru_list);
+static dcache_bucket_t *dcache_alloc_buckets(u32 size) {
+    dcache_bucket_t *buckets = (dcache_bucket_t *)kmalloc(size * sizeof(dcache_bucket_t));
+    for (size_t i = 0; i < size; i++) {
+        list_init(&buckets[i].list);
+        buckets[i].count = 0;
+        buckets[i].hits = 0;
+        buckets[i].misses = 0;
+    }
+    return buckets;
+}
 
-    for (int i = 0; i < DCACHE_NR; i++) {
-        dcache_entry_t *entry = &dcache_entries[i];
-        entry->dev = 0;
-        entry->p_nr = 0;
-        entry->nr = 0;
-        list_push(&dcache_lru_list, &entry->lru_node);
-    }    
+// 哈希表扩容一倍，重新分布所有表项，统计信息清零
+static void dcache_rehash() {
+    u32 size = dcache_hash_size * 2;
+    dcache_bucket_t *buckets = dcache_alloc_buckets(size);
+    dcache_bucket_t *old = dcache_buckets;
+    u32 old_size = dcache_hash_size;
+
+    dcache_buckets = buckets;
+    dcache_hash_size = size;
+
+    for (size_t i = 0; i < old_size; i++) {
+        list_t *list = &old[i].list;
+        while (!list_empty(list)) {
+            dcache_entry_t *entry = list_entry(list_pop(list), dcache_entry_t, hnode);
+            dcache_bucket_t *bucket = dcache_bucket(entry->hash);
+            list_push(&bucket->list, &entry->hnode);
+            bucket->count++;
+        }
+    }
+    kfree(old);
+    LOGK("dcache rehash %d buckets, %d entries\n", size, dcache_count);
 }
 
-// find cache entry
-idx_t dcache_lookup(inode_t *dir, const char *name, size_t len) {
-    u32 hash = str_hash(name, len);
-    u32 idx = hash % DCACHE_HASH_SIZE;
+// 释放表项
+static void dcache_free(dcache_entry_t *entry) {
+    dcache_bucket(entry->hash)->count--;
+    list_remove(&entry->hnode);
+    list_remove(&entry->lru_node);
+    if (entry->nr == DCACHE_NEGATIVE)
+        dcache_negative--;
+    dcache_count--;
+    kfree(entry);
+}
 
-    list_t *head = &dcache_hash_table[idx];
+static dcache_entry_t *dcache_find(inode_t *dir, const char *name, size_t len, u32 hash) {
+    dcache_bucket_t *bucket = dcache_bucket(hash);
     dcache_entry_t *entry;
 
-    list_for_each_entry(entry, head, hnode) {
+    list_for_each_entry(entry, &bucket->list, hnode) {
         // 1. check hash
         if (entry->hash != hash)
             continue;
@@ -67,78 +105,149 @@ idx_t dcache_lookup(inode_t *dir, const char *name, size_t len) {
             continue;
 
         // 3. check name
-        if (memcmp(entry->name, name, len) == 0 && entry->name[len] == EOS) {
-            // Move to front of LRU list
-            list_remove(&entry->lru_node);
-            list_push(&dcache_lru_list, &entry->lru_node);
+        if (memcmp(entry->name, name, len) == 0 && entry->name[len] == EOS)
+            return entry;
+    }
+    return NULL;
+}
 
-            return entry->nr;
-        }
+/**
+ * Dcache kernel logic
+ */
+void dcache_init() {
+    dcache_hash_size = DCACHE_HASH_MIN;
+    dcache_buckets = dcache_alloc_buckets(dcache_hash_size);
+
+    list_init(&dcache_lru_list);
+    dcache_count = 0;
+    dcache_negative = 0;
+
+    register_shrinker(dcache_shrink);
+}
+
+// find cache entry, 返回 0 表示未命中, DCACHE_NEGATIVE 表示名字不存在
+idx_t dcache_lookup(inode_t *dir, const char *name, size_t len) {
+    if (len > MAXNAMELEN)
+        return 0;
+
+    u32 hash = str_hash(name, len);
+    dcache_bucket_t *bucket = dcache_bucket(hash);
+    dcache_entry_t *entry = dcache_find(dir, name, len, hash);
+    if (!entry) {
+        bucket->misses++;
+        return 0; // miss
     }
 
-    return 0; // miss
+    bucket->hits++;
+
+    // Move to front of LRU list
+    list_remove(&entry->lru_node);
+    list_push(&dcache_lru_list, &entry->lru_node);
+    return entry->nr;
 }
 
-// add cache entry
+// add cache entry, nr 为 DCACHE_NEGATIVE 时记录不存在的名字
 void dcache_add(inode_t *dir, const char *name, size_t len, idx_t nr) {
-    // 1. get free entry from LRU list
-    if (list_empty(&dcache_lru_list)) {
+    assert(nr);
+    // 超出长度的名字不缓存，避免截断后冲突
+    if (len > MAXNAMELEN)
         return;
+
+    u32 hash = str_hash(name, len);
+    dcache_entry_t *entry = dcache_find(dir, name, len, hash);
+    if (entry) {
+        dcache_free(entry);
+    }
+
+    // 1. 达到上限复用 LRU 尾部表项，否则从 slab 分配
+    if (dcache_count >= DCACHE_MAX) {
+        entry = list_entry(dcache_lru_list.head.prev, dcache_entry_t, lru_node);
+        dcache_free(entry);
+    }
+
+    if (dcache_count >= dcache_hash_size * DCACHE_LOAD &&
+        dcache_hash_size < DCACHE_HASH_MAX) {
+        dcache_rehash();
     }
 
-    // from tail (least recently used)
-    list_node_t *node = list_popback(&dcache_lru_list);
-    dcache_entry_t *entry = list_entry(node, dcache_entry_t, lru_node);
+    entry = (dcache_entry_t *)kmalloc(sizeof(dcache_entry_t));
+    list_node_init(&entry->hnode);
+    list_node_init(&entry->lru_node);
 
-    if (entry->nr != 0)
-        list_remove(&entry->hnode); // remove from hash table
-    
     // 2. fill entry
     entry->nr = nr;
     entry->dev = dir->dev;
     entry->p_nr = dir->nr;
-    entry->hash = str_hash(name, len);
+    entry->hash = hash;
 
-    // 超出 14限制 截断
-    size_t copy_len = len > MAXNAMELEN ? MAXNAMELEN : len;
-    memcpy(entry->name, name, copy_len);
-    entry->name[copy_len] = EOS;
+    memcpy(entry->name, name, len);
+    entry->name[len] = EOS;
 
     // 3. insert into hash table
-    u32 idx = entry->hash % DCACHE_HASH_SIZE;
-    list_push(&dcache_hash_table[idx], &entry->hnode);
+    dcache_bucket_t *bucket = dcache_bucket(hash);
+    list_push(&bucket->list, &entry->hnode);
+    bucket->count++;
 
-    // 4. insert into lru list tail (most recently used)
+    // 4. insert into lru list head (most recently used)
     list_push(&dcache_lru_list, &entry->lru_node);
+
+    dcache_count++;
+    if (nr == DCACHE_NEGATIVE)
+        dcache_negative++;
 }
 
 
 // del cache entry
 void dcache_delete(inode_t *dir, const char *name, size_t len) {
-    u32 hash = str_hash(name, len);
-    u32 idx = hash % DCACHE_HASH_SIZE;
+    if (len > MAXNAMELEN)
+        return;
 
-    list_t *head = &dcache_hash_table[idx];
-    dcache_entry_t *entry;
+    dcache_entry_t *entry = dcache_find(dir, name, len, str_hash(name, len));
+    if (entry)
+        dcache_free(entry);
+}
 
-    list_for_each_entry(entry, head, hnode) {
-        if (entry->hash != hash)
+
+// 删除设备 dev 上目录 p_nr 下的所有表项，p_nr 为 0 时删除整个设备的表项
+void dcache_invalidate(dev_t dev, idx_t p_nr) {
+    dcache_entry_t *entry, *next;
+    list_for_each_entry_safe(entry, next, &dcache_lru_list, lru_node) {
+        if (entry->dev != dev)
             continue;
-        if (entry->dev != dir->dev || entry->p_nr != dir->nr)
+        if (p_nr && entry->p_nr != p_nr)
             continue;
-        if (memcmp(entry->name, name, len) == 0 && entry->name[len] == EOS) {
-            // Remove hash table and LRU list
-            list_remove(&entry->hnode);
-            list_remove(&entry->lru_node);
-
-            // reset entry
-            entry->dev = 0;
-            entry->p_nr = 0;
-            entry->nr = 0;
-            // Add back to free list
-            list_push(&dcache_lru_list, &entry->lru_node);
-            return;
-        }
+        dcache_free(entry);
+    }
+}
+
+
+// 从 LRU 尾部释放最多 count 个表项，返回释放数量
+u32 dcache_shrink(u32 count) {
+    u32 freed = 0;
+    while (freed < count && !list_empty(&dcache_lru_list)) {
+        dcache_entry_t *entry = list_entry(dcache_lru_list.head.prev, dcache_entry_t, lru_node);
+        dcache_free(entry);
+        freed++;
+    }
+    return freed;
+}
+
+
+// dcache 统计信息，用于 /proc/dcache
+void dcache_stat(dcache_stat_t *stat) {
+    memset(stat, 0, sizeof(dcache_stat_t));
+    stat->count = dcache_count;
+    stat->negative = dcache_negative;
+    stat->buckets = dcache_hash_size;
+
+    for (size_t i = 0; i < dcache_hash_size; i++) {
+        dcache_bucket_t *bucket = &dcache_buckets[i];
+        stat->hits += bucket->hits;
+        stat->misses += bucket->misses;
+        if (bucket->count)
+            stat->used++;
+        if (bucket->count > stat->longest)
+            stat->longest = bucket->count;
     }
 }
 
@@ -162,10 +271,10 @@ bool match_name(const char *name, const char *entry_name, char **next) {
 }
 
 
-// name length
-static int minix_name_len(const char * name) {
-    int len = 0;
-    while (len < MAXNAMELEN && name[len] != EOS) {
+// 路径第一个分量的长度
+size_t dentry_name_len(const char *name) {
+    size_t len = 0;
+    while (name[len] != EOS && !IS_SEPARATOR(name[len])) {
         len++;
     }
     return len;
@@ -3,29 +3,70 @@
 #include <xjos/task.h>
 #include <xjos/memory.h>
 #include <xjos/arena.h>
-#include <xjos/fifo.h>
+#include <xjos/string.h>
+#include <xjos/stdlib.h>
 #include <xjos/assert.h>
 #include <xjos/debug.h>
 #include <xjos/errno.h>
 
 #define LOGK(fmt, args...) DEBUGK(fmt, ##args)
 
+#define PIPE_PAGES 4      // 默认缓冲页数
+#define PIPE_MAX_PAGES 64 // 最大缓冲页数
+
+typedef struct pipe_t {
+    char *buf;     // 环形缓冲
+    u32 size;      // 缓冲大小, 2 的幂
+    u32 head;      // 累计写入字节数
+    u32 tail;      // 累计读出字节数
+    u32 busy;      // begin 之后未 end 的访问数，期间不能更换缓冲
+    list_t rxlist; // 等待读的进程
+    list_t txlist; // 等待写的进程
+} pipe_t;
+
+static _inline u32 pipe_used(pipe_t *pipe) {
+    return pipe->head - pipe->tail;
+}
+
+// 从缓冲读出 len 字节，最多分两段拷贝
+static void pipe_copy_out(pipe_t *pipe, char *data, u32 len) {
+    u32 pos = pipe->tail & (pipe->size - 1);
+    u32 chunk = MIN(len, pipe->size - pos);
+    memcpy(data, pipe->buf + pos, chunk);
+    memcpy(data + chunk, pipe->buf, len - chunk);
+    pipe->tail += len;
+}
+
+// 唤醒等待队列中的所有进程
+static void pipe_wakeup(list_t *list) {
+    while (!list_empty(list)) {
+        task_t *task = list_entry(list_pop(list), task_t, node);
+        task_unblock(task, EOK);
+    }
+}
+
 static inode_t *pipe_open() {
     inode_t *inode = get_free_inode();
     // 但是被占用了
     inode->dev = -FS_TYPE_PIPE;
-    // 申请内存，表示缓冲队列
-    inode->desc = (void *)kmalloc(sizeof(fifo_t));
-    // 管道缓冲区一页内存
-    inode->addr = (void *)alloc_kpage(1);
+    // 申请内存，表示管道描述符
+    pipe_t *pipe = (pipe_t *)kmalloc(sizeof(pipe_t));
+    inode->desc = pipe;
+    // 管道缓冲区
+    pipe->buf = (char *)alloc_kpage(PIPE_PAGES);
+    pipe->size = PIPE_PAGES * PAGE_SIZE;
+    pipe->head = 0;
+    pipe->tail = 0;
+    pipe->busy = 0;
+    list_init(&pipe->rxlist);
+    list_init(&pipe->txlist);
+    inode->addr = pipe->buf;
     // 两个文件
     inode->count = 2;
     // 管道类型
     inode->type = FS_TYPE_PIPE;
     // 管道操作
     inode->op = fs_get_op(FS_TYPE_PIPE);
-    // 初始化输入输出设备
-    fifo_init((fifo_t *)inode->desc, (char *)inode->buf, PAGE_SIZE);
     return inode;
 }
 
@@ -37,65 +78,184 @@ static void pipe_close(inode_t *inode) {
         return;
     inode->type = FS_TYPE_NONE;
 
-    // 释放描述符 fifo
-    kfree(inode->desc);
+    pipe_t *pipe = (pipe_t *)inode->desc;
+    assert(list_empty(&pipe->rxlist));
+    assert(list_empty(&pipe->txlist));
+
     // 释放缓冲区
-    free_kpage((u32)inode->addr, 1);
+    free_kpage((u32)pipe->buf, pipe->size / PAGE_SIZE);
+    // 释放描述符
+    kfree(pipe);
     // 释放 inode
     put_free_inode(inode);
 }
 
+/**
+ * 直接访问环形缓冲，供 pipe_read/pipe_write 和 splice 使用
+ *
+ * begin 返回一段连续的可读数据 (或可写空间) 及其长度，
+ * 调用者拷贝之后用 end 提交实际的字节数。
+ * begin 返回非零时缓冲被占用，调用者可能在拷贝中睡眠，
+ * 必须调用 end 释放 (可以提交 0 字节)，之前 pipe_setsize 返回 -EBUSY。
+ */
+
+// 获取可读的连续数据，缓冲为空时 wait 为真则等待，否则返回 0
+u32 pipe_read_begin(inode_t *inode, char **data, bool wait) {
+    assert(inode->type == FS_TYPE_PIPE);
+    pipe_t *pipe = (pipe_t *)inode->desc;
+    while (!pipe_used(pipe)) {
+        if (!wait)
+            return 0;
+        task_block(running_task(), &pipe->rxlist, TASK_BLOCKED, TIMELESS);
+    }
+
+    u32 pos = pipe->tail & (pipe->size - 1);
+    *data = pipe->buf + pos;
+    pipe->busy++;
+    return MIN(pipe_used(pipe), pipe->size - pos);
+}
+
+void pipe_read_end(inode_t *inode, u32 len) {
+    pipe_t *pipe = (pipe_t *)inode->desc;
+    assert(pipe->busy);
+    assert(len <= pipe_used(pipe));
+    pipe->busy--;
+    bool full = (pipe_used(pipe) == pipe->size);
+    pipe->tail += len;
+
+    // 写进程只在缓冲满时等待，由满变为不满时唤醒
+    if (full && len)
+        pipe_wakeup(&pipe->txlist);
+}
+
+// 获取可写的连续空间，缓冲满时等待
+u32 pipe_write_begin(inode_t *inode, char **data) {
+    assert(inode->type == FS_TYPE_PIPE);
+    pipe_t *pipe = (pipe_t *)inode->desc;
+    while (pipe_used(pipe) == pipe->size) {
+        task_block(running_task(), &pipe->txlist, TASK_BLOCKED, TIMELESS);
+    }
+
+    u32 pos = pipe->head & (pipe->size - 1);
+    *data = pipe->buf + pos;
+    pipe->busy++;
+    return MIN(pipe->size - pipe_used(pipe), pipe->size - pos);
+}
+
+void pipe_write_end(inode_t *inode, u32 len) {
+    pipe_t *pipe = (pipe_t *)inode->desc;
+    assert(pipe->busy);
+    assert(len <= pipe->size - pipe_used(pipe));
+    pipe->busy--;
+    bool empty = (pipe_used(pipe) == 0);
+    pipe->head += len;
+
+    // 读进程只在缓冲空时等待，由空变为非空时唤醒
+    if (empty && len)
+        pipe_wakeup(&pipe->rxlist);
+}
+
 static int pipe_read(inode_t *inode, char *data, int count, off_t offset) {
-    fifo_t *fifo = (fifo_t *)inode->desc;
     int nr = 0;
     while (nr < count) {
-        if (fifo_empty(fifo)) {
-            assert(inode->rxwaiter == NULL);
-            inode->rxwaiter = running_task();
-            task_block(inode->rxwaiter, NULL, TASK_BLOCKED, TIMELESS);
-        }
-        data[nr++] = fifo_get(fifo);
-        if (inode->txwaiter) {
-            task_unblock(inode->txwaiter, EOK);
-            inode->txwaiter = NULL;
+        char *ptr;
+        u32 len = pipe_read_begin(inode, &ptr, true);
+        len = MIN(len, (u32)(count - nr));
+        // 拷贝失败时数据留在管道中
+        if (copy_to_user(data + nr, ptr, len) < EOK) {
+            pipe_read_end(inode, 0);
+            return nr ? nr : -EFAULT;
         }
+        pipe_read_end(inode, len);
+        nr += len;
     }
     return nr;
 }
 
 static int pipe_write(inode_t *inode, char *data, int count, off_t offset) {
-    fifo_t *fifo = (fifo_t *)inode->desc;
     int nr = 0;
     while (nr < count) {
-        if (fifo_full(fifo)) {
-            assert(inode->txwaiter == NULL);
-            inode->txwaiter = running_task();
-            task_block(inode->txwaiter, NULL, TASK_BLOCKED, TIMELESS);
-        }
-        fifo_put(fifo, data[nr++]);
-        if (inode->rxwaiter) {
-            task_unblock(inode->rxwaiter, EOK);
-            inode->rxwaiter = NULL;
+        char *ptr;
+        u32 len = pipe_write_begin(inode, &ptr);
+        len = MIN(len, (u32)(count - nr));
+        if (copy_from_user(ptr, data + nr, len) < EOK) {
+            pipe_write_end(inode, 0);
+            return nr ? nr : -EFAULT;
         }
+        pipe_write_end(inode, len);
+        nr += len;
     }
     return nr;
 }
 
+// 获取管道缓冲大小
+int pipe_getsize(inode_t *inode) {
+    assert(inode->type == FS_TYPE_PIPE);
+    pipe_t *pipe = (pipe_t *)inode->desc;
+    return pipe->size;
+}
+
+// 调整管道缓冲大小，向上取整为 2 的幂个页，返回实际大小
+int pipe_setsize(inode_t *inode, u32 size) {
+    assert(inode->type == FS_TYPE_PIPE);
+    pipe_t *pipe = (pipe_t *)inode->desc;
+
+    u32 pages = 1;
+    while (pages * PAGE_SIZE < size && pages < PIPE_MAX_PAGES)
+        pages <<= 1;
+    if (pages * PAGE_SIZE < size)
+        return -EINVAL;
+
+    // splice 等还持有缓冲中的指针
+    if (pipe->busy)
+        return -EBUSY;
+
+    u32 used = pipe_used(pipe);
+    if (pages * PAGE_SIZE < used)
+        return -EBUSY;
+
+    if (pages * PAGE_SIZE == pipe->size)
+        return pipe->size;
+
+    char *buf = (char *)alloc_kpage(pages);
+    pipe_copy_out(pipe, buf, used);
+    free_kpage((u32)pipe->buf, pipe->size / PAGE_SIZE);
+
+    bool grow = pages * PAGE_SIZE > pipe->size;
+    pipe->buf = buf;
+    pipe->size = pages * PAGE_SIZE;
+    pipe->head = used;
+    pipe->tail = 0;
+    inode->addr = buf;
+
+    // 扩大后有了空闲空间
+    if (grow)
+        pipe_wakeup(&pipe->txlist);
+
+    LOGK("pipe resize to %d bytes\n", pipe->size);
+    return pipe->size;
+}
+
 int sys_pipe(fd_t pipefd[2]) {
     // LOGK("pipe system call!!!!!!! %d\n", sizeof(fifo_t));
 
-    inode_t *inode = pipe_open();
-
     task_t *task = running_task();
     file_t *files[2];
+    fd_t fd[2];
 
-    pipefd[0] = fd_get(&files[0]);
-    if (pipefd[0] < EOK)
-        goto rollback;
+    fd[0] = fd_get(&files[0]);
+    if (fd[0] < EOK)
+        return -EMFILE;
 
-    pipefd[1] = fd_get(&files[1]);
-    if (pipefd[1] < EOK)
-        goto rollback;
+    fd[1] = fd_get(&files[1]);
+    if (fd[1] < EOK) {
+        // 还没有绑定 inode，fd_put 不接受
+        task->files[fd[0]] = NULL;
+        put_file(files[0]);
+        return -EMFILE;
+    }
+
+    inode_t *inode = pipe_open();
 
     files[0]->inode = inode;
     files[0]->flags = O_RDONLY;
@@ -103,13 +263,14 @@ int sys_pipe(fd_t pipefd[2]) {
     files[1]->inode = inode;
     files[1]->flags = O_WRONLY;
 
-    return EOK;
-
-rollback:
-    for (size_t i = 0; i < 2; i++) {
-        fd_put(pipefd[i]);
+    // pipefd 是用户地址，先在内核填好再复制出去
+    err_t ret = copy_to_user(pipefd, fd, sizeof(fd));
+    if (ret < EOK) {
+        // 两个文件都关闭后管道随之释放
+        fd_put(fd[0]);
+        fd_put(fd[1]);
     }
-    return -EMFILE;
+    return ret;
 }
 
 static fs_op_t pipe_op = {
@@ -133,6 +294,13 @@ static fs_op_t pipe_op = {
     fs_default_nosys,
     fs_default_nosys,
     fs_default_nosys,
+    fs_default_nosys,
+    fs_default_nosys,
+    fs_default_nosys,
+    fs_default_nosys,
+    fs_default_nosys,
+    fs_default_nosys,
+    fs_default_nosys,
 };
 
 void pipe_init() {
@@ -0,0 +1,561 @@
+#include <fs/fs.h>
+#include <fs/stat.h>
+#include <fs/buffer.h>
+#include <drivers/zram.h>
+#include <xjos/task.h>
+#include <xjos/sched.h>
+#include <xjos/memory.h>
+#include <xjos/interrupt.h>
+#include <xjos/net.h>
+#include <xjos/string.h>
+#include <xjos/stdio.h>
+#include <xjos/stdlib.h>
+#include <xjos/assert.h>
+#include <xjos/debug.h>
+#include <xjos/errno.h>
+
+#define LOGK(fmt, args...) DEBUGK(fmt, ##args)
+
+extern time_t sys_time();
+extern task_t *tasks_table[TASK_NR];
+
+/**
+ * procfs 内核状态文件系统
+ *
+ * 文件不占用存储，每次 read 时根据内核当前状态生成内容。
+ * 固定文件的节点号在 proc_table 中，进程目录 /proc/<pid> 下的节点号由 pid 计算。
+ */
+
+#define PROC_BUF_PAGES 2    // 生成文件内容的缓冲页数
+#define PROC_PID_BASE 0x100 // 进程节点号起点
+#define PROC_PID_SHIFT 4    // 每个进程目录下最多 16 个节点
+#define PROC_PID_POS 16     // 根目录 readdir 中进程目录的起始位置
+
+#define PROC_ROOT_NR 1
+#define PROC_NET_NR 6
+
+#define PAGE_KB (PAGE_SIZE / 1024)
+
+typedef int (*proc_show_t)(char *buf, task_t *task);
+
+typedef struct proc_entry_t {
+    char *name;
+    idx_t nr;         // 节点号，进程目录下为相对序号
+    idx_t parent;     // 父目录节点号
+    mode_t mode;      // 文件模式
+    proc_show_t show; // 生成文件内容，返回长度
+} proc_entry_t;
+
+static _inline idx_t proc_pid_nr(pid_t pid, idx_t idx) {
+    return PROC_PID_BASE + (pid << PROC_PID_SHIFT) + idx;
+}
+
+static _inline pid_t proc_pid(inode_t *inode) {
+    return (inode->nr - PROC_PID_BASE) >> PROC_PID_SHIFT;
+}
+
+// 进程节点对应的进程，进程已经退出返回 NULL
+static task_t *proc_task(inode_t *inode) {
+    if (inode->nr < PROC_PID_BASE)
+        return NULL;
+    return get_task(proc_pid(inode));
+}
+
+// 避免溢出的百分比
+static u32 percent(u32 part, u32 total) {
+    if (!total)
+        return 0;
+    if (part < 0x1000000)
+        return part * 100 / total;
+    return part / (total / 100);
+}
+
+static char task_state(task_t *task) {
+    static char states[] = "IRRDSWZ";
+    return states[task->state];
+}
+
+static int proc_meminfo(char *buf, task_t *task) {
+    memory_stat_t mem;
+    buffer_stat_t bstat;
+    memory_stat(&mem);
+    buffer_stat(&bstat);
+
+    int len = 0;
+    len += sprintf(buf + len, "MemTotal:    %8d kB\n", mem.total_pages * PAGE_KB);
+    len += sprintf(buf + len, "MemFree:     %8d kB\n", mem.free_pages * PAGE_KB);
+    len += sprintf(buf + len, "KernelTotal: %8d kB\n", mem.kernel_pages * PAGE_KB);
+    len += sprintf(buf + len, "KernelFree:  %8d kB\n", mem.kernel_free * PAGE_KB);
+    len += sprintf(buf + len, "Buffers:     %8d kB\n", bstat.count * BLOCK_SIZE / 1024);
+    len += sprintf(buf + len, "Dirty:       %8d kB\n", bstat.dirty * BLOCK_SIZE / 1024);
+    return len;
+}
+
+static int proc_buffers(char *buf, task_t *task) {
+    buffer_stat_t stat;
+    buffer_stat(&stat);
+
+    int len = 0;
+    len += sprintf(buf + len, "count   %d\n", stat.count);
+    len += sprintf(buf + len, "max     %d\n", stat.max);
+    len += sprintf(buf + len, "free    %d\n", stat.free);
+    len += sprintf(buf + len, "dirty   %d\n", stat.dirty);
+    len += sprintf(buf + len, "hits    %d\n", stat.hits);
+    len += sprintf(buf + len, "misses  %d\n", stat.misses);
+    len += sprintf(buf + len, "ratio   %d%%\n", percent(stat.hits, stat.hits + stat.misses));
+    len += sprintf(buf + len, "reads   %d\n", stat.reads);
+    len += sprintf(buf + len, "writes  %d\n", stat.writes);
+    len += sprintf(buf + len, "dax     %d\n", stat.dax);
+    len += sprintf(buf + len, "heads   %d\n", stat.heads);
+    return len;
+}
+
+static int proc_sched(char *buf, task_t *task) {
+    int len = 0;
+    len += sprintf(buf + len, "uptime   %d ms\n", jiffies * jiffy);
+    len += sprintf(buf + len, "ready    %d\n", sched_get_task_count());
+    len += sprintf(buf + len, "weight   %d\n", sched_get_total_weight());
+    len += sprintf(buf + len, "vruntime %u\n", (u32)sched_get_min_vruntime());
+    len += sprintf(buf + len, "  PID  PPID S NICE WEIGHT   VRUNTIME    RUNTIME NAME\n");
+
+    for (size_t i = 0; i < TASK_NR; i++) {
+        task_t *ptr = tasks_table[i];
+        if (!ptr)
+            continue;
+        len += sprintf(buf + len, "%5d %5d %c %4d %6d %10u %10u %s\n",
+                       ptr->pid, ptr->ppid, task_state(ptr), ptr->nice, ptr->weight,
+                       (u32)ptr->vruntime, ptr->runtime * jiffy, ptr->name);
+    }
+    return len;
+}
+
+static char *irq_names[] = {
+    "clock", "keyboard", "cascade", "serial2",
+    "serial1", "sb16", "floppy", "parallel1",
+    "rtc", "redirect", "irq10", "nic",
+    "mouse", "math", "harddisk", "harddisk2",
+};
+
+static int proc_interrupts(char *buf, task_t *task) {
+    int len = 0;
+    len += sprintf(buf + len, " VEC      COUNT NAME\n");
+
+    for (size_t i = 0; i < IRQ_SLAVE_NR + 8; i++) {
+        u32 count = interrupt_get_count(i);
+        if (!count)
+            continue;
+        char *name = i < IRQ_MASTER_NR ? "exception" : irq_names[i - IRQ_MASTER_NR];
+        len += sprintf(buf + len, "0x%02x %10u %s\n", i, count, name);
+    }
+    len += sprintf(buf + len, "0x%02x %10u %s\n", 0x80, interrupt_get_count(0x80), "syscall");
+    return len;
+}
+
+static int proc_net_dev(char *buf, task_t *task) {
+    int len = 0;
+    len += sprintf(buf + len, "Iface   RxPackets    RxBytes RxQueue  TxPackets    TxBytes TxQueue\n");
+
+    netif_t *netif;
+    for (size_t i = 0; (netif = netif_index(i)); i++) {
+        len += sprintf(buf + len, "%-6s %10u %10u %7d %10u %10u %7d\n",
+                       netif->name,
+                       netif->rx_packets, netif->rx_bytes, list_len(&netif->rx_pbuf_list),
+                       netif->tx_packets, netif->tx_bytes, list_len(&netif->tx_pbuf_list));
+    }
+    return len;
+}
+
+// pid (name) state ppid pgid sid uid nice weight runtime(ms) start(ms) vruntime brk
+static int proc_pid_stat(char *buf, task_t *task) {
+    return sprintf(buf, "%d (%s) %c %d %d %d %d %d %d %u %u %u %u\n",
+                   task->pid, task->name, task_state(task),
+                   task->ppid, task->pgid, task->sid, task->uid,
+                   task->nice, task->weight,
+                   task->runtime * jiffy, task->start_time * jiffy,
+                   (u32)task->vruntime, task->brk);
+}
+
+// 压缩内存磁盘，大小单位 kB
+static int proc_zram(char *buf, task_t *task) {
+    int len = 0;
+    len += sprintf(buf + len, "Device    Size    Orig   Compr  MemUsed  MemMax   Zero    Raw  Ratio   Reads  Writes Failed\n");
+
+    zram_stat_t stat;
+    for (size_t i = 0; zram_stat(i, &stat); i++) {
+        u32 orig = stat.stored * PAGE_KB;
+        u32 used = stat.mem_pages * PAGE_KB;
+        len += sprintf(buf + len, "%-7s %6d %7d %7d %8d %7d %6d %6d %5d%% %7u %7u %6d\n",
+                       stat.name, stat.pages * PAGE_KB, orig, stat.compr_bytes / 1024,
+                       used, stat.max_pages * PAGE_KB, stat.zero, stat.raw,
+                       percent(orig, used), stat.reads, stat.writes, stat.failed);
+    }
+    return len;
+}
+
+// 目录项缓存，判断哈希表大小和缓存容量是否合适
+static int proc_dcache(char *buf, task_t *task) {
+    dcache_stat_t stat;
+    dcache_stat(&stat);
+
+    int len = 0;
+    len += sprintf(buf + len, "entries  %d\n", stat.count);
+    len += sprintf(buf + len, "negative %d\n", stat.negative);
+    len += sprintf(buf + len, "buckets  %d\n", stat.buckets);
+    len += sprintf(buf + len, "used     %d\n", stat.used);
+    len += sprintf(buf + len, "longest  %d\n", stat.longest);
+    len += sprintf(buf + len, "hits     %d\n", stat.hits);
+    len += sprintf(buf + len, "misses   %d\n", stat.misses);
+    len += sprintf(buf + len, "ratio    %d%%\n", percent(stat.hits, stat.hits + stat.misses));
+    return len;
+}
+
+static proc_entry_t proc_table[] = {
+    {"", PROC_ROOT_NR, PROC_ROOT_NR, IFDIR | 0555, NULL},
+    {"meminfo", 2, PROC_ROOT_NR, IFREG | 0444, proc_meminfo},
+    {"buffers", 3, PROC_ROOT_NR, IFREG | 0444, proc_buffers},
+    {"sched", 4, PROC_ROOT_NR, IFREG | 0444, proc_sched},
+    {"interrupts", 5, PROC_ROOT_NR, IFREG | 0444, proc_interrupts},
+    {"net", PROC_NET_NR, PROC_ROOT_NR, IFDIR | 0555, NULL},
+    {"dev", 7, PROC_NET_NR, IFREG | 0444, proc_net_dev},
+    {"zram", 8, PROC_ROOT_NR, IFREG | 0444, proc_zram},
+    {"dcache", 9, PROC_ROOT_NR, IFREG | 0444, proc_dcache},
+    {NULL, 0, 0, 0, NULL},
+};
+
+// /proc/<pid> 下的节点，序号 0 是进程目录本身
+static proc_entry_t proc_pid_table[] = {
+    {"", 0, 0, IFDIR | 0555, NULL},
+    {"stat", 1, 0, IFREG | 0444, proc_pid_stat},
+    {NULL, 0, 0, 0, NULL},
+};
+
+static proc_entry_t *proc_entry(idx_t nr) {
+    proc_entry_t *table = proc_table;
+    if (nr >= PROC_PID_BASE) {
+        table = proc_pid_table;
+        nr = (nr - PROC_PID_BASE) & ((1 << PROC_PID_SHIFT) - 1);
+    }
+
+    for (proc_entry_t *entry = table; entry->name; entry++) {
+        if (entry->nr == nr)
+            return entry;
+    }
+    return NULL;
+}
+
+static inode_t *proc_iget(super_t *super, idx_t nr) {
+    inode_t *inode = find_inode(super->dev, nr);
+    if (inode) {
+        inode->count++;
+        inode->atime = sys_time();
+        return fit_inode(inode);
+    }
+
+    proc_entry_t *entry = proc_entry(nr);
+    assert(entry);
+
+    inode = get_free_inode();
+    inode->dev = super->dev;
+    inode->nr = nr;
+    inode->count = 1;
+    inode->desc = entry;
+    inode->super = super;
+    inode->type = FS_TYPE_PROC;
+    inode->op = fs_get_op(FS_TYPE_PROC);
+    inode->mode = entry->mode;
+    inode->atime = inode->mtime = inode->ctime = sys_time();
+
+    // 进程节点属于进程的用户
+    task_t *task = proc_task(inode);
+    if (task) {
+        inode->uid = task->uid;
+        inode->gid = task->gid;
+    }
+
+    list_push(&super->inode_list, &inode->node);
+    hash_inode(inode);
+    return fit_inode(inode);
+}
+
+static int proc_evict(inode_t *inode) {
+    assert(inode->type == FS_TYPE_PROC);
+    assert(!inode->count);
+
+    list_remove(&inode->node);
+    put_free_inode(inode);
+    return EOK;
+}
+
+static void proc_close(inode_t *inode) {
+    assert(inode->type == FS_TYPE_PROC);
+    inode->count--;
+    if (inode->count)
+        return;
+    proc_evict(inode);
+}
+
+// 父目录的节点号
+static idx_t proc_parent(inode_t *inode) {
+    proc_entry_t *entry = (proc_entry_t *)inode->desc;
+    if (inode->nr < PROC_PID_BASE)
+        return entry->parent;
+    if (!entry->nr)
+        return PROC_ROOT_NR;
+    return proc_pid_nr(proc_pid(inode), entry->parent);
+}
+
+// 目录 dir 中名字 name 对应的节点号，不存在返回 0
+static idx_t proc_find(inode_t *dir, const char *name, size_t len) {
+    if (len == 1 && name[0] == '.')
+        return dir->nr;
+    if (len == 2 && name[0] == '.' && name[1] == '.')
+        return proc_parent(dir);
+
+    proc_entry_t *table = proc_table;
+    idx_t parent = dir->nr;
+    if (dir->nr >= PROC_PID_BASE) {
+        if (!proc_task(dir))
+            return 0;
+        table = proc_pid_table;
+        parent = 0;
+    }
+
+    for (proc_entry_t *entry = table; entry->name; entry++) {
+        if (entry->parent != parent || entry->nr == parent)
+            continue;
+        if (strlen(entry->name) != len || memcmp(entry->name, name, len))
+            continue;
+        if (table == proc_table)
+            return entry->nr;
+        return proc_pid_nr(proc_pid(dir), entry->nr);
+    }
+
+    if (dir->nr != PROC_ROOT_NR || len > 3)
+        return 0;
+
+    // 进程目录
+    pid_t pid = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (name[i] < '0' || name[i] > '9')
+            return 0;
+        pid = pid * 10 + name[i] - '0';
+    }
+    if (pid >= TASK_NR || !tasks_table[pid])
+        return 0;
+    return proc_pid_nr(pid, 0);
+}
+
+static err_t proc_namei(inode_t *dir, char *name, char **next, inode_t **result) {
+    size_t len = dentry_name_len(name);
+    idx_t nr = proc_find(dir, name, len);
+    if (!nr) {
+        return -ENOENT;
+    }
+
+    *next = name + len;
+    if (IS_SEPARATOR(**next))
+        (*next)++;
+
+    *result = proc_iget(dir->super, nr);
+    return EOK;
+}
+
+static int proc_open(inode_t *dir, char *name, int flags, int mode, inode_t **result) {
+    idx_t nr = proc_find(dir, name, dentry_name_len(name));
+    if (!nr) {
+        return (flags & O_CREAT) ? -EROFS : -ENOENT;
+    }
+
+    if ((flags & O_ACCMODE) != O_RDONLY || (flags & O_TRUNC)) {
+        return -EROFS;
+    }
+
+    *result = proc_iget(dir->super, nr);
+    return EOK;
+}
+
+static int proc_read(inode_t *inode, char *data, int len, off_t offset) {
+    proc_entry_t *entry = (proc_entry_t *)inode->desc;
+    if (!entry->show)
+        return -EISDIR;
+
+    task_t *task = NULL;
+    if (inode->nr >= PROC_PID_BASE && !(task = proc_task(inode)))
+        return -ESRCH;
+
+    // 每次读取重新生成，内容不超过缓冲大小
+    char *buf = (char *)alloc_kpage(PROC_BUF_PAGES);
+    int size = entry->show(buf, task);
+    assert(size < PROC_BUF_PAGES * PAGE_SIZE);
+
+    int ret = EOF;
+    if (offset < size) {
+        ret = MIN(len, size - offset);
+        if (copy_to_user(data, buf + offset, ret) < EOK)
+            ret = -EFAULT;
+    }
+
+    free_kpage((u32)buf, PROC_BUF_PAGES);
+    inode->atime = sys_time();
+    return ret;
+}
+
+static int proc_readdir(inode_t *inode, dentry_t *entry, size_t count, off_t offset) {
+    if (!ISDIR(inode->mode))
+        return -ENOTDIR;
+
+    if (offset < 2) {
+        entry->nr = offset ? proc_parent(inode) : inode->nr;
+        entry->namelen = offset + 1;
+        strcpy(entry->name, offset ? ".." : ".");
+        entry->length = 1;
+        return entry->length;
+    }
+
+    proc_entry_t *table = proc_table;
+    idx_t parent = inode->nr;
+    if (inode->nr >= PROC_PID_BASE) {
+        if (!proc_task(inode))
+            return EOF;
+        table = proc_pid_table;
+        parent = 0;
+    }
+
+    off_t pos = 2;
+    for (proc_entry_t *ptr = table; ptr->name; ptr++) {
+        if (ptr->parent != parent || ptr->nr == parent)
+            continue;
+        if (pos++ < offset)
+            continue;
+
+        entry->nr = table == proc_table ? ptr->nr : proc_pid_nr(proc_pid(inode), ptr->nr);
+        entry->namelen = strlen(ptr->name);
+        strcpy(entry->name, ptr->name);
+        entry->length = 1;
+        return entry->length;
+    }
+
+    if (inode->nr != PROC_ROOT_NR)
+        return EOF;
+
+    // 进程目录的位置为 PROC_PID_POS + pid
+    assert(pos <= PROC_PID_POS);
+    pid_t pid = offset > PROC_PID_POS ? offset - PROC_PID_POS : 0;
+    for (; pid < TASK_NR; pid++) {
+        if (!tasks_table[pid])
+            continue;
+        entry->nr = proc_pid_nr(pid, 0);
+        entry->namelen = sprintf(entry->name, "%d", pid);
+        entry->length = PROC_PID_POS + pid + 1 - offset;
+        return entry->length;
+    }
+    return EOF;
+}
+
+static int proc_stat(inode_t *inode, stat_t *statbuf) {
+    statbuf->dev = inode->dev;
+    statbuf->nr = inode->nr;
+    statbuf->mode = inode->mode;
+    statbuf->nlinks = ISDIR(inode->mode) ? 2 : 1;
+    statbuf->uid = inode->uid;
+    statbuf->gid = inode->gid;
+    statbuf->rdev = 0;
+    statbuf->size = 0;
+    statbuf->atime = inode->atime;
+    statbuf->mtime = inode->mtime;
+    statbuf->ctime = inode->ctime;
+    return EOK;
+}
+
+static int proc_permission(inode_t *inode, int mask) {
+    u16 mode = inode->mode;
+
+    task_t *task = running_task();
+    if (task->uid == KERNEL_USER) {
+        return true;
+    }
+
+    if (task->uid == inode->uid) {
+        mode >>= 6;
+    } else if (task->gid == inode->gid) {
+        mode >>= 3;
+    }
+
+    if ((mode & mask & 0b111) == mask) {
+        return true;
+    }
+    return false;
+}
+
+static int proc_fsync(inode_t *inode, off_t offset, size_t len, int flags) {
+    return EOK;
+}
+
+static int proc_sync_fs(super_t *super) {
+    return EOK;
+}
+
+static int proc_put_super(super_t *super) {
+    assert(list_empty(&super->inode_list));
+    LOGK("procfs dev %d released\n", super->dev);
+    return EOK;
+}
+
+// procfs 不在块设备上，read_super 探测时直接失败
+static int proc_super(dev_t dev, super_t *super) {
+    return -EFSUNK;
+}
+
+super_t *proc_mount() {
+    super_t *super = get_free_super();
+    if (!super)
+        return NULL;
+    super->dev = get_anon_dev();
+    super->type = FS_TYPE_PROC;
+    super->count = 1;
+    super->desc = NULL;
+    super->buf = NULL;
+    super->info = NULL;
+    super->sector_size = PAGE_SIZE;
+    super->block_size = PAGE_SIZE;
+    super->imount = NULL;
+    super->iroot = proc_iget(super, PROC_ROOT_NR);
+
+    LOGK("procfs dev %d mounted\n", super->dev);
+    return super;
+}
+
+static fs_op_t proc_op = {
+    fs_default_nosys,
+    proc_super,
+
+    proc_open,
+    proc_close,
+
+    proc_read,
+    fs_default_nosys,
+    fs_default_nosys,
+
+    proc_stat,
+    proc_permission,
+
+    proc_namei,
+    fs_default_nosys,
+    fs_default_nosys,
+    fs_default_nosys,
+    fs_default_nosys,
+    fs_default_nosys,
+    proc_readdir,
+    fs_default_nosys,
+    proc_evict,
+    fs_default_nosys,
+    proc_fsync,
+
+    proc_sync_fs,
+    proc_put_super,
+    fs_default_nosys,
+};
+
+void proc_init() {
+    fs_register_op(FS_TYPE_PROC, &proc_op);
+}
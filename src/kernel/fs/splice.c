@@ -0,0 +1,185 @@
+#include <fs/fs.h>
+#include <fs/stat.h>
+#include <xjos/assert.h>
+#include <xjos/debug.h>
+#include <xjos/memory.h>
+#include <xjos/stdlib.h>
+#include <xjos/errno.h>
+
+#define LOGK(fmt, args...) DEBUGK(fmt, ##args)
+
+/**
+ * 内核中的数据搬运: sendfile / splice / copy_file_range
+ *
+ * 管道一端直接读写环形缓冲，数据只拷贝一次；
+ * 其它情况经过一页内核缓冲中转，不经过用户空间，也没有多次系统调用。
+ */
+
+#define SPLICE_CHUNK PAGE_SIZE   // 每次搬运的最大字节数
+#define SPLICE_SOCKET_CHUNK 1024 // 发往套接字时每个数据报的大小, 小于 MTU
+
+static u32 splice_chunk(inode_t *inode) {
+    if (inode->type == FS_TYPE_SOCKET)
+        return SPLICE_SOCKET_CHUNK;
+    return SPLICE_CHUNK;
+}
+
+// 从 in 的 inoff 处搬运最多 len 字节到 out 的 outoff 处，管道忽略偏移
+static int do_splice(inode_t *in, off_t *inoff, inode_t *out, off_t *outoff, u32 len) {
+    char *page = NULL;
+    u32 total = 0;
+    int ret = EOK;
+
+    // 环形缓冲和中转页都是内核地址
+    bool ds = set_kernel_ds(true);
+
+    while (total < len) {
+        u32 chunk = MIN(len - total, splice_chunk(out));
+        char *data = NULL;
+        int n;
+
+        if (in->type == FS_TYPE_PIPE) {
+            // 管道 -> 文件: 直接从环形缓冲写出，已经搬运过数据时不再等待
+            u32 avail = pipe_read_begin(in, &data, total == 0);
+            if (!avail)
+                break;
+            n = out->op->write(out, data, MIN(avail, chunk), *outoff);
+            pipe_read_end(in, n > 0 ? n : 0);
+        } else if (out->type == FS_TYPE_PIPE) {
+            // 文件 -> 管道: 直接读入环形缓冲
+            u32 room = pipe_write_begin(out, &data);
+            n = in->op->read(in, data, MIN(room, chunk), *inoff);
+            pipe_write_end(out, n > 0 ? n : 0);
+        } else {
+            // 文件 -> 文件/套接字: 经过一页内核缓冲
+            if (!page)
+                page = (char *)alloc_kpage(1);
+            n = in->op->read(in, page, chunk, *inoff);
+            if (n > 0) {
+                int w = out->op->write(out, page, n, *outoff);
+                if (w < n)
+                    n = w;
+            }
+        }
+
+        if (n <= 0) {
+            // 读到文件末尾不算错误
+            if (n < 0 && n != EOF)
+                ret = n;
+            break;
+        }
+
+        if (in->type != FS_TYPE_PIPE)
+            *inoff += n;
+        if (out->type != FS_TYPE_PIPE)
+            *outoff += n;
+        total += n;
+    }
+
+    set_kernel_ds(ds);
+    if (page)
+        free_kpage((u32)page, 1);
+
+    if (!total && ret < EOK)
+        return ret;
+    return total;
+}
+
+// 检查文件描述符及读写权限
+static err_t splice_file(fd_t fd, bool write, file_t **file) {
+    err_t ret = fd_check(fd, file);
+    if (ret < EOK)
+        return ret;
+
+    int mode = (*file)->flags & O_ACCMODE;
+    if (write && mode == O_RDONLY)
+        return -EBADF;
+    if (!write && mode == O_WRONLY)
+        return -EBADF;
+    if (ISDIR((*file)->inode->mode))
+        return -EISDIR;
+    return EOK;
+}
+
+// 在两个文件之间搬运数据，偏移为空时使用并更新文件偏移
+static int splice_files(file_t *fin, off_t *off_in, file_t *fout, off_t *off_out, u32 len) {
+    off_t inoff = fin->offset;
+    off_t outoff = fout->offset;
+
+    // 用户给出的偏移在内核中更新，搬运之后再写回
+    if (off_in && copy_from_user(&inoff, off_in, sizeof(off_t)) < EOK)
+        return -EFAULT;
+    if (off_out && copy_from_user(&outoff, off_out, sizeof(off_t)) < EOK)
+        return -EFAULT;
+
+    int ret = do_splice(fin->inode, &inoff, fout->inode, &outoff, len);
+
+    if (!off_in)
+        fin->offset = inoff;
+    else if (copy_to_user(off_in, &inoff, sizeof(off_t)) < EOK)
+        ret = -EFAULT;
+
+    if (!off_out)
+        fout->offset = outoff;
+    else if (copy_to_user(off_out, &outoff, sizeof(off_t)) < EOK)
+        ret = -EFAULT;
+
+    return ret;
+}
+
+int sys_sendfile(fd_t out_fd, fd_t in_fd, off_t *offset, u32 count) {
+    file_t *fin;
+    file_t *fout;
+    err_t ret;
+    if ((ret = splice_file(in_fd, false, &fin)) < EOK)
+        return ret;
+    if ((ret = splice_file(out_fd, true, &fout)) < EOK)
+        return ret;
+
+    // 输入必须可以定位
+    if (fin->inode->type == FS_TYPE_PIPE || fin->inode->type == FS_TYPE_SOCKET)
+        return -ESPIPE;
+
+    return splice_files(fin, offset, fout, NULL, count);
+}
+
+int sys_splice(fd_t fd_in, off_t *off_in, fd_t fd_out, off_t *off_out, u32 len, int flags) {
+    file_t *fin;
+    file_t *fout;
+    err_t ret;
+    if ((ret = splice_file(fd_in, false, &fin)) < EOK)
+        return ret;
+    if ((ret = splice_file(fd_out, true, &fout)) < EOK)
+        return ret;
+
+    bool pin = fin->inode->type == FS_TYPE_PIPE;
+    bool pout = fout->inode->type == FS_TYPE_PIPE;
+
+    // 至少一端是管道，管道不能指定偏移
+    if (!pin && !pout)
+        return -EINVAL;
+    if ((pin && off_in) || (pout && off_out))
+        return -ESPIPE;
+    if (fin->inode == fout->inode)
+        return -EINVAL;
+
+    return splice_files(fin, off_in, fout, off_out, len);
+}
+
+int sys_copy_file_range(fd_t fd_in, off_t *off_in, fd_t fd_out, off_t *off_out, u32 len, int flags) {
+    if (flags)
+        return -EINVAL;
+
+    file_t *fin;
+    file_t *fout;
+    err_t ret;
+    if ((ret = splice_file(fd_in, false, &fin)) < EOK)
+        return ret;
+    if ((ret = splice_file(fd_out, true, &fout)) < EOK)
+        return ret;
+
+    if (!ISFILE(fin->inode->mode) || !ISFILE(fout->inode->mode))
+        return -EINVAL;
+
+    return splice_files(fin, off_in, fout, off_out, len);
+}
@@ -7,13 +7,21 @@
 #include <xjos/string.h>
 #include <xjos/debug.h>
 #include <xjos/stdlib.h>
+#include <xjos/arena.h>
 
 #define LOGK(fmt, args...) DEBUGK(fmt, ##args)
 
 #define SUPER_NR 16
+#define ANON_DEV_BASE 0x10000 // 匿名设备号起点，大于所有块设备号
 
 static super_t super_table[SUPER_NR]; // 超级块表
 static super_t *root;                 // 根文件系统超级块
+static dev_t anon_dev = ANON_DEV_BASE;
+
+// 为不在块设备上的文件系统 (tmpfs, procfs) 分配设备号
+dev_t get_anon_dev() {
+    return anon_dev++;
+}
 
 // get a free super block from super block table
 super_t *get_free_super() {
@@ -24,7 +32,7 @@ super_t *get_free_super() {
         }
     }
 
-    panic("no free super block!!!");
+    return NULL;
 }
 
 
@@ -52,10 +60,30 @@ void put_super(super_t *super) {
     if (super->count)
         return;
 
+    int type = super->type;
     super->type = FS_TYPE_NONE;
     iput(super->imount);
     iput(super->iroot);
+    prune_inodes(super->dev);
+    dcache_invalidate(super->dev, 0);
+    if (type != FS_TYPE_NONE)
+        fs_get_op(type)->put_super(super);
     brelse(super->buf);
+
+    if (super->info) {
+        kfree(super->info);
+        super->info = NULL;
+    }
+}
+
+
+void ssync() {
+    for (size_t i = 0; i < SUPER_NR; i++) {
+        super_t *super = &super_table[i];
+        if (super->type == FS_TYPE_NONE)
+            continue;
+        fs_get_op(super->type)->sync_fs(super);
+    }
 }
 
 
@@ -69,6 +97,8 @@ super_t *read_super(dev_t dev) {
     LOGK("Reading super block from device %d\n", dev);
 
     super = get_free_super();
+    if (!super)
+        return NULL;
     super->count++;
 
     for (size_t i = 1; i < FS_TYPE_NUM; i++) {
@@ -119,6 +149,7 @@ void super_init() {
         super->desc = NULL;
         super->buf = NULL;
         super->iroot = NULL;
+        super->info = NULL;
         super->block_size = 0;
         super->sector_size = 0;
         list_init(&super->inode_list);
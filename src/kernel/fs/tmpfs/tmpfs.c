@@ -0,0 +1,924 @@
+#include <fs/fs.h>
+#include <fs/stat.h>
+#include <fs/buffer.h>
+#include <drivers/device.h>
+#include <xjos/task.h>
+#include <xjos/memory.h>
+#include <xjos/arena.h>
+#include <xjos/string.h>
+#include <xjos/stdlib.h>
+#include <xjos/assert.h>
+#include <xjos/debug.h>
+#include <xjos/errno.h>
+
+#define LOGK(fmt, args...) DEBUGK(fmt, ##args)
+
+extern time_t sys_time();
+
+/**
+ * tmpfs 内存文件系统
+ *
+ * 文件数据直接放在页分配器分配的内核页中，目录项放在每个目录自己的哈希表里，
+ * 读写和查找都不经过块设备和高速缓冲。
+ *
+ * 节点 (tmpfs_node_t) 从创建一直存在到最后一个链接被删除，inode_t 只在被引用期间存在，
+ * 引用归零立即释放，不进入 inode LRU。卸载时释放整棵树。
+ */
+
+#define TMPFS_PAGES 512        // 默认容量 2M (页)
+#define TMPFS_MAX_PAGES 2048   // 容量上限 8M，内核内存只有 16M
+#define TMPFS_RESERVE 256      // 内核空闲页少于 1M 时不再分配
+#define TMPFS_NODES_MIN 64     // 节点数量下限，否则每页一个节点
+#define TMPFS_HASH_MIN 8       // 目录哈希表初始大小, 2 的幂
+#define TMPFS_HASH_LOAD 2      // 平均链长超过时扩容
+#define TMPFS_INDEX_MIN 8      // 文件页表初始大小
+
+#define ACC_MODE(x) ("\004\002\006\377"[(x)&O_ACCMODE])
+
+typedef struct tmpfs_node_t {
+    idx_t nr;       // 节点号，同一个文件系统内不重复使用
+    mode_t mode;    // 文件模式
+    u32 nlinks;     // 链接数
+    int uid;        // 用户 id
+    int gid;        // 组 id
+    size_t size;    // 文件大小
+    time_t mtime;   // 修改时间
+    time_t ctime;   // 创建时间
+    dev_t rdev;     // 设备文件的设备号
+
+    u32 *pages;     // 文件数据页，0 表示空洞
+    u32 npages;     // 页表长度
+
+    struct tmpfs_node_t *parent;   // 父目录，根目录指向自己
+    list_t *hash;                  // 目录项哈希表
+    u32 hash_size;                 // 哈希桶数量, 2 的幂
+    list_t entries;                // 目录项按位置排序
+    u32 count;                     // 目录项数量
+    u32 next_pos;                  // 下一个目录项的位置
+    struct tmpfs_dentry_t *cursor; // 上次 readdir 返回的目录项
+} tmpfs_node_t;
+
+typedef struct tmpfs_dentry_t {
+    list_node_t hnode;   // 哈希链节点
+    list_node_t node;    // 目录项链表节点
+    u32 hash;            // 名字哈希
+    u32 pos;             // readdir 位置，0 和 1 是 . 和 ..
+    tmpfs_node_t *child; // 目录项指向的节点
+    char name[MAXNAMELEN];
+} tmpfs_dentry_t;
+
+typedef struct tmpfs_info_t {
+    tmpfs_node_t *root; // 根目录
+    u32 max_pages;      // 数据页上限
+    u32 used_pages;     // 已用数据页
+    u32 max_nodes;      // 节点上限
+    u32 nodes;          // 已用节点
+    idx_t next_nr;      // 下一个节点号
+} tmpfs_info_t;
+
+// FNV-1a
+static u32 tmpfs_hash(const char *name, size_t len) {
+    u32 hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (u8)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static _inline tmpfs_info_t *tmpfs_info(inode_t *inode) {
+    return (tmpfs_info_t *)inode->super->info;
+}
+
+// 节点属性同步到 inode
+static void tmpfs_update(inode_t *inode) {
+    tmpfs_node_t *node = (tmpfs_node_t *)inode->desc;
+    inode->mode = node->mode;
+    inode->size = node->size;
+    inode->uid = node->uid;
+    inode->gid = node->gid;
+    inode->rdev = node->rdev;
+    inode->mtime = node->mtime;
+    inode->ctime = node->ctime;
+}
+
+static list_t *tmpfs_hash_alloc(u32 size) {
+    list_t *hash = (list_t *)kmalloc(size * sizeof(list_t));
+    for (size_t i = 0; i < size; i++) {
+        list_init(&hash[i]);
+    }
+    return hash;
+}
+
+static tmpfs_node_t *tmpfs_node_alloc(tmpfs_info_t *info, int mode) {
+    if (info->nodes >= info->max_nodes)
+        return NULL;
+
+    task_t *task = running_task();
+    tmpfs_node_t *node = (tmpfs_node_t *)kmalloc(sizeof(tmpfs_node_t));
+    memset(node, 0, sizeof(tmpfs_node_t));
+
+    node->nr = info->next_nr++;
+    node->mode = mode;
+    node->nlinks = 1;
+    node->uid = task->uid;
+    node->gid = task->gid;
+    node->mtime = node->ctime = sys_time();
+
+    if (ISDIR(mode)) {
+        node->hash_size = TMPFS_HASH_MIN;
+        node->hash = tmpfs_hash_alloc(node->hash_size);
+        list_init(&node->entries);
+        node->next_pos = 2;
+    }
+
+    info->nodes++;
+    return node;
+}
+
+// 释放文件的所有数据页
+static void tmpfs_free_pages(tmpfs_info_t *info, tmpfs_node_t *node) {
+    for (size_t i = 0; i < node->npages; i++) {
+        if (!node->pages[i])
+            continue;
+        free_kpage(node->pages[i], 1);
+        node->pages[i] = 0;
+        info->used_pages--;
+    }
+    if (node->pages)
+        kfree(node->pages);
+    node->pages = NULL;
+    node->npages = 0;
+}
+
+static void tmpfs_node_free(tmpfs_info_t *info, tmpfs_node_t *node) {
+    tmpfs_free_pages(info, node);
+    if (node->hash) {
+        assert(!node->count);
+        kfree(node->hash);
+    }
+    kfree(node);
+    info->nodes--;
+}
+
+// 找到节点对应的 inode，不存在则创建
+static inode_t *tmpfs_iget(super_t *super, tmpfs_node_t *node) {
+    inode_t *inode = find_inode(super->dev, node->nr);
+    if (inode) {
+        inode->count++;
+        inode->atime = sys_time();
+        return fit_inode(inode);
+    }
+
+    inode = get_free_inode();
+    inode->dev = super->dev;
+    inode->nr = node->nr;
+    inode->count = 1;
+    inode->desc = node;
+    inode->super = super;
+    inode->type = FS_TYPE_TMPFS;
+    inode->op = fs_get_op(FS_TYPE_TMPFS);
+    inode->atime = sys_time();
+    tmpfs_update(inode);
+
+    list_push(&super->inode_list, &inode->node);
+    hash_inode(inode);
+    return fit_inode(inode);
+}
+
+static int tmpfs_evict(inode_t *inode) {
+    assert(inode->type == FS_TYPE_TMPFS);
+    assert(!inode->count);
+
+    // 已经删除的节点随最后一个引用释放
+    tmpfs_node_t *node = (tmpfs_node_t *)inode->desc;
+    if (!node->nlinks)
+        tmpfs_node_free(tmpfs_info(inode), node);
+    inode->desc = NULL;
+
+    list_remove(&inode->node);
+    put_free_inode(inode);
+    return EOK;
+}
+
+static void tmpfs_close(inode_t *inode) {
+    assert(inode->type == FS_TYPE_TMPFS);
+    inode->count--;
+    if (inode->count)
+        return;
+
+    // 数据都在节点中，inode 不需要缓存
+    tmpfs_evict(inode);
+}
+
+// 第 idx 页的地址，create 时分配缺少的页，超出容量或内核内存不足返回 0
+static u32 tmpfs_page(inode_t *inode, idx_t idx, bool create) {
+    tmpfs_node_t *node = (tmpfs_node_t *)inode->desc;
+    if (idx < node->npages && node->pages[idx])
+        return node->pages[idx];
+    if (!create)
+        return 0;
+
+    tmpfs_info_t *info = tmpfs_info(inode);
+    if (info->used_pages >= info->max_pages)
+        return 0;
+
+    // 容量只是上限，几个 tmpfs 加起来可能超过内核内存，保留一部分给内核
+    memory_stat_t mem;
+    memory_stat(&mem);
+    if (mem.kernel_free < TMPFS_RESERVE + 1)
+        return 0;
+
+    if (idx >= node->npages) {
+        u32 npages = node->npages ? node->npages : TMPFS_INDEX_MIN;
+        while (npages <= idx)
+            npages *= 2;
+
+        u32 *pages = (u32 *)kmalloc(npages * sizeof(u32));
+        memset(pages, 0, npages * sizeof(u32));
+        if (node->pages) {
+            memcpy(pages, node->pages, node->npages * sizeof(u32));
+            kfree(node->pages);
+        }
+        node->pages = pages;
+        node->npages = npages;
+    }
+
+    // alloc_kpage 已经清零
+    node->pages[idx] = alloc_kpage(1);
+    info->used_pages++;
+    return node->pages[idx];
+}
+
+static int tmpfs_read(inode_t *inode, char *data, int len, off_t offset) {
+    tmpfs_node_t *node = (tmpfs_node_t *)inode->desc;
+    if (ISCHR(node->mode)) {
+        assert(node->rdev);
+        return device_read(node->rdev, data, len, 0, 0);
+    } else if (ISBLK(node->mode)) {
+        assert(node->rdev);
+        assert(len % BLOCK_SIZE == 0);
+        assert(device_read(node->rdev, data, len / BLOCK_SIZE, offset / BLOCK_SIZE, 0) == EOK);
+        return len;
+    }
+
+    if (ISDIR(node->mode))
+        return -EISDIR;
+
+    if (offset >= node->size)
+        return EOF;
+
+    u32 begin = offset;
+    u32 left = MIN(len, node->size - offset);
+    err_t ret = EOK;
+    while (left) {
+        u32 page = tmpfs_page(inode, offset / PAGE_SIZE, false);
+        u32 start = offset % PAGE_SIZE;
+        u32 chars = MIN(PAGE_SIZE - start, left);
+
+        // 空洞读出 0
+        if (page) {
+            ret = copy_to_user(data, (char *)page + start, chars);
+        } else {
+            ret = clear_user(data, chars);
+        }
+        if (ret < EOK)
+            break;
+
+        offset += chars;
+        left -= chars;
+        data += chars;
+    }
+
+    if (offset == begin && ret < EOK)
+        return ret;
+
+    inode->atime = sys_time();
+    return offset - begin;
+}
+
+static int tmpfs_write(inode_t *inode, char *data, int len, off_t offset) {
+    tmpfs_node_t *node = (tmpfs_node_t *)inode->desc;
+    if (ISCHR(node->mode)) {
+        assert(node->rdev);
+        return device_write(node->rdev, data, len, 0, 0);
+    } else if (ISBLK(node->mode)) {
+        assert(node->rdev);
+        assert(len % BLOCK_SIZE == 0);
+        assert(device_write(node->rdev, data, len / BLOCK_SIZE, offset / BLOCK_SIZE, 0) == EOK);
+        return len;
+    }
+
+    if (ISDIR(node->mode))
+        return -EISDIR;
+
+    // 文件大小不超过文件系统容量，同时限制页表长度
+    u32 limit = tmpfs_info(inode)->max_pages * PAGE_SIZE;
+    if ((u32)offset >= limit)
+        return -EFBIG;
+
+    u32 begin = offset;
+    u32 left = MIN((u32)len, limit - offset);
+    err_t ret = EOK;
+    while (left) {
+        u32 page = tmpfs_page(inode, offset / PAGE_SIZE, true);
+        if (!page)
+            break;
+
+        u32 start = offset % PAGE_SIZE;
+        u32 chars = MIN(PAGE_SIZE - start, left);
+        if ((ret = copy_from_user((char *)page + start, data, chars)) < EOK)
+            break;
+
+        offset += chars;
+        left -= chars;
+        data += chars;
+    }
+
+    if (offset == begin)
+        return ret < EOK ? ret : -ENOSPC;
+
+    if ((u32)offset > node->size)
+        node->size = offset;
+    node->mtime = sys_time();
+    tmpfs_update(inode);
+    return offset - begin;
+}
+
+static int tmpfs_direct_io(inode_t *inode, char *data, int len, off_t offset, int type) {
+    // 数据本来就不经过缓冲
+    if (type == REQ_READ)
+        return tmpfs_read(inode, data, len, offset);
+    return tmpfs_write(inode, data, len, offset);
+}
+
+static int tmpfs_truncate(inode_t *inode) {
+    tmpfs_node_t *node = (tmpfs_node_t *)inode->desc;
+    if (!ISFILE(node->mode))
+        return EOK;
+
+    tmpfs_free_pages(tmpfs_info(inode), node);
+    node->size = 0;
+    node->mtime = sys_time();
+    tmpfs_update(inode);
+    return EOK;
+}
+
+static int tmpfs_seek(inode_t *inode, off_t offset, int whence) {
+    tmpfs_node_t *node = (tmpfs_node_t *)inode->desc;
+    u32 size = node->size;
+    if (!ISFILE(node->mode)) {
+        return whence == SEEK_DATA ? offset : size;
+    }
+
+    idx_t end = div_round_up(size, PAGE_SIZE);
+    idx_t idx = offset / PAGE_SIZE;
+    for (; idx < end; idx++) {
+        bool data = tmpfs_page(inode, idx, false) != 0;
+        if (data == (whence == SEEK_DATA))
+            break;
+    }
+
+    if (idx >= end) {
+        return whence == SEEK_DATA ? -ENXIO : size;
+    }
+    return MAX((u32)offset, idx * PAGE_SIZE);
+}
+
+static int tmpfs_fsync(inode_t *inode, off_t offset, size_t len, int flags) {
+    return EOK;
+}
+
+static int tmpfs_sync_fs(super_t *super) {
+    return EOK;
+}
+
+static int tmpfs_stat(inode_t *inode, stat_t *statbuf) {
+    tmpfs_node_t *node = (tmpfs_node_t *)inode->desc;
+    statbuf->dev = inode->dev;
+    statbuf->nr = inode->nr;
+    statbuf->mode = node->mode;
+    statbuf->nlinks = node->nlinks;
+    statbuf->uid = node->uid;
+    statbuf->gid = node->gid;
+    statbuf->rdev = node->rdev;
+    statbuf->size = node->size;
+    statbuf->atime = inode->atime;
+    statbuf->mtime = node->mtime;
+    statbuf->ctime = node->ctime;
+    return EOK;
+}
+
+static int tmpfs_permission(inode_t *inode, int mask) {
+    tmpfs_node_t *node = (tmpfs_node_t *)inode->desc;
+    u16 mode = node->mode;
+
+    if (!node->nlinks) {
+        return false;
+    }
+
+    task_t *task = running_task();
+    if (task->uid == KERNEL_USER) {
+        return true;
+    }
+
+    if (task->uid == node->uid) {
+        mode >>= 6;
+    } else if (task->gid == node->gid) {
+        mode >>= 3;
+    }
+
+    if ((mode & mask & 0b111) == mask) {
+        return true;
+    }
+    return false;
+}
+
+/**
+ * 目录项
+ */
+
+static tmpfs_dentry_t *find_entry(tmpfs_node_t *dir, const char *name, size_t len) {
+    u32 hash = tmpfs_hash(name, len);
+    list_t *bucket = &dir->hash[hash & (dir->hash_size - 1)];
+
+    tmpfs_dentry_t *entry;
+    list_for_each_entry(entry, bucket, hnode) {
+        if (entry->hash != hash)
+            continue;
+        if (memcmp(entry->name, name, len) == 0 && entry->name[len] == EOS)
+            return entry;
+    }
+    return NULL;
+}
+
+// 查找名字对应的节点，包括 . 和 ..
+static tmpfs_node_t *find_node(tmpfs_node_t *dir, const char *name, size_t len) {
+    if (len == 1 && name[0] == '.')
+        return dir;
+    if (len == 2 && name[0] == '.' && name[1] == '.')
+        return dir->parent;
+
+    tmpfs_dentry_t *entry = find_entry(dir, name, len);
+    return entry ? entry->child : NULL;
+}
+
+// 哈希表扩容一倍
+static void dentry_rehash(tmpfs_node_t *dir) {
+    u32 size = dir->hash_size * 2;
+    list_t *hash = tmpfs_hash_alloc(size);
+
+    tmpfs_dentry_t *entry;
+    list_for_each_entry(entry, &dir->entries, node) {
+        list_remove(&entry->hnode);
+        list_push(&hash[entry->hash & (size - 1)], &entry->hnode);
+    }
+
+    kfree(dir->hash);
+    dir->hash = hash;
+    dir->hash_size = size;
+}
+
+static void add_entry(tmpfs_node_t *dir, const char *name, size_t len, tmpfs_node_t *child) {
+    if (dir->count >= dir->hash_size * TMPFS_HASH_LOAD)
+        dentry_rehash(dir);
+
+    tmpfs_dentry_t *entry = (tmpfs_dentry_t *)kmalloc(sizeof(tmpfs_dentry_t));
+    memcpy(entry->name, name, len);
+    entry->name[len] = EOS;
+    entry->hash = tmpfs_hash(name, len);
+    entry->pos = dir->next_pos++;
+    entry->child = child;
+
+    list_push(&dir->hash[entry->hash & (dir->hash_size - 1)], &entry->hnode);
+    list_pushback(&dir->entries, &entry->node);
+
+    dir->count++;
+    dir->size = (dir->count + 2) * sizeof(tmpfs_dentry_t);
+    dir->mtime = sys_time();
+}
+
+static void del_entry(tmpfs_node_t *dir, tmpfs_dentry_t *entry) {
+    if (dir->cursor == entry)
+        dir->cursor = NULL;
+
+    list_remove(&entry->hnode);
+    list_remove(&entry->node);
+    kfree(entry);
+
+    dir->count--;
+    dir->size = (dir->count + 2) * sizeof(tmpfs_dentry_t);
+    dir->mtime = sys_time();
+}
+
+// 在 dir 中创建名为 name 的节点
+static err_t tmpfs_create(inode_t *dir, char *name, int mode, tmpfs_node_t **result) {
+    tmpfs_node_t *dnode = (tmpfs_node_t *)dir->desc;
+    size_t len = dentry_name_len(name);
+
+    if (!len)
+        return -ENOENT;
+    if (len >= MAXNAMELEN)
+        return -ENAMETOOLONG;
+    if (find_node(dnode, name, len))
+        return -EEXIST;
+
+    tmpfs_node_t *node = tmpfs_node_alloc(tmpfs_info(dir), mode);
+    if (!node)
+        return -ENOSPC;
+
+    add_entry(dnode, name, len, node);
+    tmpfs_update(dir);
+    *result = node;
+    return EOK;
+}
+
+static int tmpfs_readdir(inode_t *inode, dentry_t *entry, size_t count, off_t offset) {
+    tmpfs_node_t *dir = (tmpfs_node_t *)inode->desc;
+    if (!ISDIR(dir->mode))
+        return -ENOTDIR;
+
+    if (offset < 2) {
+        entry->nr = offset ? dir->parent->nr : dir->nr;
+        entry->namelen = offset + 1;
+        strcpy(entry->name, offset ? ".." : ".");
+        entry->length = 1;
+        return entry->length;
+    }
+
+    // 顺序读取时从上次的位置继续，不必从头扫描
+    list_node_t *ptr = dir->entries.head.next;
+    if (dir->cursor && dir->cursor->pos < (u32)offset)
+        ptr = &dir->cursor->node;
+
+    for (; ptr != &dir->entries.head; ptr = ptr->next) {
+        tmpfs_dentry_t *dentry = list_entry(ptr, tmpfs_dentry_t, node);
+        if (dentry->pos < (u32)offset)
+            continue;
+
+        dir->cursor = dentry;
+        entry->nr = dentry->child->nr;
+        entry->namelen = strlen(dentry->name);
+        memcpy(entry->name, dentry->name, entry->namelen + 1);
+        entry->length = dentry->pos + 1 - offset;
+        return entry->length;
+    }
+    return EOF;
+}
+
+static int tmpfs_open(inode_t *dir, char *name, int flags, int mode, inode_t **result) {
+    tmpfs_node_t *dnode = (tmpfs_node_t *)dir->desc;
+    inode_t *inode = NULL;
+    int ret = EOF;
+
+    if ((flags & O_TRUNC) && ((flags & O_ACCMODE) == O_RDONLY)) {
+        flags |= O_RDWR;
+    }
+
+    tmpfs_node_t *node = find_node(dnode, name, dentry_name_len(name));
+    if (node) {
+        inode = tmpfs_iget(dir->super, node);
+        goto makeup;
+    }
+
+    if (!(flags & O_CREAT)) {
+        ret = -ENOENT;
+        goto rollback;
+    }
+
+    if (!tmpfs_permission(dir, P_WRITE)) {
+        ret = -EPERM;
+        goto rollback;
+    }
+
+    task_t *task = running_task();
+    ret = tmpfs_create(dir, name, (mode & 0777 & ~task->umask) | IFREG, &node);
+    if (ret < EOK)
+        goto rollback;
+    inode = tmpfs_iget(dir->super, node);
+
+makeup:
+    if (!inode->op->permission(inode, ACC_MODE(flags & O_ACCMODE))) {
+        ret = -EACCES;
+        goto rollback;
+    }
+
+    if (ISDIR(inode->mode) && ((flags & O_ACCMODE) != O_RDONLY)) {
+        ret = -EISDIR;
+        goto rollback;
+    }
+
+    inode->atime = sys_time();
+
+    if (flags & O_TRUNC) {
+        inode->op->truncate(inode);
+    }
+
+    *result = inode;
+    return EOK;
+
+rollback:
+    iput(inode);
+    return ret;
+}
+
+static err_t tmpfs_namei(inode_t *dir, char *name, char **next, inode_t **result) {
+    tmpfs_node_t *dnode = (tmpfs_node_t *)dir->desc;
+    size_t len = dentry_name_len(name);
+
+    tmpfs_node_t *node = find_node(dnode, name, len);
+    if (!node) {
+        return -ENOENT;
+    }
+
+    *next = name + len;
+    if (IS_SEPARATOR(**next))
+        (*next)++;
+
+    *result = tmpfs_iget(dir->super, node);
+    return EOK;
+}
+
+static int tmpfs_mkdir(inode_t *dir, char *name, int mode) {
+    tmpfs_node_t *dnode = (tmpfs_node_t *)dir->desc;
+    assert(ISDIR(dnode->mode));
+
+    if (!tmpfs_permission(dir, P_WRITE)) {
+        return -EPERM;
+    }
+
+    task_t *task = running_task();
+    tmpfs_node_t *node;
+    int ret = tmpfs_create(dir, name, (mode & 0777 & ~task->umask) | IFDIR, &node);
+    if (ret < EOK)
+        return ret;
+
+    node->parent = dnode;
+    node->nlinks = 2;          // 一个是 '.' 一个是 name
+    node->size = 2 * sizeof(tmpfs_dentry_t);
+
+    dnode->nlinks++;           // ..
+    return EOK;
+}
+
+static int tmpfs_rmdir(inode_t *dir, char *name) {
+    tmpfs_node_t *dnode = (tmpfs_node_t *)dir->desc;
+    assert(ISDIR(dnode->mode));
+
+    if (!tmpfs_permission(dir, P_WRITE)) {
+        return -EPERM;
+    }
+
+    size_t len = dentry_name_len(name);
+    tmpfs_dentry_t *entry = find_entry(dnode, name, len);
+    if (!entry) {
+        return find_node(dnode, name, len) ? -EPERM : -ENOENT;
+    }
+
+    tmpfs_node_t *node = entry->child;
+    if (!ISDIR(node->mode)) {
+        return -ENOTDIR;
+    }
+
+    task_t *task = running_task();
+    if ((dnode->mode & ISVTX) && task->uid != node->uid) {
+        return -EPERM;
+    }
+
+    if (node->count) {
+        return -ENOTEMPTY;
+    }
+
+    // 当前目录或者安装点
+    if (find_inode(dir->dev, node->nr)) {
+        return -EBUSY;
+    }
+
+    del_entry(dnode, entry);
+    node->nlinks = 0;
+    tmpfs_node_free(tmpfs_info(dir), node);
+
+    dnode->nlinks--;
+    dnode->ctime = sys_time();
+    tmpfs_update(dir);
+    return EOK;
+}
+
+static int tmpfs_link(inode_t *odir, char *oldname, inode_t *ndir, char *newname) {
+    inode_t *inode = NULL;
+    char *next = NULL;
+    int ret = EOF;
+
+    // 由 ndir 调用，odir 可能在其它文件系统上
+    if (odir->dev != ndir->dev) {
+        return -EXDEV;
+    }
+
+    ret = tmpfs_namei(odir, oldname, &next, &inode);
+    if (ret < EOK) {
+        goto rollback;
+    }
+
+    if (ISDIR(inode->mode)) {
+        ret = -EPERM;
+        goto rollback;
+    }
+
+    if (inode->dev != ndir->dev) {
+        ret = -EXDEV;
+        goto rollback;
+    }
+
+    if (!tmpfs_permission(ndir, P_WRITE)) {
+        ret = -EACCES;
+        goto rollback;
+    }
+
+    tmpfs_node_t *dnode = (tmpfs_node_t *)ndir->desc;
+    size_t len = dentry_name_len(newname);
+    if (!len || len >= MAXNAMELEN) {
+        ret = len ? -ENAMETOOLONG : -ENOENT;
+        goto rollback;
+    }
+    if (find_node(dnode, newname, len)) {
+        ret = -EEXIST;
+        goto rollback;
+    }
+
+    tmpfs_node_t *node = (tmpfs_node_t *)inode->desc;
+    add_entry(dnode, newname, len, node);
+    tmpfs_update(ndir);
+
+    node->nlinks++;
+    node->ctime = sys_time();
+    tmpfs_update(inode);
+    ret = EOK;
+
+rollback:
+    iput(inode);
+    return ret;
+}
+
+static int tmpfs_unlink(inode_t *dir, char *name) {
+    tmpfs_node_t *dnode = (tmpfs_node_t *)dir->desc;
+
+    if (!tmpfs_permission(dir, P_WRITE)) {
+        return -EPERM;
+    }
+
+    tmpfs_dentry_t *entry = find_entry(dnode, name, dentry_name_len(name));
+    if (!entry) {
+        return -ENOENT;
+    }
+
+    tmpfs_node_t *node = entry->child;
+    if (ISDIR(node->mode)) {
+        return -EPERM;
+    }
+
+    task_t *task = running_task();
+    if ((dnode->mode & ISVTX) && task->uid != node->uid) {
+        return -EPERM;
+    }
+
+    del_entry(dnode, entry);
+    tmpfs_update(dir);
+
+    node->nlinks--;
+    node->ctime = sys_time();
+
+    // 仍然打开的文件在关闭时释放
+    if (!node->nlinks && !find_inode(dir->dev, node->nr)) {
+        tmpfs_node_free(tmpfs_info(dir), node);
+    }
+    return EOK;
+}
+
+static int tmpfs_mknod(inode_t *dir, char *name, int mode, int dev) {
+    if (!tmpfs_permission(dir, P_WRITE)) {
+        return -EPERM;
+    }
+
+    tmpfs_node_t *node;
+    int ret = tmpfs_create(dir, name, mode, &node);
+    if (ret < EOK)
+        return ret;
+
+    if (ISBLK(mode) || ISCHR(mode)) {
+        node->rdev = dev;
+    }
+    return EOK;
+}
+
+// 释放目录下的整棵树，硬链接的文件在最后一个链接处释放
+static void tmpfs_free_tree(tmpfs_info_t *info, tmpfs_node_t *dir) {
+    while (!list_empty(&dir->entries)) {
+        tmpfs_dentry_t *entry = list_entry(list_pop(&dir->entries), tmpfs_dentry_t, node);
+        list_remove(&entry->hnode);
+        dir->count--;
+
+        tmpfs_node_t *node = entry->child;
+        kfree(entry);
+
+        if (ISDIR(node->mode)) {
+            tmpfs_free_tree(info, node);
+            tmpfs_node_free(info, node);
+        } else if (!--node->nlinks) {
+            tmpfs_node_free(info, node);
+        }
+    }
+}
+
+static int tmpfs_put_super(super_t *super) {
+    tmpfs_info_t *info = (tmpfs_info_t *)super->info;
+
+    // 卸载前所有 inode 都已经释放
+    assert(list_empty(&super->inode_list));
+
+    tmpfs_free_tree(info, info->root);
+    tmpfs_node_free(info, info->root);
+    assert(!info->nodes);
+    assert(!info->used_pages);
+
+    LOGK("tmpfs dev %d released\n", super->dev);
+    return EOK;
+}
+
+// tmpfs 不在块设备上，read_super 探测时直接失败
+static int tmpfs_super(dev_t dev, super_t *super) {
+    return -EFSUNK;
+}
+
+// 创建一个新的 tmpfs，容量为 size KB，0 使用默认容量
+super_t *tmpfs_mount(u32 size) {
+    u32 pages = TMPFS_PAGES;
+    if (size) {
+        pages = div_round_up(size, PAGE_SIZE / 1024);
+    }
+    pages = MIN(pages, TMPFS_MAX_PAGES);
+
+    super_t *super = get_free_super();
+    if (!super)
+        return NULL;
+    super->dev = get_anon_dev();
+    super->type = FS_TYPE_TMPFS;
+    super->count = 1;
+    super->desc = NULL;
+    super->buf = NULL;
+    super->sector_size = PAGE_SIZE;
+    super->block_size = PAGE_SIZE;
+    super->imount = NULL;
+
+    tmpfs_info_t *info = (tmpfs_info_t *)kmalloc(sizeof(tmpfs_info_t));
+    info->max_pages = pages;
+    info->used_pages = 0;
+    info->max_nodes = pages > TMPFS_NODES_MIN ? pages : TMPFS_NODES_MIN;
+    info->nodes = 0;
+    info->next_nr = 1;
+    super->info = info;
+
+    info->root = tmpfs_node_alloc(info, IFDIR | ISVTX | 0777);
+    info->root->parent = info->root;
+    info->root->nlinks = 2;
+    info->root->size = 2 * sizeof(tmpfs_dentry_t);
+
+    super->iroot = tmpfs_iget(super, info->root);
+
+    LOGK("tmpfs dev %d mounted, %d pages\n", super->dev, pages);
+    return super;
+}
+
+static fs_op_t tmpfs_op = {
+    fs_default_nosys,
+    tmpfs_super,
+
+    tmpfs_open,
+    tmpfs_close,
+
+    tmpfs_read,
+    tmpfs_write,
+    tmpfs_truncate,
+
+    tmpfs_stat,
+    tmpfs_permission,
+
+    tmpfs_namei,
+    tmpfs_mkdir,
+    tmpfs_rmdir,
+    tmpfs_link,
+    tmpfs_unlink,
+    tmpfs_mknod,
+    tmpfs_readdir,
+    fs_default_nosys,
+    tmpfs_evict,
+    tmpfs_direct_io,
+    tmpfs_fsync,
+
+    tmpfs_sync_fs,
+    tmpfs_put_super,
+    tmpfs_seek,
+};
+
+void tmpfs_init() {
+    fs_register_op(FS_TYPE_TMPFS, &tmpfs_op);
+}
@@ -68,6 +68,9 @@ void clock_handler(int vector) {
     task_t *task = running_task();    
     assert(task->magic == XJOS_MAGIC);
 
+    // 运行时间统计，idle 的运行时间即空闲时间
+    task->runtime++;
+
     // 2. idle task check
     if (task == idle_task) {
         // if idle running, but other tasks ready (woken up or existing)
@@ -95,6 +98,16 @@ time_t sys_time() {
     return startup_time + (jiffies * JIFFY) / 1000;
 }
 
+// 开机以来的微秒数，jiffy 内的部分由 PIT 计数得到
+u32 clock_us() {
+    outb(PIT_CTRL_REG, 0b00000000); // latch channel 0
+    u32 count = inb(PIT_CHAN0_REG);
+    count |= inb(PIT_CHAN0_REG) << 8;
+
+    u32 elapsed = count < CLOCK_COUNTER ? CLOCK_COUNTER - count : 0;
+    return jiffies * JIFFY * 1000 + elapsed * 1000 / (OSCILLATOR / 1000);
+}
+
 
 void pit_init() {
     // mode 2
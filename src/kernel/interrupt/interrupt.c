@@ -24,6 +24,9 @@ gdt_ptr_t idt_ptr;
 // all interrupt handlers func
 handler_t handler_table[IDT_SIZE];
 
+// 每个向量的中断次数，由 handler.asm 在分发前累加
+u32 interrupt_count[IDT_SIZE];
+
 extern handler_t handler_entry_table[ENTRY_SIZE];
 extern void syscall_handler();
 extern void page_fault();
@@ -78,6 +81,12 @@ void set_interrupt_handler(u32 irq, handler_t handler) {
 }
 
 
+u32 interrupt_get_count(u32 vector) {
+    assert(vector < IDT_SIZE);
+    return interrupt_count[vector];
+}
+
+
 void set_interrupt_mask(u32 irq, bool enable) {
     assert(irq >= 0 && irq < 16);
 
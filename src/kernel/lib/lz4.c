@@ -0,0 +1,194 @@
+#include <xjos/lz4.h>
+#include <xjos/string.h>
+#include <xjos/assert.h>
+#include <xjos/errno.h>
+
+/**
+ * LZ4 block format
+ *
+ * sequence = token literals [offset match]
+ * token 高 4 位是字面量长度，低 4 位是匹配长度 - 4，等于 15 时后面跟着扩展字节，
+ * 每个 255 继续累加。offset 是两字节小端。最后一个序列只有字面量，
+ * 且最后 5 个字节一定是字面量，最后一个匹配至少在结尾 12 字节之前开始。
+ */
+
+#define MINMATCH 4
+#define LASTLITERALS 5
+#define MFLIMIT 12
+
+#define RUN_MASK 15
+#define ML_MASK 15
+
+
+static _inline u32 read32(const u8 *ptr) {
+    u32 value;
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+
+static _inline u32 lz4_hash(u32 seq) {
+    return (seq * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+
+// 长度扩展字节
+static u8 *lz4_length(u8 *op, u32 len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = len;
+    return op;
+}
+
+
+// 一个序列最多占用的字节数
+static _inline u32 lz4_bound(u32 literals, u32 match) {
+    return 1 + literals / 255 + 1 + literals + 2 + match / 255 + 1;
+}
+
+
+int lz4_compress(const void *src, int len, void *dst, int cap, void *work) {
+    assert(len >= 0 && len <= LZ4_MAX_INPUT);
+
+    const u8 *base = src;
+    const u8 *ip = base;
+    const u8 *anchor = base;
+    const u8 *iend = base + len;
+    const u8 *mflimit = iend - MFLIMIT;
+    const u8 *matchlimit = iend - LASTLITERALS;
+
+    u8 *op = dst;
+    u8 *oend = op + cap;
+
+    // 表中记录 hash 最近一次出现的位置，输入不超过 64KB，u16 够用
+    u16 *table = work;
+    memset(table, 0, LZ4_WORK_SIZE);
+
+    while (len > MFLIMIT && ip < mflimit) {
+        u32 seq = read32(ip);
+        u32 hash = lz4_hash(seq);
+        const u8 *ref = base + table[hash];
+        table[hash] = ip - base;
+
+        if (ref >= ip || read32(ref) != seq) {
+            ip++;
+            continue;
+        }
+
+        // 向前扩展匹配，减少字面量
+        while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+            ip--;
+            ref--;
+        }
+
+        const u8 *mp = ip + MINMATCH;
+        const u8 *rp = ref + MINMATCH;
+        while (mp < matchlimit && *mp == *rp) {
+            mp++;
+            rp++;
+        }
+
+        u32 literals = ip - anchor;
+        u32 match = mp - ip - MINMATCH;
+        if (lz4_bound(literals, match) > (u32)(oend - op))
+            return 0;
+
+        u8 *token = op++;
+        *token = (literals >= RUN_MASK ? RUN_MASK : literals) << 4;
+        if (literals >= RUN_MASK)
+            op = lz4_length(op, literals - RUN_MASK);
+        memcpy(op, anchor, literals);
+        op += literals;
+
+        u16 offset = ip - ref;
+        *op++ = offset & 0xff;
+        *op++ = offset >> 8;
+
+        *token |= match >= ML_MASK ? ML_MASK : match;
+        if (match >= ML_MASK)
+            op = lz4_length(op, match - ML_MASK);
+
+        ip = mp;
+        anchor = ip;
+
+        // 记录匹配末尾附近的位置，利于下一次匹配
+        if (ip < mflimit)
+            table[lz4_hash(read32(ip - 2))] = ip - 2 - base;
+    }
+
+    // 剩余的字面量
+    u32 literals = iend - anchor;
+    if (1 + literals / 255 + 1 + literals > (u32)(oend - op))
+        return 0;
+
+    u8 *token = op++;
+    *token = (literals >= RUN_MASK ? RUN_MASK : literals) << 4;
+    if (literals >= RUN_MASK)
+        op = lz4_length(op, literals - RUN_MASK);
+    memcpy(op, anchor, literals);
+    op += literals;
+
+    return op - (u8 *)dst;
+}
+
+
+// 读取扩展长度，越界返回 false
+static bool lz4_extend(const u8 **ip, const u8 *iend, u32 *len) {
+    u8 byte;
+    do {
+        if (*ip >= iend)
+            return false;
+        byte = *(*ip)++;
+        *len += byte;
+    } while (byte == 255);
+    return true;
+}
+
+
+int lz4_decompress(const void *src, int len, void *dst, int cap) {
+    const u8 *ip = src;
+    const u8 *iend = ip + len;
+
+    u8 *base = dst;
+    u8 *op = base;
+    u8 *oend = base + cap;
+
+    while (ip < iend) {
+        u8 token = *ip++;
+
+        u32 literals = token >> 4;
+        if (literals == RUN_MASK && !lz4_extend(&ip, iend, &literals))
+            return -EINVAL;
+        if (literals > (u32)(iend - ip) || literals > (u32)(oend - op))
+            return -EINVAL;
+        memcpy(op, ip, literals);
+        op += literals;
+        ip += literals;
+
+        // 最后一个序列没有匹配
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return -EINVAL;
+        u32 offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (!offset || offset > (u32)(op - base))
+            return -EINVAL;
+
+        u32 match = token & ML_MASK;
+        if (match == ML_MASK && !lz4_extend(&ip, iend, &match))
+            return -EINVAL;
+        match += MINMATCH;
+        if (match > (u32)(oend - op))
+            return -EINVAL;
+
+        // 匹配可能与输出重叠，逐字节复制
+        const u8 *ref = op - offset;
+        while (match--)
+            *op++ = *ref++;
+    }
+    return op - base;
+}
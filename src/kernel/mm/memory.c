@@ -9,6 +9,7 @@
 #include <xjos/syscall_nr.h>
 #include <fs/fs.h>
 #include <xjos/printk.h>
+#include <xjos/errno.h>
 
 
 #define LOGK(fmt, args...) DEBUGK(fmt, ##args)
@@ -67,6 +68,8 @@ static u32 memory_base = 0;    // Available memory base, value should = 1M
 static u32 memory_size = 0;    // Available memory size
 static u32 total_pages = 0;    // all memory pages
 static u32 free_pages = 0;     // free memory pages
+static u32 kernel_pages = 0;   // kernel memory pages (1M ~ 16M)
+static u32 kernel_free = 0;    // free kernel memory pages
 
 #define used_pages (total_pages - free_pages)   // used memory pages
 
@@ -156,6 +159,9 @@ void memory_map_init() {
     bitmap_init(&kernel_map, (u8*)KERNEL_MAP_BITS, length, IDX(MEMORY_BASE));
     bitmap_scan(&kernel_map, memory_map_pages);
 
+    kernel_pages = length * 8;
+    kernel_free = kernel_pages - memory_map_pages;
+
 }
 
 
@@ -227,11 +233,12 @@ _inline void set_cr3(u32 pde) {
 }
 
 
-// set cr3 reg, PE -> 1, enable paging
+// set cr3 reg, PG -> 1, enable paging
+// WP -> 1, 内核写只读页同样产生缺页，copy_to_user 才会写时复制或返回 -EFAULT
 static _inline void enable_page() {
     asm volatile(
         "movl %cr0, %eax\n"
-        "orl $0x80000000, %eax\n"
+        "orl $0x80010000, %eax\n"
         "movl %eax, %cr0\n"
     );
 }
@@ -407,10 +414,42 @@ static void reset_page(bitmap_t *map, u32 addr, u32 count) {
 }
 
 
+#define SHRINKER_NR 8
+#define SHRINK_BATCH 32
+
+static shrinker_t shrinkers[SHRINKER_NR];
+static u32 shrinker_count = 0;
+
+void register_shrinker(shrinker_t shrinker) {
+    assert(shrinker_count < SHRINKER_NR);
+    shrinkers[shrinker_count++] = shrinker;
+}
+
+
+// 依次调用回收函数，返回回收对象总数
+u32 shrink_memory(u32 count) {
+    u32 freed = 0;
+    for (size_t i = 0; i < shrinker_count; i++) {
+        freed += shrinkers[i](count);
+    }
+    return freed;
+}
+
+
 u32 alloc_kpage(u32 count) {
     assert(count > 0);
 
-    idx_t vaddr = scan_page(&kernel_map, count);
+    int32 index = bitmap_scan(&kernel_map, count);
+    if (index == EOF) {
+        // 内核页不足，先回收缓存对象再重试
+        shrink_memory(SHRINK_BATCH);
+        index = bitmap_scan(&kernel_map, count);
+    }
+    if (index == EOF)
+        panic("Alloc kernel page fail!");
+
+    idx_t vaddr = PAGE(index);
+    kernel_free -= count;
     MM_TRACEK("Alloc kernel pages 0x%p count %d\n", vaddr, count);
     memset((void*)vaddr, 0, count * PAGE_SIZE);
     return vaddr;
@@ -422,6 +461,7 @@ void free_kpage(u32 vaddr, u32 count) {
     assert(count > 0);
 
     reset_page(&kernel_map, vaddr, count);
+    kernel_free += count;
     MM_TRACEK("free kernel pages 0x%p count %d\n", vaddr, count);
 }
 
@@ -571,7 +611,6 @@ page_entry_t *copy_pde() {
             continue;
 
         assert(memory_map[dentry->index] > 0);
-        dentry->write = false;   // read only
         memory_map[dentry->index]++;   // ref count + 1
         assert(memory_map[dentry->index] < 255);
 
@@ -586,13 +625,17 @@ page_entry_t *copy_pde() {
             // present
             assert(memory_map[entry->index] > 0);
             // if dont shared page, read only
-            if (!entry->shared) {
+            // 页表只读时其中的页已经只读，开启 WP 后不能再写只读的页表
+            if (!entry->shared && entry->write) {
                 entry->write = false;
             }
             memory_map[entry->index]++;
 
             assert(memory_map[entry->index] < 255);
         }
+
+        // 页表项修改完之后再把页表设为只读，最后 set_cr3 刷新 TLB
+        dentry->write = false;   // read only
     }
 
     pde = (page_entry_t *)alloc_kpage(1);    // new pde
@@ -607,6 +650,14 @@ page_entry_t *copy_pde() {
 }
 
 
+void memory_stat(memory_stat_t *stat) {
+    stat->total_pages = total_pages;
+    stat->free_pages = free_pages;
+    stat->kernel_pages = kernel_pages;
+    stat->kernel_free = kernel_free;
+}
+
+
 int sys_brk(void *addr) {
     // LOGK("task brk 0x%p\n", addr);
     u32 brk = (u32)addr;
@@ -655,7 +706,16 @@ void *sys_mmap(void *addr, size_t length, int prot, int flags, int fd, off_t off
         link_page(page);
         memset((void *)page, 0, PAGE_SIZE);
         bitmap_set(task->vmap, IDX(page), true);
+    }
 
+    // 先读入文件内容，之后才设置页面只读
+    if (fd != EOF) {
+        sys_lseek(fd, offset, SEEK_SET);
+        sys_read(fd, (void *)vaddr, length);    // todo
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        u32 page = vaddr + i * PAGE_SIZE;
         page_entry_t *entry = get_entry_private(page, false);
         entry->user = true;
         entry->write = false;
@@ -673,11 +733,6 @@ void *sys_mmap(void *addr, size_t length, int prot, int flags, int fd, off_t off
         flush_tlb(page);
     }
 
-    if (fd != EOF) {
-        sys_lseek(fd, offset, SEEK_SET);
-        sys_read(fd, (void *)vaddr, length);    // todo
-    }
-
     return (void *)vaddr;
 }
 
@@ -747,6 +802,36 @@ typedef struct {
 }_packed page_error_code_t;
 
 
+// 异常修复表：访问用户内存的指令和出错后继续执行的位置，
+// 由 ex_table 段收集，链接器生成段的起止符号
+typedef struct exception_entry_t {
+    u32 insn;
+    u32 fixup;
+} exception_entry_t;
+
+extern exception_entry_t __start_ex_table[];
+extern exception_entry_t __stop_ex_table[];
+
+#define EX_TABLE(insn, fixup)            \
+    ".pushsection ex_table, \"a\"\n"     \
+    ".long " #insn ", " #fixup "\n"      \
+    ".popsection\n"
+
+// 内核态出错的指令在修复表中时，修改返回地址到修复代码
+static bool fixup_exception(u32 cs, u32 *eip) {
+    if (cs & 3)
+        return false;
+
+    for (exception_entry_t *entry = __start_ex_table; entry < __stop_ex_table; entry++) {
+        if (entry->insn != *eip)
+            continue;
+        LOGK("fixup user access at 0x%p\n", *eip);
+        *(volatile u32 *)eip = entry->fixup;
+        return true;
+    }
+    return false;
+}
+
 void page_fault(u32 vector,
     u32 edi, u32 esi, u32 ebp, u32 esp,
     u32 ebx, u32 edx, u32 ecx, u32 eax,
@@ -764,6 +849,9 @@ void page_fault(u32 vector,
     
     // if user process access kernel memory, panic
     if (vaddr < USER_EXEC_ADDR || vaddr >= USER_STACK_TOP) {
+        // eip 是中断栈上的返回地址，修改后从修复代码继续
+        if (fixup_exception(cs, &eip))
+            return;
         assert(task->uid);
         LOGK("fault address 0x%p eip 0x%p\n", vaddr, eip);
         printk("Segmentation Fault: Invalid memory access at 0x%p by task %s\n",
@@ -779,13 +867,16 @@ void page_fault(u32 vector,
         assert(entry->present);
 
         if (entry->readonly) {
+            if (fixup_exception(cs, &eip))
+                return;
             LOGK("fault address 0x%p eip 0x%p\n", vaddr, eip);
             printk("Segmentation Fault: Write to Read-Only page at 0x%p\n", vaddr);
             task_exit(-1);
             return;
         }
 
-        assert(!entry->shared);  // not shared page
+        // 共享页本身可写，缺页只能来自 fork 后只读的页表，copy_on_write 会私有化页表
+        assert(!entry->shared || !get_pde()[DIDX(vaddr)].write);
 
         copy_on_write(vaddr);
         return;
@@ -801,38 +892,149 @@ void page_fault(u32 vector,
         return;
     }
 
+    if (fixup_exception(cs, &eip))
+        return;
+
     LOGK("fault address 0x%p eip 0x%p\n", vaddr, eip);
     LOGK("task 0x%p name %s brk 0x%p page fault\n", task, task->name, task->brk);
 
     panic("page fault!!!");
 }
 
-bool memory_access(void *vaddr, int size, bool write, bool user) {
-    u32 page = PAGE(IDX(vaddr));
-    u32 last = (u32)(vaddr) + size;
 
-    page_entry_t *entry;
-    for (size_t i = 0; page < last; i++, page += PAGE_SIZE) {
-        // 页目录
-        page_entry_t *pde = get_pde();
-        idx_t idx = DIDX(page);
+bool set_kernel_ds(bool on) {
+    task_t *task = running_task();
+    bool old = task->flags & TASK_KERNEL_DS;
+    if (on)
+        task->flags |= TASK_KERNEL_DS;
+    else
+        task->flags &= ~TASK_KERNEL_DS;
+    return old;
+}
+
+// 用户地址必须在 [USER_EXEC_ADDR, USER_STACK_TOP) 内，范围内未映射的页由缺页修复处理；
+// 内核地址在每个任务中都有映射，访问不会出错，只有 TASK_KERNEL_DS 的任务可以传入
+static bool user_range(const void *addr, size_t count) {
+    u32 start = (u32)addr;
+    if (!addr || start + count < start)
+        return false;
+    if (running_task()->flags & TASK_KERNEL_DS)
+        return true;
+    return start >= USER_EXEC_ADDR && start + count <= USER_STACK_TOP;
+}
 
-        // 页框
-        entry = &pde[idx];
-        if (!entry->present)
-            return false;
+static err_t user_copy(void *dst, const void *src, size_t count) {
+    err_t ret = EOK;
+    asm volatile(
+        "1: rep movsb\n"
+        "   jmp 3f\n"
+        "2: movl %4, %0\n"
+        "3:\n"
+        EX_TABLE(1b, 2b)
+        : "+r"(ret), "+D"(dst), "+S"(src), "+c"(count)
+        : "i"(-EFAULT)
+        : "memory");
+    return ret;
+}
 
-        // 页表
-        page_entry_t *table = (page_entry_t *)(PDE_MASK | (idx << 12));
-        entry = &table[TIDX(page)];
+err_t copy_from_user(void *dst, const void *src, size_t count) {
+    if (!count)
+        return EOK;
+    if (!user_range(src, count))
+        return -EFAULT;
+    return user_copy(dst, src, count);
+}
 
-        if (!entry->present)
-            return false;
-        if (write && entry->readonly)
-            return false;
-        if (user && !entry->user)
-            return false;
+err_t copy_to_user(void *dst, const void *src, size_t count) {
+    if (!count)
+        return EOK;
+    if (!user_range(dst, count))
+        return -EFAULT;
+    return user_copy(dst, src, count);
+}
+
+err_t clear_user(void *dst, size_t count) {
+    if (!count)
+        return EOK;
+    if (!user_range(dst, count))
+        return -EFAULT;
+
+    err_t ret = EOK;
+    asm volatile(
+        "1: rep stosb\n"
+        "   jmp 3f\n"
+        "2: movl %3, %0\n"
+        "3:\n"
+        EX_TABLE(1b, 2b)
+        : "+r"(ret), "+D"(dst), "+c"(count)
+        : "i"(-EFAULT), "a"(0)
+        : "memory");
+    return ret;
+}
+
+int strncpy_from_user(char *dst, const char *src, size_t count) {
+    if (!count)
+        return 0;
+
+    // 字符串可以在用户空间末尾之前结束，只检查到末尾
+    size_t limit = count;
+    if (!(running_task()->flags & TASK_KERNEL_DS) && (u32)src >= USER_EXEC_ADDR && (u32)src < USER_STACK_TOP)
+        limit = MIN(count, USER_STACK_TOP - (u32)src);
+    if (!user_range(src, limit))
+        return -EFAULT;
+
+    // 按页复制，结束符之后的页可能没有映射
+    size_t copied = 0;
+    while (copied < limit) {
+        size_t chunk = MIN(limit - copied, PAGE_SIZE - ((u32)(src + copied) & (PAGE_SIZE - 1)));
+        err_t ret = user_copy(dst + copied, src + copied, chunk);
+        if (ret < EOK)
+            return ret;
+
+        char *end = memchr(dst + copied, 0, chunk);
+        if (end)
+            return end - dst;
+        copied += chunk;
+    }
+    return limit == count ? (int)count : -EFAULT;
+}
+
+
+// 固定用户缓冲所在的物理页，设备直接访问期间页面不会被释放
+// write 表示设备要写入内存，先写一次页面完成写时复制
+err_t pin_user_pages(void *addr, size_t count, bool write) {
+    if (!count)
+        return EOK;
+    if (!user_range(addr, count))
+        return -EFAULT;
+
+    u32 start = (u32)addr & ~(PAGE_SIZE - 1);
+    u32 end = (u32)addr + count;
+    for (u32 page = start; page < end; page += PAGE_SIZE) {
+        char *ptr = (char *)MAX(page, (u32)addr);
+        char ch;
+        err_t ret = copy_from_user(&ch, ptr, 1);
+        if (ret == EOK && write)
+            ret = copy_to_user(ptr, &ch, 1);
+        if (ret < EOK) {
+            if (page > start)
+                unpin_user_pages(addr, page - (u32)addr);
+            return ret;
+        }
+
+        u32 idx = IDX(get_paddr(page));
+        assert(memory_map[idx] > 0 && memory_map[idx] < 255);
+        memory_map[idx]++;
     }
+    return EOK;
+}
 
-    return true;
-}
\ No newline at end of file
+void unpin_user_pages(void *addr, size_t count) {
+    u32 end = (u32)addr + count;
+    for (u32 page = (u32)addr & ~(PAGE_SIZE - 1); page < end; page += PAGE_SIZE) {
+        u32 idx = IDX(get_paddr(page));
+        // 页面仍然映射在当前任务中，引用至少为 2
+        assert(memory_map[idx] > 1);
+        memory_map[idx]--;
+    }
+}
@@ -1,31 +1,21 @@
 #include <xjos/net.h>
 #include <xjos/arena.h>
-#include <xjos/task.h>
 #include <xjos/string.h>
 #include <xjos/memory.h>
 
 
-err_t iovec_check(iovec_t *iov, int iovlen, int write) {
+// iov 是内核中的副本，用户地址在读写时由 copy_*_user 检查
+err_t iovec_check(iovec_t *iov, int iovlen) {
     if (!iov)
         return -EFAULT;   
     if (iovlen < 0)
         return -EINVAL;
 
-    bool user = true;
-    if (running_task()->uid == KERNEL_USER)
-        user = false;
-
-    // I/O 向量可访问
-    if (!memory_access(iov, iovlen * sizeof(iovec_t), false, user))
-        return -EFAULT;
-
     for (; iovlen > 0; iov++, iovlen--) {
         if (iov->size <= 0)
             return -EINVAL;
         if (!iov->base)
             return -EINVAL;
-        if (!memory_access(iov->base, iov->size, write, user))
-            return -EFAULT;
     }
 
     return EOK;
@@ -42,15 +32,22 @@ size_t iovec_size(iovec_t *iov, int iovlen) {
     return size;
 }
 
+// 复制用户的 I/O 向量，长度无效或不可访问时返回 NULL
 iovec_t *iovec_dup(iovec_t *iov, int iovlen) {
     iovec_t *newiov;
 
+    if (iovlen <= 0 || iovlen > IOVEC_MAX)
+        return NULL;
+
     newiov = (iovec_t *)kmalloc(iovlen * sizeof(iovec_t));
     if (!newiov) {
         return NULL;
     }
 
-    memcpy(newiov, iov, iovlen * sizeof(iovec_t));
+    if (copy_from_user(newiov, iov, iovlen * sizeof(iovec_t)) < EOK) {
+        kfree(newiov);
+        return NULL;
+    }
 
     return newiov;
 }
@@ -66,7 +63,8 @@ int iovec_read(iovec_t *iov, int iovlen, char *buf, size_t count) {
         if (count < iov->size)
             len = count;
 
-        memcpy(buf, iov->base, len);
+        if (copy_from_user(buf, iov->base, len) < EOK)
+            return -EFAULT;
 
         read += len;
         iov->base += len;
@@ -90,7 +88,8 @@ int iovec_write(iovec_t *iov, int iovlen, char *buf, size_t count) {
         if (count < iov->size)
             len = count;
 
-        memcpy(iov->base, buf, len);
+        if (copy_to_user(iov->base, buf, len) < EOK)
+            return -EFAULT;
 
         written += len;
         iov->base += len;
@@ -55,6 +55,15 @@ netif_t *netif_get() {
     return netif;
 }
 
+netif_t *netif_index(idx_t idx) {
+    netif_t *netif;
+    list_for_each_entry(netif, &netif_list, node) {
+        if (!idx--)
+            return netif;
+    }
+    return NULL;
+}
+
 netif_t *netif_route(ip_addr_t addr) {
     list_t *list = &netif_list;
     netif_t *netif;
@@ -83,6 +92,8 @@ bool ip_addr_isown(ip_addr_t addr) {
 }
 
 void netif_input(netif_t *netif, pbuf_t *pbuf) {
+    netif->rx_packets++;
+    netif->rx_bytes += pbuf->length;
     list_push(&netif->rx_pbuf_list, &pbuf->node);
     if (neti_task->state == TASK_WAITING) {
         task_unblock(neti_task, EOK);
@@ -90,6 +101,8 @@ void netif_input(netif_t *netif, pbuf_t *pbuf) {
 }
 
 void netif_output(netif_t *netif, pbuf_t *pbuf) {
+    netif->tx_packets++;
+    netif->tx_bytes += pbuf->length;
     list_push(&netif->tx_pbuf_list, &pbuf->node);
     if (neto_task->state == TASK_WAITING) {
         task_unblock(neto_task, EOK);
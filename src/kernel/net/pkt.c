@@ -99,8 +99,10 @@ static int pkt_sendmsg(socket_t *s, msghdr_t *msg, u32 flags) {
     pbuf_t *pbuf = pbuf_get();
 
     ret = iovec_read(msg->iov, msg->iovlen, (char *)pbuf->payload, size);
-    if (ret < EOK)
+    if (ret < EOK) {
+        pbuf_put(pbuf);
         return ret;
+    }
     pbuf->length = size;
 
     netif_t *netif = netif_get();
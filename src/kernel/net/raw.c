@@ -115,8 +115,10 @@ static int raw_sendmsg(socket_t *s, msghdr_t *msg, u32 flags) {
     pbuf_t *pbuf = pbuf_get();
 
     ret = iovec_read(msg->iov, msg->iovlen, (char *)pbuf->eth->payload, size);
-    if (ret < EOK)
+    if (ret < EOK) {
+        pbuf_put(pbuf);
         return ret;
+    }
 
     netif_t *netif = netif_route(pbuf->eth->ip->dst);
 
@@ -6,6 +6,7 @@
 #include <xjos/assert.h>
 #include <xjos/debug.h>
 #include <xjos/errno.h>
+#include <xjos/memory.h>
 
 
 #define LOGK(fmt, args...) DEBUGK(fmt, ##args)
@@ -173,13 +174,37 @@ int sys_accept(int fd, sockaddr_t *addr, int *addrlen) {
     return fd;
 }
 
+// 用户传入的地址复制到内核，协议层只访问副本
+static err_t socket_name_in(sockaddr_t *addr, const sockaddr_t *name, int namelen) {
+    memset(addr, 0, sizeof(sockaddr_t));
+    if (namelen < 0)
+        return -EINVAL;
+    return copy_from_user(addr, name, MIN(namelen, (int)sizeof(sockaddr_t)));
+}
+
+// 协议层填充的地址按用户缓冲长度截断，实际长度写回 namelen
+static err_t socket_name_out(sockaddr_t *name, int *namelen, sockaddr_t *addr, int len) {
+    int size;
+    if (copy_from_user(&size, namelen, sizeof(int)) < EOK)
+        return -EFAULT;
+    if (size < 0)
+        return -EINVAL;
+    if (copy_to_user(name, addr, MIN(size, MIN(len, (int)sizeof(sockaddr_t)))) < EOK)
+        return -EFAULT;
+    return copy_to_user(namelen, &len, sizeof(int));
+}
+
 int sys_bind(int fd, const sockaddr_t *name, int namelen) {
     if (!name)
         return -EFAULT;
     if (namelen < sizeof(sockaddr_in_t))
         return -EFAULT;
 
-    sockaddr_in_t *sin = (sockaddr_in_t *)name;
+    sockaddr_t addr;
+    if (socket_name_in(&addr, name, namelen) < EOK)
+        return -EFAULT;
+
+    sockaddr_in_t *sin = (sockaddr_in_t *)&addr;
     switch (sin->family) {
         case AF_INET:
         case AF_UNSPEC:
@@ -194,7 +219,7 @@ int sys_bind(int fd, const sockaddr_t *name, int namelen) {
     if (!s)
         return -EINVAL;
 
-    return socket_get_op(s->type)->bind(s, name, namelen);
+    return socket_get_op(s->type)->bind(s, &addr, namelen);
 }
 
 int sys_connect(int fd, const sockaddr_t *name, int namelen) {
@@ -203,7 +228,11 @@ int sys_connect(int fd, const sockaddr_t *name, int namelen) {
     if (namelen < sizeof(sockaddr_in_t))
         return -EFAULT;
 
-    sockaddr_in_t *sin = (sockaddr_in_t *)name;
+    sockaddr_t addr;
+    if (socket_name_in(&addr, name, namelen) < EOK)
+        return -EFAULT;
+
+    sockaddr_in_t *sin = (sockaddr_in_t *)&addr;
     switch (sin->family) {
         case AF_INET:
         case AF_UNSPEC:
@@ -218,7 +247,7 @@ int sys_connect(int fd, const sockaddr_t *name, int namelen) {
     if (!s)
         return -EINVAL;
 
-    return socket_get_op(s->type)->connect(s, name, namelen);
+    return socket_get_op(s->type)->connect(s, &addr, namelen);
 }
 
 int sys_shutdown(int fd, int how) {
@@ -234,7 +263,12 @@ int sys_getpeername(int fd, sockaddr_t *name, int *namelen) {
     if (!s)
         return -EINVAL;
 
-    return socket_get_op(s->type)->getpeername(s, name, namelen);
+    sockaddr_t addr;
+    int len = 0;
+    int ret = socket_get_op(s->type)->getpeername(s, &addr, &len);
+    if (ret < EOK)
+        return ret;
+    return socket_name_out(name, namelen, &addr, len);
 }
 
 int sys_getsockname(int fd, sockaddr_t *name, int *namelen) {
@@ -242,7 +276,12 @@ int sys_getsockname(int fd, sockaddr_t *name, int *namelen) {
     if (!s)
         return -EINVAL;
 
-    return socket_get_op(s->type)->getsockname(s, name, namelen);
+    sockaddr_t addr;
+    int len = 0;
+    int ret = socket_get_op(s->type)->getsockname(s, &addr, &len);
+    if (ret < EOK)
+        return ret;
+    return socket_name_out(name, namelen, &addr, len);
 }
 
 int sys_getsockopt(int fd, int level, int optname, void *optval, int *optlen) {
@@ -263,13 +302,11 @@ int sys_setsockopt(int fd, int level, int optname, const void *optval, int optle
         case SO_SNDTIMEO:
             if (optlen != 4)
                 return -EINVAL;
-            s->sndtimeo = *(int *)optval;
-            return EOK;
+            return copy_from_user(&s->sndtimeo, optval, sizeof(int));
         case SO_RCVTIMEO:
             if (optlen != 4)
                 return -EINVAL;
-            s->rcvtimeo = *(int *)optval;
-            return EOK;
+            return copy_from_user(&s->rcvtimeo, optval, sizeof(int));
         default:
             break;
         }
@@ -290,9 +327,10 @@ int sys_recvfrom(int fd, void *data, int size, u32 flags, sockaddr_t *from, int
 
     msghdr_t msg;
     iovec_t iov;
+    sockaddr_t addr;
 
-    msg.name = from;
-    msg.namelen = fromlen ? *fromlen : 0;
+    msg.name = from ? &addr : NULL;
+    msg.namelen = 0;
 
     msg.iov = &iov;
     msg.iovlen = 1;
@@ -300,14 +338,17 @@ int sys_recvfrom(int fd, void *data, int size, u32 flags, sockaddr_t *from, int
     iov.base = data;
     iov.size = size;
 
-    int ret = iovec_check(msg.iov, msg.iovlen, true);
+    int ret = iovec_check(msg.iov, msg.iovlen);
     if (ret < EOK)
         return ret;
 
     ret = socket_get_op(s->type)->recvmsg(s, &msg, flags);
 
-    if (fromlen)
-        *fromlen = msg.namelen;
+    if (ret >= EOK && from && fromlen) {
+        err_t err = socket_name_out(from, fromlen, &addr, msg.namelen);
+        if (err < EOK)
+            return err;
+    }
 
     return ret;
 }
@@ -318,14 +359,29 @@ int sys_recvmsg(int fd, msghdr_t *msg, u32 flags) {
         return -EINVAL;
 
     msghdr_t m;
-    memcpy(&m, msg, sizeof(msghdr_t));
-    m.iov = iovec_dup(msg->iov, msg->iovlen);
+    if (copy_from_user(&m, msg, sizeof(msghdr_t)) < EOK)
+        return -EFAULT;
 
-    int ret = iovec_check(m.iov, m.iovlen, true);
-    if (ret < EOK)
-        return ret;
+    sockaddr_t addr;
+    sockaddr_t *name = m.name;
+    int namelen = m.namelen;
+    m.name = name ? &addr : NULL;
+
+    m.iov = iovec_dup(m.iov, m.iovlen);
+    if (!m.iov)
+        return -EFAULT;
 
-    ret = socket_get_op(s->type)->recvmsg(s, &m, flags);
+    int ret = iovec_check(m.iov, m.iovlen);
+    if (ret == EOK)
+        ret = socket_get_op(s->type)->recvmsg(s, &m, flags);
+
+    if (ret >= EOK && name) {
+        int len = MIN(m.namelen, (int)sizeof(sockaddr_t));
+        if (namelen < 0 ||
+            copy_to_user(name, &addr, MIN(namelen, len)) < EOK ||
+            copy_to_user(&msg->namelen, &m.namelen, sizeof(int)) < EOK)
+            ret = -EFAULT;
+    }
 
     kfree(m.iov);
     return ret;
@@ -343,9 +399,15 @@ int sys_sendto(int fd, void *data, int size, u32 flags, sockaddr_t *to, int tole
 
     msghdr_t msg;
     iovec_t iov;
+    sockaddr_t addr;
 
-    msg.name = to;
+    msg.name = NULL;
     msg.namelen = tolen;
+    if (to) {
+        if (socket_name_in(&addr, to, tolen) < EOK)
+            return -EFAULT;
+        msg.name = &addr;
+    }
 
     msg.iov = &iov;
     msg.iovlen = 1;
@@ -353,7 +415,7 @@ int sys_sendto(int fd, void *data, int size, u32 flags, sockaddr_t *to, int tole
     iov.base = data;
     iov.size = size;
 
-    int ret = iovec_check(msg.iov, msg.iovlen, false);
+    int ret = iovec_check(msg.iov, msg.iovlen);
     if (ret < EOK)
         return ret;
 
@@ -366,14 +428,23 @@ int sys_sendmsg(int fd, msghdr_t *msg, u32 flags) {
         return -EINVAL;
 
     msghdr_t m;
-    memcpy(&m, msg, sizeof(msghdr_t));
-    m.iov = iovec_dup(msg->iov, msg->iovlen);
+    if (copy_from_user(&m, msg, sizeof(msghdr_t)) < EOK)
+        return -EFAULT;
 
-    int ret = iovec_check(m.iov, m.iovlen, false);
-    if (ret < EOK)
-        return ret;
+    sockaddr_t addr;
+    if (m.name) {
+        if (socket_name_in(&addr, m.name, m.namelen) < EOK)
+            return -EFAULT;
+        m.name = &addr;
+    }
+
+    m.iov = iovec_dup(m.iov, m.iovlen);
+    if (!m.iov)
+        return -EFAULT;
 
-    ret = socket_get_op(s->type)->sendmsg(s, &m, flags);
+    int ret = iovec_check(m.iov, m.iovlen);
+    if (ret == EOK)
+        ret = socket_get_op(s->type)->sendmsg(s, &m, flags);
 
     kfree(m.iov);
     return ret;
@@ -450,6 +521,13 @@ static fs_op_t socket_op = {
     fs_default_nosys,
     fs_default_nosys,
     fs_default_nosys,
+    fs_default_nosys,
+    fs_default_nosys,
+    fs_default_nosys,
+    fs_default_nosys,
+    fs_default_nosys,
+    fs_default_nosys,
+    fs_default_nosys,
 };
 
 void socket_init() {
@@ -198,8 +198,10 @@ static int udp_sendmsg(socket_t *s, msghdr_t *msg, u32 flags) {
     udp_t *udp = pbuf->eth->ip->udp;
 
     ret = iovec_read(msg->iov, msg->iovlen, (char *)udp->payload, size);
-    if (ret < EOK)
+    if (ret < EOK) {
+        pbuf_put(pbuf);
         return ret;
+    }
 
     if (msg->name) {
         sockaddr_in_t *sin = (sockaddr_in_t *)msg->name;
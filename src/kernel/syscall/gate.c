@@ -23,6 +23,8 @@ static void sys_default() {
 }
 
 int sys_sync() {
+    isync();
+    ssync();
     bsync();
     return 0;
 }
@@ -39,6 +41,13 @@ extern int sys_read();
 extern int sys_write();
 extern int sys_lseek();
 extern int sys_readdir();
+extern int sys_getdents();
+extern int sys_sendfile();
+extern int sys_splice();
+extern int sys_copy_file_range();
+
+extern int sys_ioprio_set();
+extern int sys_ioprio_get();
 
 extern int sys_execve();
 extern int sys_kill();
@@ -78,6 +87,11 @@ extern int sys_getpgrp();
 extern int sys_stty();
 extern int sys_gtty();
 extern int sys_ioctl();
+extern int sys_fcntl();
+
+extern int sys_fsync();
+extern int sys_fdatasync();
+extern int sys_sync_file_range();
 
 extern int sys_signal();
 extern int sys_sgetmask();
@@ -122,12 +136,15 @@ void syscall_init() {
     syscall_table[SYS_NR_SETPGID] = sys_setpgid;
     syscall_table[SYS_NR_GETPGID] = sys_getpgrp;
     syscall_table[SYS_NR_SETSID] = sys_setsid;
+    syscall_table[SYS_NR_IOPRIO_SET] = sys_ioprio_set;
+    syscall_table[SYS_NR_IOPRIO_GET] = sys_ioprio_get;
 
     syscall_table[SYS_NR_KILL] = sys_kill;
 
     syscall_table[SYS_NR_STTY] = sys_stty;
     syscall_table[SYS_NR_GTTY] = sys_gtty;
     syscall_table[SYS_NR_IOCTL] = sys_ioctl;
+    syscall_table[SYS_NR_FCNTL] = sys_fcntl;
 
     syscall_table[SYS_NR_FORK] = task_fork;
 
@@ -154,6 +171,10 @@ void syscall_init() {
     syscall_table[SYS_NR_WRITE] = sys_write;
     syscall_table[SYS_NR_LSEEK] = sys_lseek;
     syscall_table[SYS_NR_READDIR] = sys_readdir;
+    syscall_table[SYS_NR_GETDENTS] = sys_getdents;
+    syscall_table[SYS_NR_SENDFILE] = sys_sendfile;
+    syscall_table[SYS_NR_SPLICE] = sys_splice;
+    syscall_table[SYS_NR_COPY_FILE_RANGE] = sys_copy_file_range;
 
     syscall_table[SYS_NR_EXECVE] = sys_execve;
 
@@ -161,6 +182,9 @@ void syscall_init() {
 
     syscall_table[SYS_NR_UMASK] = sys_umask;
     syscall_table[SYS_NR_SYNC] = sys_sync;
+    syscall_table[SYS_NR_FSYNC] = sys_fsync;
+    syscall_table[SYS_NR_FDATASYNC] = sys_fdatasync;
+    syscall_table[SYS_NR_SYNC_FILE_RANGE] = sys_sync_file_range;
 
     syscall_table[SYS_NR_CHDIR] = sys_chdir;
     syscall_table[SYS_NR_CHROOT] = sys_chroot;
@@ -393,6 +393,9 @@ int sys_execve(char *filename, char *argv[], char *envp[]) {
     iput(task->iexec);
     task->iexec = inode;
 
+    // 新程序只能传入用户地址
+    task->flags &= ~TASK_KERNEL_DS;
+
     LOGK("execve jump user %s eip=%p esp=%p\n", kfilename, entry, top);
 
     // 栈顶预留 intr_frame_t。
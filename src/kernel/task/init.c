@@ -2,7 +2,9 @@
 #include <xjos/task.h>
 #include <xjos/stdio.h>
 #include <xjos/interrupt.h>
+#include <xjos/memory.h>
 #include <fs/buffer.h>
+#include <fs/fs.h>
 
 
 extern int sys_execve(char *filename, char *argv[], char *envp[]);
@@ -15,7 +17,10 @@ extern void time_init();
 extern void tty_init();
 
 extern void ramdisk_init();
+extern void zram_init();
 extern void ide_init();
+extern void ahci_init();
+extern void virtio_blk_init();
 extern void floppy_init();
 extern void sb16_init();
 extern void e1000_init();
@@ -24,14 +29,20 @@ extern void buffer_init();
 extern void file_init();
 extern void inode_init();
 extern void pipe_init();
+extern void tmpfs_init();
+extern void proc_init();
 extern void minix_init();
 extern void super_init(); 
 extern void dcache_init();
 extern void dev_init();
+extern int sys_mount(char *devname, char *dirname, int flags);
 
 static volatile bool task_sync_done = false;
 
 void init_thread() {
+    // 挂载、创建设备节点时传入的路径都在内核中，execve 之后清除
+    set_kernel_ds(true);
+
     // 1. 基础硬件外设初始化
     serial_init();   // 初始化串口 (用于内核打印和调试)
     keyboard_init(); // 初始化键盘
@@ -40,7 +51,10 @@ void init_thread() {
 
     // 2. 块设备驱动初始化
     ramdisk_init();  // 初始化内存虚拟磁盘
+    zram_init();     // 初始化压缩内存磁盘
     ide_init();      // 初始化 IDE 硬盘设备
+    ahci_init();     // 初始化 SATA 硬盘设备
+    virtio_blk_init(); // 初始化 virtio 块设备
     sb16_init();     // 初始化 Sound Blaster 16 声卡
     floppy_init();   // 初始化软盘驱动 (如果存在)
     e1000_init();    // 初始化 Intel E1000 网卡
@@ -50,12 +64,15 @@ void init_thread() {
     inode_init();    // 初始化 inode 缓存
     minix_init();    // 初始化 minix 文件系统
     pipe_init();     // 初始化管道
+    tmpfs_init();    // 初始化内存文件系统
+    proc_init();     // 初始化 procfs
+    dcache_init();   // 初始化目录项缓存 (卸载超级块时需要清除表项)
     super_init();    // 初始化并挂载超级块 (解析磁盘上的文件系统结构)
-    dcache_init();     // 初始化目录项缓存 (依赖超级块和 inode)
 
     // 4. 上层设备文件抽象初始化
 
     dev_init();      // 初始化 /dev 下的设备文件节点
+    sys_mount("proc", "/proc", MOUNT_PROC); // 挂载内核状态文件系统
 
     task_sync_done = true; // 标记初始化完成
     // 5. 进入用户模式，运行 init 进程
@@ -79,8 +96,11 @@ void sync_thread() {
     set_interrupt_state(true);
     while (true) {
         bool intr = interrupt_disable();
-        if (task_sync_done)
+        if (task_sync_done) {
+            isync();
+            ssync();
             bsync();
+        }
         task_sleep(5000); // every 5 seconds
         set_interrupt_state(intr);
     }
@@ -198,6 +198,13 @@ u32 _inline sched_get_task_count(void) {
     return cfs_task_count;
 }
 
+/**
+ * @brief (Public API) Gets the total weight of ready tasks.
+ */
+u32 sched_get_total_weight(void) {
+    return cfs_total_weight;
+}
+
 /**
  * @brief (Public API) Core Scheduler
  */
@@ -63,6 +63,7 @@ static task_t *get_free_task() {
             memset(task, 0, PAGE_SIZE);
             
             task->pid = i;
+            task->start_time = jiffies;
             tasks_table[i] = task;
             return task;
         }
@@ -220,6 +221,8 @@ pid_t task_fork() {
     child->pid = pid;
     child->ppid = parent->pid;
     child->state = TASK_READY;
+    child->runtime = 0;
+    child->start_time = jiffies;
     child->magic = XJOS_MAGIC;
 
     // add, fix ref count
@@ -363,6 +366,8 @@ static task_t *task_create(target_t target, const char *name, int nice, u32 uid)
     task->nice = nice;
     task->weight = sched_nice_to_weight(nice);
     task->vruntime = sched_get_min_vruntime();
+    task->ioprio = 0;
+    task->io_vtime = 0;
 
     // init signal
     task->signal = 0;
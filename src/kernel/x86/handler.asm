@@ -2,6 +2,7 @@
 ; Interrupt handler
 
 extern handler_table
+extern interrupt_count
 extern task_signal
 
 section .text
@@ -38,6 +39,7 @@ interrupt_entry:
 
     push eax    ; stack top is func first argment
 
+    inc dword [interrupt_count + eax * 4]   ; statistics
 
     call [handler_table + eax * 4]
 
@@ -181,6 +183,8 @@ global syscall_handler
 syscall_handler:
     ; xchg bx, bx
 
+    inc dword [interrupt_count + 0x80 * 4]  ; statistics
+
     push eax
     call syscall_check
     add esp, 4
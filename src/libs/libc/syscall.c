@@ -140,6 +140,15 @@ int setsid() {
 }
 
 
+int ioprio_set(int which, int who, int ioprio) {
+    return _syscall3(SYS_NR_IOPRIO_SET, which, who, ioprio);
+}
+
+int ioprio_get(int which, int who) {
+    return _syscall2(SYS_NR_IOPRIO_GET, which, who);
+}
+
+
 int stty() {
     return _syscall0(SYS_NR_STTY);
 }
@@ -154,6 +163,10 @@ int ioctl(fd_t fd, int cmd, int args) {
     return _syscall3(SYS_NR_IOCTL, fd, cmd, args);
 }
 
+int fcntl(fd_t fd, int cmd, int arg) {
+    return _syscall3(SYS_NR_FCNTL, fd, cmd, arg);
+}
+
 
 pid_t fork() {
     return _syscall0(SYS_NR_FORK);
@@ -208,6 +221,22 @@ int readdir(fd_t fd, void *dir, int count) {
     return _syscall3(SYS_NR_READDIR, fd, (u32)dir, count);
 }
 
+int getdents(fd_t fd, void *buf, int count, int flags) {
+    return _syscall4(SYS_NR_GETDENTS, fd, (u32)buf, count, flags);
+}
+
+int sendfile(fd_t out_fd, fd_t in_fd, off_t *offset, size_t count) {
+    return _syscall4(SYS_NR_SENDFILE, out_fd, in_fd, (u32)offset, count);
+}
+
+int splice(fd_t fd_in, off_t *off_in, fd_t fd_out, off_t *off_out, size_t len, int flags) {
+    return _syscall6(SYS_NR_SPLICE, fd_in, (u32)off_in, fd_out, (u32)off_out, len, flags);
+}
+
+int copy_file_range(fd_t fd_in, off_t *off_in, fd_t fd_out, off_t *off_out, size_t len, int flags) {
+    return _syscall6(SYS_NR_COPY_FILE_RANGE, fd_in, (u32)off_in, fd_out, (u32)off_out, len, flags);
+}
+
 int execve(char *filename, char *argv[], char *envp[]) {
     return _syscall3(SYS_NR_EXECVE, (u32)filename, (u32)argv, (u32)envp);
 }
@@ -288,6 +317,18 @@ void sync() {
     _syscall0(SYS_NR_SYNC);
 }
 
+int fsync(fd_t fd) {
+    return _syscall1(SYS_NR_FSYNC, fd);
+}
+
+int fdatasync(fd_t fd) {
+    return _syscall1(SYS_NR_FDATASYNC, fd);
+}
+
+int sync_file_range(fd_t fd, off_t offset, off_t nbytes, int flags) {
+    return _syscall4(SYS_NR_SYNC_FILE_RANGE, fd, (u32)offset, (u32)nbytes, flags);
+}
+
 int stat(char *filename, stat_t *statbuf) {
     return _syscall2(SYS_NR_STAT, (u32)filename, (u32)statbuf);
 }
@@ -24,5 +24,9 @@ int cmd_pkt(int argc, char **argv, char **envp);
 int cmd_server(int argc, char **argv, char **envp);
 int cmd_ping(int argc, char **argv, char **envp);
 int cmd_client(int argc, char **argv, char **envp);
+int cmd_ps(int argc, char **argv, char **envp);
+int cmd_top(int argc, char **argv, char **envp);
+int cmd_ionice(int argc, char **argv, char **envp);
+int cmd_iostat(int argc, char **argv, char **envp);
 
 #endif /* XJOS_USER_BUILTIN_APPLETS_H */
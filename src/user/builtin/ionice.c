@@ -0,0 +1,84 @@
+#include <xjos/types.h>
+#include <xjos/stdio.h>
+#include <xjos/syscall.h>
+#include <xjos/string.h>
+#include <xjos/stdlib.h>
+#include <xjos/ioprio.h>
+
+static char *class_names[IOPRIO_CLASS_NR] = {"none", "realtime", "best-effort", "idle"};
+
+static char path[64];
+
+static void show(pid_t pid) {
+    int ioprio = ioprio_get(IOPRIO_WHO_PROCESS, pid);
+    if (ioprio < 0) {
+        printf("ionice: pid %d not found\n", pid);
+        return;
+    }
+
+    int class = IOPRIO_PRIO_CLASS(ioprio);
+    if (class == IOPRIO_CLASS_NONE || class == IOPRIO_CLASS_IDLE)
+        printf("%s\n", class_names[class]);
+    else
+        printf("%s: prio %d\n", class_names[class], IOPRIO_PRIO_DATA(ioprio));
+}
+
+static void usage() {
+    printf("Usage: ionice [-c class] [-n level] [-p pid | command [args]]\n");
+    printf("  class: 1 realtime, 2 best-effort, 3 idle; level: 0 (high) - 7 (low)\n");
+}
+
+int cmd_ionice(int argc, char **argv, char **envp) {
+    int class = -1;
+    int level = 4;
+    pid_t pid = 0;
+    int i = 1;
+
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+            class = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            level = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            pid = atoi(argv[++i]);
+        } else {
+            usage();
+            return EOF;
+        }
+    }
+
+    if (class < 0 && i == argc) {
+        show(pid);
+        return 0;
+    }
+
+    if (class < 0)
+        class = IOPRIO_CLASS_BE;
+    if (class == IOPRIO_CLASS_IDLE)
+        level = 0;
+
+    int ret = ioprio_set(IOPRIO_WHO_PROCESS, pid, IOPRIO_PRIO_VALUE(class, level));
+    if (ret < 0) {
+        printf("ionice: set ioprio failed %d\n", ret);
+        return ret;
+    }
+
+    if (i == argc)
+        return 0;
+
+    // 以新的优先级执行命令
+    char *filename = argv[i];
+    if (!strchr(filename, '/')) {
+        sprintf(path, "/bin/%s", filename);
+        filename = path;
+    }
+    ret = execve(filename, &argv[i], envp);
+    printf("ionice: %s execution failed\n", argv[i]);
+    return ret;
+}
+
+#ifndef XJOS_BUSYBOX_APPLET
+int main(int argc, char **argv, char **envp) {
+    return cmd_ionice(argc, argv, envp);
+}
+#endif
@@ -0,0 +1,255 @@
+#include <xjos/types.h>
+#include <xjos/stdio.h>
+#include <xjos/syscall.h>
+#include <xjos/string.h>
+#include <xjos/stdlib.h>
+#include <xjos/fcntl.h>
+#include <xjos/dirent.h>
+#include <drivers/device.h>
+
+#define DENTS_LEN 1024
+#define IOSTAT_DEV_NR 16
+#define BUFFERS_LEN 512
+
+typedef struct iostat_dev_t {
+    char name[16];
+    iostat_t prev;
+    iostat_t curr;
+} iostat_dev_t;
+
+static iostat_dev_t devs[IOSTAT_DEV_NR];
+static int dev_count;
+
+static char dents[DENTS_LEN];
+static char buffers[BUFFERS_LEN];
+
+// 每个磁盘只取一次，分区返回的是整个磁盘的统计
+static void find_devices() {
+    fd_t fd = open("/dev", O_RDONLY, 0);
+    if (fd < 0)
+        return;
+
+    while (dev_count < IOSTAT_DEV_NR) {
+        int len = getdents(fd, dents, DENTS_LEN, 0);
+        if (len <= 0)
+            break;
+
+        for (int offset = 0; offset < len && dev_count < IOSTAT_DEV_NR;) {
+            getdent_t *entry = (getdent_t *)(dents + offset);
+            offset += entry->reclen;
+
+            char path[32];
+            stat_t statbuf;
+            sprintf(path, "/dev/%s", entry->name);
+            if (stat(path, &statbuf) < 0 || !ISBLK(statbuf.mode))
+                continue;
+
+            fd_t dev = open(path, O_RDONLY, 0);
+            if (dev < 0)
+                continue;
+
+            iostat_dev_t *ptr = &devs[dev_count];
+            int ret = ioctl(dev, DEV_CMD_IOSTAT_GET, (int)&ptr->curr);
+            close(dev);
+            if (ret < 0)
+                continue;
+
+            bool dup = false;
+            for (int i = 0; i < dev_count; i++) {
+                if (devs[i].curr.dev == ptr->curr.dev)
+                    dup = true;
+            }
+            if (dup)
+                continue;
+
+            strcpy(ptr->name, entry->name);
+            dev_count++;
+        }
+    }
+    close(fd);
+}
+
+static bool sample(iostat_dev_t *ptr) {
+    char path[32];
+    sprintf(path, "/dev/%s", ptr->name);
+    fd_t fd = open(path, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    ptr->prev = ptr->curr;
+    int ret = ioctl(fd, DEV_CMD_IOSTAT_GET, (int)&ptr->curr);
+    close(fd);
+    return ret >= 0;
+}
+
+// 打印 value / count，保留两位小数
+static void print_avg(u32 value, u32 count) {
+    if (!count) {
+        printf("    0.00");
+        return;
+    }
+    printf(" % 4d.%02d", value / count, value % count * 100 / count);
+}
+
+static void show(iostat_dev_t *ptr, bool delta) {
+    iostat_t *curr = &ptr->curr;
+    iostat_t *prev = &ptr->prev;
+    iostat_t zero;
+    if (!delta) {
+        memset(&zero, 0, sizeof(zero));
+        zero.now = curr->since;
+        prev = &zero;
+    }
+
+    u32 elapsed = curr->now - prev->now;
+    u32 rd = curr->ios[REQ_READ] - prev->ios[REQ_READ];
+    u32 wr = curr->ios[REQ_WRITE] - prev->ios[REQ_WRITE];
+    u32 queue = curr->queue_ms[REQ_READ] + curr->queue_ms[REQ_WRITE] -
+                prev->queue_ms[REQ_READ] - prev->queue_ms[REQ_WRITE];
+
+    printf("%-8s % 8d % 8d % 8d % 8d % 6d",
+           ptr->name,
+           rd, curr->sectors[REQ_READ] - prev->sectors[REQ_READ],
+           wr, curr->sectors[REQ_WRITE] - prev->sectors[REQ_WRITE],
+           curr->errors - prev->errors);
+
+    // 排队时间是调度器造成的，服务时间是磁盘本身
+    print_avg(queue, rd + wr);
+    print_avg(curr->service_ms[REQ_READ] - prev->service_ms[REQ_READ], rd);
+    print_avg(curr->service_ms[REQ_WRITE] - prev->service_ms[REQ_WRITE], wr);
+    print_avg(curr->depth_ms - prev->depth_ms, elapsed);
+
+    u32 busy = curr->busy_ms - prev->busy_ms;
+    printf(" % 4d%%\n", elapsed ? busy * 100 / elapsed : 0);
+}
+
+static void show_hist(iostat_dev_t *ptr) {
+    iostat_t *stat = &ptr->curr;
+    printf("%s latency    queue  service  (max depth %d, splits %d, flushes %d)\n",
+           ptr->name, stat->max_depth, stat->splits, stat->flushes);
+
+    for (int i = 0; i < IOSTAT_HIST_NR; i++) {
+        if (!stat->queue_hist[i] && !stat->service_hist[i])
+            continue;
+        u32 low = i ? 1 << i : 0;
+        if (low >= 1000000)
+            printf("  >= % 5ds", low / 1000000);
+        else if (low >= 1000)
+            printf("  >= % 4dms", low / 1000);
+        else
+            printf("  >= % 4dus", low);
+        printf(" % 8d % 8d\n", stat->queue_hist[i], stat->service_hist[i]);
+    }
+}
+
+// 缓冲命中率，判断是否是缓存不足导致的读盘
+static void show_buffers() {
+    fd_t fd = open("/proc/buffers", O_RDONLY, 0);
+    if (fd < 0)
+        return;
+    int len = read(fd, buffers, BUFFERS_LEN - 1);
+    close(fd);
+    if (len <= 0)
+        return;
+    buffers[len] = '\0';
+
+    printf("buffers:");
+    for (char *ptr = buffers; *ptr;) {
+        char *end = strchr(ptr, '\n');
+        if (end)
+            *end = '\0';
+        if (!memcmp(ptr, "hits", 4) || !memcmp(ptr, "misses", 6) || !memcmp(ptr, "ratio", 5)) {
+            char *value = ptr;
+            while (*value && *value != ' ')
+                value++;
+            *value++ = '\0';
+            while (*value == ' ')
+                value++;
+            printf(" %s %s", ptr, value);
+        }
+        if (!end)
+            break;
+        ptr = end + 1;
+    }
+    printf("\n");
+}
+
+static void show_all(bool delta, bool hist) {
+    printf("Device     rd_ios   rd_sec   wr_ios   wr_sec    err  queue_ms r_svc_ms w_svc_ms   depth  util\n");
+    for (int i = 0; i < dev_count; i++)
+        show(&devs[i], delta);
+    show_buffers();
+
+    if (!hist)
+        return;
+    for (int i = 0; i < dev_count; i++)
+        show_hist(&devs[i]);
+}
+
+static void usage() {
+    printf("Usage: iostat [-h] [-z] [interval [count]]\n");
+    printf("  -h  show latency histograms\n");
+    printf("  -z  reset statistics\n");
+}
+
+int cmd_iostat(int argc, char **argv, char **envp) {
+    (void)envp;
+
+    bool hist = false;
+    bool reset = false;
+    int interval = 0;
+    int count = 0; // 0 表示一直刷新
+
+    int arg = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-h")) {
+            hist = true;
+        } else if (!strcmp(argv[i], "-z")) {
+            reset = true;
+        } else if (argv[i][0] >= '0' && argv[i][0] <= '9' && arg < 2) {
+            if (arg++ == 0)
+                interval = atoi(argv[i]);
+            else
+                count = atoi(argv[i]);
+        } else {
+            usage();
+            return EOF;
+        }
+    }
+
+    find_devices();
+    if (!dev_count) {
+        printf("iostat: no block device\n");
+        return EOF;
+    }
+
+    if (reset) {
+        for (int i = 0; i < dev_count; i++) {
+            char path[32];
+            sprintf(path, "/dev/%s", devs[i].name);
+            fd_t fd = open(path, O_RDONLY, 0);
+            if (fd < 0)
+                continue;
+            ioctl(fd, DEV_CMD_IOSTAT_RESET, 0);
+            close(fd);
+        }
+        return 0;
+    }
+
+    // 第一次是开机以来的累计，之后是每个间隔的增量
+    show_all(false, hist);
+    for (int n = 1; interval > 0 && (!count || n < count); n++) {
+        sleep(interval * 1000);
+        for (int i = 0; i < dev_count; i++)
+            sample(&devs[i]);
+        printf("\n");
+        show_all(true, hist);
+    }
+    return 0;
+}
+
+#ifndef XJOS_BUSYBOX_APPLET
+int main(int argc, char **argv, char **envp) {
+    return cmd_iostat(argc, argv, envp);
+}
+#endif
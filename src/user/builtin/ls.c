@@ -9,8 +9,10 @@
 
 
 #define BUF_LEN 1024
+#define DENTS_LEN 4096
 
 static char buf[BUF_LEN];
+static char dents[DENTS_LEN];
 
 static void strftime(time_t stamp, char *buf) {
     tm time;
@@ -105,45 +107,46 @@ int cmd_ls(int argc, char **argv, char **envp) {
         list = true;
 
     lseek(fd, 0, SEEK_SET);
-    dentry_t entry;
     while (true)
     {
-        int len = readdir(fd, &entry, 1);
+        // 一次读取多个目录项，-l 时同时取回文件属性，不必逐个 stat
+        int len = getdents(fd, dents, DENTS_LEN, list ? GETDENTS_PLUS : 0);
         if (len <= 0)
             break;
-        if (!entry.nr)
-            continue;
-        if (!strcmp(entry.name, ".") || !strcmp(entry.name, ".."))
-        {
-            continue;
-        }
-        if (!list)
+
+        for (int offset = 0; offset < len;)
         {
-            printf("%s ", entry.name);
-            continue;
+            getdent_t *entry = (getdent_t *)(dents + offset);
+            offset += entry->reclen;
+
+            if (!strcmp(entry->name, ".") || !strcmp(entry->name, ".."))
+            {
+                continue;
+            }
+            if (!list)
+            {
+                printf("%s ", entry->name);
+                continue;
+            }
+
+            parsemode(entry->mode, buf);
+            printf("%s ", buf);
+
+            strftime(entry->mtime, buf);
+
+            int size = entry->size;
+            char qualifier;
+            reckon_size(&size, &qualifier);
+
+            printf("% 2d % 2d % 2d % 4d%c %s %s\n",
+                   entry->nlinks,
+                   entry->uid,
+                   entry->gid,
+                   size,
+                   qualifier,
+                   buf,
+                   entry->name);
         }
-
-        stat_t statbuf;
-        if (stat(entry.name, &statbuf) < 0)
-            continue;
-
-        parsemode(statbuf.mode, buf);
-        printf("%s ", buf);
-
-        strftime(statbuf.ctime, buf);
-
-        int size = statbuf.size;
-        char qualifier;
-        reckon_size(&size, &qualifier);
-
-        printf("% 2d % 2d % 2d % 4d%c %s %s\n",
-               statbuf.nlinks,
-               statbuf.uid,
-               statbuf.gid,
-               size,
-               qualifier,
-               buf,
-               entry.name);
     }
     if (!list)
         printf("\n");
@@ -1,17 +1,32 @@
 #include <xjos/types.h>
 #include <xjos/stdio.h>
 #include <xjos/syscall.h>
+#include <xjos/string.h>
 
 int cmd_mkfs(int argc, char **argv, char **envp) {
     (void)envp;
 
+    int args = 0;
+    for (; argc > 1 && argv[1][0] == '-'; argc--, argv++) {
+        if (!strcmp(argv[1], "-j")) {
+            args |= MKFS_JOURNAL;
+        } else if (!strcmp(argv[1], "-2")) {
+            args |= MKFS_V2;
+        } else if (!strcmp(argv[1], "-3")) {
+            args |= MKFS_V3;
+        } else if (strcmp(argv[1], "-1")) {
+            printf("mkfs: invalid option %s\n", argv[1]);
+            return EOF;
+        }
+    }
+
     if (argc < 2) {
         printf("mkfs: missing operand\n");
-        printf("Usage: mkfs <device>\n");
+        printf("Usage: mkfs [-j] [-1|-2|-3] <device>\n");
         return EOF;
     }
 
-    return mkfs(argv[1], 0);
+    return mkfs(argv[1], args);
 }
 
 #ifndef XJOS_BUSYBOX_APPLET
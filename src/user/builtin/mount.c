@@ -2,6 +2,8 @@
 #include <xjos/stdio.h>
 #include <xjos/syscall.h>
 #include <xjos/errno.h>
+#include <xjos/string.h>
+#include <xjos/stdlib.h>
 
 static const char *mount_error(int err) {
     switch (err) {
@@ -15,6 +17,8 @@ static const char *mount_error(int err) {
         return "Unknown filesystem";
     case ENOSYS:
         return "Operation not supported";
+    case EINVAL:
+        return "Invalid argument";
     default:
         return "Mount failed";
     }
@@ -23,13 +27,38 @@ static const char *mount_error(int err) {
 int cmd_mount(int argc, char **argv, char **envp) {
     (void)envp;
 
-    if (argc < 3) {
+    int flags = 0;
+    int i = 1;
+
+    // mount -t tmpfs|proc [-o size=KB] <source> <target>
+    while (i < argc && argv[i][0] == '-') {
+        if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            if (!strcmp(argv[i + 1], "tmpfs")) {
+                flags |= MOUNT_TMPFS;
+            } else if (!strcmp(argv[i + 1], "proc")) {
+                flags |= MOUNT_PROC;
+            } else {
+                printf("mount: %s\n", mount_error(EFSUNK));
+                return EOF;
+            }
+            i += 2;
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc &&
+                   !memcmp(argv[i + 1], "size=", 5)) {
+            flags |= atoi(argv[i + 1] + 5) & 0x0FFFFFFF;
+            i += 2;
+        } else {
+            printf("mount: %s\n", mount_error(EINVAL));
+            return EOF;
+        }
+    }
+
+    if (argc - i < 2) {
         printf("mount: missing operand\n");
-        printf("Usage: mount <source> <target>\n");
+        printf("Usage: mount [-t tmpfs|proc] [-o size=KB] <source> <target>\n");
         return EOF;
     }
 
-    int ret = mount(argv[1], argv[2], 0);
+    int ret = mount(argv[i], argv[i + 1], flags);
     if (ret < 0) {
         printf("mount: %s\n", mount_error(-ret));
     }
@@ -0,0 +1,133 @@
+#include <xjos/types.h>
+#include <xjos/stdio.h>
+#include <xjos/syscall.h>
+#include <xjos/string.h>
+#include <xjos/stdlib.h>
+#include <xjos/fcntl.h>
+#include <xjos/dirent.h>
+
+#define DENTS_LEN 1024
+#define STAT_LEN 256
+
+static char dents[DENTS_LEN];
+static char statbuf[STAT_LEN];
+
+// /proc/<pid>/stat 中的字段
+typedef struct proc_stat_t {
+    int pid;
+    char name[16];
+    char state;
+    int ppid;
+    int pgid;
+    int sid;
+    int uid;
+    int nice;
+    int weight;
+    int runtime; // ms
+    int start;   // ms
+} proc_stat_t;
+
+static char *parse_int(char *ptr, int *value) {
+    while (*ptr == ' ')
+        ptr++;
+
+    bool neg = false;
+    if (*ptr == '-') {
+        neg = true;
+        ptr++;
+    }
+
+    int val = 0;
+    while (*ptr >= '0' && *ptr <= '9')
+        val = val * 10 + *ptr++ - '0';
+    *value = neg ? -val : val;
+    return ptr;
+}
+
+static bool read_stat(char *pid, proc_stat_t *ps) {
+    char path[32];
+    sprintf(path, "/proc/%s/stat", pid);
+
+    fd_t fd = open(path, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    int len = read(fd, statbuf, STAT_LEN - 1);
+    close(fd);
+    if (len <= 0)
+        return false;
+    statbuf[len] = '\0';
+
+    // pid (name) state ppid pgid sid uid nice weight runtime start ...
+    char *ptr = parse_int(statbuf, &ps->pid);
+    char *name = strchr(ptr, '(');
+    char *end = strrchr(ptr, ')');
+    if (!name || !end)
+        return false;
+
+    len = MIN(end - name - 1, (int)sizeof(ps->name) - 1);
+    memcpy(ps->name, name + 1, len);
+    ps->name[len] = '\0';
+
+    ptr = end + 2;
+    ps->state = *ptr++;
+    ptr = parse_int(ptr, &ps->ppid);
+    ptr = parse_int(ptr, &ps->pgid);
+    ptr = parse_int(ptr, &ps->sid);
+    ptr = parse_int(ptr, &ps->uid);
+    ptr = parse_int(ptr, &ps->nice);
+    ptr = parse_int(ptr, &ps->weight);
+    ptr = parse_int(ptr, &ps->runtime);
+    ptr = parse_int(ptr, &ps->start);
+    return true;
+}
+
+static bool is_pid(char *name) {
+    if (!*name)
+        return false;
+    for (; *name; name++) {
+        if (*name < '0' || *name > '9')
+            return false;
+    }
+    return true;
+}
+
+int cmd_ps(int argc, char **argv, char **envp) {
+    (void)argc;
+    (void)argv;
+    (void)envp;
+
+    fd_t fd = open("/proc", O_RDONLY, 0);
+    if (fd < 0) {
+        printf("ps: /proc not mounted\n");
+        return fd;
+    }
+
+    printf("  PID  PPID S  UID NICE      TIME NAME\n");
+    while (true) {
+        int len = getdents(fd, dents, DENTS_LEN, 0);
+        if (len <= 0)
+            break;
+
+        for (int offset = 0; offset < len;) {
+            getdent_t *entry = (getdent_t *)(dents + offset);
+            offset += entry->reclen;
+
+            proc_stat_t ps;
+            if (!is_pid(entry->name) || !read_stat(entry->name, &ps))
+                continue;
+
+            printf("% 5d % 5d %c % 4d % 4d % 6d.%03d %s\n",
+                   ps.pid, ps.ppid, ps.state, ps.uid, ps.nice,
+                   ps.runtime / 1000, ps.runtime % 1000, ps.name);
+        }
+    }
+
+    close(fd);
+    return 0;
+}
+
+#ifndef XJOS_BUSYBOX_APPLET
+int main(int argc, char **argv, char **envp) {
+    return cmd_ps(argc, argv, envp);
+}
+#endif
@@ -0,0 +1,207 @@
+#include <xjos/types.h>
+#include <xjos/stdio.h>
+#include <xjos/syscall.h>
+#include <xjos/string.h>
+#include <xjos/stdlib.h>
+#include <xjos/fcntl.h>
+
+extern void clear();
+
+#define SCHED_LEN 8192
+#define TOP_NR 64 // 最多显示的进程数
+
+static char sched[SCHED_LEN];
+
+// /proc/sched 中一个进程的记录
+typedef struct top_task_t {
+    int pid;
+    int ppid;
+    char state;
+    int nice;
+    int runtime; // ms
+    int cpu;     // 千分比
+    char name[16];
+} top_task_t;
+
+typedef struct top_sample_t {
+    int uptime; // ms
+    int ready;
+    int count;
+    top_task_t tasks[TOP_NR];
+} top_sample_t;
+
+static top_sample_t samples[2];
+
+static char *skip_space(char *ptr) {
+    while (*ptr == ' ')
+        ptr++;
+    return ptr;
+}
+
+static char *parse_int(char *ptr, int *value) {
+    ptr = skip_space(ptr);
+
+    bool neg = false;
+    if (*ptr == '-') {
+        neg = true;
+        ptr++;
+    }
+
+    int val = 0;
+    while (*ptr >= '0' && *ptr <= '9')
+        val = val * 10 + *ptr++ - '0';
+    *value = neg ? -val : val;
+    return ptr;
+}
+
+// 跳过 key，读取后面的整数
+static char *parse_field(char *ptr, char *key, int *value) {
+    int len = strlen(key);
+    if (memcmp(ptr, key, len))
+        return NULL;
+    ptr = strchr(parse_int(ptr + len, value), '\n');
+    return ptr ? ptr + 1 : NULL;
+}
+
+static bool read_sched(top_sample_t *sample) {
+    fd_t fd = open("/proc/sched", O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    int len = read(fd, sched, SCHED_LEN - 1);
+    close(fd);
+    if (len <= 0)
+        return false;
+    sched[len] = '\0';
+
+    int unused;
+    char *ptr = sched;
+    if (!(ptr = parse_field(ptr, "uptime", &sample->uptime)))
+        return false;
+    if (!(ptr = parse_field(ptr, "ready", &sample->ready)))
+        return false;
+
+    // 跳过 weight, vruntime 和表头
+    for (int i = 0; i < 3 && ptr; i++) {
+        ptr = strchr(ptr, '\n');
+        if (ptr)
+            ptr++;
+    }
+
+    sample->count = 0;
+    while (ptr && *ptr && sample->count < TOP_NR) {
+        // PID PPID S NICE WEIGHT VRUNTIME RUNTIME NAME
+        top_task_t *task = &sample->tasks[sample->count++];
+        ptr = parse_int(ptr, &task->pid);
+        ptr = parse_int(ptr, &task->ppid);
+        ptr = skip_space(ptr);
+        task->state = *ptr++;
+        ptr = parse_int(ptr, &task->nice);
+        ptr = parse_int(ptr, &unused);
+        ptr = parse_int(ptr, &unused);
+        ptr = parse_int(ptr, &task->runtime);
+        ptr = skip_space(ptr);
+
+        char *end = strchr(ptr, '\n');
+        int namelen = end ? end - ptr : strlen(ptr);
+        namelen = MIN(namelen, (int)sizeof(task->name) - 1);
+        memcpy(task->name, ptr, namelen);
+        task->name[namelen] = '\0';
+        task->cpu = 0;
+
+        ptr = end ? end + 1 : NULL;
+    }
+    return true;
+}
+
+// 根据两次采样的运行时间差计算 CPU 占用
+static void calc_cpu(top_sample_t *prev, top_sample_t *curr) {
+    int elapsed = curr->uptime - prev->uptime;
+    if (elapsed <= 0)
+        return;
+
+    for (int i = 0; i < curr->count; i++) {
+        top_task_t *task = &curr->tasks[i];
+        int runtime = task->runtime;
+        for (int j = 0; j < prev->count; j++) {
+            if (prev->tasks[j].pid == task->pid) {
+                runtime -= prev->tasks[j].runtime;
+                break;
+            }
+        }
+        task->cpu = runtime * 1000 / elapsed;
+    }
+
+    // 按 CPU 占用从高到低插入排序
+    for (int i = 1; i < curr->count; i++) {
+        top_task_t task = curr->tasks[i];
+        int j = i - 1;
+        for (; j >= 0 && curr->tasks[j].cpu < task.cpu; j--)
+            curr->tasks[j + 1] = curr->tasks[j];
+        curr->tasks[j + 1] = task;
+    }
+}
+
+static void show(top_sample_t *sample) {
+    int up = sample->uptime / 1000;
+    printf("top - up %d:%02d:%02d, %d tasks, %d ready\n\n",
+           up / 3600, up / 60 % 60, up % 60, sample->count, sample->ready);
+    printf("  PID  PPID S NICE  %%CPU      TIME NAME\n");
+
+    for (int i = 0; i < sample->count; i++) {
+        top_task_t *task = &sample->tasks[i];
+        printf("% 5d % 5d %c % 4d % 3d.%d % 6d.%02d %s\n",
+               task->pid, task->ppid, task->state, task->nice,
+               task->cpu / 10, task->cpu % 10,
+               task->runtime / 1000, task->runtime % 1000 / 10,
+               task->name);
+    }
+}
+
+int cmd_top(int argc, char **argv, char **envp) {
+    (void)envp;
+
+    int delay = 2;
+    int count = 0; // 0 表示一直刷新
+
+    // top [-d seconds] [-n iterations]
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+            delay = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            count = atoi(argv[++i]);
+        } else {
+            printf("Usage: top [-d seconds] [-n iterations]\n");
+            return EOF;
+        }
+    }
+    if (delay <= 0)
+        delay = 1;
+
+    top_sample_t *prev = &samples[0];
+    top_sample_t *curr = &samples[1];
+    if (!read_sched(prev)) {
+        printf("top: /proc not mounted\n");
+        return EOF;
+    }
+
+    for (int n = 0; !count || n < count; n++) {
+        sleep(delay * 1000);
+        if (!read_sched(curr))
+            return EOF;
+
+        calc_cpu(prev, curr);
+        clear();
+        show(curr);
+
+        top_sample_t *tmp = prev;
+        prev = curr;
+        curr = tmp;
+    }
+    return 0;
+}
+
+#ifndef XJOS_BUSYBOX_APPLET
+int main(int argc, char **argv, char **envp) {
+    return cmd_top(argc, argv, envp);
+}
+#endif
@@ -45,6 +45,10 @@ static const applet_t applets[] = {
     {"server", cmd_server},
     {"ping", cmd_ping},
     {"client", cmd_client},
+    {"ps", cmd_ps},
+    {"top", cmd_top},
+    {"ionice", cmd_ionice},
+    {"iostat", cmd_iostat},
     {NULL, NULL},
 };
 
@@ -54,7 +58,7 @@ static void usage(void) {
     printf("  <applet> [args...]   (via hardlink name)\n");
     printf("applets: ls cat echo env pwd clear date" 
         "mkdir rmdir rm mount umount mkfs sh dup alarm kill float player pkt"
-        "server ping client\n");
+        "server ping client ps top ionice iostat\n");
 }
 
 int main(int argc, char **argv, char **envp) {
@@ -1,4 +1,8 @@
-BUSYBOX_APPLETS ?= ls cat echo env sh
+BUSYBOX_APPLETS ?= ls cat echo env pwd \
+clear date mkdir rmdir rm mount \
+umount mkfs sh dup kill alarm float \
+player pkt server ping client \
+ps top ionice iostat
 
 .NOTPARALLEL: image $(BUILD_DIR)/master.img $(BUILD_DIR)/slave.img
 
@@ -42,7 +46,7 @@ $(BUILD_DIR)/master.img: $(BUILD_DIR)/boot/boot.bin \
 	sudo losetup /dev/loop0 --partscan $@
 
 # minix
-	sudo mkfs.minix -1 -n 14 /dev/loop0p1
+	sudo mkfs.minix -2 -n 14 /dev/loop0p1
 
 # mount
 	sudo mount /dev/loop0p1 /mnt
@@ -54,6 +58,7 @@ $(BUILD_DIR)/master.img: $(BUILD_DIR)/boot/boot.bin \
 	mkdir -p /mnt/bin
 	mkdir -p /mnt/dev
 	mkdir -p /mnt/mnt
+	mkdir -p /mnt/proc
 
 # copy music
 # 	mkdir -p /mnt/data
@@ -99,7 +104,7 @@ $(BUILD_DIR)/slave.img: \
 
 	sudo losetup /dev/loop0 --partscan $@
 
-	sudo mkfs.minix -1 -n 14 /dev/loop0p1
+	sudo mkfs.minix -3 /dev/loop0p1
 
 	sudo mount /dev/loop0p1 /mnt
 